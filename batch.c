@@ -0,0 +1,459 @@
+#define _GNU_SOURCE // IOV_MAX
+
+#include "batch.h"
+
+#include "document.h"
+#include "editor.h"
+#include "replace.h"
+#include "save.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+
+#define BATCH_DUMP_LINE 80 // room for one line of the dump, with a 16 digit offset
+#define BATCH_PATCH_RUN (1UL << 20) // bytes of consecutive patch lines gathered into one overwrite
+
+static const char g_batch_hex[] = "0123456789abcdef";
+
+// each byte as two hex digits and as the text column shows it, filled in
+// by batch_dump() before the jobs start
+static uint16_t g_batch_hex_pairs[256];
+static char g_batch_text[256];
+
+// output collected into one buffer
+struct batch_out {
+  int fd;
+  char *buf;
+  size_t len;
+};
+
+// writev() that retries partial writes
+static int batch_writev_all(int fd, struct iovec *iov, int n_iov) {
+  while(n_iov > 0) {
+    ssize_t n = writev(fd, iov, n_iov < IOV_MAX ? n_iov : IOV_MAX);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    while(n_iov > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --n_iov;
+    }
+    if(n_iov > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+static int batch_flush(struct batch_out *o) {
+  struct iovec iov = { o->buf, o->len };
+  if(o->len && batch_writev_all(o->fd, &iov, 1) < 0) {
+    return -1;
+  }
+  o->len = 0;
+  return 0;
+}
+
+static void batch_dump_tables() {
+  for(int c = 0; c < 256; ++c) {
+    char pair[2] = { g_batch_hex[c >> 4], g_batch_hex[c & 15] };
+    memcpy(&g_batch_hex_pairs[c], pair, 2);
+    g_batch_text[c] = c >= 0x20 && c < 0x7f ? c : '.';
+  }
+}
+
+// one line of xxd's default format: the offset, eight groups of two bytes
+// padded out to their full width on the last line, and the text.  this
+// runs for every 16 bytes, so the digits come from tables two at a time
+static char *batch_dump_line(char *o, size_t offset, const unsigned char *p, size_t n) {
+  int digits = 8;
+  while(digits < 16 && (offset >> (digits * 4))) {
+    ++digits;
+  }
+  if(digits & 1) {
+    *o++ = g_batch_hex[(offset >> ((digits - 1) * 4)) & 15];
+  }
+  for(int i = (digits & ~1) - 2; i >= 0; i -= 2) {
+    uint16_t *d = (uint16_t *)o;
+    *d = g_batch_hex_pairs[(offset >> (i * 4)) & 255];
+    o += 2;
+  }
+  *o++ = ':';
+  *o++ = ' ';
+
+  if(n == 16) {
+    uint16_t *d = (uint16_t *)o;
+    for(int i = 0; i < 16; i += 2) {
+      d[0] = g_batch_hex_pairs[p[i]];
+      d[1] = g_batch_hex_pairs[p[i + 1]];
+      ((char *)d)[4] = ' ';
+      d = (uint16_t *)((char *)d + 5);
+    }
+    o = (char *)d;
+  } else {
+    for(size_t i = 0; i < 16; ++i) {
+      uint16_t *d = (uint16_t *)o;
+      *d = i < n ? g_batch_hex_pairs[p[i]] : *(const uint16_t *)"  ";
+      o += 2;
+      if(i & 1) {
+        *o++ = ' ';
+      }
+    }
+  }
+  *o++ = ' ';
+
+  for(size_t i = 0; i < n; ++i) {
+    o[i] = g_batch_text[p[i]];
+  }
+  o[n] = '\n';
+  return o + n + 1;
+}
+
+struct batch_dump_job {
+  size_t offset;
+  size_t len;
+  char *out;
+  size_t out_len;
+  int failed;
+};
+
+static void batch_dump_job_run(void *arg) {
+  struct batch_dump_job *job = arg;
+  char *o = job->out;
+  size_t pos = job->offset, end = job->offset + job->len;
+
+  // jobs start on a multiple of 16 so their lines line up with the whole
+  // dump's.  a line that straddles two pieces goes through a copy
+  doc_read_lock();
+  while(pos < end) {
+    size_t n = end - pos;
+    const unsigned char *p = (const unsigned char *)doc_view(pos, &n);
+    if(!p || n == 0) {
+      job->failed = 1;
+      break;
+    }
+    size_t whole = n & ~(size_t)15;
+    for(size_t i = 0; i < whole; i += 16) {
+      o = batch_dump_line(o, pos + i, p + i, 16);
+    }
+    pos += whole;
+    if(whole < n) {
+      unsigned char line[16];
+      size_t k = end - pos < 16 ? end - pos : 16;
+      if(doc_read(pos, (char *)line, k) != k) {
+        job->failed = 1;
+        break;
+      }
+      o = batch_dump_line(o, pos, line, k);
+      pos += k;
+    }
+  }
+  doc_read_unlock();
+  job->out_len = o - job->out;
+}
+
+// a round of dump jobs, formatted while the previous round is written
+struct batch_dump_round {
+  worker_group group;
+  struct batch_dump_job *jobs;
+  size_t n_jobs;
+};
+
+static size_t batch_dump_submit(struct batch_dump_round *round, size_t max_jobs, size_t offset, size_t len) {
+  round->n_jobs = 0;
+  while(offset < len && round->n_jobs < max_jobs) {
+    struct batch_dump_job *job = &round->jobs[round->n_jobs++];
+    job->offset = offset;
+    job->len = len - offset < BATCH_DUMP_BLOCK ? len - offset : BATCH_DUMP_BLOCK;
+    job->out_len = 0;
+    job->failed = 0;
+    offset += job->len;
+    worker_pool_submit(&round->group, batch_dump_job_run, job);
+  }
+  return offset;
+}
+
+int batch_dump(int fd) {
+  struct batch_dump_round rounds[2];
+  size_t len = doc_length();
+  size_t threads = worker_pool_threads();
+  size_t max_jobs = threads ? threads * 2 : 1;
+  int r = 0;
+
+  batch_dump_tables();
+  memset(rounds, 0, sizeof(rounds));
+  for(int i = 0; i < 2 && r == 0; ++i) {
+    worker_group_init(&rounds[i].group);
+    rounds[i].jobs = calloc(max_jobs, sizeof(struct batch_dump_job));
+    for(size_t k = 0; rounds[i].jobs && k < max_jobs && r == 0; ++k) {
+      rounds[i].jobs[k].out = malloc(BATCH_DUMP_BLOCK / 16 * BATCH_DUMP_LINE);
+      r = rounds[i].jobs[k].out ? 0 : -1;
+    }
+    r = rounds[i].jobs ? r : -1;
+  }
+  struct iovec *iov = malloc(max_jobs * sizeof(struct iovec));
+  if(r < 0 || !iov) {
+    r = -1;
+    goto done;
+  }
+
+  doc_advise(0, len, MADV_SEQUENTIAL);
+  size_t offset = batch_dump_submit(&rounds[0], max_jobs, 0, len);
+  for(int cur = 0; rounds[cur].n_jobs && r == 0; cur = !cur) {
+    struct batch_dump_round *round = &rounds[cur];
+    worker_group_wait(&round->group);
+    offset = batch_dump_submit(&rounds[!cur], max_jobs, offset, len);
+
+    for(size_t i = 0; i < round->n_jobs; ++i) {
+      if(round->jobs[i].failed) {
+        r = -1;
+      }
+      iov[i].iov_base = round->jobs[i].out;
+      iov[i].iov_len = round->jobs[i].out_len;
+    }
+    if(r == 0 && batch_writev_all(fd, iov, round->n_jobs) < 0) {
+      LOG_MSG("dump: write failed: %s", strerror(errno));
+      r = -1;
+    }
+    round->n_jobs = 0;
+  }
+  doc_advise(0, len, MADV_NORMAL);
+
+done:
+  for(int i = 0; i < 2; ++i) {
+    worker_group_cancel(&rounds[i].group);
+    worker_group_destroy(&rounds[i].group);
+    for(size_t k = 0; rounds[i].jobs && k < max_jobs; ++k) {
+      free(rounds[i].jobs[k].out);
+    }
+    free(rounds[i].jobs);
+  }
+  free(iov);
+  return r;
+}
+
+int batch_search(int fd, const char *pattern) {
+  char find[REPLACE_MAX];
+  const char *end;
+  size_t *matches, n;
+
+  int find_len = replace_unescape(pattern, '\0', find, sizeof(find), &end);
+  if(find_len <= 0) {
+    fprintf(stderr, "search: the pattern must be 1 to %d bytes\n", REPLACE_MAX);
+    return -1;
+  }
+  if(replace_find_all(find, find_len, &matches, &n) < 0) {
+    fprintf(stderr, "search: failed\n");
+    return -1;
+  }
+
+  struct batch_out o = { fd, malloc(BATCH_OUT_MAX), 0 };
+  int r = o.buf ? 0 : -1;
+  for(size_t i = 0; i < n && r == 0; ++i) {
+    // decimal, written backwards
+    char digits[24];
+    size_t k = sizeof(digits), v = matches[i];
+    digits[--k] = '\n';
+    do {
+      digits[--k] = '0' + v % 10;
+      v /= 10;
+    } while(v);
+    if(o.len + sizeof(digits) > BATCH_OUT_MAX) {
+      r = batch_flush(&o);
+    }
+    memcpy(o.buf + o.len, digits + k, sizeof(digits) - k);
+    o.len += sizeof(digits) - k;
+  }
+  if(r == 0) {
+    r = batch_flush(&o);
+  }
+  free(o.buf);
+  free(matches);
+  LOG_MSG("search: %lu matches of %d bytes", n, find_len);
+  return r < 0 ? -1 : (int)(n > 0);
+}
+
+static int batch_hex_digit(char c) {
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = tolower((unsigned char)c);
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// consecutive patch lines are gathered into one overwrite
+struct batch_patch_run {
+  size_t offset;
+  char *buf;
+  size_t len;
+};
+
+// overwrite the bytes of [offset, offset + len) that differ from src, so a
+// whole dump fed back with a few bytes changed saves only those
+static int batch_patch_overwrite(size_t offset, const char *src, size_t len) {
+  char *cur = malloc(len);
+  int r = 0;
+  if(!cur || doc_read(offset, cur, len) != len) {
+    free(cur);
+    return -1;
+  }
+  for(size_t k = 0; k < len && r == 0; ) {
+    if(cur[k] == src[k]) {
+      ++k;
+      continue;
+    }
+    size_t from = k;
+    while(k < len && cur[k] != src[k]) {
+      ++k;
+    }
+    r = doc_overwrite(offset + from, src + from, k - from);
+  }
+  free(cur);
+  return r;
+}
+
+static int batch_patch_apply(struct batch_patch_run *run) {
+  size_t len = doc_length();
+  if(run->len == 0) {
+    return 0;
+  }
+  if(run->offset > len) {
+    fprintf(stderr, "patch: offset %#lx is past the end (%#lx)\n", run->offset, len);
+    return -1;
+  }
+  // what runs over the end extends the file
+  size_t over = run->offset + run->len <= len ? run->len : len - run->offset;
+  if(batch_patch_overwrite(run->offset, run->buf, over) < 0
+      || (over < run->len && doc_insert(len, run->buf + over, run->len - over) < 0))
+  {
+    fprintf(stderr, "patch: could not apply %lu bytes at %#lx\n", run->len, run->offset);
+    return -1;
+  }
+  run->len = 0;
+  return 0;
+}
+
+int batch_patch(const char *patchfile) {
+  char line[4096], bytes[sizeof(line) / 2];
+  int lineno = 0, r = 0;
+  size_t n_lines = 0, n_bytes = 0;
+  struct batch_patch_run run = { 0, malloc(BATCH_PATCH_RUN), 0 };
+
+  FILE *fp = strcmp(patchfile, "-") == 0 ? stdin : fopen(patchfile, "r");
+  if(!fp || !run.buf) {
+    fprintf(stderr, "%s: %s\n", patchfile, strerror(errno));
+    free(run.buf);
+    return -1;
+  }
+
+  while(r == 0 && fgets(line, sizeof(line), fp)) {
+    ++lineno;
+    char *p = line;
+    while(isspace((unsigned char)*p)) {
+      ++p;
+    }
+    if(!*p || *p == '#') {
+      continue;
+    }
+
+    char *end;
+    errno = 0;
+    size_t offset = strtoul(p, &end, 16);
+    if(end == p || *end != ':' || errno) {
+      fprintf(stderr, "%s:%d: expected <hex offset>: <hex bytes>\n", patchfile, lineno);
+      r = -1;
+      break;
+    }
+
+    // pairs of hex digits, single spaces between groups; two spaces start
+    // the text column
+    size_t n = 0;
+    p = end + 1 + (end[1] == ' ');
+    while(*p && *p != '\n' && !(p[0] == ' ' && p[1] == ' ')) {
+      if(*p == ' ') {
+        ++p;
+        continue;
+      }
+      int hi = batch_hex_digit(p[0]), lo = hi < 0 ? -1 : batch_hex_digit(p[1]);
+      if(lo < 0) {
+        fprintf(stderr, "%s:%d: bad hex byte\n", patchfile, lineno);
+        r = -1;
+        break;
+      }
+      bytes[n++] = (char)(hi << 4 | lo);
+      p += 2;
+    }
+    if(r < 0 || n == 0) {
+      continue;
+    }
+
+    if(run.len && (offset != run.offset + run.len || run.len + n > BATCH_PATCH_RUN)) {
+      r = batch_patch_apply(&run);
+    }
+    if(run.len == 0) {
+      run.offset = offset;
+    }
+    memcpy(run.buf + run.len, bytes, n);
+    run.len += n;
+    ++n_lines;
+    n_bytes += n;
+  }
+  if(r == 0) {
+    r = batch_patch_apply(&run);
+  }
+  if(fp != stdin) {
+    fclose(fp);
+  }
+  free(run.buf);
+
+  if(r < 0) {
+    return -1;
+  }
+  LOG_MSG("patch: %lu bytes from %lu lines of %s", n_bytes, n_lines, patchfile);
+  if(!doc_modified()) {
+    return 0;
+  }
+  return save_cmd(0, NULL) < 0 ? -1 : 0;
+}
+
+int batch_run(int mode, const char *arg, const char *filename) {
+  int r;
+
+  if(!file_open(&g_curfile, filename, mode == BATCH_PATCH ? O_RDWR : O_RDONLY)) {
+    return 2;
+  }
+
+  switch(mode) {
+    case BATCH_DUMP :
+      r = batch_dump(STDOUT_FILENO) < 0 ? 2 : 0;
+      break;
+    case BATCH_SEARCH :
+      r = batch_search(STDOUT_FILENO, arg);
+      r = r < 0 ? 2 : r > 0 ? 0 : 1;
+      break;
+    case BATCH_PATCH :
+      r = batch_patch(arg) < 0 ? 2 : 0;
+      break;
+    default :
+      r = 2;
+      break;
+  }
+
+  file_close(&g_curfile);
+  return r;
+}
@@ -0,0 +1,39 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdlib.h>
+
+// batch modes
+//
+// the document, search and save without the screen, for pipelines.  the
+// file is opened the same way, searches go through replace_find_all() and
+// patches are saved by save_cmd(), so a batch run behaves like the editor
+// would.  output is formatted into large buffers that go out in single
+// write() or writev() calls; the dump is formatted on the worker pool a
+// block per job and written in order.
+//
+//   --dump            xxd's default format, 16 bytes a line
+//   --search <bytes>  the decimal offset of each match, one a line, with the
+//                     escapes of ":s"
+//   --patch <file>    apply "<hex offset>: <hex bytes>" lines, as printed by
+//                     --dump or xxd (the text column is ignored), and save
+
+#define BATCH_OUT_MAX (1UL << 20)    // bytes of output collected before a write
+#define BATCH_DUMP_BLOCK (1UL << 20) // bytes of input formatted by each dump job, a multiple of 16
+
+enum _batch_modes {
+  BATCH_NONE = 0,
+  BATCH_DUMP,
+  BATCH_SEARCH,
+  BATCH_PATCH
+};
+
+// run a batch mode on filename, output to stdout.  returns the exit status:
+// 0 on success, 1 if a search found nothing, 2 on errors
+int batch_run(int mode, const char *arg, const char *filename);
+
+int batch_dump(int fd);
+int batch_search(int fd, const char *pattern);
+int batch_patch(const char *patchfile);
+
+#endif // __BATCH_H__
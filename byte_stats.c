@@ -0,0 +1,214 @@
+#include "byte_stats.h"
+
+#include <string.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the counting loop runs on 32 bit counters, flush them well before they could wrap
+#define HISTOGRAM_CHUNK (1UL << 30)
+
+// counts bytes using four interleaved tables so that runs of the same byte
+// don't serialize on a single counter's load/store dependency, reading the
+// input a 64 bit word at a time
+static void byte_stats_histogram_chunk(const unsigned char *p, size_t n, uint64_t hist[256]) {
+  uint32_t t[4][256];
+  memset(t, 0, sizeof(t));
+
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16) {
+    uint64_t a, b;
+    memcpy(&a, p + i, 8);
+    memcpy(&b, p + i + 8, 8);
+    for(int s = 0; s < 64; s += 16) {
+      ++t[0][(a >> s) & 0xff];
+      ++t[1][(a >> (s + 8)) & 0xff];
+      ++t[2][(b >> s) & 0xff];
+      ++t[3][(b >> (s + 8)) & 0xff];
+    }
+  }
+  for(; i < n; ++i) {
+    ++t[0][p[i]];
+  }
+
+  for(int c = 0; c < 256; ++c) {
+    hist[c] += (uint64_t)t[0][c] + t[1][c] + t[2][c] + t[3][c];
+  }
+}
+
+void byte_stats_histogram(const unsigned char *p, size_t n, uint64_t hist[256]) {
+  while(n > 0) {
+    size_t len = n < HISTOGRAM_CHUNK ? n : HISTOGRAM_CHUNK;
+    byte_stats_histogram_chunk(p, len, hist);
+    p += len;
+    n -= len;
+  }
+}
+
+bool byte_stats_uniform(const unsigned char *p, size_t n) {
+  size_t i = 0;
+  if(n == 0) {
+    return false;
+  }
+#ifdef __SSE2__
+  __m128i fill = _mm_set1_epi8(p[0]);
+  for(; i + 64 <= n; i += 64) {
+    __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), fill);
+    __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 16)), fill);
+    __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 32)), fill);
+    __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 48)), fill);
+    __m128i all = _mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d));
+    if(_mm_movemask_epi8(all) != 0xffff) {
+      return false;
+    }
+  }
+#endif
+  for(; i < n; ++i) {
+    if(p[i] != p[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+size_t byte_stats_run_length(const unsigned char *p, size_t n, unsigned char c) {
+  size_t i = 0;
+#ifdef __SSE2__
+  __m128i fill = _mm_set1_epi8(c);
+  for(; i + 64 <= n; i += 64) {
+    __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)), fill);
+    __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 16)), fill);
+    __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 32)), fill);
+    __m128i e = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i + 48)), fill);
+    __m128i all = _mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(d, e));
+    if(_mm_movemask_epi8(all) != 0xffff) {
+      uint64_t equal = (uint64_t)(uint16_t)_mm_movemask_epi8(a)
+                     | (uint64_t)(uint16_t)_mm_movemask_epi8(b) << 16
+                     | (uint64_t)(uint16_t)_mm_movemask_epi8(d) << 32
+                     | (uint64_t)(uint16_t)_mm_movemask_epi8(e) << 48;
+      return i + __builtin_ctzll(~equal);
+    }
+  }
+#endif
+  for(; i < n; ++i) {
+    if(p[i] != c) {
+      break;
+    }
+  }
+  return i;
+}
+
+#ifdef __SSE2__
+// 0xff in each lane holding a byte in 0x20-0x7e.  the bytes are flipped into
+// signed range so the unsigned bounds become signed compares
+static inline __m128i byte_stats_printable_sse2(__m128i v) {
+  const __m128i flip = _mm_set1_epi8((char)0x80);
+  const __m128i lo = _mm_set1_epi8((char)(0x1f ^ 0x80));
+  const __m128i hi = _mm_set1_epi8((char)(0x7f ^ 0x80));
+  __m128i s = _mm_xor_si128(v, flip);
+  return _mm_and_si128(_mm_cmpgt_epi8(s, lo), _mm_cmplt_epi8(s, hi));
+}
+#endif
+
+static inline bool byte_stats_printable(unsigned char c) {
+  return c >= 0x20 && c < 0x7f;
+}
+
+uint64_t byte_stats_printable_mask(const unsigned char *p, bool tab) {
+  uint64_t mask = 0;
+#ifdef __SSE2__
+  const __m128i tabs = _mm_set1_epi8('\t');
+  for(int i = 0; i < 4; ++i) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i * 16));
+    __m128i m = byte_stats_printable_sse2(v);
+    if(tab) {
+      m = _mm_or_si128(m, _mm_cmpeq_epi8(v, tabs));
+    }
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(m) << (i * 16);
+  }
+#else
+  for(int i = 0; i < 64; ++i) {
+    if(byte_stats_printable(p[i]) || (tab && p[i] == '\t')) {
+      mask |= 1ULL << i;
+    }
+  }
+#endif
+  return mask;
+}
+
+uint64_t byte_stats_zero_mask(const unsigned char *p) {
+  uint64_t mask = 0;
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for(int i = 0; i < 4; ++i) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i * 16));
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)) << (i * 16);
+  }
+#else
+  for(int i = 0; i < 64; ++i) {
+    if(p[i] == 0) {
+      mask |= 1ULL << i;
+    }
+  }
+#endif
+  return mask;
+}
+
+void byte_stats_sanitize(char *p, size_t n, char repl) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128i r = _mm_set1_epi8(repl);
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+    __m128i keep = byte_stats_printable_sse2(v);
+    v = _mm_or_si128(_mm_and_si128(keep, v), _mm_andnot_si128(keep, r));
+    _mm_storeu_si128((__m128i *)(p + i), v);
+  }
+#endif
+  for(; i < n; ++i) {
+    if(!byte_stats_printable(p[i])) {
+      p[i] = repl;
+    }
+  }
+}
+
+double byte_stats_entropy(const uint64_t hist[256], size_t total) {
+  double e = 0.0;
+  if(total == 0) {
+    return e;
+  }
+  for(int c = 0; c < 256; ++c) {
+    if(hist[c]) {
+      double p = (double)hist[c] / total;
+      e -= p * log2(p);
+    }
+  }
+  return e;
+}
+
+int byte_stats_class(const uint64_t hist[256], size_t total, double entropy) {
+  if(total == 0 || hist[0] == total) {
+    return BYTE_CLASS_ZERO;
+  }
+
+  size_t text = hist['\t'] + hist['\n'] + hist['\r'];
+  for(int c = 0; c < 256; ++c) {
+    if(hist[c] == total) {
+      return BYTE_CLASS_FILL;
+    }
+    if(c >= 0x20 && c < 0x7f) {
+      text += hist[c];
+    }
+  }
+
+  // 95% printable counts as text
+  if(text * 20 >= total * 19) {
+    return BYTE_CLASS_TEXT;
+  }
+  if(entropy >= 7.5) {
+    return BYTE_CLASS_RANDOM;
+  }
+  return BYTE_CLASS_BINARY;
+}
@@ -0,0 +1,49 @@
+#ifndef __BYTE_STATS_H__
+#define __BYTE_STATS_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// byte statistics and classification kernels used by the overview and
+// strings panels and the main window renderer
+//
+// the kernels work on raw memory and keep no state, so they can be called
+// from worker threads on disjoint ranges and the results summed afterwards.
+
+// rough classification of a run of bytes
+enum _byte_class {
+  BYTE_CLASS_ZERO = 0, // all zero bytes
+  BYTE_CLASS_FILL,     // one repeated non-zero byte
+  BYTE_CLASS_TEXT,     // mostly printable ascii and whitespace
+  BYTE_CLASS_BINARY,   // anything else
+  BYTE_CLASS_RANDOM,   // close to 8 bits of entropy per byte (compressed/encrypted)
+  NUMBER_BYTE_CLASSES
+};
+
+// add the byte counts of p[0..n) to hist
+void byte_stats_histogram(const unsigned char *p, size_t n, uint64_t hist[256]);
+
+// true if every byte of p[0..n) equals p[0] (n > 0)
+bool byte_stats_uniform(const unsigned char *p, size_t n);
+
+// number of bytes at the start of p[0..n) that are equal to c
+size_t byte_stats_run_length(const unsigned char *p, size_t n, unsigned char c);
+
+// bit i set if p[i] is printable ascii (0x20-0x7e), or a tab when tab is true,
+// for the 64 bytes at p
+uint64_t byte_stats_printable_mask(const unsigned char *p, bool tab);
+
+// bit i set if p[i] == 0, for the 64 bytes at p
+uint64_t byte_stats_zero_mask(const unsigned char *p);
+
+// replace every byte of p[0..n) that isn't printable ascii with repl
+void byte_stats_sanitize(char *p, size_t n, char repl);
+
+// shannon entropy of a histogram in bits per byte (0.0 - 8.0)
+double byte_stats_entropy(const uint64_t hist[256], size_t total);
+
+// pick a byte class from a histogram, see enum _byte_class
+int byte_stats_class(const uint64_t hist[256], size_t total, double entropy);
+
+#endif // __BYTE_STATS_H__
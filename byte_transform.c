@@ -0,0 +1,102 @@
+#include "byte_transform.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+size_t byte_transform_width(int op) {
+  switch(op) {
+    case BYTE_TRANSFORM_SWAP16 :
+      return 2;
+    case BYTE_TRANSFORM_SWAP32 :
+      return 4;
+    case BYTE_TRANSFORM_SWAP64 :
+      return 8;
+  }
+  return 1;
+}
+
+void byte_transform_scalar(int op, char *dst, const char *src, size_t n,
+    const unsigned char *key, size_t key_len, size_t phase)
+{
+  unsigned char *d = (unsigned char *)dst;
+  const unsigned char *s = (const unsigned char *)src;
+
+  if(op == BYTE_TRANSFORM_XOR || op == BYTE_TRANSFORM_ADD) {
+    size_t k = key_len ? phase % key_len : 0;
+    for(size_t i = 0; i < n && key_len; ++i) {
+      d[i] = op == BYTE_TRANSFORM_XOR ? s[i] ^ key[k] : (unsigned char)(s[i] + key[k]);
+      k = k + 1 == key_len ? 0 : k + 1;
+    }
+    return;
+  }
+
+  size_t w = byte_transform_width(op);
+  size_t i = 0;
+  for(; i + w <= n; i += w) {
+    unsigned char word[8];
+    for(size_t j = 0; j < w; ++j) {
+      word[j] = s[i + w - 1 - j];
+    }
+    memcpy(d + i, word, w);
+  }
+  if(d != s) {
+    memmove(d + i, s + i, n - i);
+  }
+}
+
+#ifdef __SSE2__
+static inline __m128i byte_transform_swap_sse2(int op, __m128i v) {
+  // swap the bytes of each 16 bit lane, then the lanes of each word
+  v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+  if(op == BYTE_TRANSFORM_SWAP32) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+  } else if(op == BYTE_TRANSFORM_SWAP64) {
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  }
+  return v;
+}
+#endif
+
+void byte_transform(int op, char *dst, const char *src, size_t n,
+    const unsigned char *key, size_t key_len, size_t phase)
+{
+  size_t i = 0;
+#ifdef __SSE2__
+  if(op == BYTE_TRANSFORM_XOR || op == BYTE_TRANSFORM_ADD) {
+    if(key_len == 0 || key_len > BYTE_TRANSFORM_MAX_KEY) {
+      byte_transform_scalar(op, dst, src, n, key, key_len, phase);
+      return;
+    }
+    // the key repeated 16 times has a period that is a whole number of
+    // vectors, plus one more vector so any 16 bytes of it can be loaded
+    unsigned char ring[BYTE_TRANSFORM_MAX_KEY * 16 + 16];
+    size_t period = key_len * 16;
+    for(size_t j = 0; j < period + 16; ++j) {
+      ring[j] = key[j % key_len];
+    }
+    size_t at = phase % key_len;
+    for(; i + 16 <= n; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+      __m128i k = _mm_loadu_si128((const __m128i *)(ring + at));
+      v = op == BYTE_TRANSFORM_XOR ? _mm_xor_si128(v, k) : _mm_add_epi8(v, k);
+      _mm_storeu_si128((__m128i *)(dst + i), v);
+      at += 16;
+      if(at >= period) {
+        at -= period;
+      }
+    }
+    byte_transform_scalar(op, dst + i, src + i, n - i, key, key_len, phase + i);
+    return;
+  }
+  for(; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_si128((__m128i *)(dst + i), byte_transform_swap_sse2(op, v));
+  }
+#endif
+  byte_transform_scalar(op, dst + i, src + i, n - i, key, key_len, phase + i);
+}
@@ -0,0 +1,33 @@
+#ifndef __BYTE_TRANSFORM_H__
+#define __BYTE_TRANSFORM_H__
+
+#include <stdlib.h>
+
+// byte transform kernels used by the range commands
+//
+// like the byte statistics kernels they work on raw memory and keep no
+// state, so worker threads can run them on disjoint slices of a range.
+
+#define BYTE_TRANSFORM_MAX_KEY 256
+
+enum _byte_transform_op {
+  BYTE_TRANSFORM_XOR = 0,
+  BYTE_TRANSFORM_ADD,    // bytewise, wrapping
+  BYTE_TRANSFORM_SWAP16, // reverse the bytes of each 16 bit word
+  BYTE_TRANSFORM_SWAP32,
+  BYTE_TRANSFORM_SWAP64
+};
+
+size_t byte_transform_width(int op); // bytes per word of a swap, 1 for xor and add
+
+// transform n bytes from src into dst, which may be the same buffer.  xor
+// and add cycle through key starting at key[phase % key_len]; swaps leave a
+// trailing partial word alone
+void byte_transform(int op, char *dst, const char *src, size_t n,
+    const unsigned char *key, size_t key_len, size_t phase);
+
+// the same without sse2, for checking the vector kernels against
+void byte_transform_scalar(int op, char *dst, const char *src, size_t n,
+    const unsigned char *key, size_t key_len, size_t phase);
+
+#endif // __BYTE_TRANSFORM_H__
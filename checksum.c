@@ -0,0 +1,399 @@
+#include "checksum.h"
+
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CHECKSUM_X86 1
+#endif
+
+#define CRC32_POLY 0xedb88320U  // reflected IEEE 802.3
+#define CRC32C_POLY 0x82f63b78U // reflected Castagnoli
+
+// slicing-by-8 tables, t[0] is the classic bytewise table and t[k] advances
+// a byte through k more zero bytes so eight bytes can be folded per step
+static uint32_t g_crc32_table[8][256];
+static uint32_t g_crc32c_table[8][256];
+static pthread_once_t g_crc_tables_once = PTHREAD_ONCE_INIT;
+static bool g_crc32c_hw = false;
+
+static void crc_make_table(uint32_t t[8][256], uint32_t poly) {
+  for(int i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for(int k = 0; k < 8; ++k) {
+      c = c & 1 ? (c >> 1) ^ poly : c >> 1;
+    }
+    t[0][i] = c;
+  }
+  for(int i = 0; i < 256; ++i) {
+    for(int k = 1; k < 8; ++k) {
+      t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+    }
+  }
+}
+
+static void crc_init_tables() {
+  crc_make_table(g_crc32_table, CRC32_POLY);
+  crc_make_table(g_crc32c_table, CRC32C_POLY);
+#ifdef CHECKSUM_X86
+  __builtin_cpu_init();
+  g_crc32c_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static uint32_t crc_slice8(uint32_t t[8][256], uint32_t crc, const unsigned char *p, size_t len) {
+  crc = ~crc;
+  while(len && ((uintptr_t)p & 7)) {
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    --len;
+  }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  for(; len >= 8; len -= 8, p += 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    uint32_t lo = (uint32_t)w ^ crc;
+    uint32_t hi = (uint32_t)(w >> 32);
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+        ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+  }
+#endif
+  while(len--) {
+    crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+#ifdef CHECKSUM_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len) {
+  uint64_t c = ~crc;
+  while(len && ((uintptr_t)p & 7)) {
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+    --len;
+  }
+#ifdef __x86_64__
+  for(; len >= 8; len -= 8, p += 8) {
+    uint64_t w;
+    memcpy(&w, p, 8);
+    c = _mm_crc32_u64(c, w);
+  }
+#endif
+  while(len--) {
+    c = _mm_crc32_u8((uint32_t)c, *p++);
+  }
+  return ~(uint32_t)c;
+}
+#endif
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len) {
+  pthread_once(&g_crc_tables_once, crc_init_tables);
+  return crc_slice8(g_crc32_table, crc, buf, len);
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len) {
+  pthread_once(&g_crc_tables_once, crc_init_tables);
+#ifdef CHECKSUM_X86
+  if(g_crc32c_hw) {
+    return crc32c_sse42(crc, buf, len);
+  }
+#endif
+  return crc_slice8(g_crc32c_table, crc, buf, len);
+}
+
+bool crc32c_hardware() {
+  pthread_once(&g_crc_tables_once, crc_init_tables);
+  return g_crc32c_hw;
+}
+
+// combining works on the crc as a polynomial over GF(2): appending len2 zero
+// bytes to the first buffer is a linear operator, built here by repeated
+// squaring of the one-zero-bit operator (same approach as zlib)
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+  uint32_t sum = 0;
+  while(vec) {
+    if(vec & 1) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    ++mat;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+  for(int n = 0; n < 32; ++n) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+static uint32_t crc_combine(uint32_t poly, uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  uint32_t even[32], odd[32];
+  if(len2 == 0) {
+    return crc1;
+  }
+
+  odd[0] = poly; // operator for one zero bit
+  uint32_t row = 1;
+  for(int n = 1; n < 32; ++n) {
+    odd[n] = row;
+    row <<= 1;
+  }
+  gf2_matrix_square(even, odd); // two zero bits
+  gf2_matrix_square(odd, even); // four zero bits
+
+  // apply len2 zero bytes, one bit of len2 per squaring
+  do {
+    gf2_matrix_square(even, odd);
+    if(len2 & 1) {
+      crc1 = gf2_matrix_times(even, crc1);
+    }
+    len2 >>= 1;
+    if(len2 == 0) {
+      break;
+    }
+    gf2_matrix_square(odd, even);
+    if(len2 & 1) {
+      crc1 = gf2_matrix_times(odd, crc1);
+    }
+    len2 >>= 1;
+  } while(len2 != 0);
+
+  return crc1 ^ crc2;
+}
+
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  return crc_combine(CRC32_POLY, crc1, crc2, len2);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  return crc_combine(CRC32C_POLY, crc1, crc2, len2);
+}
+
+// xxHash64
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input) {
+  acc += input * XXH_P2;
+  acc = rotl64(acc, 31);
+  return acc * XXH_P1;
+}
+
+static inline uint64_t xxh64_merge_round(uint64_t acc, uint64_t val) {
+  acc ^= xxh64_round(0, val);
+  return acc * XXH_P1 + XXH_P4;
+}
+
+void xxh64_init(xxh64_state *s, uint64_t seed) {
+  memset(s, 0, sizeof(*s));
+  s->seed = seed;
+  s->v[0] = seed + XXH_P1 + XXH_P2;
+  s->v[1] = seed + XXH_P2;
+  s->v[2] = seed;
+  s->v[3] = seed - XXH_P1;
+}
+
+void xxh64_update(xxh64_state *s, const void *buf, size_t len) {
+  const unsigned char *p = buf;
+  s->total_len += len;
+
+  if(s->mem_len + len < 32) {
+    memcpy(s->mem + s->mem_len, p, len);
+    s->mem_len += len;
+    return;
+  }
+
+  if(s->mem_len) { // finish the stripe left over from the last call
+    size_t fill = 32 - s->mem_len;
+    memcpy(s->mem + s->mem_len, p, fill);
+    for(int i = 0; i < 4; ++i) {
+      s->v[i] = xxh64_round(s->v[i], read64(s->mem + i * 8));
+    }
+    p += fill;
+    len -= fill;
+    s->mem_len = 0;
+  }
+
+  uint64_t v0 = s->v[0], v1 = s->v[1], v2 = s->v[2], v3 = s->v[3];
+  for(; len >= 32; len -= 32, p += 32) {
+    v0 = xxh64_round(v0, read64(p));
+    v1 = xxh64_round(v1, read64(p + 8));
+    v2 = xxh64_round(v2, read64(p + 16));
+    v3 = xxh64_round(v3, read64(p + 24));
+  }
+  s->v[0] = v0;
+  s->v[1] = v1;
+  s->v[2] = v2;
+  s->v[3] = v3;
+
+  memcpy(s->mem, p, len);
+  s->mem_len = len;
+}
+
+uint64_t xxh64_final(xxh64_state *s) {
+  uint64_t h;
+  if(s->total_len >= 32) {
+    h = rotl64(s->v[0], 1) + rotl64(s->v[1], 7) + rotl64(s->v[2], 12) + rotl64(s->v[3], 18);
+    for(int i = 0; i < 4; ++i) {
+      h = xxh64_merge_round(h, s->v[i]);
+    }
+  } else {
+    h = s->seed + XXH_P5;
+  }
+  h += s->total_len;
+
+  const unsigned char *p = s->mem;
+  size_t len = s->mem_len;
+  for(; len >= 8; len -= 8, p += 8) {
+    h ^= xxh64_round(0, read64(p));
+    h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+  }
+  if(len >= 4) {
+    h ^= (uint64_t)read32(p) * XXH_P1;
+    h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+    p += 4;
+    len -= 4;
+  }
+  while(len--) {
+    h ^= (*p++) * XXH_P5;
+    h = rotl64(h, 11) * XXH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= XXH_P2;
+  h ^= h >> 29;
+  h *= XXH_P3;
+  h ^= h >> 32;
+  return h;
+}
+
+// SHA-256 (FIPS 180-4)
+
+static const uint32_t g_sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t x, int r) {
+  return (x >> r) | (x << (32 - r));
+}
+
+static void sha256_block(uint32_t h[8], const unsigned char *p) {
+  uint32_t w[64];
+  for(int i = 0; i < 16; ++i) {
+    w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16
+         | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+  }
+  for(int i = 16; i < 64; ++i) {
+    uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+  }
+
+  uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+  uint32_t e = h[4], f = h[5], g = h[6], hh = h[7];
+  for(int i = 0; i < 64; ++i) {
+    uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+    uint32_t ch = (e & f) ^ (~e & g);
+    uint32_t t1 = hh + s1 + ch + g_sha256_k[i] + w[i];
+    uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+    uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+    uint32_t t2 = s0 + maj;
+    hh = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  h[0] += a;
+  h[1] += b;
+  h[2] += c;
+  h[3] += d;
+  h[4] += e;
+  h[5] += f;
+  h[6] += g;
+  h[7] += hh;
+}
+
+void sha256_init(sha256_state *s) {
+  static const uint32_t init[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+  memcpy(s->h, init, sizeof(init));
+  s->total_len = 0;
+  s->mem_len = 0;
+}
+
+void sha256_update(sha256_state *s, const void *buf, size_t len) {
+  const unsigned char *p = buf;
+  s->total_len += len;
+
+  if(s->mem_len) {
+    size_t fill = 64 - s->mem_len;
+    fill = fill < len ? fill : len;
+    memcpy(s->mem + s->mem_len, p, fill);
+    s->mem_len += fill;
+    p += fill;
+    len -= fill;
+    if(s->mem_len < 64) {
+      return;
+    }
+    sha256_block(s->h, s->mem);
+    s->mem_len = 0;
+  }
+
+  for(; len >= 64; len -= 64, p += 64) {
+    sha256_block(s->h, p);
+  }
+
+  memcpy(s->mem, p, len);
+  s->mem_len = len;
+}
+
+void sha256_final(sha256_state *s, unsigned char digest[32]) {
+  uint64_t bits = s->total_len * 8;
+  unsigned char pad[72] = { 0x80 };
+  size_t pad_len = s->mem_len < 56 ? 56 - s->mem_len : 120 - s->mem_len;
+
+  for(int i = 0; i < 8; ++i) {
+    pad[pad_len + i] = bits >> (56 - i * 8);
+  }
+  sha256_update(s, pad, pad_len + 8);
+
+  for(int i = 0; i < 8; ++i) {
+    digest[i * 4] = s->h[i] >> 24;
+    digest[i * 4 + 1] = s->h[i] >> 16;
+    digest[i * 4 + 2] = s->h[i] >> 8;
+    digest[i * 4 + 3] = s->h[i];
+  }
+}
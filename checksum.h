@@ -0,0 +1,50 @@
+#ifndef __CHECKSUM_H__
+#define __CHECKSUM_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// checksum and hash algorithms
+//
+// each algorithm is incremental: start from the *_init value (or state),
+// feed it the data in as many pieces as needed, then finish.  the crcs use
+// the usual pre/post inversion, so crc32_update(0, ...) on a whole buffer
+// gives the same value as zlib's crc32().
+
+#define CRC32_INIT 0
+
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len); // IEEE 802.3 polynomial
+uint32_t crc32c_update(uint32_t crc, const void *buf, size_t len); // Castagnoli, uses SSE4.2 if available
+bool crc32c_hardware(); // true if crc32c_update() runs on the SSE4.2 crc32 instruction
+
+// crc of the concatenation of two buffers given each one's crc and the second's length
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+struct _xxh64_state {
+  uint64_t v[4];
+  uint64_t total_len;
+  unsigned char mem[32];
+  size_t mem_len;
+  uint64_t seed;
+};
+typedef struct _xxh64_state xxh64_state;
+
+void xxh64_init(xxh64_state *s, uint64_t seed);
+void xxh64_update(xxh64_state *s, const void *buf, size_t len);
+uint64_t xxh64_final(xxh64_state *s);
+
+struct _sha256_state {
+  uint32_t h[8];
+  uint64_t total_len;
+  unsigned char mem[64];
+  size_t mem_len;
+};
+typedef struct _sha256_state sha256_state;
+
+void sha256_init(sha256_state *s);
+void sha256_update(sha256_state *s, const void *buf, size_t len);
+void sha256_final(sha256_state *s, unsigned char digest[32]);
+
+#endif // __CHECKSUM_H__
@@ -0,0 +1,208 @@
+#include "clipboard.h"
+
+#include "document.h"
+#include "editor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static struct {
+  doc_ref *refs;
+  size_t n_refs;
+  size_t max_refs;
+  size_t len;
+} g_clip = {
+  .refs = NULL,
+  .n_refs = 0,
+  .max_refs = 0,
+  .len = 0
+};
+
+// append a reference, extending the last one when it continues it
+static int clip_add(doc_ref *refs, size_t *n, size_t *max, const doc_ref *ref) {
+  doc_ref *last = *n ? &refs[*n - 1] : NULL;
+  if(last && last->in_file == ref->in_file && last->src + last->len == ref->src) {
+    last->len += ref->len;
+    return 0;
+  }
+  if(*n == *max) {
+    return -1;
+  }
+  refs[(*n)++] = *ref;
+  return 0;
+}
+
+struct clip_yank_state {
+  doc_ref *refs;
+  size_t n_refs;
+  size_t max_refs;
+};
+
+static int clip_collect(const doc_span *span, void *arg) {
+  struct clip_yank_state *st = arg;
+  doc_ref ref = { span->len, span->kind == DOC_SPAN_FILE, 0 };
+  switch(span->kind) {
+    case DOC_SPAN_FILE :
+      ref.src = span->file_offset;
+      break;
+    case DOC_SPAN_ADD :
+      ref.src = span->add_offset;
+      break;
+    default :
+      if(doc_stash(span->data, span->len, &ref) < 0) {
+        return -1;
+      }
+      break;
+  }
+
+  if(st->n_refs == st->max_refs) {
+    size_t max = st->max_refs ? st->max_refs * 2 : 16;
+    doc_ref *refs = realloc(st->refs, max * sizeof(doc_ref));
+    if(!refs) {
+      return -1;
+    }
+    st->refs = refs;
+    st->max_refs = max;
+  }
+  return clip_add(st->refs, &st->n_refs, &st->max_refs, &ref);
+}
+
+int clip_yank(size_t offset, size_t len) {
+  struct clip_yank_state st = { NULL, 0, 0 };
+  if(offset > doc_length() || len > doc_length() - offset) {
+    return -1;
+  }
+  if(doc_for_each_span_in(offset, len, clip_collect, &st) != 0) {
+    free(st.refs);
+    return -1;
+  }
+  free(g_clip.refs);
+  g_clip.refs = st.refs;
+  g_clip.n_refs = st.n_refs;
+  g_clip.max_refs = st.max_refs;
+  g_clip.len = len;
+  return 0;
+}
+
+int clip_delete(size_t offset, size_t len) {
+  if(clip_yank(offset, len) < 0) {
+    return -1;
+  }
+  return doc_delete(offset, len);
+}
+
+int clip_put(size_t offset) {
+  if(g_clip.len == 0) {
+    return -1;
+  }
+  return doc_replace_refs(offset, 0, g_clip.refs, g_clip.n_refs);
+}
+
+size_t clip_length() {
+  return g_clip.len;
+}
+
+size_t clip_memory() {
+  return g_clip.max_refs * sizeof(doc_ref);
+}
+
+void clip_clear() {
+  free(g_clip.refs);
+  g_clip.refs = NULL;
+  g_clip.n_refs = 0;
+  g_clip.max_refs = 0;
+  g_clip.len = 0;
+}
+
+int clip_detach_file(size_t offset, size_t len) {
+  size_t end = offset + len;
+  bool touched = false;
+  for(size_t i = 0; i < g_clip.n_refs; ++i) {
+    const doc_ref *r = &g_clip.refs[i];
+    if(r->in_file && r->src < end && r->src + r->len > offset) {
+      touched = true;
+      break;
+    }
+  }
+  if(!touched) {
+    return 0;
+  }
+
+  // each reference splits into at most three
+  size_t max = g_clip.n_refs * 3, n = 0;
+  doc_ref *refs = malloc(max * sizeof(doc_ref));
+  if(!refs) {
+    return -1;
+  }
+  for(size_t i = 0; i < g_clip.n_refs; ++i) {
+    const doc_ref *r = &g_clip.refs[i];
+    if(!r->in_file || r->src >= end || r->src + r->len <= offset) {
+      refs[n++] = *r;
+      continue;
+    }
+    size_t b = r->src > offset ? r->src : offset;
+    size_t e = r->src + r->len < end ? r->src + r->len : end;
+    size_t got = e - b;
+    const char *data = file_view(&g_curfile, b, &got);
+    doc_ref copy;
+    if(!data || got != e - b || doc_stash(data, got, &copy) < 0) {
+      free(refs);
+      return -1;
+    }
+    if(b > r->src) {
+      refs[n++] = (doc_ref){ b - r->src, true, r->src };
+    }
+    refs[n++] = copy;
+    if(e < r->src + r->len) {
+      refs[n++] = (doc_ref){ r->src + r->len - e, true, e };
+    }
+  }
+  free(g_clip.refs);
+  g_clip.refs = refs;
+  g_clip.n_refs = n;
+  g_clip.max_refs = max;
+  return 0;
+}
+
+int yank_cmd(int argc, char *argv[]) {
+  char msg[96];
+  size_t offset = editor_get_cursor_offset();
+  size_t len = 0;
+
+  if(argc > 1) {
+    char *end;
+    len = strtoul(argv[1], &end, 0);
+    if(*end || len == 0) {
+      set_status_window_text("usage: yank [count]");
+      return -1;
+    }
+    if(offset < doc_length() && len > doc_length() - offset) {
+      len = doc_length() - offset;
+    }
+  } else {
+    editor_get_selection(&offset, &len);
+  }
+
+  if(clip_yank(offset, len) < 0) {
+    set_status_window_text("yank: failed");
+    return -1;
+  }
+  snprintf(msg, sizeof(msg), "yanked %lu bytes at 0x%lx", len, offset);
+  set_status_window_text(msg);
+  return 0;
+}
+
+int put_cmd(int argc, char *argv[]) {
+  char msg[96];
+  (void)argc;
+  (void)argv;
+
+  size_t offset = editor_get_cursor_offset();
+  if(clip_put(offset) < 0) {
+    set_status_window_text(clip_length() ? "put: failed" : "put: the clipboard is empty");
+    return -1;
+  }
+  snprintf(msg, sizeof(msg), "put %lu bytes at 0x%lx", clip_length(), offset);
+  set_status_window_text(msg);
+  return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef __CLIPBOARD_H__
+#define __CLIPBOARD_H__
+
+#include <stdlib.h>
+
+// clipboard:
+//
+// yanked bytes are kept as references into the file and the document's add
+// buffer (see doc_ref), never copied, so yanking and putting a range costs
+// the same whatever its size.  only overwritten bytes, which have no stable
+// place to refer to, are copied into the add buffer when they are yanked.
+//
+
+int clip_yank(size_t offset, size_t len); // replace the clipboard with a range of the document
+int clip_delete(size_t offset, size_t len); // yank a range, then delete it
+int clip_put(size_t offset); // insert the clipboard at offset
+size_t clip_length(); // bytes on the clipboard
+size_t clip_memory(); // bytes allocated for the references
+void clip_clear();
+
+// the file is about to be rewritten at [offset, offset + len), stash the
+// bytes the clipboard refers to there
+int clip_detach_file(size_t offset, size_t len);
+
+int yank_cmd(int argc, char *argv[]); // ":yank [count]"
+int put_cmd(int argc, char *argv[]); // ":put"
+
+#endif // __CLIPBOARD_H__
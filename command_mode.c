@@ -1,10 +1,16 @@
 #include "command_mode.h"
 
 #include "editor.h"
+#include "skip.h"
+#include "undo.h"
+#include "clipboard.h"
+#include "document.h"
 #include "logger.h"
 
 #include <ncurses.h>
 
+static bool g_quit_warned = false; // q was pressed once with unsaved changes
+
 int cmd_mode_enter() {
   editor_set_focus(g_windows.mainwnd);
   return 0;
@@ -19,38 +25,84 @@ int cmd_mode_place_cursor() {
 }
 
 int cmd_mode_new_char(int c) {
+  if(c != 'q') {
+    g_quit_warned = false;
+  }
   switch(c) {
     case 'q' :
+      if(doc_modified() && !g_quit_warned) {
+        g_quit_warned = true;
+        set_status_window_text("unsaved changes, :w saves them, q again quits without saving");
+        break;
+      }
       return -1;
     case 'i' :
       editor_switch_mode(MODE_INSERT);
       break;
+    case 'R' :
+      editor_switch_mode(MODE_OVERWRITE);
+      break;
+    case 'v' :
+      editor_switch_mode(MODE_VISUAL);
+      break;
+    case 'p' :
+    case 'P' :
+      {
+        // p puts after the byte under the cursor, P before it
+        size_t offset = editor_get_cursor_offset();
+        if(c == 'p' && offset < doc_length()) {
+          ++offset;
+        }
+        if(clip_put(offset) < 0) {
+          set_status_window_text(clip_length() ? "put failed" : "the clipboard is empty");
+        }
+      }
+      break;
+    case ':' :
+      editor_switch_mode(MODE_LINE);
+      set_input_window_text(":");
+      break;
+    case 'u' :
+      undo();
+      break;
+    case 18 : // ctrl-r
+      redo();
+      break;
+    case 'z' :
+      skip_fill();
+      break;
+    case 'Z' :
+      skip_diff();
+      break;
+    case KEY_MOUSE :
+      editor_mouse_event();
+      break;
     case KEY_LEFT :
     case 'h':
       {
         editor_char_left_main();
-        LOG_MSG("key left");
+        LOG_DEBUG("key left");
       }
       break;
     case KEY_RIGHT :
     case 'l':
       {
         editor_char_right_main();
-        LOG_MSG("key right");
+        LOG_DEBUG("key right");
       }
       break;
     case KEY_DOWN :
     case 'j':
       {
         editor_line_down_main();
-        LOG_MSG("Lines: first: %d, current: %d, last: %d", g_editor.screen.firstline_number, g_editor.screen.curline_number, g_editor.screen.lastline_number);
+        LOG_DEBUG("Lines: first: %d, current: %d, last: %d", g_editor.screen.firstline_number, g_editor.screen.curline_number, g_editor.screen.lastline_number);
       }
       break;
     case KEY_UP :
     case 'k':
       {
         editor_line_up_main();
-        LOG_MSG("Lines: first: %d, current: %d, last: %d", g_editor.screen.firstline_number, g_editor.screen.curline_number, g_editor.screen.lastline_number);
+        LOG_DEBUG("Lines: first: %d, current: %d, last: %d", g_editor.screen.firstline_number, g_editor.screen.curline_number, g_editor.screen.lastline_number);
       }
       break;
   }
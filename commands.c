@@ -0,0 +1,105 @@
+#include "commands.h"
+
+#include "editor.h"
+#include "overview.h"
+#include "hashing.h"
+#include "compare.h"
+#include "strings_panel.h"
+#include "skip.h"
+#include "save.h"
+#include "edit.h"
+#include "undo.h"
+#include "clipboard.h"
+#include "transform.h"
+#include "replace.h"
+#include "latency.h"
+#include "memstat.h"
+#include "follow.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#define COMMAND_MAX_ARGS 16
+
+const editor_command g_commands[] = {
+  { "overview", overview_cmd, "overview [next]" },
+  { "hash", hash_cmd, "hash <crc32|crc32c|xxh64|sha256> [sel]" },
+  { "compare", compare_cmd, "compare <file>" },
+  { "strings", strings_cmd, "strings [next|<min length>]" },
+  { "skip", skip_cmd, "skip [diff]" },
+  { "w", save_cmd, "w" },
+  { "patch", edit_patch_cmd, "patch <hex bytes>" },
+  { "insert", edit_insert_cmd, "insert <hex bytes>" },
+  { "delete", edit_delete_cmd, "delete [count]" },
+  { "yank", yank_cmd, "yank [count]" },
+  { "put", put_cmd, "put" },
+  { "fill", fill_cmd, "fill <hex bytes>" },
+  { "xor", xor_cmd, "xor <hex bytes>" },
+  { "add", add_cmd, "add <hex bytes>" },
+  { "swap", swap_cmd, "swap <16|32|64>" },
+  { "s", replace_cmd, "s/<find>/<replace>/" },
+  { "undo", undo_cmd, "undo [limit <bytes>]" },
+  { "redo", redo_cmd, "redo" },
+  { "latency", latency_cmd, "latency [reset]" },
+  { "mem", mem_cmd, "mem [limit <bytes>]" },
+  { "follow", follow_cmd, "follow [off]" },
+  { NULL, NULL, NULL }
+};
+
+bool commands_parse_size(const char *s, size_t *size) {
+  char *end;
+  unsigned long long n = strtoull(s, &end, 0);
+  switch(*end) {
+    case 'k' : case 'K' : n <<= 10; ++end; break;
+    case 'm' : case 'M' : n <<= 20; ++end; break;
+    case 'g' : case 'G' : n <<= 30; ++end; break;
+  }
+  if(end == s || *end) {
+    return false;
+  }
+  *size = n;
+  return true;
+}
+
+int commands_run(char *line) {
+  char *argv[COMMAND_MAX_ARGS + 1];
+  int argc = 0;
+  char *save = NULL;
+
+  // "s/find/replace/" is one argument, spaces and all
+  if(line[0] == 's' && ispunct((unsigned char)line[1])) {
+    char name[] = "s";
+    argv[argc++] = name;
+    argv[argc++] = line + 1;
+    argv[argc] = NULL;
+    undo_seal();
+    return replace_cmd(argc, argv);
+  }
+
+  for(char *tok = strtok_r(line, " \t", &save);
+      tok && argc < COMMAND_MAX_ARGS;
+      tok = strtok_r(NULL, " \t", &save))
+  {
+    argv[argc++] = tok;
+  }
+  argv[argc] = NULL;
+
+  if(argc == 0) {
+    return 0;
+  }
+
+  // changes made by separate commands are undone separately
+  undo_seal();
+
+  for(const editor_command *cmd = g_commands; cmd->name; ++cmd) {
+    if(strcmp(cmd->name, argv[0]) == 0) {
+      return cmd->run(argc, argv);
+    }
+  }
+
+  char msg[128];
+  snprintf(msg, sizeof(msg), "Unknown command: %s", argv[0]);
+  set_status_window_text(msg);
+  return -1;
+}
@@ -0,0 +1,27 @@
+#ifndef __COMMANDS_H__
+#define __COMMANDS_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// commands typed on the input line after ':' in command mode
+//
+// a command is looked up by its first word and called with the words of the
+// line in argc/argv (argv[0] is the command name).  handlers report their
+// results in the status window and return < 0 on error.
+struct _editor_command {
+  const char *name;
+  int (*run)(int argc, char *argv[]);
+  const char *usage;
+};
+typedef struct _editor_command editor_command;
+
+extern const editor_command g_commands[];
+
+// a byte count with an optional k, m or g suffix, e.g. "16m"
+bool commands_parse_size(const char *s, size_t *size);
+
+// split line into words and run the matching command, modifies line
+int commands_run(char *line);
+
+#endif // __COMMANDS_H__
@@ -0,0 +1,546 @@
+#include "compare.h"
+
+#include "document.h"
+#include "editor.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <limits.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define COMPARE_BLOCK 4096
+#define COMPARE_MAX_BLOCKS (1UL << 23)        // block size grows past this many blocks
+#define COMPARE_JOB_BLOCKS 1024               // blocks hashed by one worker job
+#define COMPARE_SEARCH_LIMIT (16UL << 20)     // how far to roll looking for the data to line up again
+#define COMPARE_FILTER_BITS 24                // size of the bitmap that screens hash lookups
+#define COMPARE_VIEW_CHUNK (1UL << 20)
+
+#define RK_MULT 0x9e3779b97f4a7c15ULL
+
+compare_state g_compare = {
+  .valid = false,
+  .hunks = NULL,
+  .n_hunks = 0,
+  .max_hunks = 0
+};
+
+struct compare_entry {
+  uint64_t hash;
+  size_t block;
+};
+
+struct compare_side {
+  const file_info *file; // NULL for the document
+  size_t len;
+  size_t n_blocks;       // whole blocks, a partial last block is compared bytewise
+  uint64_t *hashes;
+  struct compare_entry *sorted; // (hash, block) in ascending order
+  uint64_t *filter;      // one bit per top COMPARE_FILTER_BITS bits of a hash
+};
+
+struct compare_job {
+  struct compare_side *side;
+  size_t first;
+  size_t count;
+};
+
+static struct {
+  size_t block_size;
+  uint64_t rk_pow; // RK_MULT ^ (block_size - 1), removes the byte leaving the window
+  struct compare_side a;
+  struct compare_side b;
+  worker_group group;
+  size_t done;     // progress of the current phase
+  bool failed;
+} g_cmp;
+
+static uint64_t g_rk_table[256];
+static char g_cmp_filename[PATH_MAX];
+
+static void compare_init_rk() {
+  uint64_t x = 0x243f6a8885a308d3ULL; // splitmix64 from a fixed seed, stable between runs
+  for(int i = 0; i < 256; ++i) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    g_rk_table[i] = z ^ (z >> 31);
+  }
+}
+
+static const unsigned char *side_view(const struct compare_side *s, size_t offset, size_t *len) {
+  return (const unsigned char *)(s->file ? file_view(s->file, offset, len) : doc_view(offset, len));
+}
+
+static inline uint64_t rk_update(uint64_t h, const unsigned char *p, size_t n) {
+  for(size_t i = 0; i < n; ++i) {
+    h = h * RK_MULT + g_rk_table[p[i]];
+  }
+  return h;
+}
+
+// index of the first differing byte of p and q, n if they're equal
+static size_t compare_mismatch(const unsigned char *p, const unsigned char *q, size_t n) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for(; i + 16 <= n; i += 16) {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + i)),
+                                _mm_loadu_si128((const __m128i *)(q + i)));
+    int mask = _mm_movemask_epi8(eq);
+    if(mask != 0xffff) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+#endif
+  for(; i < n && p[i] == q[i]; ++i);
+  return i;
+}
+
+// number of equal bytes at the start of x[xo..] and y[yo..], at most n
+static size_t compare_common_prefix(const struct compare_side *x, size_t xo,
+    const struct compare_side *y, size_t yo, size_t n)
+{
+  size_t same = 0;
+  while(same < n) {
+    size_t xn = n - same, yn = n - same;
+    const unsigned char *p = side_view(x, xo + same, &xn);
+    const unsigned char *q = side_view(y, yo + same, &yn);
+    if(!p || !q) {
+      break;
+    }
+    size_t len = xn < yn ? xn : yn;
+    size_t m = compare_mismatch(p, q, len);
+    same += m;
+    if(m < len) {
+      break;
+    }
+  }
+  return same;
+}
+
+// number of equal bytes at the end of x[..xe) and y[..ye), at most n
+static size_t compare_common_suffix(const struct compare_side *x, size_t xe,
+    const struct compare_side *y, size_t ye, size_t n)
+{
+  size_t same = 0;
+  while(same < n) {
+    size_t chunk = n - same < 256 ? n - same : 256;
+    size_t xn = chunk, yn = chunk;
+    const unsigned char *p = side_view(x, xe - same - chunk, &xn);
+    const unsigned char *q = side_view(y, ye - same - chunk, &yn);
+    if(!p || !q || xn < chunk || yn < chunk) {
+      break;
+    }
+    size_t i = chunk;
+    while(i > 0 && p[i - 1] == q[i - 1]) {
+      --i;
+    }
+    same += chunk - i;
+    if(i > 0) {
+      break;
+    }
+  }
+  return same;
+}
+
+static void compare_hash_job(void *arg) {
+  struct compare_job *job = arg;
+  struct compare_side *side = job->side;
+  size_t bs = g_cmp.block_size;
+
+  for(size_t b = job->first; b < job->first + job->count; ++b) {
+    if(worker_group_cancelled(&g_cmp.group)) {
+      break;
+    }
+    uint64_t h = 0;
+    size_t offset = b * bs, left = bs;
+    while(left > 0) {
+      size_t n = left;
+      const unsigned char *p = side_view(side, offset, &n);
+      if(!p) {
+        break;
+      }
+      h = rk_update(h, p, n);
+      offset += n;
+      left -= n;
+    }
+    side->hashes[b] = h;
+    __atomic_add_fetch(&g_cmp.done, bs, __ATOMIC_RELAXED);
+  }
+}
+
+static int compare_entry_cmp(const void *x, const void *y) {
+  const struct compare_entry *a = x, *b = y;
+  if(a->hash != b->hash) {
+    return a->hash < b->hash ? -1 : 1;
+  }
+  return a->block < b->block ? -1 : a->block > b->block;
+}
+
+static void compare_index_job(void *arg) {
+  struct compare_side *side = arg;
+  for(size_t b = 0; b < side->n_blocks; ++b) {
+    side->sorted[b].hash = side->hashes[b];
+    side->sorted[b].block = b;
+    side->filter[side->hashes[b] >> (64 - COMPARE_FILTER_BITS) >> 6] |=
+      1ULL << ((side->hashes[b] >> (64 - COMPARE_FILTER_BITS)) & 63);
+  }
+  qsort(side->sorted, side->n_blocks, sizeof(struct compare_entry), compare_entry_cmp);
+}
+
+// first block in [from, to) with hash h, or -1
+static long compare_lookup(const struct compare_side *side, uint64_t h, size_t from, size_t to) {
+  uint64_t bit = h >> (64 - COMPARE_FILTER_BITS);
+  if(!(side->filter[bit >> 6] & (1ULL << (bit & 63)))) {
+    return -1;
+  }
+
+  size_t lo = 0, hi = side->n_blocks;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const struct compare_entry *e = &side->sorted[mid];
+    if(e->hash < h || (e->hash == h && e->block < from)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if(lo < side->n_blocks && side->sorted[lo].hash == h && side->sorted[lo].block < to) {
+    return side->sorted[lo].block;
+  }
+  return -1;
+}
+
+struct compare_cursor {
+  const struct compare_side *side;
+  size_t offset;
+  const unsigned char *p;
+  size_t avail;
+};
+
+static inline int compare_cursor_next(struct compare_cursor *c) {
+  if(c->avail == 0) {
+    size_t n = COMPARE_VIEW_CHUNK;
+    c->p = side_view(c->side, c->offset, &n);
+    if(!c->p || n == 0) {
+      return -1;
+    }
+    c->avail = n;
+  }
+  --c->avail;
+  ++c->offset;
+  return *c->p++;
+}
+
+// roll a block sized window over `roll` from `start`, looking for a block of
+// `fixed` that starts within the search limit after fixed_from
+static bool compare_roll(const struct compare_side *roll, size_t start,
+    const struct compare_side *fixed, size_t fixed_from,
+    size_t *roll_off, size_t *fixed_off)
+{
+  size_t bs = g_cmp.block_size;
+  if(start + bs > roll->len) {
+    return false;
+  }
+
+  struct compare_cursor in = { roll, start, NULL, 0 };
+  struct compare_cursor out = { roll, start, NULL, 0 };
+  uint64_t h = 0;
+  for(size_t i = 0; i < bs; ++i) {
+    h = h * RK_MULT + g_rk_table[compare_cursor_next(&in) & 0xff];
+  }
+
+  size_t from = (fixed_from + bs - 1) / bs;
+  size_t to = (fixed_from + COMPARE_SEARCH_LIMIT) / bs + 1;
+  to = to < fixed->n_blocks ? to : fixed->n_blocks;
+  size_t end = start + COMPARE_SEARCH_LIMIT < roll->len - bs ? start + COMPARE_SEARCH_LIMIT : roll->len - bs;
+
+  for(size_t pos = start; ; ++pos) {
+    long blk = compare_lookup(fixed, h, from, to);
+    if(blk >= 0 && compare_common_prefix(roll, pos, fixed, blk * bs, bs) == bs) {
+      *roll_off = pos;
+      *fixed_off = blk * bs;
+      return true;
+    }
+    if(pos >= end || ((pos & 0xffff) == 0 && worker_group_cancelled(&g_cmp.group))) {
+      break;
+    }
+    int o = compare_cursor_next(&out);
+    int n = compare_cursor_next(&in);
+    if(o < 0 || n < 0) {
+      break;
+    }
+    h = (h - g_rk_table[o] * g_cmp.rk_pow) * RK_MULT + g_rk_table[n];
+  }
+  return false;
+}
+
+static int compare_add_hunk(size_t a_off, size_t a_len, size_t b_off, size_t b_len) {
+  compare_hunk *last = g_compare.n_hunks ? &g_compare.hunks[g_compare.n_hunks - 1] : NULL;
+  if(last && last->a_off + last->a_len == a_off && last->b_off + last->b_len == b_off) {
+    last->a_len += a_len;
+    last->b_len += b_len;
+    return 0;
+  }
+
+  if(g_compare.n_hunks == g_compare.max_hunks) {
+    size_t max = g_compare.max_hunks ? g_compare.max_hunks * 2 : 64;
+    compare_hunk *hunks = realloc(g_compare.hunks, max * sizeof(compare_hunk));
+    if(!hunks) {
+      return -1;
+    }
+    g_compare.hunks = hunks;
+    g_compare.max_hunks = max;
+  }
+
+  compare_hunk *h = &g_compare.hunks[g_compare.n_hunks++];
+  h->a_off = a_off;
+  h->a_len = a_len;
+  h->b_off = b_off;
+  h->b_len = b_len;
+  return 0;
+}
+
+static void compare_walk_job(void *unused) {
+  const struct compare_side *a_side = &g_cmp.a, *b_side = &g_cmp.b;
+  size_t bs = g_cmp.block_size;
+  size_t a = 0, b = 0;
+  (void)unused;
+
+  while(a < a_side->len && b < b_side->len) {
+    if(worker_group_cancelled(&g_cmp.group)) {
+      g_cmp.failed = true;
+      return;
+    }
+    __atomic_store_n(&g_cmp.done, a, __ATOMIC_RELAXED);
+
+    // while both sides are on block boundaries the hashes say if they match
+    if(a % bs == 0 && b % bs == 0 && a / bs < a_side->n_blocks && b / bs < b_side->n_blocks) {
+      if(a_side->hashes[a / bs] == b_side->hashes[b / bs]) {
+        a += bs;
+        b += bs;
+        continue;
+      }
+    }
+
+    // compare bytes up to the next block boundary on side a
+    size_t lim = bs - a % bs;
+    lim = lim < a_side->len - a ? lim : a_side->len - a;
+    lim = lim < b_side->len - b ? lim : b_side->len - b;
+    size_t n = compare_common_prefix(a_side, a, b_side, b, lim);
+    a += n;
+    b += n;
+    if(n == lim) {
+      continue;
+    }
+
+    // a and b differ here, find the closest place they line up again by
+    // rolling over each side looking for a block of the other
+    size_t a1, b1, a2, b2;
+    bool found_a = compare_roll(a_side, a, b_side, b, &a1, &b1);
+    bool found_b = compare_roll(b_side, b, a_side, a, &b2, &a2);
+    if(found_b && (!found_a || (a2 - a) + (b2 - b) < (a1 - a) + (b1 - b))) {
+      a1 = a2;
+      b1 = b2;
+    } else if(!found_a) {
+      a1 = a + COMPARE_SEARCH_LIMIT < a_side->len ? a + COMPARE_SEARCH_LIMIT : a_side->len;
+      b1 = b + COMPARE_SEARCH_LIMIT < b_side->len ? b + COMPARE_SEARCH_LIMIT : b_side->len;
+    }
+
+    // the sync point is block granular, give back the equal bytes before it
+    size_t tail = a1 - a < b1 - b ? a1 - a : b1 - b;
+    tail = compare_common_suffix(a_side, a1, b_side, b1, tail);
+    if(compare_add_hunk(a, a1 - tail - a, b, b1 - tail - b) < 0) {
+      g_cmp.failed = true;
+      return;
+    }
+    a = a1;
+    b = b1;
+  }
+
+  if(a < a_side->len || b < b_side->len) {
+    if(compare_add_hunk(a, a_side->len - a, b, b_side->len - b) < 0) {
+      g_cmp.failed = true;
+    }
+  }
+}
+
+static void compare_free_side(struct compare_side *s) {
+  free(s->hashes);
+  free(s->sorted);
+  free(s->filter);
+  memset(s, 0, sizeof(*s));
+}
+
+static int compare_setup_side(struct compare_side *s, const file_info *file, size_t len) {
+  s->file = file;
+  s->len = len;
+  s->n_blocks = len / g_cmp.block_size;
+  s->hashes = malloc((s->n_blocks ? s->n_blocks : 1) * sizeof(uint64_t));
+  s->sorted = malloc((s->n_blocks ? s->n_blocks : 1) * sizeof(struct compare_entry));
+  s->filter = calloc((1UL << COMPARE_FILTER_BITS) / 64, sizeof(uint64_t));
+  return s->hashes && s->sorted && s->filter ? 0 : -1;
+}
+
+static int compare_submit_hashing(struct compare_side *s, struct compare_job *jobs) {
+  size_t n_jobs = 0;
+  for(size_t first = 0; first < s->n_blocks; first += COMPARE_JOB_BLOCKS) {
+    jobs[n_jobs].side = s;
+    jobs[n_jobs].first = first;
+    jobs[n_jobs].count = s->n_blocks - first < COMPARE_JOB_BLOCKS ? s->n_blocks - first : COMPARE_JOB_BLOCKS;
+    if(worker_pool_submit(&g_cmp.group, compare_hash_job, &jobs[n_jobs]) < 0) {
+      return -1;
+    }
+    ++n_jobs;
+  }
+  return n_jobs;
+}
+
+int compare_run() {
+  struct compare_job *jobs = NULL;
+  int r = -1;
+
+  compare_free();
+  compare_init_rk();
+
+  size_t a_len = doc_length(), b_len = g_cmpfile.mm_len;
+  size_t longest = a_len > b_len ? a_len : b_len;
+  g_cmp.block_size = COMPARE_BLOCK;
+  while(longest / g_cmp.block_size > COMPARE_MAX_BLOCKS) {
+    g_cmp.block_size *= 2;
+  }
+  g_cmp.rk_pow = 1;
+  for(size_t i = 1; i < g_cmp.block_size; ++i) {
+    g_cmp.rk_pow *= RK_MULT;
+  }
+  g_cmp.failed = false;
+
+  worker_group_init(&g_cmp.group);
+  if(compare_setup_side(&g_cmp.a, NULL, a_len) < 0
+      || compare_setup_side(&g_cmp.b, &g_cmpfile, b_len) < 0)
+  {
+    goto cleanup;
+  }
+
+  size_t n_jobs = (g_cmp.a.n_blocks + COMPARE_JOB_BLOCKS - 1) / COMPARE_JOB_BLOCKS
+                + (g_cmp.b.n_blocks + COMPARE_JOB_BLOCKS - 1) / COMPARE_JOB_BLOCKS;
+  jobs = calloc(n_jobs ? n_jobs : 1, sizeof(struct compare_job));
+  if(!jobs) {
+    goto cleanup;
+  }
+
+  // hash every whole block of both sides
+  g_cmp.done = 0;
+  int n_a = compare_submit_hashing(&g_cmp.a, jobs);
+  if(n_a < 0 || compare_submit_hashing(&g_cmp.b, jobs + n_a) < 0) {
+    worker_group_cancel(&g_cmp.group);
+    goto cleanup;
+  }
+  size_t total = (g_cmp.a.n_blocks + g_cmp.b.n_blocks) * g_cmp.block_size;
+  if(editor_wait_progress(&g_cmp.group, "compare: hashing", &g_cmp.done, total) < 0) {
+    goto cleanup;
+  }
+
+  // sort each side's hashes so the other side can look blocks up
+  g_cmp.done = 0;
+  worker_pool_submit(&g_cmp.group, compare_index_job, &g_cmp.a);
+  worker_pool_submit(&g_cmp.group, compare_index_job, &g_cmp.b);
+  if(editor_wait_progress(&g_cmp.group, "compare: indexing", &g_cmp.done, 0) < 0) {
+    goto cleanup;
+  }
+
+  // walk both sides producing hunks
+  g_cmp.done = 0;
+  worker_pool_submit(&g_cmp.group, compare_walk_job, NULL);
+  if(editor_wait_progress(&g_cmp.group, "compare: matching", &g_cmp.done, a_len) < 0 || g_cmp.failed) {
+    goto cleanup;
+  }
+
+  g_compare.a_len = a_len;
+  g_compare.b_len = b_len;
+  g_compare.valid = true;
+  r = 0;
+
+cleanup:
+  worker_group_destroy(&g_cmp.group);
+  free(jobs);
+  compare_free_side(&g_cmp.a);
+  compare_free_side(&g_cmp.b);
+  if(r < 0) {
+    compare_free();
+  }
+  return r;
+}
+
+void compare_free() {
+  free(g_compare.hunks);
+  g_compare.hunks = NULL;
+  g_compare.n_hunks = 0;
+  g_compare.max_hunks = 0;
+  g_compare.valid = false;
+}
+
+long compare_find_hunk(size_t a_off) {
+  size_t lo = 0, hi = g_compare.n_hunks;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(g_compare.hunks[mid].a_off <= a_off) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (long)lo - 1;
+}
+
+size_t compare_map_offset(size_t a_off) {
+  long i = compare_find_hunk(a_off);
+  if(i < 0) {
+    return a_off; // nothing differs before a_off
+  }
+
+  const compare_hunk *h = &g_compare.hunks[i];
+  if(a_off < h->a_off + h->a_len) {
+    size_t d = a_off - h->a_off;
+    return h->b_off + (d < h->b_len ? d : h->b_len);
+  }
+  return h->b_off + h->b_len + (a_off - h->a_off - h->a_len);
+}
+
+int compare_cmd(int argc, char *argv[]) {
+  char msg[160];
+  if(argc < 2) {
+    set_status_window_text("usage: compare <file>");
+    return -1;
+  }
+
+  if(g_cmpfile.filename) {
+    file_close(&g_cmpfile);
+  }
+
+  snprintf(g_cmp_filename, sizeof(g_cmp_filename), "%s", argv[1]);
+  if(!file_open(&g_cmpfile, g_cmp_filename, O_RDONLY)) {
+    snprintf(msg, sizeof(msg), "compare: could not open %s", argv[1]);
+    set_status_window_text(msg);
+    return -1;
+  }
+
+  if(compare_run() < 0) {
+    file_close(&g_cmpfile);
+    set_status_window_text("compare: cancelled");
+    return -1;
+  }
+
+  LOG_MSG("compare with %s: %lu differences", g_cmp_filename, g_compare.n_hunks);
+  editor_switch_mode(MODE_COMPARE);
+  editor_redraw_main_window_full();
+  snprintf(msg, sizeof(msg), "compare: %lu differences (n/N next/prev, q quits)", g_compare.n_hunks);
+  set_status_window_text(msg);
+  return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef __COMPARE_H__
+#define __COMPARE_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// binary compare of the document (side a) against g_cmpfile (side b)
+//
+// both sides are cut into fixed size blocks which are hashed on the worker
+// pool with a rolling polynomial hash.  equal aligned blocks are skipped by
+// comparing hashes; at a difference, a window is rolled forward over each
+// side and looked up in the other side's block hashes to find where the
+// data lines up again, so an insertion only costs one hunk instead of
+// making the rest of the file differ.
+//
+
+// a range of side a that differs from a range of side b, everything between
+// hunks is equal (shifted by however much the previous hunks moved it)
+struct _compare_hunk {
+  size_t a_off;
+  size_t a_len;
+  size_t b_off;
+  size_t b_len;
+};
+typedef struct _compare_hunk compare_hunk;
+
+struct _compare_state {
+  bool valid;
+  size_t a_len;
+  size_t b_len;
+  compare_hunk *hunks;
+  size_t n_hunks;
+  size_t max_hunks;
+};
+typedef struct _compare_state compare_state;
+
+extern compare_state g_compare;
+
+// diff the document against g_cmpfile, returns < 0 on failure or cancel
+int compare_run();
+void compare_free(); // drop the hunks
+
+size_t compare_map_offset(size_t a_off); // offset on side b that lines up with a_off on side a
+long compare_find_hunk(size_t a_off); // index of the last hunk starting at or before a_off, -1 if none
+
+int compare_cmd(int argc, char *argv[]); // ":compare <file>"
+
+#endif // __COMPARE_H__
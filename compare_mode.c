@@ -0,0 +1,192 @@
+#include "compare_mode.h"
+
+#include "compare.h"
+#include "document.h"
+#include "editor.h"
+#include "logger.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+// the main window is split down the middle, side a (the document) on the
+// left and side b (g_cmpfile) on the right, each as offset/hex/ascii rows.
+// rows of side b are lined up with side a through the hunks, so an insertion
+// shows up as one highlighted region instead of shifting everything after it.
+
+#define COMPARE_MAX_ROW 256
+
+static size_t g_top = 0;          // side a offset of the first row
+static size_t g_bytes_per_row = 16;
+static long g_cur_hunk = -1;
+
+static size_t compare_mode_extent() {
+  // past the end of side a the rows keep going if side b is longer
+  size_t b_end = compare_map_offset(g_compare.a_len);
+  size_t extra = g_compare.b_len > b_end ? g_compare.b_len - b_end : 0;
+  return g_compare.a_len + extra;
+}
+
+static void compare_mode_status() {
+  char msg[160];
+  size_t b = compare_map_offset(g_top);
+  if(g_compare.n_hunks == 0) {
+    snprintf(msg, sizeof(msg), "compare: files are identical (%lu bytes)", g_compare.a_len);
+  } else {
+    snprintf(msg, sizeof(msg), "compare: diff %ld/%lu  a 0x%lx  b 0x%lx  (n/N next/prev, q quits)",
+        g_cur_hunk + 1, g_compare.n_hunks, g_top, b);
+  }
+  set_status_window_text(msg);
+}
+
+int compare_mode_enter() {
+  g_top = 0;
+  g_cur_hunk = -1;
+  editor_set_focus(g_windows.mainwnd);
+  return 0;
+}
+
+int compare_mode_exit() {
+  compare_free();
+  file_close(&g_cmpfile);
+  return 0;
+}
+
+static void compare_mode_goto_hunk(long i) {
+  if(i < 0 || (size_t)i >= g_compare.n_hunks) {
+    return;
+  }
+  g_cur_hunk = i;
+  g_top = g_compare.hunks[i].a_off - g_compare.hunks[i].a_off % g_bytes_per_row;
+}
+
+int compare_mode_new_char(int c) {
+  int h = g_windows.mainwnd_geom.h > 0 ? g_windows.mainwnd_geom.h : 1;
+  size_t extent = compare_mode_extent();
+  size_t page = g_bytes_per_row * h;
+
+  switch(c) {
+    case 'q' :
+    case 27 : // escape
+      editor_switch_mode(MODE_COMMAND);
+      editor_redraw_main_window_full();
+      return 0;
+    case KEY_DOWN :
+    case 'j' :
+      if(g_top + g_bytes_per_row < extent) {
+        g_top += g_bytes_per_row;
+      }
+      break;
+    case KEY_UP :
+    case 'k' :
+      g_top = g_top > g_bytes_per_row ? g_top - g_bytes_per_row : 0;
+      break;
+    case KEY_NPAGE :
+    case ' ' :
+      if(g_top + page < extent) {
+        g_top += page;
+      }
+      break;
+    case KEY_PPAGE :
+      g_top = g_top > page ? g_top - page : 0;
+      break;
+    case 'g' :
+      g_top = 0;
+      break;
+    case 'G' :
+      g_top = extent > page ? (extent - page) - (extent - page) % g_bytes_per_row : 0;
+      break;
+    case 'n' :
+      {
+        // first hunk that starts below the top row
+        long i = compare_find_hunk(g_top + g_bytes_per_row - 1) + 1;
+        compare_mode_goto_hunk(i);
+      }
+      break;
+    case 'N' :
+    case 'p' :
+      {
+        long i = compare_find_hunk(g_top);
+        if(i >= 0 && g_compare.hunks[i].a_off >= g_top) {
+          --i;
+        }
+        compare_mode_goto_hunk(i);
+      }
+      break;
+  }
+
+  editor_redraw_main_window_full();
+  compare_mode_status();
+  return 0;
+}
+
+static size_t compare_mode_read(bool side_a, size_t offset, unsigned char *dst, size_t len) {
+  if(side_a) {
+    return doc_read(offset, (char *)dst, len);
+  }
+  size_t n = len;
+  const char *p = file_view(&g_cmpfile, offset, &n);
+  if(p) {
+    memcpy(dst, p, n);
+  }
+  return p ? n : 0;
+}
+
+static void compare_mode_draw_side(WINDOW *w, int y, int x, int digits, size_t offset,
+    const unsigned char *mine, size_t n_mine, const unsigned char *theirs, size_t n_theirs)
+{
+  if(n_mine == 0) {
+    return;
+  }
+
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%0*lx", digits, offset);
+  mvwaddstr(w, y, x, buf);
+  x += digits + 1;
+
+  for(size_t i = 0; i < n_mine; ++i) {
+    bool differs = i >= n_theirs || mine[i] != theirs[i];
+    wattrset(w, differs ? A_REVERSE : A_NORMAL);
+    snprintf(buf, sizeof(buf), "%02x", mine[i]);
+    mvwaddstr(w, y, x + i * 3, buf);
+    mvwaddch(w, y, x + g_bytes_per_row * 3 + i, isprint(mine[i]) ? mine[i] : '.');
+  }
+  wattrset(w, A_NORMAL);
+}
+
+void compare_mode_redraw() {
+  WINDOW *w = g_windows.mainwnd;
+  int h = g_windows.mainwnd_geom.h, width = g_windows.mainwnd_geom.w;
+  int half = width / 2;
+  unsigned char a_buf[COMPARE_MAX_ROW], b_buf[COMPARE_MAX_ROW];
+
+  // enough hex digits for the longer side's offsets
+  int digits = 8;
+  size_t longest = g_compare.a_len > g_compare.b_len ? g_compare.a_len : g_compare.b_len;
+  while(digits < 16 && (longest >> (digits * 4))) {
+    ++digits;
+  }
+
+  // each byte takes three columns of hex and one of ascii
+  size_t bpr = half > digits + 2 ? (half - digits - 2) / 4 : 1;
+  bpr = bpr >= 8 ? bpr & ~7UL : (bpr ? bpr : 1);
+  bpr = bpr < COMPARE_MAX_ROW ? bpr : COMPARE_MAX_ROW;
+  if(bpr != g_bytes_per_row) {
+    g_top -= g_top % bpr;
+    g_bytes_per_row = bpr;
+  }
+
+  for(int y = 0; y < h; ++y) {
+    size_t a = g_top + y * bpr;
+    size_t b = compare_map_offset(a);
+    size_t na = a < g_compare.a_len ? compare_mode_read(true, a, a_buf, bpr) : 0;
+    size_t nb = b < g_compare.b_len ? compare_mode_read(false, b, b_buf, bpr) : 0;
+    if(na == 0 && nb == 0) {
+      break;
+    }
+    compare_mode_draw_side(w, y, 0, digits, a, a_buf, na, b_buf, nb);
+    compare_mode_draw_side(w, y, half, digits, b, b_buf, nb, a_buf, na);
+  }
+
+  wmove(w, 0, 0);
+}
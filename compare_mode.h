@@ -0,0 +1,9 @@
+#ifndef __COMPARE_MODE_H__
+#define __COMPARE_MODE_H__
+
+int compare_mode_enter();
+int compare_mode_new_char(int c);
+int compare_mode_exit();
+void compare_mode_redraw();
+
+#endif // __COMPARE_MODE_H__
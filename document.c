@@ -0,0 +1,906 @@
+#define _GNU_SOURCE // SEEK_DATA, SEEK_HOLE
+
+#include "document.h"
+
+#include "editor.h"
+#include "patch_map.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define DOC_MAX_WATCHERS 8
+#define DOC_ADD_MIN (64UL << 10) // smallest growth of the add buffer
+#define DOC_FILL_TILE (64UL << 10) // bytes of a fill pattern stored for a pattern piece
+
+static doc_change_fn g_doc_watchers[DOC_MAX_WATCHERS];
+static int g_doc_n_watchers = 0;
+static doc_change_fn g_doc_before_watchers[DOC_MAX_WATCHERS];
+static int g_doc_n_before_watchers = 0;
+static const doc_log_ops *g_doc_log = NULL;
+static bool g_doc_external = false; // the change came from the file on disk, not an edit
+
+// a run of the document, either bytes of the file or bytes in the add
+// buffer.  a pattern piece repeats period bytes of the add buffer for as
+// long as it is, starting phase bytes into them, so a fill of any length
+// costs one tile of the pattern.
+struct doc_piece {
+  size_t offset; // where the piece starts in the document
+  size_t len;
+  bool in_file;
+  size_t src;    // offset into the file or into the add buffer
+  size_t period; // 0 unless this is a pattern piece
+  size_t phase;
+};
+
+// while the document is unmodified there are no pieces and it reads straight
+// from the file.  the first edit that changes the length starts the table off
+// as one piece covering the file.  the add buffer only grows, bytes that were
+// once inserted stay where they are so anything can keep referring to them.
+//
+// overwrites don't touch the table, they go to the patch map keyed by
+// document offset, so typing over bytes costs memory for the bytes changed
+// and nothing else.  the next change of length folds the patches into the
+// table first, since their offsets would move.
+static struct {
+  struct doc_piece *pieces; // sorted by offset, no gaps between them
+  size_t n_pieces;
+  size_t max_pieces;
+  size_t length;
+  bool modified;
+
+  char *add;
+  size_t add_len;
+  size_t add_max;
+
+  // overwrites that kept the length, on top of the pieces
+  patch_map patches;
+
+  pthread_rwlock_t lock;
+  pthread_once_t lock_once;
+} g_doc = {
+  .pieces = NULL,
+  .n_pieces = 0,
+  .max_pieces = 0,
+  .length = 0,
+  .modified = false,
+  .add = NULL,
+  .add_len = 0,
+  .add_max = 0,
+  .lock_once = PTHREAD_ONCE_INIT
+};
+
+// writers are preferred so a stream of short background reads can't hold
+// off an edit
+static void doc_init_lock() {
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+  pthread_rwlock_init(&g_doc.lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+}
+
+void doc_read_lock() {
+  pthread_once(&g_doc.lock_once, doc_init_lock);
+  pthread_rwlock_rdlock(&g_doc.lock);
+}
+
+void doc_read_unlock() {
+  pthread_rwlock_unlock(&g_doc.lock);
+}
+
+static void doc_write_lock() {
+  pthread_once(&g_doc.lock_once, doc_init_lock);
+  pthread_rwlock_wrlock(&g_doc.lock);
+}
+
+static void doc_write_unlock() {
+  pthread_rwlock_unlock(&g_doc.lock);
+}
+
+// index of the piece holding offset, n_pieces if it's past the end
+static size_t doc_find_piece(size_t offset) {
+  size_t lo = 0, hi = g_doc.n_pieces;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(g_doc.pieces[mid].offset + g_doc.pieces[mid].len <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+size_t doc_length() {
+  if(g_doc.modified) {
+    return g_doc.length;
+  }
+  return g_curfile.mm_len;
+}
+
+size_t doc_read(size_t offset, char *dst, size_t len) {
+  size_t copied = 0;
+  while(copied < len) {
+    size_t n = len - copied;
+    const char *src = doc_view(offset + copied, &n);
+    if(!src || n == 0) {
+      break;
+    }
+    memcpy(dst + copied, src, n);
+    copied += n;
+  }
+  return copied;
+}
+
+const char *doc_view(size_t offset, size_t *len) {
+  if(g_doc.patches.n_runs && offset < doc_length()) {
+    const char *p = patch_map_view(&g_doc.patches, offset, len);
+    if(p) {
+      return p;
+    }
+  }
+  if(!g_doc.modified) {
+    return file_view(&g_curfile, offset, len);
+  }
+
+  size_t i = doc_find_piece(offset);
+  if(i >= g_doc.n_pieces) {
+    *len = 0;
+    return NULL;
+  }
+  const struct doc_piece *p = &g_doc.pieces[i];
+  size_t skip = offset - p->offset;
+  *len = *len < p->len - skip ? *len : p->len - skip;
+  if(p->in_file) {
+    return file_view(&g_curfile, p->src + skip, len);
+  }
+  if(p->period) {
+    size_t at = (p->phase + skip) % p->period;
+    *len = *len < p->period - at ? *len : p->period - at;
+    return g_doc.add + p->src + at;
+  }
+  return g_doc.add + p->src + skip;
+}
+
+// make sure a piece starts at offset, returns the index of that piece
+static size_t doc_split(size_t offset) {
+  size_t i = doc_find_piece(offset);
+  if(i >= g_doc.n_pieces || g_doc.pieces[i].offset == offset) {
+    return i;
+  }
+
+  struct doc_piece *p = &g_doc.pieces[i];
+  size_t head = offset - p->offset;
+  memmove(p + 2, p + 1, (g_doc.n_pieces - i - 1) * sizeof(struct doc_piece));
+  p[1].offset = offset;
+  p[1].len = p->len - head;
+  p[1].in_file = p->in_file;
+  p[1].src = p->period ? p->src : p->src + head;
+  p[1].period = p->period;
+  p[1].phase = p->period ? (p->phase + head) % p->period : 0;
+  p->len = head;
+  ++g_doc.n_pieces;
+  return i + 1;
+}
+
+static int doc_reserve(size_t n_pieces, size_t add_len) {
+  if(n_pieces > g_doc.max_pieces) {
+    size_t max = g_doc.max_pieces ? g_doc.max_pieces : 64;
+    while(max < n_pieces) {
+      max *= 2;
+    }
+    struct doc_piece *pieces = realloc(g_doc.pieces, max * sizeof(struct doc_piece));
+    if(!pieces) {
+      return -1;
+    }
+    g_doc.pieces = pieces;
+    g_doc.max_pieces = max;
+  }
+  if(add_len > g_doc.add_max) {
+    size_t max = g_doc.add_max > DOC_ADD_MIN ? g_doc.add_max : DOC_ADD_MIN;
+    while(max < add_len) {
+      max *= 2;
+    }
+    char *add = realloc(g_doc.add, max);
+    if(!add) {
+      return -1;
+    }
+    g_doc.add = add;
+    g_doc.add_max = max;
+  }
+  return 0;
+}
+
+// replace old_len bytes at offset with the pieces in with, whose offsets are
+// filled in.  the caller holds the write lock and has reserved room for
+// n + 2 more pieces.
+static void doc_splice(size_t offset, size_t old_len, const struct doc_piece *with, size_t n) {
+  size_t doc_len = doc_length();
+  size_t new_len = 0;
+
+  if(!g_doc.modified) {
+    g_doc.n_pieces = 0;
+    if(doc_len > 0) {
+      g_doc.pieces[0].offset = 0;
+      g_doc.pieces[0].len = doc_len;
+      g_doc.pieces[0].in_file = true;
+      g_doc.pieces[0].src = 0;
+      g_doc.pieces[0].period = 0;
+      g_doc.pieces[0].phase = 0;
+      g_doc.n_pieces = 1;
+    }
+    g_doc.length = doc_len;
+    g_doc.modified = true;
+  }
+
+  size_t first = doc_split(offset);
+  size_t last = doc_split(offset + old_len);
+
+  // drop the replaced pieces, the add buffer keeps their bytes
+  memmove(&g_doc.pieces[first], &g_doc.pieces[last], (g_doc.n_pieces - last) * sizeof(struct doc_piece));
+  g_doc.n_pieces -= last - first;
+
+  for(size_t i = 0; i < n; ++i) {
+    if(with[i].len == 0) {
+      continue;
+    }
+    // typing appends to the piece of the previous keystroke
+    struct doc_piece *prev = first > 0 ? &g_doc.pieces[first - 1] : NULL;
+    if(prev && prev->in_file == with[i].in_file && prev->src + prev->len == with[i].src
+        && !prev->period && !with[i].period)
+    {
+      prev->len += with[i].len;
+    } else {
+      struct doc_piece *p = &g_doc.pieces[first];
+      memmove(p + 1, p, (g_doc.n_pieces - first) * sizeof(struct doc_piece));
+      *p = with[i];
+      p->offset = offset + new_len;
+      ++g_doc.n_pieces;
+      ++first;
+    }
+    new_len += with[i].len;
+  }
+
+  // everything after the change moves by the difference
+  for(size_t i = first; i < g_doc.n_pieces; ++i) {
+    g_doc.pieces[i].offset = g_doc.pieces[i].offset - old_len + new_len;
+  }
+  g_doc.length = g_doc.length - old_len + new_len;
+}
+
+// append bytes to the add buffer, the caller holds the write lock
+static int doc_add_bytes(const char *src, size_t len, size_t *at) {
+  if(doc_reserve(0, g_doc.add_len + len) < 0) {
+    return -1;
+  }
+  *at = g_doc.add_len;
+  memcpy(g_doc.add + g_doc.add_len, src, len);
+  g_doc.add_len += len;
+  return 0;
+}
+
+// replace bytes in the piece table, the caller holds the write lock
+static int doc_replace_pieces(size_t offset, size_t old_len, const char *src, size_t new_len) {
+  struct doc_piece p = { 0, new_len, false, 0, 0, 0 };
+  if(doc_reserve(g_doc.n_pieces + 3 + !g_doc.modified, 0) < 0) {
+    return -1;
+  }
+  if(new_len > 0 && doc_add_bytes(src, new_len, &p.src) < 0) {
+    return -1;
+  }
+  doc_splice(offset, old_len, &p, new_len > 0);
+  return 0;
+}
+
+// move the patches into the piece table, the caller holds the write lock
+static int doc_fold_patches() {
+  patch_map *pm = &g_doc.patches;
+  for(size_t i = 0; i < pm->n_runs; ++i) {
+    const patch_run *r = &pm->runs[i];
+    if(doc_replace_pieces(r->offset, r->len, pm->pool + r->data, r->len) < 0) {
+      // the runs before i are in the table, rewriting them again is harmless
+      return -1;
+    }
+  }
+  patch_map_clear(pm);
+  return 0;
+}
+
+int doc_replace(size_t offset, size_t old_len, const char *src, size_t new_len) {
+  size_t doc_len = doc_length();
+  if(offset > doc_len || old_len > doc_len - offset) {
+    return -1;
+  }
+  if(old_len == 0 && new_len == 0) {
+    return 0;
+  }
+  if(old_len == new_len) {
+    return doc_overwrite(offset, src, new_len);
+  }
+
+  doc_changing(offset, old_len, new_len);
+
+  doc_write_lock();
+  if(doc_fold_patches() < 0 || doc_replace_pieces(offset, old_len, src, new_len) < 0) {
+    doc_write_unlock();
+    return -1;
+  }
+  doc_write_unlock();
+
+  if(g_doc_log) {
+    g_doc_log->replace(offset, old_len, src, new_len);
+  }
+  doc_changed(offset, old_len, new_len);
+  return 0;
+}
+
+int doc_overwrite(size_t offset, const char *src, size_t len) {
+  if(offset >= doc_length() || len > doc_length() - offset) {
+    return -1;
+  }
+  doc_changing(offset, len, len);
+
+  doc_write_lock();
+  int r = patch_map_write(&g_doc.patches, offset, src, len);
+  doc_write_unlock();
+  if(r < 0) {
+    return -1;
+  }
+
+  if(g_doc_log) {
+    g_doc_log->replace(offset, len, src, len);
+  }
+  doc_changed(offset, len, len);
+  return 0;
+}
+
+int doc_replace_refs(size_t offset, size_t old_len, const doc_ref *refs, size_t n) {
+  size_t doc_len = doc_length();
+  size_t new_len = 0;
+  if(offset > doc_len || old_len > doc_len - offset) {
+    return -1;
+  }
+  for(size_t i = 0; i < n; ++i) {
+    new_len += refs[i].len;
+  }
+  doc_changing(offset, old_len, new_len);
+
+  struct doc_piece *with = malloc((n ? n : 1) * sizeof(struct doc_piece));
+  if(!with) {
+    return -1;
+  }
+  for(size_t i = 0; i < n; ++i) {
+    with[i].len = refs[i].len;
+    with[i].in_file = refs[i].in_file;
+    with[i].src = refs[i].src;
+    with[i].period = 0;
+    with[i].phase = 0;
+  }
+
+  doc_write_lock();
+  if(doc_fold_patches() < 0 || doc_reserve(g_doc.n_pieces + n + 2 + !g_doc.modified, 0) < 0) {
+    doc_write_unlock();
+    free(with);
+    return -1;
+  }
+  doc_splice(offset, old_len, with, n);
+  doc_write_unlock();
+  free(with);
+
+  if(g_doc_log) {
+    g_doc_log->replace_refs(offset, old_len, refs, n);
+  }
+  doc_changed(offset, old_len, new_len);
+  return 0;
+}
+
+int doc_fill(size_t offset, size_t len, const char *pattern, size_t pattern_len) {
+  size_t doc_len = doc_length();
+  if(offset >= doc_len || len > doc_len - offset || pattern_len == 0) {
+    return -1;
+  }
+  if(len == 0) {
+    return 0;
+  }
+
+  // as many whole copies of the pattern as fit in a tile, or the fill
+  size_t copies = DOC_FILL_TILE / pattern_len;
+  if(copies == 0) {
+    copies = 1;
+  }
+  if(copies > (len + pattern_len - 1) / pattern_len) {
+    copies = (len + pattern_len - 1) / pattern_len;
+  }
+  size_t tile_len = copies * pattern_len;
+  char *tile = malloc(tile_len);
+  if(!tile) {
+    return -1;
+  }
+  for(size_t i = 0; i < copies; ++i) {
+    memcpy(tile + i * pattern_len, pattern, pattern_len);
+  }
+
+  doc_changing(offset, len, len);
+
+  struct doc_piece p = { 0, len, false, 0, tile_len < len ? tile_len : 0, 0 };
+  doc_write_lock();
+  int r = -1;
+  if(doc_fold_patches() == 0 && doc_reserve(g_doc.n_pieces + 3 + !g_doc.modified, 0) == 0
+      && doc_add_bytes(tile, tile_len, &p.src) == 0)
+  {
+    doc_splice(offset, len, &p, 1);
+    r = 0;
+  }
+  doc_write_unlock();
+  free(tile);
+  if(r < 0) {
+    return -1;
+  }
+
+  if(g_doc_log) {
+    g_doc_log->fill(offset, len, pattern, pattern_len);
+  }
+  doc_changed(offset, len, len);
+  return 0;
+}
+
+// append the part of the old pieces from *i on that lies in [begin, end) to
+// out, advancing *i past the pieces that end by end
+static void doc_copy_pieces(struct doc_piece *out, size_t *n_out, size_t *offset,
+    const struct doc_piece *old, size_t n_old, size_t *i, size_t begin, size_t end)
+{
+  for(; *i < n_old && old[*i].offset < end; ++*i) {
+    const struct doc_piece *p = &old[*i];
+    size_t skip = begin > p->offset ? begin - p->offset : 0;
+    size_t stop = p->offset + p->len < end ? p->offset + p->len : end;
+    if(p->offset + skip < stop) {
+      struct doc_piece *q = &out[(*n_out)++];
+      *q = *p;
+      q->offset = *offset;
+      q->len = stop - p->offset - skip;
+      q->src = p->period ? p->src : p->src + skip;
+      q->phase = p->period ? (p->phase + skip) % p->period : 0;
+      *offset += q->len;
+    }
+    if(p->offset + p->len > end) {
+      break;
+    }
+  }
+}
+
+int doc_replace_all(const size_t *offsets, size_t n, size_t old_len, const char *with, size_t new_len) {
+  size_t doc_len = doc_length();
+  if(n == 0) {
+    return 0;
+  }
+  for(size_t i = 0; i < n; ++i) {
+    if(offsets[i] > doc_len || old_len > doc_len - offsets[i]
+        || (i > 0 && offsets[i] < offsets[i - 1] + old_len))
+    {
+      return -1;
+    }
+  }
+
+  size_t begin = offsets[0], end = offsets[n - 1] + old_len;
+  size_t changed = end - begin - n * old_len + n * new_len;
+  doc_changing(begin, end - begin, changed);
+
+  doc_write_lock();
+  int r = -1;
+  struct doc_piece repl = { 0, new_len, false, 0, 0, 0 };
+  if(doc_fold_patches() < 0 || doc_reserve(3, 0) < 0
+      || (new_len > 0 && doc_add_bytes(with, new_len, &repl.src) < 0))
+  {
+    goto cleanup;
+  }
+
+  // an empty splice turns the unmodified file into its one piece
+  doc_splice(0, 0, NULL, 0);
+
+  // every match can split a piece in two and adds the replacement
+  size_t max = g_doc.n_pieces + 2 * n + 1;
+  struct doc_piece *pieces = malloc(max * sizeof(struct doc_piece));
+  if(!pieces) {
+    goto cleanup;
+  }
+
+  // one pass over the old pieces and the matches together, the replacement
+  // bytes are stored once and every match refers to them
+  size_t n_pieces = 0, offset = 0, i = 0, from = 0;
+  for(size_t m = 0; m < n; ++m) {
+    doc_copy_pieces(pieces, &n_pieces, &offset, g_doc.pieces, g_doc.n_pieces, &i, from, offsets[m]);
+    if(new_len > 0) {
+      repl.offset = offset;
+      pieces[n_pieces++] = repl;
+      offset += new_len;
+    }
+    from = offsets[m] + old_len;
+  }
+  doc_copy_pieces(pieces, &n_pieces, &offset, g_doc.pieces, g_doc.n_pieces, &i, from, doc_len);
+
+  free(g_doc.pieces);
+  g_doc.pieces = pieces;
+  g_doc.n_pieces = n_pieces;
+  g_doc.max_pieces = max;
+  g_doc.length = offset;
+  r = 0;
+
+cleanup:
+  doc_write_unlock();
+  if(r < 0) {
+    return -1;
+  }
+
+  if(g_doc_log) {
+    g_doc_log->replace_all(offsets, n, old_len, with, new_len);
+  }
+  doc_changed(begin, end - begin, changed);
+  return 0;
+}
+
+int doc_stash(const char *src, size_t len, doc_ref *ref) {
+  doc_write_lock();
+  int r = doc_add_bytes(src, len, &ref->src);
+  doc_write_unlock();
+  ref->len = len;
+  ref->in_file = false;
+  if(r == 0 && g_doc_log) {
+    g_doc_log->stash(src, len);
+  }
+  return r;
+}
+
+const char *doc_add_buffer(size_t *len) {
+  *len = g_doc.add_len;
+  return g_doc.add;
+}
+
+int doc_insert(size_t offset, const char *src, size_t len) {
+  return doc_replace(offset, 0, src, len);
+}
+
+int doc_delete(size_t offset, size_t len) {
+  return doc_replace(offset, len, NULL, 0);
+}
+
+bool doc_modified() {
+  return g_doc.modified || g_doc.patches.n_runs;
+}
+
+size_t doc_patched_bytes() {
+  return patch_map_bytes(&g_doc.patches);
+}
+
+size_t doc_memory(size_t *add_len) {
+  *add_len = g_doc.add_len;
+  return g_doc.max_pieces * sizeof(struct doc_piece) + g_doc.add_max + patch_map_memory(&g_doc.patches);
+}
+
+// pass on the part of a span of the pieces inside [begin, end), cut where
+// patches cover it
+static int doc_emit_span(const doc_span *span, size_t begin, size_t end, doc_span_fn fn, void *arg) {
+  const patch_map *pm = &g_doc.patches;
+  size_t offset = span->offset > begin ? span->offset : begin;
+  end = span->offset + span->len < end ? span->offset + span->len : end;
+  size_t i = patch_map_find(pm, offset);
+
+  while(offset < end) {
+    doc_span part = *span;
+    part.offset = offset;
+    if(i < pm->n_runs && pm->runs[i].offset <= offset) {
+      const patch_run *r = &pm->runs[i];
+      size_t run_end = r->offset + r->len;
+      part.len = (run_end < end ? run_end : end) - offset;
+      part.kind = DOC_SPAN_PATCH;
+      part.file_offset = 0;
+      part.data = pm->pool + r->data + (offset - r->offset);
+      if(run_end <= end) {
+        ++i;
+      }
+    } else {
+      size_t next = i < pm->n_runs && pm->runs[i].offset < end ? pm->runs[i].offset : end;
+      part.len = next - offset;
+      part.file_offset += offset - span->offset;
+      part.add_offset += offset - span->offset;
+      part.data = span->data ? span->data + (offset - span->offset) : NULL;
+    }
+    int r = fn(&part, arg);
+    if(r) {
+      return r;
+    }
+    offset += part.len;
+  }
+  return 0;
+}
+
+// a pattern piece is passed on as one span per pass over its tile, each of
+// them plain bytes of the add buffer
+static int doc_emit_pattern(const struct doc_piece *p, size_t begin, size_t end, doc_span_fn fn, void *arg) {
+  size_t skip = begin > p->offset ? begin - p->offset : 0;
+  size_t at = (p->phase + skip) % p->period;
+  size_t offset = p->offset + skip;
+  size_t piece_end = p->offset + p->len < end ? p->offset + p->len : end;
+
+  while(offset < piece_end) {
+    doc_span span;
+    span.offset = offset;
+    span.len = p->period - at < piece_end - offset ? p->period - at : piece_end - offset;
+    span.kind = DOC_SPAN_ADD;
+    span.file_offset = 0;
+    span.add_offset = p->src + at;
+    span.data = g_doc.add + p->src + at;
+    int r = doc_emit_span(&span, offset, offset + span.len, fn, arg);
+    if(r) {
+      return r;
+    }
+    offset += span.len;
+    at = 0;
+  }
+  return 0;
+}
+
+int doc_for_each_span_in(size_t offset, size_t len, doc_span_fn fn, void *arg) {
+  doc_span span;
+  size_t end = offset + len;
+  if(!g_doc.modified) {
+    span.offset = 0;
+    span.len = doc_length();
+    span.kind = DOC_SPAN_FILE;
+    span.file_offset = 0;
+    span.add_offset = 0;
+    span.data = NULL;
+    return doc_emit_span(&span, offset, end, fn, arg);
+  }
+
+  for(size_t i = doc_find_piece(offset); i < g_doc.n_pieces && g_doc.pieces[i].offset < end; ++i) {
+    const struct doc_piece *p = &g_doc.pieces[i];
+    int r;
+    span.offset = p->offset;
+    span.len = p->len;
+    span.kind = p->in_file ? DOC_SPAN_FILE : DOC_SPAN_ADD;
+    span.file_offset = p->in_file ? p->src : 0;
+    span.add_offset = p->in_file ? 0 : p->src;
+    span.data = p->in_file ? NULL : g_doc.add + p->src;
+    if(p->period) {
+      r = doc_emit_pattern(p, offset, end, fn, arg);
+    } else {
+      r = doc_emit_span(&span, offset, end, fn, arg);
+    }
+    if(r) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+int doc_for_each_span(doc_span_fn fn, void *arg) {
+  return doc_for_each_span_in(0, doc_length(), fn, arg);
+}
+
+void doc_mark_saved() {
+  doc_write_lock();
+  patch_map_clear(&g_doc.patches);
+  g_doc.n_pieces = 0;
+  g_doc.length = 0;
+  g_doc.modified = false;
+  doc_write_unlock();
+}
+
+int doc_reopen() {
+  const char *filename = g_curfile.filename;
+  int flags = fcntl(g_curfile.fd, F_GETFL) & O_ACCMODE;
+
+  // background readers may hold pointers into the old mapping
+  doc_write_lock();
+  file_close(&g_curfile);
+  int r = file_open(&g_curfile, filename, flags);
+  patch_map_clear(&g_doc.patches);
+  g_doc.n_pieces = 0;
+  g_doc.length = 0;
+  g_doc.modified = false;
+  doc_write_unlock();
+  return r ? 0 : -1;
+}
+
+int doc_file_grown(size_t file_len) {
+  size_t old_file_len = g_curfile.mm ? g_curfile.mm_len : 0;
+  size_t offset = doc_length();
+  if(file_len <= old_file_len) {
+    return 0;
+  }
+  size_t grown = file_len - old_file_len;
+
+  g_doc_external = true;
+  doc_changing(offset, 0, grown);
+  doc_write_lock();
+  int r = doc_reserve(g_doc.n_pieces + 3, 0);
+  if(r == 0) {
+    r = file_remap(&g_curfile, file_len);
+  }
+  if(r == 0 && g_doc.modified) {
+    // the new bytes of the file go after everything, extending the last
+    // piece if it ends where the file did
+    struct doc_piece p = { 0, grown, true, old_file_len, 0, 0 };
+    doc_splice(offset, 0, &p, 1);
+  }
+  doc_write_unlock();
+  if(r == 0) {
+    doc_changed(offset, 0, grown);
+  }
+  g_doc_external = false;
+  return r;
+}
+
+int doc_file_reload() {
+  size_t old_len = doc_length();
+  int r = doc_reopen();
+  g_doc_external = true;
+  doc_changed(0, old_len, doc_length());
+  g_doc_external = false;
+  return r;
+}
+
+bool doc_external_change() {
+  return g_doc_external;
+}
+
+const char *file_view(const file_info *f, size_t offset, size_t *len) {
+  if(f->gz) {
+    return gzip_view(f->gz, offset, len);
+  }
+  if(!f->mm || offset >= (size_t)f->mm_len) {
+    *len = 0;
+    return NULL;
+  }
+  if(*len > f->mm_len - offset) {
+    *len = f->mm_len - offset;
+  }
+  return f->mm + offset;
+}
+
+// calls fn for each part of [offset, offset + len) that is still in the file,
+// with the document offset and the file offset
+static size_t doc_file_ranges(size_t offset, size_t len,
+    size_t (*fn)(size_t doc_off, size_t file_off, size_t n, void *arg), void *arg)
+{
+  if(!g_doc.modified) {
+    return fn(offset, offset, len, arg);
+  }
+  for(size_t i = doc_find_piece(offset); i < g_doc.n_pieces && len > 0; ++i) {
+    const struct doc_piece *p = &g_doc.pieces[i];
+    size_t skip = offset > p->offset ? offset - p->offset : 0;
+    size_t n = p->len - skip < len ? p->len - skip : len;
+    if(p->in_file) {
+      size_t r = fn(p->offset + skip, p->src + skip, n, arg);
+      if(r != (size_t)-1) {
+        return r;
+      }
+    }
+    offset = p->offset + skip + n;
+    len -= n;
+  }
+  return (size_t)-1;
+}
+
+static size_t doc_seek_range(size_t doc_off, size_t file_off, size_t n, void *arg) {
+  int whence = *(int *)arg;
+  off_t r = lseek(g_curfile.fd, file_off, whence);
+  if(r < 0) {
+    // ENXIO means there is no data past file_off, anything else means the
+    // file system can't tell and it all counts as data
+    if(errno == ENXIO || whence == SEEK_HOLE) {
+      return (size_t)-1;
+    }
+    return doc_off;
+  }
+  if((size_t)r >= file_off + n) {
+    return (size_t)-1;
+  }
+  return doc_off + ((size_t)r - file_off);
+}
+
+size_t doc_next_data(size_t offset) {
+  size_t doc_len = doc_length();
+  if(offset >= doc_len || g_curfile.fd < 0 || g_curfile.gz) {
+    return offset;
+  }
+
+  // bytes that aren't in the file are always data, so only look as far as
+  // the end of the piece holding offset
+  size_t end = doc_len;
+  if(g_doc.modified) {
+    const struct doc_piece *p = &g_doc.pieces[doc_find_piece(offset)];
+    if(!p->in_file) {
+      return offset;
+    }
+    end = p->offset + p->len;
+  }
+  // nor are patched ones
+  size_t i = patch_map_find(&g_doc.patches, offset);
+  if(i < g_doc.patches.n_runs && g_doc.patches.runs[i].offset < end) {
+    end = g_doc.patches.runs[i].offset > offset ? g_doc.patches.runs[i].offset : offset;
+  }
+  if(end == offset) {
+    return offset;
+  }
+  int whence = SEEK_DATA;
+  size_t r = doc_file_ranges(offset, end - offset, doc_seek_range, &whence);
+  return r != (size_t)-1 ? r : end;
+}
+
+size_t doc_next_hole(size_t offset) {
+  size_t doc_len = doc_length();
+  if(offset >= doc_len || g_curfile.fd < 0 || g_curfile.gz) {
+    return doc_len;
+  }
+  int whence = SEEK_HOLE;
+  for(;;) {
+    size_t r = doc_file_ranges(offset, doc_len - offset, doc_seek_range, &whence);
+    if(r == (size_t)-1) {
+      return doc_len;
+    }
+    // a patch over the hole is data, the hole may go on after it
+    size_t i = patch_map_find(&g_doc.patches, r);
+    if(i >= g_doc.patches.n_runs || g_doc.patches.runs[i].offset > r) {
+      return r;
+    }
+    offset = g_doc.patches.runs[i].offset + g_doc.patches.runs[i].len;
+    if(offset >= doc_len) {
+      return doc_len;
+    }
+  }
+}
+
+static size_t doc_advise_range(size_t doc_off, size_t file_off, size_t n, void *arg) {
+  // madvise wants a page aligned start
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t begin = file_off & ~(page - 1);
+  madvise(g_curfile.mm + begin, n + (file_off - begin), *(int *)arg);
+  (void)doc_off;
+  return (size_t)-1;
+}
+
+void doc_advise(size_t offset, size_t len, int advice) {
+  size_t doc_len = doc_length();
+  if(!g_curfile.mm || offset >= doc_len) {
+    return;
+  }
+  len = len < doc_len - offset ? len : doc_len - offset;
+  doc_file_ranges(offset, len, doc_advise_range, &advice);
+}
+
+int doc_watch(doc_change_fn fn) {
+  if(g_doc_n_watchers >= DOC_MAX_WATCHERS) {
+    return -1;
+  }
+  g_doc_watchers[g_doc_n_watchers++] = fn;
+  return 0;
+}
+
+void doc_set_log(const doc_log_ops *ops) {
+  g_doc_log = ops;
+}
+
+int doc_watch_before(doc_change_fn fn) {
+  if(g_doc_n_before_watchers >= DOC_MAX_WATCHERS) {
+    return -1;
+  }
+  g_doc_before_watchers[g_doc_n_before_watchers++] = fn;
+  return 0;
+}
+
+void doc_changing(size_t offset, size_t old_len, size_t new_len) {
+  for(int i = 0; i < g_doc_n_before_watchers; ++i) {
+    g_doc_before_watchers[i](offset, old_len, new_len);
+  }
+}
+
+void doc_changed(size_t offset, size_t old_len, size_t new_len) {
+  for(int i = 0; i < g_doc_n_watchers; ++i) {
+    g_doc_watchers[i](offset, old_len, new_len);
+  }
+}
@@ -0,0 +1,136 @@
+#ifndef __DOCUMENT_H__
+#define __DOCUMENT_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+struct _file_info;
+
+// document:
+//
+// byte addressed view of the file being edited.  features that work on raw
+// bytes (overview, scanners, hashing) read through here instead of walking
+// the editor lines, and anything that changes bytes reports it through
+// doc_changed() so that cached results can be invalidated.
+//
+// edits are kept as a piece table over the read only mapping of the file:
+// the document is a list of pieces that are either ranges of the file or of
+// an append-only buffer of inserted bytes.  overwrites that keep the length
+// are held apart in a sparse patch map on top of the pieces.  the mapping is
+// never written to.  background jobs that read the document while the editor
+// keeps taking keys hold the read lock for as long as they use a pointer
+// from doc_view(); edits take the write lock.
+//
+
+enum _doc_span_kind {
+  DOC_SPAN_FILE,  // still in the file, at file_offset
+  DOC_SPAN_ADD,   // inserted, at add_offset in the add buffer
+  DOC_SPAN_PATCH  // overwritten, the bytes at data change with later overwrites
+};
+
+// a run of the document that is either still in the file or held in memory
+// at data
+struct _doc_span {
+  size_t offset;
+  size_t len;
+  int kind;
+  size_t file_offset;
+  size_t add_offset;
+  const char *data; // NULL if the bytes are in the file
+};
+typedef struct _doc_span doc_span;
+
+// bytes by reference, a range of the file or of the add buffer.  neither
+// changes while the file is open, so a reference can be kept and put back
+// into the document later without copying the bytes
+struct _doc_ref {
+  size_t len;
+  bool in_file;
+  size_t src; // offset in the file or in the add buffer
+};
+typedef struct _doc_ref doc_ref;
+
+// calls fn for every span in order of offset, stops early and returns fn's
+// result if it is non-zero
+typedef int (*doc_span_fn)(const doc_span *span, void *arg);
+
+// called after old_len bytes at offset were replaced by new_len bytes
+typedef void (*doc_change_fn)(size_t offset, size_t old_len, size_t new_len);
+
+// told about every change with what it takes to make it again.  calling the
+// same functions with the same arguments in the same order on the same file
+// gives the same document, down to where bytes end up in the add buffer.
+struct _doc_log_ops {
+  void (*replace)(size_t offset, size_t old_len, const char *src, size_t new_len);
+  void (*replace_refs)(size_t offset, size_t old_len, const doc_ref *refs, size_t n);
+  void (*stash)(const char *src, size_t len);
+  void (*fill)(size_t offset, size_t len, const char *pattern, size_t pattern_len);
+  void (*replace_all)(const size_t *offsets, size_t n, size_t old_len, const char *with, size_t new_len);
+};
+typedef struct _doc_log_ops doc_log_ops;
+
+size_t doc_length(); // number of bytes in the document
+
+// copy up to len bytes starting at offset into dst, returns the number of bytes copied
+size_t doc_read(size_t offset, char *dst, size_t len);
+
+// pointer to the bytes at offset, *len is reduced to the length that is
+// contiguous in memory.  returns NULL if offset is past the end.
+const char *doc_view(size_t offset, size_t *len);
+
+// like doc_view() but for the bytes of a file as it is on disk
+const char *file_view(const struct _file_info *f, size_t offset, size_t *len);
+
+// the next offset at or after offset that may hold data.  holes in sparse
+// files read as zeros, so everything in between is known to be zero without
+// reading it.  returns offset if the file system can't tell.
+size_t doc_next_data(size_t offset);
+
+// the start of the next hole at or after offset, doc_length() if there is none
+size_t doc_next_hole(size_t offset);
+
+// replace old_len bytes at offset with new_len bytes from src.
+// returns < 0 if the range is past the end or memory ran out
+int doc_replace(size_t offset, size_t old_len, const char *src, size_t new_len);
+int doc_overwrite(size_t offset, const char *src, size_t len); // keeps the length
+int doc_insert(size_t offset, const char *src, size_t len);
+// replace old_len bytes at offset with the referenced bytes
+int doc_replace_refs(size_t offset, size_t old_len, const doc_ref *refs, size_t n);
+// overwrite len bytes at offset with a repeated pattern.  only one tile of
+// the pattern is stored however long the range is
+int doc_fill(size_t offset, size_t len, const char *pattern, size_t pattern_len);
+// replace old_len bytes at each of n sorted, non-overlapping offsets with
+// the same new bytes.  the piece table is rebuilt in one pass and the new
+// bytes are stored once, so the cost is linear in the number of pieces and
+// matches however far the replacements shift the rest of the document.
+int doc_replace_all(const size_t *offsets, size_t n, size_t old_len, const char *with, size_t new_len);
+int doc_stash(const char *src, size_t len, doc_ref *ref); // copy bytes to the add buffer so they can be referenced
+const char *doc_add_buffer(size_t *len); // everything ever inserted, see doc_log_ops
+int doc_delete(size_t offset, size_t len);
+
+bool doc_modified(); // true if there are edits that haven't been saved
+size_t doc_patched_bytes(); // bytes held by overwrites that haven't been folded into the pieces
+size_t doc_memory(size_t *add_len); // bytes allocated for the pieces, add buffer and patches, *add_len of the add buffer is used
+int doc_for_each_span(doc_span_fn fn, void *arg);
+int doc_for_each_span_in(size_t offset, size_t len, doc_span_fn fn, void *arg); // only the spans covering a range, cut to it
+void doc_mark_saved(); // the file on disk now holds the document, read it from there
+int doc_reopen(); // like doc_mark_saved() after the file was replaced by a new one under its name
+// the file grew on disk to file_len bytes, the new bytes are appended to the
+// document and watchers are told about it like an insert at the end
+int doc_file_grown(size_t file_len);
+int doc_file_reload(); // doc_reopen() a file that changed on disk and tell the watchers it was all replaced
+bool doc_external_change(); // true while watchers hear of a change from the file on disk rather than an edit
+
+void doc_read_lock();
+void doc_read_unlock();
+
+// pass an madvise() hint for a range of the document, e.g. MADV_SEQUENTIAL before streaming it
+void doc_advise(size_t offset, size_t len, int advice);
+
+void doc_set_log(const doc_log_ops *ops); // ops to record every change with, NULL for none
+int doc_watch(doc_change_fn fn); // register fn to be told about changes
+int doc_watch_before(doc_change_fn fn); // register fn to be told about changes before they are made
+void doc_changing(size_t offset, size_t old_len, size_t new_len); // notify watchers of a coming change
+void doc_changed(size_t offset, size_t old_len, size_t new_len); // notify watchers of a change
+
+#endif // __DOCUMENT_H__
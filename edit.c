@@ -0,0 +1,114 @@
+#include "edit.h"
+
+#include "document.h"
+#include "editor.h"
+#include "clipboard.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define EDIT_MAX_PATCH 256
+
+static int edit_hex_digit(char c) {
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = tolower((unsigned char)c);
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+int edit_parse_hex(int argc, char *argv[], char *out, size_t max) {
+  size_t n = 0;
+  for(int i = 0; i < argc; ++i) {
+    const char *s = argv[i];
+    if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+      s += 2;
+    }
+    if(strlen(s) % 2) {
+      return -1;
+    }
+    for(; *s; s += 2) {
+      int hi = edit_hex_digit(s[0]), lo = edit_hex_digit(s[1]);
+      if(hi < 0 || lo < 0 || n >= max) {
+        return -1;
+      }
+      out[n++] = (char)(hi << 4 | lo);
+    }
+  }
+  return n;
+}
+
+int edit_patch_cmd(int argc, char *argv[]) {
+  char bytes[EDIT_MAX_PATCH];
+  char msg[96];
+
+  int n = edit_parse_hex(argc - 1, argv + 1, bytes, sizeof(bytes));
+  if(n <= 0) {
+    set_status_window_text("usage: patch <hex bytes>");
+    return -1;
+  }
+
+  size_t offset = editor_get_cursor_offset();
+  if(doc_overwrite(offset, bytes, n) < 0) {
+    set_status_window_text("patch: past the end of the file");
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "patched %d bytes at 0x%lx", n, offset);
+  set_status_window_text(msg);
+  return 0;
+}
+
+int edit_insert_cmd(int argc, char *argv[]) {
+  char bytes[EDIT_MAX_PATCH];
+  char msg[96];
+
+  int n = edit_parse_hex(argc - 1, argv + 1, bytes, sizeof(bytes));
+  if(n <= 0) {
+    set_status_window_text("usage: insert <hex bytes>");
+    return -1;
+  }
+
+  size_t offset = editor_get_cursor_offset();
+  if(doc_insert(offset, bytes, n) < 0) {
+    set_status_window_text("insert: failed");
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "inserted %d bytes at 0x%lx", n, offset);
+  set_status_window_text(msg);
+  return 0;
+}
+
+int edit_delete_cmd(int argc, char *argv[]) {
+  char msg[96];
+  size_t n = 1;
+
+  if(argc > 1) {
+    char *end;
+    n = strtoul(argv[1], &end, 0);
+    if(*end || n == 0) {
+      set_status_window_text("usage: delete [count]");
+      return -1;
+    }
+  }
+
+  size_t offset = editor_get_cursor_offset();
+  if(offset >= doc_length()) {
+    set_status_window_text("delete: past the end of the file");
+    return -1;
+  }
+  if(n > doc_length() - offset) {
+    n = doc_length() - offset;
+  }
+  if(clip_delete(offset, n) < 0) {
+    set_status_window_text("delete: failed");
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "deleted %lu bytes at 0x%lx", n, offset);
+  set_status_window_text(msg);
+  return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef __EDIT_H__
+#define __EDIT_H__
+
+#include <stdlib.h>
+
+// commands that change bytes of the document
+
+// parse hex bytes from the words of argv into out, spaces between bytes are
+// optional.  returns the number of bytes or -1 if a word isn't hex
+int edit_parse_hex(int argc, char *argv[], char *out, size_t max);
+
+int edit_patch_cmd(int argc, char *argv[]); // ":patch <hex bytes>" overwrites at the cursor
+int edit_insert_cmd(int argc, char *argv[]); // ":insert <hex bytes>" inserts before the cursor
+int edit_delete_cmd(int argc, char *argv[]); // ":delete [count]" removes bytes from the cursor on, yanking them
+
+#endif // __EDIT_H__
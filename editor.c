@@ -1,23 +1,36 @@
+#define _GNU_SOURCE // mremap, O_TMPFILE
+
 #include "editor.h"
 
 #include "command_mode.h"
 #include "insert_mode.h"
+#include "overwrite_mode.h"
+#include "visual_mode.h"
+#include "line_mode.h"
+#include "compare_mode.h"
+#include "byte_stats.h"
+#include "document.h"
 #include "logger.h"
 
 #include <unistd.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
 #include <fcntl.h> 
 #include <stdlib.h> 
 #include <limits.h>
+#include <libgen.h>
 #include <assert.h>
+#include <string.h>
 
-#include <ctype.h>
 
 editor_window g_windows = { 
   .mainwnd = NULL, 
   .statuswnd = NULL, 
-  .inputwnd = NULL 
+  .inputwnd = NULL,
+  .panelwnd = NULL
 };
 
 mode_ops g_modes[] = {
@@ -25,15 +38,46 @@ mode_ops g_modes[] = {
     "command",
     cmd_mode_enter,
     cmd_mode_new_char,
-    cmd_mode_exit
+    cmd_mode_exit,
+    NULL
   },
   {
     "insert",
     insert_mode_enter,
     insert_mode_new_char,
-    insert_mode_exit
+    insert_mode_exit,
+    NULL
+  },
+  {
+    "overwrite",
+    overwrite_mode_enter,
+    overwrite_mode_new_char,
+    overwrite_mode_exit,
+    NULL
+  },
+  {
+    "visual",
+    visual_mode_enter,
+    visual_mode_new_char,
+    visual_mode_exit,
+    NULL
+  },
+  {
+    "line",
+    line_mode_enter,
+    line_mode_new_char,
+    line_mode_exit,
+    NULL
   },
   {
+    "compare",
+    compare_mode_enter,
+    compare_mode_new_char,
+    compare_mode_exit,
+    compare_mode_redraw
+  },
+  {
+    NULL,
     NULL,
     NULL,
     NULL,
@@ -43,11 +87,21 @@ mode_ops g_modes[] = {
 
 editor_status g_editor = { 
   .mode = MODE_COMMAND,
+  .panel = NULL,
   .data = {
     .lines = NULL,
     .firstline = NULL,
     .lastline = NULL,
-    .n_lines = 0
+    .n_lines = 0,
+    .shift_line = NULL,
+    .shift_number = 0,
+    .shift = 0,
+    .loaded = NULL,
+    .n_loaded = 0,
+    .max_loaded = 0,
+    .hand = 0,
+    .loaded_bytes = 0,
+    .max_loaded_bytes = EDITOR_LINE_MEMORY_DEFAULT
   },
   .screen = {
     .focus = NULL,
@@ -57,6 +111,8 @@ editor_status g_editor = {
     .lastline_number = 0,
     .curline = NULL,
     .curline_number = 0,
+    .sel_offset = 0,
+    .sel_len = 0,
     .linebuf = NULL,
     .linebuf_len = 0
   }
@@ -66,7 +122,20 @@ file_info g_curfile = {
   .filename = NULL, 
   .fp = NULL, 
   .fd = -1, 
+  .kind = FILE_KIND_REGULAR,
   .mm = NULL, 
+  .gz = NULL,
+  .mm_offset = 0, 
+  .mm_len = 0 
+};
+
+file_info g_cmpfile = { 
+  .filename = NULL, 
+  .fp = NULL, 
+  .fd = -1, 
+  .kind = FILE_KIND_REGULAR,
+  .mm = NULL, 
+  .gz = NULL,
   .mm_offset = 0, 
   .mm_len = 0 
 };
@@ -83,15 +152,16 @@ int editor_line_list_len() {
 
 // functions
 
-int setup_curses() {
-  WINDOW *r = initscr();
-  if(!r) {
-    return false;
-  }
-
+// what setup_curses() and setup_curses_headless() share once the screen is up
+static void setup_curses_modes() {
   if(has_colors()) {
     start_color();
-    init_pair(1, COLOR_CYAN, COLOR_BLACK);
+    init_pair(PAIR_STATUS, COLOR_CYAN, COLOR_BLACK);
+    init_pair(PAIR_CLASS_ZERO, COLOR_WHITE, COLOR_BLACK);
+    init_pair(PAIR_CLASS_FILL, COLOR_BLUE, COLOR_BLACK);
+    init_pair(PAIR_CLASS_TEXT, COLOR_GREEN, COLOR_BLACK);
+    init_pair(PAIR_CLASS_BINARY, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(PAIR_CLASS_RANDOM, COLOR_RED, COLOR_BLACK);
     //init_pair(1, COLOR_CYAN, COLOR_BLACK);
     //init_pair(2, COLOR_BLACK, COLOR_WHITE);
   }
@@ -111,7 +181,57 @@ int setup_curses() {
   //wbkgdset(stdscr, COLOR_PAIR(2));
   werase(stdscr);
   wrefresh(stdscr);
+}
+
+int setup_curses() {
+  // with the file coming in on stdin the keys come from the terminal
+  if(!isatty(STDIN_FILENO)) {
+    FILE *tty = fopen("/dev/tty", "r");
+    if(!tty || !newterm(NULL, stdout, tty)) {
+      return false;
+    }
+    setup_curses_modes();
+    return true;
+  }
+
+  WINDOW *r = initscr();
+  if(!r) {
+    return false;
+  }
+  setup_curses_modes();
+  return true;
+}
+
+int setup_curses_headless() {
+  int fds[2];
+  FILE *out = fopen("/dev/null", "w");
+  if(!out) {
+    return false;
+  }
+
+  // input is a pipe nobody writes to, so a getch() with a timeout waits for
+  // it like it would on a terminal instead of returning at end of file.  the
+  // write end stays open for as long as the process runs
+  if(pipe(fds) < 0) {
+    fclose(out);
+    return false;
+  }
+  FILE *in = fdopen(fds[0], "r");
+  if(!in) {
+    close(fds[0]);
+    close(fds[1]);
+    fclose(out);
+    return false;
+  }
 
+  const char *term = getenv("TERM");
+  if(!newterm(term && *term ? term : "xterm", out, in)) {
+    fclose(in);
+    close(fds[1]);
+    fclose(out);
+    return false;
+  }
+  setup_curses_modes();
   return true;
 }
 
@@ -126,7 +246,7 @@ int setup_windows() {
   // status window, 1 character high, full width of screen, below main window
   g_windows.statuswnd = newwin(1, COLS, LINES - 2, 0);
   if(g_windows.statuswnd) {
-    wattrset(g_windows.statuswnd, COLOR_PAIR(1));
+    wattrset(g_windows.statuswnd, COLOR_PAIR(PAIR_STATUS));
     wnoutrefresh(g_windows.statuswnd);
   }
   
@@ -158,103 +278,897 @@ void cleanup_curses() {
   endwin();
 }
 
-int open_file(const char *filename) {
-  int fd;
-  FILE *fp;
-  fd = open(filename, O_RDWR);
-  if(fd < 0) {
-    fprintf(stderr, "Could not open %s\n", filename);
-    return false;
+// a temporary file that is gone once closed, for a stream too big to keep in memory
+static int file_spill_fd() {
+  const char *dir = getenv("TMPDIR");
+  char path[PATH_MAX];
+  dir = dir && *dir ? dir : "/tmp";
+
+  int fd = open(dir, O_TMPFILE | O_RDWR, 0600);
+  if(fd >= 0 || (errno != EOPNOTSUPP && errno != EISDIR && errno != ENOENT)) {
+    return fd;
+  }
+  // file systems without O_TMPFILE
+  snprintf(path, sizeof(path), "%s/hexeditor.XXXXXX", dir);
+  fd = mkstemp(path);
+  if(fd >= 0) {
+    unlink(path);
+  }
+  return fd;
+}
+
+static int file_write_all(int fd, const char *p, size_t len) {
+  while(len > 0) {
+    ssize_t n = write(fd, p, len);
+    if(n < 0 && errno == EINTR) {
+      continue;
+    }
+    if(n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// read a pipe or other unseekable input to its end.  the bytes are kept in
+// an anonymous mapping until there are FILE_STREAM_MEM of them, then they go
+// to a temporary file which is mapped once everything is in.  either way the
+// result is a read only mapping like any other file's
+static int file_read_stream(file_info *f) {
+  static char chunk[FILE_STREAM_CHUNK];
+  char *mem = NULL;
+  size_t len = 0, max = 0, shown = 0;
+  int spill = -1;
+
+  for(;;) {
+    if(spill < 0 && max - len < FILE_STREAM_CHUNK) {
+      if(max + FILE_STREAM_CHUNK > FILE_STREAM_MEM) {
+        spill = file_spill_fd();
+        if(spill < 0 || file_write_all(spill, mem, len) < 0) {
+          LOG_MSG("Could not spill %s to a temporary file: %s", f->filename, strerror(errno));
+          break;
+        }
+        munmap(mem, max);
+        mem = NULL;
+        max = 0;
+      } else {
+        size_t new_max = max ? max * 2 : FILE_STREAM_CHUNK;
+        char *m = mem ? mremap(mem, max, new_max, MREMAP_MAYMOVE)
+            : mmap(NULL, new_max, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(m == MAP_FAILED) {
+          break;
+        }
+        mem = m;
+        max = new_max;
+      }
+    }
+
+    // once spilled the chunks pass through a buffer of their own
+    char *dst = spill < 0 ? mem + len : chunk;
+    ssize_t n = read(f->fd, dst, spill < 0 ? max - len : sizeof(chunk));
+    if(n < 0 && errno == EINTR) {
+      continue;
+    }
+    if(n < 0 || (n > 0 && spill >= 0 && file_write_all(spill, chunk, n) < 0)) {
+      LOG_MSG("Could not read %s: %s", f->filename, strerror(errno));
+      break;
+    }
+    if(n == 0) {
+      // the whole stream is in
+      if(spill >= 0) {
+        mem = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, spill, 0) : NULL;
+        if(mem == MAP_FAILED) {
+          break;
+        }
+        close(f->fd);
+        f->fd = spill;
+      } else if(len == 0) {
+        munmap(mem, max);
+        mem = NULL;
+      } else {
+        // file_close() unmaps mm_len bytes, give back the rest now
+        size_t page = sysconf(_SC_PAGESIZE), keep = (len + page - 1) / page * page;
+        if(keep < max) {
+          munmap(mem + keep, max - keep);
+        }
+        mprotect(mem, keep, PROT_READ);
+      }
+      f->mm = mem;
+      f->mm_len = len;
+      f->mm_offset = 0;
+      LOG_MSG("Read %lu bytes from %s%s", len, f->filename, spill >= 0 ? " into a temporary file" : "");
+      return true;
+    }
+    len += n;
+
+    if(g_windows.statuswnd && len - shown >= FILE_STREAM_PROGRESS) {
+      char msg[128];
+      snprintf(msg, sizeof(msg), "reading %s: %luM", f->filename, len >> 20);
+      set_status_window_text(msg);
+      wrefresh(g_windows.statuswnd);
+      shown = len;
+    }
+  }
+
+  if(spill >= 0) {
+    close(spill);
+  }
+  if(mem && spill < 0) {
+    munmap(mem, max);
+  }
+  return false;
+}
+
+static void file_index_progress(size_t done, size_t total, void *arg) {
+  const file_info *f = arg;
+  char msg[128];
+  if(g_windows.statuswnd) {
+    snprintf(msg, sizeof(msg), "indexing %s: %luM of %luM", f->filename, done >> 20, total >> 20);
+    set_status_window_text(msg);
+    wrefresh(g_windows.statuswnd);
+  }
+}
+
+// open gzip data through its seek index, kept as ".<name>.hxi" next to it
+static int file_open_gzip(file_info *f) {
+  char dir[PATH_MAX], base[PATH_MAX], index[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", f->filename);
+  snprintf(base, sizeof(base), "%s", f->filename);
+  snprintf(index, sizeof(index), "%s/.%s.hxi", dirname(dir), basename(base));
+
+  f->gz = gzip_open(f->fd, index, file_index_progress, f);
+  if(!f->gz) {
+    return false;
+  }
+  f->kind = FILE_KIND_GZIP;
+  f->mm = NULL;
+  f->mm_len = gzip_length(f->gz);
+  f->mm_offset = 0;
+  return true;
+}
+
+int file_open(file_info *f, const char *filename, int flags) {
+  int fd;
+  FILE *fp;
+  struct stat s;
+
+  // "-" is stdin, and pipes are only ever read.  opening a fifo for writing
+  // too would keep its end of file from ever arriving
+  bool is_stdin = strcmp(filename, "-") == 0;
+  if(is_stdin || (stat(filename, &s) == 0 && (S_ISFIFO(s.st_mode) || S_ISCHR(s.st_mode) || S_ISSOCK(s.st_mode)))) {
+    flags = (flags & ~O_ACCMODE) | O_RDONLY;
+  }
+  fd = is_stdin ? dup(STDIN_FILENO) : open(filename, flags);
+  if(fd < 0 && (errno == EACCES || errno == EROFS) && (flags & O_ACCMODE) != O_RDONLY) {
+    // look without being able to save, like a device without write access
+    flags = (flags & ~O_ACCMODE) | O_RDONLY;
+    fd = open(filename, flags);
+  }
+  if(fd < 0) {
+    LOG_MSG("Could not open %s: %s", filename, strerror(errno));
+    return false;
+  }
+
+  f->fd = fd;
+
+  fd = dup(fd); // duplicate the descriptor so that we can open a FILE*
+  if(fd < 0) {
+    close(f->fd);
+    f->fd = -1;
+    return false;
+  }
+
+  fp = fdopen(fd, (flags & O_ACCMODE) == O_RDONLY ? "r" : "r+");
+  if(!fp) {
+    close(fd);
+    close(f->fd);
+    f->fd = -1;
+    return false;
+  }
+
+  f->fp = fp;
+  f->filename = filename;
+
+  if(fstat(f->fd, &s) < 0) {
+    file_close(f);
+    return false;
+  }
+
+  size_t size = s.st_size;
+  f->kind = FILE_KIND_REGULAR;
+  if(S_ISBLK(s.st_mode)) {
+    // st_size is 0 for a device, it knows its own size.  the whole device
+    // is mapped, address space is plentiful and pages only come in as
+    // they're looked at
+    uint64_t bytes;
+    if(ioctl(f->fd, BLKGETSIZE64, &bytes) < 0) {
+      file_close(f);
+      return false;
+    }
+    size = bytes;
+    f->kind = FILE_KIND_DEVICE;
+  } else if(!S_ISREG(s.st_mode)) {
+    f->kind = FILE_KIND_STREAM;
+    if(!file_read_stream(f)) {
+      file_close(f);
+      return false;
+    }
+    return true;
+  } else if(size > 0 && gzip_detect(f->fd)) {
+    if(file_open_gzip(f)) {
+      return true;
+    }
+    // damaged, the raw bytes can still be looked at
+    LOG_MSG("%s is not valid gzip data, opening it as it is", filename);
+  }
+
+  // mmap() refuses empty mappings, an empty file just has no map
+  char *mm = NULL;
+  if(size > 0) {
+    mm = mmap(0, size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+    if(mm == MAP_FAILED) {
+      file_close(f);
+      return false;
+    }
+  }
+
+  f->mm = mm;
+  f->mm_len = size;
+  f->mm_offset = 0;
+  return true;
+}
+
+bool file_writable(const file_info *f) {
+  return f->fd >= 0 && f->kind != FILE_KIND_STREAM && f->kind != FILE_KIND_GZIP && (fcntl(f->fd, F_GETFL) & O_ACCMODE) != O_RDONLY;
+}
+
+void file_close(file_info *f) {
+  if(f->mm) {
+    munmap(f->mm, f->mm_len);
+    f->mm = NULL;
+  }
+  if(f->gz) {
+    gzip_close(f->gz);
+    f->gz = NULL;
+  }
+  f->mm_len = 0;
+
+  if(f->fp) {
+    fclose(f->fp);
+    f->fp = NULL;
+  }
+
+  if(f->fd >= 0) {
+    close(f->fd);
+    f->fd = -1;
+  }
+
+  f->filename = NULL;
+}
+
+int file_remap(file_info *f, size_t len) {
+  // the pages already mapped stay where they are when the map can grow in
+  // place, and keep their contents when it has to move
+  char *mm = NULL;
+  if(len > 0 && f->mm) {
+    mm = mremap(f->mm, f->mm_len, len, MREMAP_MAYMOVE);
+  } else if(len > 0) {
+    mm = mmap(0, len, PROT_READ, MAP_PRIVATE, f->fd, 0);
+  } else if(f->mm) {
+    munmap(f->mm, f->mm_len);
+  }
+  if(mm == MAP_FAILED) {
+    return -1;
+  }
+  f->mm = mm;
+  f->mm_len = len;
+  return 0;
+}
+
+int open_file(const char *filename) {
+  return file_open(&g_curfile, filename, O_RDWR);
+}
+
+// what a loaded line counts against max_loaded_bytes
+static size_t editor_line_charge(const struct editor_line *el) {
+  return el->flags & EDITOR_LINE_DIRTY ? 0 : sizeof(gap_buffer) + el->gb->maxlen;
+}
+
+// a line got its gap buffer
+static int editor_track_line(struct editor_line *el, unsigned char flags) {
+  if(g_editor.data.n_loaded == g_editor.data.max_loaded) {
+    size_t max = g_editor.data.max_loaded ? g_editor.data.max_loaded * 2 : 256;
+    struct editor_line **loaded = realloc(g_editor.data.loaded, max * sizeof(struct editor_line *));
+    if(!loaded) {
+      return -1;
+    }
+    g_editor.data.loaded = loaded;
+    g_editor.data.max_loaded = max;
+  }
+  el->slot = g_editor.data.n_loaded;
+  el->flags = flags;
+  g_editor.data.loaded[g_editor.data.n_loaded++] = el;
+  g_editor.data.loaded_bytes += editor_line_charge(el);
+  return 0;
+}
+
+// the line was typed into, it no longer comes from the document as it is
+static void editor_dirty_line(struct editor_line *el) {
+  if(el->gb && !(el->flags & EDITOR_LINE_DIRTY)) {
+    g_editor.data.loaded_bytes -= editor_line_charge(el);
+    el->flags |= EDITOR_LINE_DIRTY;
+  }
+}
+
+// drop a line's gap buffer, the document still has its bytes
+static void editor_unload_line(struct editor_line *el) {
+  if(!el->gb) {
+    return;
+  }
+  g_editor.data.loaded_bytes -= editor_line_charge(el);
+  struct editor_line *moved = g_editor.data.loaded[--g_editor.data.n_loaded];
+  g_editor.data.loaded[el->slot] = moved;
+  moved->slot = el->slot;
+  gap_buffer_delete(el->gb);
+  el->gb = NULL;
+  el->flags = 0;
+}
+
+static void editor_free_lines(struct editor_line *el) {
+  while(el) {
+    struct editor_line *next = el->next;
+    editor_unload_line(el);
+    free(el);
+    el = next;
+  }
+}
+
+// split document bytes [begin, end) into a chain of lines, each starting
+// after a newline.  none of them is loaded.  returns the first line or
+// NULL if memory ran out.
+static struct editor_line *editor_split_lines(size_t begin, size_t end,
+    struct editor_line **last, size_t *n_lines)
+{
+  struct editor_line *first = NULL, *prev = NULL;
+  size_t bmark = begin;
+  *n_lines = 0;
+
+  while(bmark < end) {
+    // find the next instance of a newline
+    size_t emark = bmark;
+    bool newline = false;
+    while(emark < end && !newline) {
+      size_t n = end - emark;
+      const char *p = doc_view(emark, &n);
+      if(!p) {
+        break;
+      }
+      const char *nl = memchr(p, '\n', n);
+      newline = nl != NULL;
+      emark += newline ? (size_t)(nl - p) + 1 : n;
+    }
+    if(emark == bmark) {
+      break;
+    }
+
+    struct editor_line *el = malloc(sizeof(struct editor_line));
+    if(!el) {
+      editor_free_lines(first);
+      return NULL;
+    }
+
+    el->gb = NULL;
+    el->win = 0;
+    el->offset = bmark;
+    el->next = NULL;
+    el->prev = prev;
+    el->slot = 0;
+    el->flags = 0;
+    if(prev) {
+      prev->next = el;
+    } else {
+      first = el;
+    }
+
+    prev = el;
+    ++*n_lines;
+    bmark = emark;
+  }
+
+  *last = prev;
+  return first;
+}
+
+// document offset of el, which is line number `number`
+static size_t editor_line_offset(const struct editor_line *el, size_t number) {
+  if(g_editor.data.shift_line && number >= g_editor.data.shift_number) {
+    return el->offset + g_editor.data.shift;
+  }
+  return el->offset;
+}
+
+// bytes of line number `number` without its newline, loaded or not
+static size_t editor_line_length(const struct editor_line *el, size_t number) {
+  size_t begin = editor_line_offset(el, number);
+  if(el->next) {
+    return editor_line_offset(el->next, number + 1) - 1 - begin;
+  }
+  size_t end = doc_length();
+  char c;
+  if(end > begin && doc_read(end - 1, &c, 1) == 1 && c == '\n') {
+    --end;
+  }
+  return end - begin;
+}
+
+// true if the loaded window of a line holds its bytes from `from` up to `to`
+static bool editor_line_covers(const struct editor_line *el, size_t from, size_t to) {
+  return el->gb && el->win <= from && to <= el->win + gap_buffer_length(el->gb);
+}
+
+// the gap buffer of line number `number` holding the line's bytes from
+// `from` up to `to`, a range no longer than half a window.  it is read from
+// the document if the line isn't loaded or its window is somewhere else, the
+// document has the bytes of the old one too.  NULL if memory ran out
+static gap_buffer *editor_load_line(struct editor_line *el, size_t number, size_t from, size_t to) {
+  if(editor_line_covers(el, from, to)) {
+    el->flags |= EDITOR_LINE_USED;
+    return el->gb;
+  }
+  editor_unload_line(el);
+
+  // the range goes in the middle, with room to type on either side of it
+  size_t len = editor_line_length(el, number);
+  size_t win = to > EDITOR_LINE_WINDOW / 2 ? to - EDITOR_LINE_WINDOW / 2 : 0;
+  win = win < from ? win : from;
+  size_t n = len - win < EDITOR_LINE_WINDOW ? len - win : EDITOR_LINE_WINDOW;
+  gap_buffer *gb = gap_buffer_new(n);
+  if(!gb) {
+    return NULL;
+  }
+  size_t begin = editor_line_offset(el, number) + win;
+  for(size_t i = 0; i < n; ) {
+    size_t m = n - i;
+    const char *p = doc_view(begin + i, &m);
+    if(!p || gap_buffer_addn(gb, p, m) < 0) {
+      break;
+    }
+    i += m;
+  }
+  gap_buffer_setcursor(gb, 0);
+
+  el->gb = gb;
+  el->win = win;
+  if(editor_track_line(el, EDITOR_LINE_USED) < 0) {
+    el->gb = NULL;
+    gap_buffer_delete(gb);
+    return NULL;
+  }
+  return gb;
+}
+
+// evict clean lines until they fit in max_loaded_bytes.  the hand clears
+// the used mark of lines drawn since it last came by and takes the ones
+// that weren't; the lines on the screen and the dirty ones are passed over
+static void editor_trim_lines() {
+  struct editor_line *el;
+  if(g_editor.data.loaded_bytes <= g_editor.data.max_loaded_bytes) {
+    return;
+  }
+  for(el = g_editor.screen.firstline; el; el = el->next) {
+    el->flags |= EDITOR_LINE_SHOWN;
+    if(el == g_editor.screen.lastline) {
+      break;
+    }
+  }
+  if(g_editor.screen.curline) {
+    g_editor.screen.curline->flags |= EDITOR_LINE_SHOWN;
+  }
+
+  // twice around is enough to clear every used mark
+  for(size_t steps = 2 * g_editor.data.n_loaded;
+      steps > 0 && g_editor.data.n_loaded && g_editor.data.loaded_bytes > g_editor.data.max_loaded_bytes; --steps)
+  {
+    if(g_editor.data.hand >= g_editor.data.n_loaded) {
+      g_editor.data.hand = 0;
+    }
+    el = g_editor.data.loaded[g_editor.data.hand];
+    if(el->flags & (EDITOR_LINE_SHOWN | EDITOR_LINE_DIRTY)) {
+      ++g_editor.data.hand;
+    } else if(el->flags & EDITOR_LINE_USED) {
+      el->flags &= ~EDITOR_LINE_USED;
+      ++g_editor.data.hand;
+    } else {
+      // the last loaded line moves into the slot, the hand looks at it next
+      editor_unload_line(el);
+    }
+  }
+
+  for(el = g_editor.screen.firstline; el; el = el->next) {
+    el->flags &= ~EDITOR_LINE_SHOWN;
+    if(el == g_editor.screen.lastline) {
+      break;
+    }
+  }
+  if(g_editor.screen.curline) {
+    g_editor.screen.curline->flags &= ~EDITOR_LINE_SHOWN;
+  }
+}
+
+void editor_set_line_memory(size_t limit) {
+  g_editor.data.max_loaded_bytes = limit;
+  editor_trim_lines();
+}
+
+size_t editor_line_memory(size_t *limit) {
+  *limit = g_editor.data.max_loaded_bytes;
+  return g_editor.data.loaded_bytes;
+}
+
+// bring every line's offset up to date, walking all the lines after the last
+// edit.  changes made through the document rather than by typing need it.
+static void editor_settle_offsets() {
+  for(struct editor_line *el = g_editor.data.shift_line; el; el = el->next) {
+    el->offset += g_editor.data.shift;
+  }
+  g_editor.data.shift_line = NULL;
+  g_editor.data.shift_number = 0;
+  g_editor.data.shift = 0;
+}
+
+// the lines after el, line number `number`, moved by delta.  only the lines
+// between el and the previous edit's are walked.
+static void editor_shift_after(struct editor_line *el, size_t number, size_t delta) {
+  struct editor_line *next = el->next;
+  struct editor_line *from = g_editor.data.shift_line;
+  if(!next) {
+    return;
+  }
+  if(from && g_editor.data.shift_number > number + 1) {
+    // the lines up to the old shift_line are about to count as shifted
+    for(struct editor_line *l = next; l != from; l = l->next) {
+      l->offset -= g_editor.data.shift;
+    }
+  } else if(from) {
+    // and the ones from it up to el no longer do
+    for(struct editor_line *l = from; l != next; l = l->next) {
+      l->offset += g_editor.data.shift;
+    }
+  } else {
+    g_editor.data.shift = 0;
+  }
+  g_editor.data.shift_line = next;
+  g_editor.data.shift_number = number + 1;
+  g_editor.data.shift += delta;
+}
+
+// number of the line holding offset, the line itself goes in *line if it isn't NULL
+static long editor_line_at_offset(size_t offset, struct editor_line **line) {
+  struct editor_line *el = g_editor.data.firstline;
+  long n = 0;
+
+  while(el && el->next && editor_line_offset(el->next, n + 1) <= offset) {
+    el = el->next;
+    ++n;
+  }
+  if(line) {
+    *line = el;
+  }
+  return el ? n : -1;
+}
+
+// put the cursor on offset if the line holding it is on the screen
+static void editor_goto_offset_cursor(size_t offset) {
+  struct editor_line *el = g_editor.screen.firstline;
+  size_t number = g_editor.screen.firstline_number;
+
+  while(el && el != g_editor.screen.lastline && el->next
+      && editor_line_offset(el->next, number + 1) <= offset)
+  {
+    el = el->next;
+    ++number;
+  }
+  if(!el || offset < editor_line_offset(el, number)) {
+    return;
+  }
+  g_editor.screen.curline = el;
+  g_editor.screen.curline_number = number;
+  g_editor.screen.curline_cursor = offset - editor_line_offset(el, number);
+}
+
+// where an offset ends up after old_len bytes at offset were replaced by new_len
+static size_t editor_moved_offset(size_t pos, size_t offset, size_t old_len, size_t new_len) {
+  if(pos < offset) {
+    return pos;
+  }
+  if(pos < offset + old_len) {
+    return offset; // inside the replaced bytes
+  }
+  return pos - old_len + new_len;
+}
+
+// an overwrite that stays inside one line and brings no newline with it
+// only changes bytes of that line, write them into its gap buffer
+static bool editor_overwrite_line(size_t offset, size_t len) {
+  char buf[256];
+  struct editor_line *el = g_editor.screen.curline;
+  if(!el || offset < el->offset) {
+    el = g_editor.data.firstline;
+  }
+  while(el && el->next && el->next->offset <= offset) {
+    el = el->next;
+  }
+  if(!el || offset < el->offset || len > sizeof(buf)
+      || offset + len > (el->next ? el->next->offset - 1 : doc_length()))
+  {
+    return false;
+  }
+  if(doc_read(offset, buf, len) != len || memchr(buf, '\n', len)) {
+    return false;
+  }
+  // a window that has only some of the bytes is read again when it's needed
+  size_t col = offset - el->offset;
+  if(!editor_line_covers(el, col, col + len)) {
+    editor_unload_line(el);
+    return true;
+  }
+  for(size_t i = 0; i < len; ++i) {
+    *gap_buffer_getpos(el->gb, col - el->win + i) = buf[i];
+  }
+  editor_dirty_line(el);
+  return true;
+}
+
+// show the last lines of the document, and the cursor on the last line if
+// it was there or has gone off the top
+static void editor_show_end(bool cursor_at_end) {
+  struct editor_line *el = g_editor.data.lastline;
+  size_t number = g_editor.data.n_lines - 1;
+  for(int row = 1; el && el->prev && row < g_windows.mainwnd_geom.h; ++row) {
+    el = el->prev;
+    --number;
+  }
+  g_editor.screen.firstline = el;
+  g_editor.screen.firstline_number = number;
+  g_editor.screen.lastline = g_editor.data.lastline;
+  g_editor.screen.lastline_number = g_editor.data.n_lines - 1;
+  if(cursor_at_end || !g_editor.screen.curline || g_editor.screen.curline_number < number) {
+    g_editor.screen.curline = cursor_at_end ? g_editor.data.lastline : el;
+    g_editor.screen.curline_number = cursor_at_end ? g_editor.data.n_lines - 1 : number;
+    g_editor.screen.curline_cursor = 0;
+  }
+}
+
+bool editor_at_end() {
+  return !g_editor.screen.lastline || g_editor.screen.lastline == g_editor.data.lastline;
+}
+
+void editor_screen_range(size_t *begin, size_t *end) {
+  *begin = *end = 0;
+  if(g_editor.screen.firstline && g_editor.screen.lastline) {
+    *begin = editor_line_offset(g_editor.screen.firstline, g_editor.screen.firstline_number);
+    *end = editor_line_offset(g_editor.screen.lastline, g_editor.screen.lastline_number)
+      + editor_line_length(g_editor.screen.lastline, g_editor.screen.lastline_number) + 1;
+  }
+}
+
+void editor_scroll_to_end() {
+  if(g_editor.data.lastline) {
+    editor_show_end(g_editor.screen.curline == g_editor.screen.lastline);
+    editor_redraw_main_window_full();
+  }
+}
+
+// bytes added at the end of the document, as a followed file grows.  the
+// last line is finished if it had no newline and the rest is split onto the
+// end, so the cost is in the new bytes only.  the screen follows along if it
+// was showing the end.
+static bool editor_lines_appended(size_t offset, size_t len) {
+  struct editor_line *last = g_editor.data.lastline;
+  if(!last || last->flags & EDITOR_LINE_DIRTY) {
+    return false;
+  }
+  bool at_end = editor_at_end();
+  bool cursor_at_end = g_editor.screen.curline == last;
+  size_t end = offset + len;
+
+  // the last line runs up to the new bytes if it had no newline, it is read
+  // again when it's drawn
+  char c;
+  if(offset > 0 && doc_read(offset - 1, &c, 1) == 1 && c != '\n') {
+    editor_unload_line(last);
+    while(offset < end) {
+      size_t n = end - offset;
+      const char *p = doc_view(offset, &n);
+      if(!p) {
+        break;
+      }
+      const char *nl = memchr(p, '\n', n);
+      offset += nl ? (size_t)(nl - p) + 1 : n;
+      if(nl) {
+        break;
+      }
+    }
+  }
+
+  struct editor_line *new_last = NULL;
+  size_t n_new = 0;
+  struct editor_line *new_first = editor_split_lines(offset, end, &new_last, &n_new);
+  if(!new_first && end > offset) {
+    LOG_MSG("Could not load lines at %lu", offset);
+    return true;
+  }
+  if(new_first) {
+    // the new lines come after any pending shift, which they must not get
+    for(struct editor_line *el = new_first; el && g_editor.data.shift_line; el = el->next) {
+      el->offset -= g_editor.data.shift;
+    }
+    new_first->prev = last;
+    last->next = new_first;
+    g_editor.data.lastline = new_last;
+    g_editor.data.n_lines += n_new;
+  }
+
+  if(at_end) {
+    editor_show_end(cursor_at_end);
+  }
+  editor_redraw_main_window_full();
+  return true;
+}
+
+// set while the editor changes the document for a key it has already
+// applied to its lines
+static bool g_editor_typing = false;
+
+// the document changed under some lines, rebuild them from it.  when the
+// newlines stayed where they were only the gap buffers are swapped,
+// otherwise the lines are spliced, the ones after them moved, and the screen
+// is put back over the same bytes.
+static void editor_doc_changed(size_t offset, size_t old_len, size_t new_len) {
+  if(g_editor_typing) {
+    return;
+  }
+  if(doc_external_change() && old_len == 0 && offset + new_len == doc_length()
+      && editor_lines_appended(offset, new_len))
+  {
+    return;
+  }
+  editor_settle_offsets();
+
+  struct editor_line *first = g_editor.data.firstline;
+  size_t top = g_editor.screen.firstline ? g_editor.screen.firstline->offset : 0;
+  size_t cursor = editor_get_cursor_offset();
+
+  if(!first) {
+    // the document was empty
+    struct editor_line *last;
+    size_t n;
+    first = editor_split_lines(0, doc_length(), &last, &n);
+    g_editor.data.lines = first;
+    g_editor.data.firstline = first;
+    g_editor.data.lastline = last;
+    g_editor.data.n_lines = n;
+    g_editor.screen.curline_cursor = 0;
+    editor_goto_line_scan(0);
+    editor_goto_offset_cursor(editor_moved_offset(cursor, offset, old_len, new_len));
+    editor_redraw_main_window_full();
+    return;
+  }
+
+  if(old_len == new_len && editor_overwrite_line(offset, new_len)) {
+    editor_redraw_main_window_full();
+    return;
   }
 
-  g_curfile.fd = fd;
+  while(first->next && first->next->offset <= offset) {
+    first = first->next;
+  }
 
-  fd = dup(fd); // duplicate the descriptor so that we can open a FILE*
-  if(fd < 0) {
-    close(g_curfile.fd);
-    return false;
+  // a newline that was overwritten or deleted joins the line after it
+  struct editor_line *last = first;
+  size_t change_end = offset + (old_len ? old_len : 1);
+  while(last->next && last->next->offset < change_end) {
+    last = last->next;
+  }
+  if(last->next) {
+    last = last->next;
   }
 
-  fp = fdopen(fd, "r+");
-  if(!fp) {
-    close(fd);
-    close(g_curfile.fd);
-    return false;
+  struct editor_line *after = last->next;
+  size_t begin = first->offset;
+  size_t end = after ? after->offset - old_len + new_len : doc_length();
+  struct editor_line *new_last = NULL;
+  size_t n_new = 0;
+  struct editor_line *new_first = editor_split_lines(begin, end, &new_last, &n_new);
+  if(!new_first && end > begin) {
+    LOG_MSG("Could not reload lines at %lu", begin);
+    return;
+  }
+
+  bool same = old_len == new_len;
+  size_t n_old = 0;
+  for(struct editor_line *a = first, *b = new_first; ; a = a->next, b = b ? b->next : NULL) {
+    ++n_old;
+    if(!b || a->offset != b->offset) {
+      same = false;
+    }
+    if(a == last) {
+      same = same && b == new_last;
+      break;
+    }
   }
 
-  g_curfile.fp = fp;
-  g_curfile.filename = filename;
+  if(same) {
+    // the lines are where they were, they are read again when drawn
+    for(struct editor_line *a = first; ; a = a->next) {
+      editor_unload_line(a);
+      if(a == last) {
+        break;
+      }
+    }
+    editor_free_lines(new_first);
+    editor_redraw_main_window_full();
+    return;
+  }
 
-  struct stat s;
-  if(fstat(g_curfile.fd, &s) < 0) {
-    close(fd);
-    close(g_curfile.fd);
-    return false;
+  // splice the new lines in place of first..last
+  struct editor_line *before = first->prev;
+  struct editor_line *head = new_first ? new_first : after;
+  struct editor_line *tail = new_last ? new_last : before;
+  if(new_first) {
+    new_first->prev = before;
+    new_last->next = after;
+  }
+  if(before) {
+    before->next = head;
+  } else {
+    g_editor.data.lines = head;
+    g_editor.data.firstline = head;
   }
+  if(after) {
+    after->prev = tail;
+  } else {
+    g_editor.data.lastline = tail;
+  }
+  last->next = NULL;
+  editor_free_lines(first);
+  g_editor.data.n_lines = g_editor.data.n_lines + n_new - n_old;
 
-  char *mm = mmap(0, s.st_size, PROT_READ, MAP_PRIVATE, g_curfile.fd, 0);
-  if(!mm) {
-    close(fd);
-    close(g_curfile.fd);
-    return false;
+  for(struct editor_line *el = after; el && old_len != new_len; el = el->next) {
+    el->offset = el->offset - old_len + new_len;
   }
 
-  g_curfile.mm = mm;
-  g_curfile.mm_len = s.st_size;
-  g_curfile.mm_offset = 0;
-  return true;
+  top = editor_moved_offset(top, offset, old_len, new_len);
+  cursor = editor_moved_offset(cursor, offset, old_len, new_len);
+  g_editor.screen.firstline = NULL;
+  g_editor.screen.curline = NULL;
+  g_editor.screen.curline_number = 0;
+  editor_goto_line_scan(editor_line_at_offset(top, NULL));
+  editor_goto_offset_cursor(cursor);
+  editor_redraw_main_window_full();
 }
 
 int setup_editor() {
-  size_t bmark = 0, emark = 0;
   struct editor_line *last_line = NULL;
   size_t n_lines = 0;
 
   // read through file data and separate into lines
-  // each line in the file is assigned to one gap buffer
-  while(bmark < g_curfile.mm_len) {
-
-    // find the next instance of a newline
-    while(emark < g_curfile.mm_len && g_curfile.mm[emark++] != '\n');
-
-    // create a gap buffer for the current line
-    gap_buffer *gb = gap_buffer_new(emark - bmark);
-    if(!gb) {
-      return false;
-    }
-
-    struct editor_line *el = malloc(sizeof(struct editor_line));
-    if(!el) {
-      gap_buffer_delete(gb);
-      gb = NULL;
-      return false;
-    }
-
-    el->gb = gb;
-    el->next = NULL;
-    el->prev = last_line;
-
-    if(last_line) {
-      last_line->next = el;
-    } else {
-      // set up the editor state if this is the first line
-      g_editor.data.lines = el;
-      g_editor.data.firstline = el;
-    }
-
-    // load data into the gap buffer, skip the newline at the end
-    for(size_t i = bmark; i < emark - 1; ++i) {
-      gap_buffer_addch(gb, g_curfile.mm[i]);
-    }
-    gap_buffer_setcursor(gb, 0);
-
-    last_line = el;
-    ++n_lines;
-    bmark = emark;
+  // each line gets a gap buffer when it is first drawn or edited
+  struct editor_line *lines = editor_split_lines(0, doc_length(), &last_line, &n_lines);
+  if(!lines && doc_length() > 0) {
+    return false;
   }
+  g_editor.data.lines = lines;
+  g_editor.data.firstline = lines;
   g_editor.data.lastline = last_line;
   g_editor.data.n_lines = n_lines;
 
+  if(doc_watch(editor_doc_changed) < 0) {
+    return false;
+  }
+
   // set up the line buffer for the screen
   assert(!g_editor.screen.linebuf);
   char *new_linebuf = malloc(g_windows.mainwnd_geom.w);
@@ -279,6 +1193,9 @@ void cleanup_editor() {
   g_editor.data.firstline = NULL;
   g_editor.data.lastline = NULL;
   g_editor.data.n_lines = 0;
+  g_editor.data.shift_line = NULL;
+  g_editor.data.shift_number = 0;
+  g_editor.data.shift = 0;
 
   g_editor.screen.focus = NULL;
   g_editor.screen.firstline = NULL;
@@ -291,15 +1208,13 @@ void cleanup_editor() {
   g_editor.screen.linebuf = NULL;
   g_editor.screen.linebuf_len = 0;
 
-  while(el) {
-    struct editor_line *next = el->next;
-    if(el->gb) {
-      gap_buffer_delete(el->gb);
-      el->gb = NULL;
-    }
-    free(el);
-    el = next;
-  }
+  editor_free_lines(el);
+  free(g_editor.data.loaded);
+  g_editor.data.loaded = NULL;
+  g_editor.data.n_loaded = 0;
+  g_editor.data.max_loaded = 0;
+  g_editor.data.hand = 0;
+  g_editor.data.loaded_bytes = 0;
 
   if(linebuf) {
     free(linebuf);
@@ -308,25 +1223,11 @@ void cleanup_editor() {
 }
 
 void cleanup_file() {
-  if(g_curfile.mm) {
-    munmap(g_curfile.mm, g_curfile.mm_len);
-    g_curfile.mm = NULL;
-  }
-
-  if(g_curfile.fp) {
-    fclose(g_curfile.fp);
-    g_curfile.fp = NULL;
-  }
-
-  if(g_curfile.fd >= 0) {
-    close(g_curfile.fd);
-    g_curfile.fd = -1;
-  }
-
-  g_curfile.filename = NULL;
+  file_close(&g_curfile);
 }
 
 void cleanup_windows() {
+  if(g_windows.panelwnd) delwin(g_windows.panelwnd);
   if(g_windows.mainwnd) delwin(g_windows.mainwnd);
   if(g_windows.inputwnd) delwin(g_windows.inputwnd);
   if(g_windows.statuswnd) delwin(g_windows.statuswnd);
@@ -351,6 +1252,11 @@ void clear_status_window() {
 }
 
 void set_status_window_text(const char *str) {
+  // the batch modes run without windows, what they'd show goes to stderr
+  if(!g_windows.statuswnd) {
+    fprintf(stderr, "%s\n", str);
+    return;
+  }
   clear_status_window();
   waddstr(g_windows.statuswnd, str);
 }
@@ -427,13 +1333,27 @@ void editor_update_window_sizes() {
   // --status--
   // --input---
   //
-  // All windows are full screen width
+  // All windows are full screen width, except that a side panel takes its
+  // columns from the right of the main window
   //
-  wresize(g_windows.mainwnd, LINES - 2, COLS);
+  int panel_w = 0;
+  if(g_windows.panelwnd && g_editor.panel) {
+    panel_w = g_editor.panel->width < COLS - 1 ? g_editor.panel->width : COLS - 1;
+    panel_w = panel_w > 0 ? panel_w : 0;
+  }
+
+  wresize(g_windows.mainwnd, LINES - 2, COLS - panel_w);
   mvwin(g_windows.mainwnd, 0, 0);
   getbegyx(g_windows.mainwnd, g_windows.mainwnd_geom.y, g_windows.mainwnd_geom.x);
   getmaxyx(g_windows.mainwnd, g_windows.mainwnd_geom.h, g_windows.mainwnd_geom.w);
 
+  if(g_windows.panelwnd) {
+    wresize(g_windows.panelwnd, LINES - 2, panel_w ? panel_w : 1);
+    mvwin(g_windows.panelwnd, 0, COLS - panel_w);
+    getbegyx(g_windows.panelwnd, g_windows.panelwnd_geom.y, g_windows.panelwnd_geom.x);
+    getmaxyx(g_windows.panelwnd, g_windows.panelwnd_geom.h, g_windows.panelwnd_geom.w);
+  }
+
   wresize(g_windows.statuswnd, 1, COLS);
   mvwin(g_windows.statuswnd, LINES - 2, 0);
   getbegyx(g_windows.statuswnd, g_windows.statuswnd_geom.y, g_windows.statuswnd_geom.x);
@@ -473,16 +1393,13 @@ int editor_resize_event() {
 
   if(g_editor.screen.curline_number > g_editor.screen.lastline_number) {
 
-    int curpos = g_editor.screen.curline_cursor;
-    if(g_editor.screen.curline && g_editor.screen.curline->gb) {
-      curpos = gap_buffer_getcursor(g_editor.screen.curline->gb);
-    }
+    size_t curpos = g_editor.screen.curline_cursor;
 
     g_editor.screen.curline = g_editor.screen.lastline;
     g_editor.screen.curline_number = g_editor.screen.lastline_number;
 
-    if(g_editor.screen.curline && g_editor.screen.curline->gb) {
-      int new_curpos = gap_buffer_getcursor(g_editor.screen.curline->gb);
+    if(g_editor.screen.curline) {
+      size_t new_curpos = editor_line_length(g_editor.screen.curline, g_editor.screen.curline_number);
       curpos = new_curpos < curpos ? new_curpos : curpos;
     } else {
       curpos = 0;
@@ -501,6 +1418,9 @@ void editor_refresh_windows() {
 
   wnoutrefresh(stdscr);
   wnoutrefresh(g_windows.mainwnd);
+  if(g_windows.panelwnd) {
+    wnoutrefresh(g_windows.panelwnd);
+  }
   wnoutrefresh(g_windows.statuswnd);
   wnoutrefresh(g_windows.inputwnd);
 
@@ -509,59 +1429,206 @@ void editor_refresh_windows() {
   doupdate();
 }
 
+// reverse the part of a drawn line that is selected, the newline is shown
+// as one cell after the text
+static void editor_highlight_line(int row, size_t offset, size_t n, int width) {
+  size_t sel_end = g_editor.screen.sel_offset + g_editor.screen.sel_len;
+  size_t line_end = offset + n + 1;
+  if(g_editor.screen.sel_len == 0 || sel_end <= offset || g_editor.screen.sel_offset >= line_end) {
+    return;
+  }
+  size_t b = g_editor.screen.sel_offset > offset ? g_editor.screen.sel_offset - offset : 0;
+  size_t e = (sel_end < line_end ? sel_end : line_end) - offset;
+  if(b < (size_t)width) {
+    mvwchgat(g_windows.mainwnd, row, b, (e < (size_t)width ? e : (size_t)width) - b, A_REVERSE, 0, NULL);
+  }
+}
+
+// the first byte of a line drawn at the left edge.  lines show their first
+// screen width, except the cursor's line when a skip or search put the
+// cursor further along it, then the width holding the cursor is shown
+static size_t editor_line_view(const struct editor_line *el, size_t number) {
+  size_t w = g_editor.screen.linebuf_len;
+  if(el != g_editor.screen.curline || w == 0) {
+    return 0;
+  }
+  size_t col = g_editor.screen.curline_cursor, len = editor_line_length(el, number);
+  col = col < len ? col : len;
+  return col < w ? 0 : col - col % w;
+}
+
+// draw a line of the document on a row of the main window
+static void editor_draw_line(int row, struct editor_line *el, size_t number) {
+  char *linebuf = g_editor.screen.linebuf;
+  size_t linebuf_len = g_editor.screen.linebuf_len;
+
+  wmove(g_windows.mainwnd, row, 0);
+  wclrtoeol(g_windows.mainwnd);
+
+  // only the part of the line that fits on the row is loaded, a window that
+  // has some of it but not all leaves it to the document
+  size_t offset = editor_line_offset(el, number), len = editor_line_length(el, number);
+  size_t begin = editor_line_view(el, number);
+  size_t n = len - begin < linebuf_len ? len - begin : linebuf_len;
+  if(!el->gb) {
+    editor_load_line(el, number, begin, begin + n);
+  }
+  if(editor_line_covers(el, begin, begin + n)) {
+    el->flags |= EDITOR_LINE_USED;
+    for(size_t i = 0; i < n; ++i) {
+      linebuf[i] = gap_buffer_getbyte(el->gb, begin + i - el->win);
+    }
+  } else {
+    n = doc_read(offset + begin, linebuf, n);
+  }
+  if(n > 0) {
+    byte_stats_sanitize(linebuf, n, ' ');
+    waddnstr(g_windows.mainwnd, linebuf, n);
+  }
+  editor_highlight_line(row, offset + begin, len - begin, getmaxx(g_windows.mainwnd));
+}
+
+// put the curses cursor of the main window where the editor cursor is
+static void editor_move_cursor_main() {
+  int mx = getmaxx(g_windows.mainwnd);
+  size_t curs_pos = g_editor.screen.curline_cursor;
+  if(g_editor.screen.curline) {
+    size_t len = editor_line_length(g_editor.screen.curline, g_editor.screen.curline_number);
+    curs_pos = curs_pos < len ? curs_pos : len;
+    curs_pos -= editor_line_view(g_editor.screen.curline, g_editor.screen.curline_number);
+  }
+
+  if(wmove(g_windows.mainwnd, 
+            g_editor.screen.curline_number - g_editor.screen.firstline_number, // should always be < my
+            curs_pos < (size_t)mx ? (int)curs_pos : mx - 1) == ERR) 
+  {
+    LOG_MSG("Moving cursor to %d,%lu failed, width: %d, height: %d", g_editor.screen.curline_number - g_editor.screen.firstline_number, curs_pos, getmaxx(stdscr), getmaxy(stdscr));
+  }
+}
+
 void editor_redraw_main_window_full() {
-  int mx, my, cx, cy, cur_line = 0;
+  int my, cur_line = 0;
 
   werase(g_windows.mainwnd);
 
+  if(g_modes[g_editor.mode].redraw_main) {
+    g_modes[g_editor.mode].redraw_main();
+    editor_redraw_panel();
+    editor_refresh_windows();
+    return;
+  }
+
   if(!g_editor.screen.linebuf) {
     editor_refresh_windows();
     return;
   }
 
-  getmaxyx(g_windows.mainwnd, my, mx);
-  wmove(g_windows.mainwnd, 0, 0);
+  my = getmaxy(g_windows.mainwnd);
 
   struct editor_line *el = g_editor.screen.firstline;
-  char *linebuf = g_editor.screen.linebuf;
-  size_t linebuf_len = g_editor.screen.linebuf_len;
-
-  cx = 0;
   while(el && cur_line < my) {
-    int n_copied = gap_buffer_copy(el->gb, linebuf, linebuf_len);
-    for(int i = 0; i < n_copied; ++i) {
-      if(isprint(linebuf[i])) {
-        waddch(g_windows.mainwnd, linebuf[i]);
-      } else {
-        waddch(g_windows.mainwnd, ' ');
-      }
+    editor_draw_line(cur_line, el, g_editor.screen.firstline_number + cur_line);
+    el = el->next;
+    ++cur_line;
+  }
+
+  editor_move_cursor_main();
+  editor_trim_lines();
+
+  editor_redraw_panel();
+
+  editor_refresh_windows();
+}
+
+int editor_show_panel(const panel_ops *panel) {
+  if(panel == g_editor.panel) {
+    return 0;
+  }
+
+  if(g_windows.panelwnd) {
+    delwin(g_windows.panelwnd);
+    g_windows.panelwnd = NULL;
+  }
+  g_editor.panel = panel;
+
+  if(panel) {
+    int panel_w = panel->width < COLS - 1 ? panel->width : COLS - 1;
+    g_windows.panelwnd = newwin(LINES - 2, panel_w > 0 ? panel_w : 1, 0, COLS - panel_w);
+    if(!g_windows.panelwnd) {
+      g_editor.panel = NULL;
     }
+  }
 
-    if(wmove(g_windows.mainwnd, ++cx, 0) == ERR) {
-      break;
+  // the main window changes width, so go through the resize path
+  werase(stdscr);
+  int r = editor_resize_event();
+  if(panel && !g_editor.panel) {
+    r = -1;
+  }
+  return r;
+}
+
+void editor_redraw_panel() {
+  if(!g_editor.panel || !g_windows.panelwnd) {
+    return;
+  }
+  werase(g_windows.panelwnd);
+  g_editor.panel->redraw(g_windows.panelwnd);
+}
+
+bool editor_busy() {
+  return g_editor.panel && g_editor.panel->busy && g_editor.panel->busy();
+}
+
+void editor_idle() {
+  if(g_editor.panel && g_editor.panel->idle && g_editor.panel->idle()) {
+    editor_redraw_panel();
+  }
+}
+
+int editor_wait_progress(worker_group *g, const char *what, const size_t *done, size_t total) {
+  if(!g_windows.statuswnd) {
+    worker_group_wait(g);
+    return 0;
+  }
+
+  // keys other than escape are dropped while waiting
+  timeout(100);
+  while(worker_group_busy(g)) {
+    char msg[128];
+    size_t n = __atomic_load_n(done, __ATOMIC_RELAXED);
+    snprintf(msg, sizeof(msg), "%s: %3d%% (Esc to cancel)", what,
+        total ? (int)((double)n * 100.0 / total) : 100);
+    set_status_window_text(msg);
+    editor_refresh_windows();
+
+    if(getch() == 27) {
+      worker_group_cancel(g);
+      timeout(-1);
+      return -1;
     }
-    el = el->next;
-    ++cur_line;
   }
+  timeout(-1);
+  return 0;
+}
 
-  int curs_pos = g_editor.screen.curline_cursor >= 0 ? g_editor.screen.curline_cursor : 0; 
-  if(g_editor.screen.curline 
-      && g_editor.screen.curline->gb) 
-  {
-    gap_buffer_setcursor(g_editor.screen.curline->gb, curs_pos);
-    curs_pos = curs_pos < gap_buffer_getcursor(g_editor.screen.curline->gb) 
-                ? curs_pos 
-                : gap_buffer_getcursor(g_editor.screen.curline->gb);
+void editor_mouse_event() {
+  MEVENT ev;
+  if(getmouse(&ev) != OK) {
+    return;
   }
 
-  if(wmove(g_windows.mainwnd, 
-            g_editor.screen.curline_number - g_editor.screen.firstline_number, // should always be < my
-            curs_pos < mx ? curs_pos : mx - 1) == ERR) 
-  {
-    LOG_MSG("Moving cursor to %d,%d failed, width: %d, height: %d", g_editor.screen.curline_number - g_editor.screen.firstline_number, curs_pos < mx ? curs_pos : mx, getmaxx(stdscr), getmaxy(stdscr));
+  if(!(ev.bstate & (BUTTON1_CLICKED | BUTTON1_PRESSED))) {
+    return;
   }
 
-  editor_refresh_windows();
+  if(g_editor.panel && g_editor.panel->click && g_windows.panelwnd
+      && wenclose(g_windows.panelwnd, ev.y, ev.x)) 
+  {
+    int y = ev.y, x = ev.x;
+    wmouse_trafo(g_windows.panelwnd, &y, &x, false);
+    g_editor.panel->click(y, x);
+  }
 }
 
 long editor_get_top_line() {
@@ -569,9 +1636,7 @@ long editor_get_top_line() {
 }
 
 long editor_goto_line_scan(long dest_line) {
-  struct editor_line *el = g_editor.screen.firstline 
-                            ? g_editor.screen.firstline 
-                            : g_editor.data.firstline;
+  struct editor_line *el = g_editor.data.firstline;
   if(dest_line < 0) {
     dest_line = 0;
   }
@@ -603,6 +1668,11 @@ long editor_goto_line_scan(long dest_line) {
     el = el->next;
     ++cur_line;
   }
+  // the loop stops on the last line without looking at it
+  if(el && cur_line <= new_curline_number) {
+    g_editor.screen.curline = el;
+    g_editor.screen.curline_number = cur_line;
+  }
 
   g_editor.screen.lastline = el;
   g_editor.screen.lastline_number = cur_line;
@@ -610,42 +1680,89 @@ long editor_goto_line_scan(long dest_line) {
   return g_editor.screen.firstline_number;
 }
 
+long editor_goto_offset_scan(size_t offset) {
+  struct editor_line *el;
+  long line = editor_line_at_offset(offset, &el);
+  if(line < 0) {
+    return -1;
+  }
+
+  editor_goto_line_scan(line);
+
+  // the line holding the offset ends up at the top of the screen
+  g_editor.screen.curline = g_editor.screen.firstline;
+  g_editor.screen.curline_number = g_editor.screen.firstline_number;
+  size_t begin = editor_line_offset(el, line);
+  g_editor.screen.curline_cursor = offset > begin ? offset - begin : 0;
+
+  editor_redraw_main_window_full();
+
+  return line;
+}
+
+size_t editor_get_cursor_offset() {
+  struct editor_line *el = g_editor.screen.curline;
+  if(!el) {
+    return 0;
+  }
+  size_t col = g_editor.screen.curline_cursor;
+  size_t len = editor_line_length(el, g_editor.screen.curline_number);
+  if(col > len) {
+    col = len;
+  }
+  return editor_line_offset(el, g_editor.screen.curline_number) + col;
+}
+
+void editor_set_selection(size_t offset, size_t len) {
+  g_editor.screen.sel_offset = offset;
+  g_editor.screen.sel_len = len;
+}
+
+void editor_get_selection(size_t *offset, size_t *len) {
+  struct editor_line *el = g_editor.screen.curline;
+  if(g_editor.screen.sel_len) {
+    *offset = g_editor.screen.sel_offset;
+    *len = g_editor.screen.sel_len;
+    return;
+  }
+  *offset = 0;
+  *len = 0;
+  if(el) {
+    *offset = editor_line_offset(el, g_editor.screen.curline_number);
+    *len = editor_line_length(el, g_editor.screen.curline_number);
+  }
+}
+
 void editor_char_left_main() {
-  if(!g_editor.screen.curline || !g_editor.screen.curline->gb) {
+  if(!g_editor.screen.curline) {
     return;
   }
-  gap_buffer *gb = g_editor.screen.curline->gb;
 
-  int buf_len = gap_buffer_length(gb);
+  size_t buf_len = editor_line_length(g_editor.screen.curline, g_editor.screen.curline_number);
   if(g_editor.screen.curline_cursor > buf_len) {
     g_editor.screen.curline_cursor = buf_len;
   }
 
   if(g_editor.screen.curline_cursor > 0) {
     --g_editor.screen.curline_cursor;
-    gap_buffer_setcursor(gb, g_editor.screen.curline_cursor);
-    g_editor.screen.curline_cursor = gap_buffer_getcursor(gb);
   }
   editor_update_cursor_main();
 }
 
 void editor_char_right_main() {
-  if(!g_editor.screen.curline || !g_editor.screen.curline->gb) {
+  if(!g_editor.screen.curline) {
     return;
   }
 
-  gap_buffer *gb = g_editor.screen.curline->gb;
-
-  int buf_len = gap_buffer_length(gb);
+  size_t buf_len = editor_line_length(g_editor.screen.curline, g_editor.screen.curline_number);
   if(g_editor.screen.curline_cursor > buf_len) {
     return;
   }
   
-  int pos = g_editor.screen.curline_cursor;
+  size_t pos = g_editor.screen.curline_cursor;
   if(pos < g_windows.mainwnd_geom.w - 1 ? g_windows.mainwnd_geom.w - 2 : 0) {
     ++pos;
-    gap_buffer_setcursor(gb, pos);
-    g_editor.screen.curline_cursor = gap_buffer_getcursor(gb);
+    g_editor.screen.curline_cursor = pos < buf_len ? pos : buf_len;
   }
   editor_update_cursor_main();
 }
@@ -657,7 +1774,7 @@ void editor_line_down_main() {
   if(!el || !el->next) {
     return;
   }
-  LOG_MSG("Moving down from %d to %d", g_editor.screen.curline_number, g_editor.screen.curline_number + 1);
+  LOG_DEBUG("Moving down from %d to %d", g_editor.screen.curline_number, g_editor.screen.curline_number + 1);
   el = el->next;
   ++ln;
   
@@ -673,7 +1790,6 @@ void editor_line_down_main() {
 
   g_editor.screen.curline = el;
   g_editor.screen.curline_number = ln;
-  gap_buffer_setcursor(g_editor.screen.curline->gb, g_editor.screen.curline_cursor);
 
   editor_update_cursor_main();
 }
@@ -699,7 +1815,6 @@ void editor_line_up_main() {
 
   g_editor.screen.curline = el;
   g_editor.screen.curline_number = ln;
-  gap_buffer_setcursor(g_editor.screen.curline->gb, g_editor.screen.curline_cursor);
 
   editor_update_cursor_main();
 }
@@ -707,3 +1822,231 @@ void editor_line_up_main() {
 void editor_update_cursor_main() {
   editor_redraw_main_window_full();
 }
+
+// point lastline at the last line that fits below firstline
+static void editor_fit_screen() {
+  struct editor_line *el = g_editor.screen.firstline;
+  size_t number = g_editor.screen.firstline_number;
+  for(int row = 1; el && el->next && row < g_windows.mainwnd_geom.h; ++row) {
+    el = el->next;
+    ++number;
+  }
+  g_editor.screen.lastline = el;
+  g_editor.screen.lastline_number = number;
+}
+
+// redraw the cursor's row only
+static void editor_redraw_curline() {
+  struct editor_line *el = g_editor.screen.curline;
+  size_t number = g_editor.screen.curline_number;
+  editor_draw_line(number - g_editor.screen.firstline_number, el, number);
+  editor_move_cursor_main();
+  editor_refresh_windows();
+}
+
+// change the document for a key that is applied to the lines by the caller
+static int editor_typed(size_t offset, size_t old_len, const char *src, size_t new_len) {
+  g_editor_typing = true;
+  int r = doc_replace(offset, old_len, src, new_len);
+  g_editor_typing = false;
+  return r;
+}
+
+// the document took a key the lines then couldn't.  the shift it gave the
+// lines after el is taken back before they're brought up to date from the
+// document, which would move them again
+static void editor_typed_failed(struct editor_line *el, size_t number, size_t delta,
+    size_t offset, size_t old_len, size_t new_len)
+{
+  editor_shift_after(el, number, -delta);
+  editor_doc_changed(offset, old_len, new_len);
+}
+
+// the newline before the cursor splits its line, the text after the cursor
+// moves to a new line below
+static void editor_split_curline(size_t offset) {
+  struct editor_line *el = g_editor.screen.curline;
+  size_t number = g_editor.screen.curline_number;
+  struct editor_line *nl = malloc(sizeof(struct editor_line));
+  gap_buffer *tail = nl ? gap_buffer_split(el->gb) : NULL;
+  if(!tail) {
+    free(nl);
+    editor_typed_failed(el, number, 1, offset - 1, 0, 1);
+    return;
+  }
+
+  nl->gb = tail;
+  nl->win = 0;
+  if(editor_track_line(nl, EDITOR_LINE_USED | EDITOR_LINE_DIRTY) < 0) {
+    gap_buffer_delete(tail);
+    free(nl);
+    editor_typed_failed(el, number, 1, offset - 1, 0, 1);
+    return;
+  }
+  nl->offset = offset;
+  nl->prev = el;
+  nl->next = el->next;
+  if(el->next) {
+    el->next->prev = nl;
+  } else {
+    g_editor.data.lastline = nl;
+  }
+  el->next = nl;
+  ++g_editor.data.n_lines;
+
+  // the new line is numbered like the ones around it, before shift_line
+  // or behind by shift
+  if(g_editor.data.shift_line && g_editor.data.shift_number > number) {
+    ++g_editor.data.shift_number;
+  } else if(g_editor.data.shift_line) {
+    nl->offset -= g_editor.data.shift;
+  }
+
+  int row = number - g_editor.screen.firstline_number;
+  g_editor.screen.curline = nl;
+  g_editor.screen.curline_number = number + 1;
+  g_editor.screen.curline_cursor = 0;
+
+  if(row + 1 >= g_windows.mainwnd_geom.h) {
+    g_editor.screen.firstline = g_editor.screen.firstline->next;
+    ++g_editor.screen.firstline_number;
+    editor_fit_screen();
+    editor_redraw_main_window_full();
+    return;
+  }
+  editor_fit_screen();
+  editor_draw_line(row, el, number);
+  wmove(g_windows.mainwnd, row + 1, 0);
+  winsertln(g_windows.mainwnd);
+  editor_redraw_curline();
+}
+
+int editor_insert_char_main(char c) {
+  struct editor_line *el = g_editor.screen.curline;
+  size_t number = g_editor.screen.curline_number;
+  size_t col = g_editor.screen.curline_cursor;
+  if(el && col > editor_line_length(el, number)) {
+    col = editor_line_length(el, number);
+  }
+  if(!el || !editor_load_line(el, number, col, col)) {
+    return doc_insert(editor_get_cursor_offset(), &c, 1);
+  }
+
+  size_t offset = editor_line_offset(el, number) + col;
+  if(editor_typed(offset, 0, &c, 1) < 0) {
+    return -1;
+  }
+  editor_shift_after(el, number, 1);
+  editor_dirty_line(el);
+
+  gap_buffer_setcursor(el->gb, col - el->win);
+  if(c == '\n') {
+    editor_split_curline(offset + 1);
+    return 0;
+  }
+  if(gap_buffer_addch(el->gb, c) != 1) {
+    editor_typed_failed(el, number, 1, offset, 0, 1);
+    return 0;
+  }
+  g_editor.screen.curline_cursor = col + 1;
+  editor_redraw_curline();
+  return 0;
+}
+
+// backspace at the start of a line removes the newline before it, the line
+// is appended to the one above
+static int editor_join_curline() {
+  struct editor_line *el = g_editor.screen.curline;
+  struct editor_line *prev = el->prev;
+  size_t number = g_editor.screen.curline_number;
+  size_t offset = editor_line_offset(el, number);
+  size_t prev_len = prev ? editor_line_length(prev, number - 1) : 0;
+  if(!prev || !editor_load_line(prev, number - 1, prev_len, prev_len) || !editor_load_line(el, number, 0, 0)) {
+    return 0;
+  }
+  if(editor_typed(offset - 1, 1, NULL, 0) < 0) {
+    return -1;
+  }
+  editor_shift_after(prev, number - 1, (size_t)-1);
+  editor_dirty_line(prev);
+
+  if(gap_buffer_append(prev->gb, el->gb) < 0) {
+    editor_typed_failed(prev, number - 1, (size_t)-1, offset - 1, 1, 0);
+    return 0;
+  }
+  // two windows joined, it is read again at its usual size when it's needed
+  if(gap_buffer_length(prev->gb) > 2 * EDITOR_LINE_WINDOW) {
+    editor_unload_line(prev);
+  }
+
+  // el was shift_line, the line after it takes its place and number
+  prev->next = el->next;
+  if(el->next) {
+    el->next->prev = prev;
+  } else {
+    g_editor.data.lastline = prev;
+  }
+  g_editor.data.shift_line = el->next;
+  if(!el->next) {
+    g_editor.data.shift = 0;
+  }
+  --g_editor.data.n_lines;
+
+  int row = number - g_editor.screen.firstline_number;
+  g_editor.screen.curline = prev;
+  g_editor.screen.curline_number = number - 1;
+  g_editor.screen.curline_cursor = prev_len;
+  if(g_editor.screen.firstline == el) {
+    g_editor.screen.firstline = prev;
+    --g_editor.screen.firstline_number;
+  }
+  editor_unload_line(el);
+  free(el);
+
+  if(row == 0) {
+    editor_fit_screen();
+    editor_redraw_main_window_full();
+    return 0;
+  }
+  wmove(g_windows.mainwnd, row, 0);
+  wdeleteln(g_windows.mainwnd);
+  editor_fit_screen();
+  int last_row = g_editor.screen.lastline_number - g_editor.screen.firstline_number;
+  if(last_row == g_windows.mainwnd_geom.h - 1) {
+    editor_draw_line(last_row, g_editor.screen.lastline, g_editor.screen.lastline_number);
+  }
+  editor_redraw_curline();
+  return 0;
+}
+
+int editor_backspace_main() {
+  struct editor_line *el = g_editor.screen.curline;
+  size_t number = g_editor.screen.curline_number;
+  if(!el) {
+    return 0;
+  }
+
+  size_t col = g_editor.screen.curline_cursor;
+  if(col > editor_line_length(el, number)) {
+    col = editor_line_length(el, number);
+  }
+  if(col == 0) {
+    return editor_join_curline();
+  }
+  if(!editor_load_line(el, number, col - 1, col)) {
+    return 0;
+  }
+
+  size_t offset = editor_line_offset(el, number) + col - 1;
+  if(editor_typed(offset, 1, NULL, 0) < 0) {
+    return -1;
+  }
+  editor_shift_after(el, number, (size_t)-1);
+  editor_dirty_line(el);
+
+  gap_buffer_setcursor(el->gb, col - el->win);
+  gap_buffer_delch(el->gb);
+  g_editor.screen.curline_cursor = col - 1;
+  editor_redraw_curline();
+  return 0;
+}
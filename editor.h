@@ -2,6 +2,8 @@
 #define __EDITOR_H__
 
 #include "gap_buffer.h"
+#include "worker_pool.h"
+#include "gzip_index.h"
 
 #include <ncurses.h>
 
@@ -19,39 +21,113 @@ struct _editor_window {
 
   WINDOW *inputwnd;
   struct _editor_window_geom inputwnd_geom;
+
+  WINDOW *panelwnd; // side panel, only exists while a panel is shown
+  struct _editor_window_geom panelwnd_geom;
 };
 typedef struct _editor_window editor_window;
 
 extern editor_window g_windows;
 
+// color pairs set up by setup_curses()
+enum _editor_color_pairs {
+  PAIR_STATUS = 1,
+  PAIR_CLASS_ZERO, // byte classes in the order of enum _byte_class
+  PAIR_CLASS_FILL,
+  PAIR_CLASS_TEXT,
+  PAIR_CLASS_BINARY,
+  PAIR_CLASS_RANDOM
+};
+
 // curses windows
+#define FILE_STREAM_CHUNK (1UL << 20)     // bytes read from a pipe at a time
+#define FILE_STREAM_MEM (64UL << 20)      // a pipe is kept in memory up to this, then in a temporary file
+#define FILE_STREAM_PROGRESS (64UL << 20) // bytes read between updates of the status window
+
+enum _file_kinds {
+  FILE_KIND_REGULAR = 0,
+  FILE_KIND_DEVICE,      // a block device, sized with BLKGETSIZE64, only saved in place
+  FILE_KIND_STREAM,      // a pipe, stdin ("-") or a character device, read to its end and never saved
+  FILE_KIND_GZIP         // gzip data, viewed decompressed through a seek index and never saved
+};
+
 struct _file_info {
   const char *filename;
   FILE *fp;       // file pointer
-  int fd;         // file descriptor
-  char *mm;       // mmapped area
+  int fd;         // file descriptor, a temporary file for a stream that was spilled
+  int kind;       // FILE_KIND_*
+  char *mm;       // mmapped area, NULL for gzip data
+  gzip_file *gz;  // the seek index of gzip data
   long mm_offset; // offset into file that is mmaped
   long mm_len;    // length of memory map
 }; 
 typedef struct _file_info file_info;
 
-extern file_info g_curfile;
+extern file_info g_curfile; // the document being edited
+extern file_info g_cmpfile; // second document, open while comparing
+
+#define EDITOR_LINE_MEMORY_DEFAULT (16UL << 20) // bytes of clean lines kept loaded
+#define EDITOR_LINE_WINDOW (64UL << 10)         // most bytes of one line loaded at a time
+
+enum _editor_line_flags {
+  EDITOR_LINE_USED = 1,  // drawn since the clock hand last passed
+  EDITOR_LINE_DIRTY = 2, // typed into, stays loaded
+  EDITOR_LINE_SHOWN = 4  // on the screen while lines are evicted
+};
 
+// a line is loaded into its gap buffer when it is drawn or typed into, a
+// window of up to EDITOR_LINE_WINDOW bytes around where that happens.  before
+// that and after it is evicted gb is NULL.  the document always has all of
+// the line, from offset up to the next line's
 struct editor_line {
-  gap_buffer *gb; // gap buffer for writing characters
+  gap_buffer *gb; // gap buffer for writing characters, NULL if not loaded
+  size_t win;     // offset in the line of the first byte in gb
+  size_t offset;  // offset of the start of the line in the file
 
   struct editor_line *next;
   struct editor_line *prev;
+
+  unsigned int slot;   // index in data.loaded while gb is set
+  unsigned char flags; // EDITOR_LINE_*
+};
+
+// a side panel displayed to the right of the main window
+struct _panel_ops {
+  const char *panel_name;
+  int width;                    // columns taken from the main window
+  void (*redraw)(WINDOW *wnd);  // draw the panel contents
+  void (*click)(int y, int x);  // mouse click at window relative coords
+  bool (*idle)();               // poll background work, true if the panel should be redrawn
+  bool (*busy)();               // true while background work is outstanding
 };
+typedef struct _panel_ops panel_ops;
 
 // holds global state for the editor
 struct _editor_status {
   int mode;
+  const panel_ops *panel; // panel shown next to the main window, or NULL
   struct {
     struct editor_line *lines;
     struct editor_line *firstline; // should be same as lines
     struct editor_line *lastline;
     size_t n_lines;
+
+    // typing moves the offsets of all the lines after it.  rather than
+    // walking them, the lines from shift_line (number shift_number) on are
+    // behind by shift, which wraps around for deletions.  the next edit
+    // somewhere else only walks the lines between the two.
+    struct editor_line *shift_line;
+    size_t shift_number;
+    size_t shift;
+
+    // the loaded lines, swept by a clock hand that evicts clean ones not
+    // drawn since its last pass once they take more than max_loaded_bytes
+    struct editor_line **loaded;
+    size_t n_loaded;
+    size_t max_loaded;
+    size_t hand;
+    size_t loaded_bytes; // gap buffers of clean loaded lines
+    size_t max_loaded_bytes;
   } data;
 
   struct {
@@ -64,6 +140,10 @@ struct _editor_status {
     size_t curline_number;
     size_t curline_cursor; // where on the line the cursor should be placed
 
+    // highlighted range of the document, sel_len is 0 when nothing is selected
+    size_t sel_offset;
+    size_t sel_len;
+
     // a buffer that is the width of the windows
     char *linebuf;
     size_t linebuf_len;
@@ -78,6 +158,10 @@ extern editor_status g_editor;
 enum _command_modes {
   MODE_COMMAND = 0,
   MODE_INSERT,
+  MODE_OVERWRITE,
+  MODE_VISUAL,
+  MODE_LINE,
+  MODE_COMPARE,
   NUMBER_MODES
 };
 
@@ -87,6 +171,7 @@ struct _mode_ops {
   int (*enter_mode)();
   int (*new_char)(int c);
   int (*exit_mode)();
+  void (*redraw_main)(); // draws the main window instead of the lines, or NULL
 };
 typedef struct _mode_ops mode_ops;
 
@@ -96,7 +181,12 @@ extern mode_ops g_modes[];
 
 // setup 
 int setup_curses(); // initializes ncurses structures
+int setup_curses_headless(); // the same on /dev/null, the size comes from LINES and COLUMNS or the terminfo entry
 int setup_windows(); // sets up windows (for ncurses)
+int file_open(file_info *f, const char *filename, int flags); // open and map a file, flags as for open()
+void file_close(file_info *f); // unmap and close a file opened with file_open()
+bool file_writable(const file_info *f); // false for streams and files opened read only
+int file_remap(file_info *f, size_t len); // map len bytes of a file whose size changed, -1 if it couldn't be mapped
 int open_file(const char *filename); // opens/reads desired file
 int setup_editor(); // sets up initial editor state
 
@@ -127,10 +217,29 @@ void editor_update_window_sizes(); // update saved window sizes to terminal size
 int editor_resize_event(); // high-level method called on a resize event
 void editor_refresh_windows(); // refresh the contents of windows
 void editor_redraw_main_window_full(); // redraw main window with buffer contents
+bool editor_at_end(); // true if the last line of the document is on the screen
+void editor_screen_range(size_t *begin, size_t *end); // document bytes of the lines on the screen
+void editor_set_line_memory(size_t limit); // bytes of clean lines kept loaded, evicting down to it
+size_t editor_line_memory(size_t *limit); // bytes of clean lines loaded
+void editor_scroll_to_end(); // show the last lines of the document
+
+int editor_show_panel(const panel_ops *panel); // show a side panel, NULL hides it
+void editor_redraw_panel(); // redraw the side panel if one is shown
+bool editor_busy(); // true while background work wants periodic editor_idle() calls
+void editor_idle(); // called from the main loop when no key arrived
+void editor_mouse_event(); // handle a KEY_MOUSE event
+
+// wait for a worker group while showing done/total in the status window,
+// returns -1 if the user pressed escape (the group is cancelled)
+int editor_wait_progress(worker_group *g, const char *what, const size_t *done, size_t total);
 
 long editor_get_top_line(); // get the first line displayed on the editor window
 
 long editor_goto_line_scan(long line); // slow method to go to a specified line by scanning from first line
+long editor_goto_offset_scan(size_t offset); // go to the line holding a file offset, scanning from first line
+size_t editor_get_cursor_offset(); // file offset under the main window cursor
+void editor_get_selection(size_t *offset, size_t *len); // the highlighted range, or the current line
+void editor_set_selection(size_t offset, size_t len); // highlight a range, len 0 clears it
 void editor_char_left_main(); // move main window cursor left one character
 void editor_char_right_main(); // move main window cursor right one character
 void editor_line_down_main(); // move main window cursor down one line (or scroll)
@@ -138,4 +247,7 @@ void editor_line_up_main(); // move main window cursor up one line (or scroll)
 
 void editor_update_cursor_main(); // explicitly place the main window cursor according to editor state
 
+int editor_insert_char_main(char c); // insert c before the cursor, a newline splits the line
+int editor_backspace_main(); // delete before the cursor, at the start of a line join it to the previous one
+
 #endif // __EDITOR_H__
@@ -0,0 +1,195 @@
+#include "follow.h"
+
+#include "document.h"
+#include "editor.h"
+#include "undo.h"
+#include "clipboard.h"
+#include "latency.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+static struct {
+  bool active;
+  int fd;                 // inotify, -1 if only polling
+  int file_wd;            // the file itself, gone once it is moved or deleted
+  int dir_wd;             // its directory, for a new file under the name
+  char filename[PATH_MAX];
+  char base[PATH_MAX];
+  uint64_t last_check;
+} g_follow = {
+  .active = false,
+  .fd = -1,
+  .file_wd = -1,
+  .dir_wd = -1,
+  .last_check = 0
+};
+
+// watch whichever file is under the name now
+static void follow_watch_file() {
+  if(g_follow.fd < 0) {
+    return;
+  }
+  if(g_follow.file_wd >= 0) {
+    inotify_rm_watch(g_follow.fd, g_follow.file_wd);
+  }
+  g_follow.file_wd = inotify_add_watch(g_follow.fd, g_follow.filename,
+      IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+}
+
+// the file under the name isn't the one that's open, or it shrank
+static void follow_reopen(const char *what) {
+  char msg[PATH_MAX + 96];
+
+  // the edits stay on the old file.  a replaced one is still open as it
+  // was, but the end cut off a truncated one is gone
+  if(doc_modified()) {
+    snprintf(msg, sizeof(msg), "follow: %s was %s under unsaved changes, stopped", g_follow.filename, what);
+    follow_stop();
+    set_status_window_text(msg);
+    return;
+  }
+
+  bool at_end = editor_at_end();
+  int r = doc_file_reload();
+  // both refer to bytes of the old file
+  undo_clear();
+  clip_clear();
+  if(r < 0) {
+    snprintf(msg, sizeof(msg), "follow: %s was %s and could not be opened again", g_follow.filename, what);
+    follow_stop();
+    set_status_window_text(msg);
+    return;
+  }
+
+  follow_watch_file();
+  if(at_end) {
+    editor_scroll_to_end();
+  }
+  snprintf(msg, sizeof(msg), "follow: %s was %s, opened again", g_follow.filename, what);
+  set_status_window_text(msg);
+  LOG_MSG("%s", msg);
+}
+
+// compare the open file and the one under the name with what is mapped
+static void follow_check() {
+  struct stat fs, ns;
+  bool have_file = g_curfile.fd >= 0 && fstat(g_curfile.fd, &fs) == 0;
+  bool have_name = stat(g_follow.filename, &ns) == 0;
+
+  if(have_name && (!have_file || ns.st_ino != fs.st_ino || ns.st_dev != fs.st_dev)) {
+    follow_reopen("replaced");
+  } else if(have_file && fs.st_size < g_curfile.mm_len) {
+    follow_reopen("truncated");
+  } else if(have_file && fs.st_size > g_curfile.mm_len) {
+    if(doc_file_grown(fs.st_size) < 0) {
+      follow_stop();
+      set_status_window_text("follow: could not map the new bytes, stopped");
+    }
+  }
+}
+
+bool follow_start() {
+  if(g_curfile.fd < 0 || g_curfile.kind != FILE_KIND_REGULAR) {
+    return false;
+  }
+  follow_stop();
+
+  char dir[PATH_MAX], base[PATH_MAX];
+  snprintf(g_follow.filename, sizeof(g_follow.filename), "%s", g_curfile.filename);
+  snprintf(dir, sizeof(dir), "%s", g_curfile.filename);
+  snprintf(base, sizeof(base), "%s", g_curfile.filename);
+  snprintf(g_follow.base, sizeof(g_follow.base), "%s", basename(base));
+
+  // without inotify the file is still polled
+  g_follow.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(g_follow.fd >= 0) {
+    g_follow.dir_wd = inotify_add_watch(g_follow.fd, dirname(dir), IN_CREATE | IN_MOVED_TO);
+    follow_watch_file();
+  } else {
+    LOG_MSG("follow: no inotify, polling %s", g_follow.filename);
+  }
+
+  g_follow.active = true;
+  g_follow.last_check = latency_now();
+  follow_check();
+  if(g_follow.active) {
+    editor_scroll_to_end();
+  }
+  return true;
+}
+
+void follow_stop() {
+  if(g_follow.fd >= 0) {
+    close(g_follow.fd);
+  }
+  g_follow.fd = -1;
+  g_follow.file_wd = -1;
+  g_follow.dir_wd = -1;
+  g_follow.active = false;
+}
+
+bool follow_active() {
+  return g_follow.active;
+}
+
+void follow_idle() {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  ssize_t n;
+
+  if(!g_follow.active) {
+    return;
+  }
+
+  // only the events say something happened, follow_check() finds out what
+  while(g_follow.fd >= 0 && (n = read(g_follow.fd, buf, sizeof(buf))) > 0) {
+    for(char *p = buf; p < buf + n; ) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      if(ev->wd != g_follow.dir_wd || (ev->len && strcmp(ev->name, g_follow.base) == 0)) {
+        changed = true;
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+
+  uint64_t now = latency_now();
+  if(changed || now - g_follow.last_check >= FOLLOW_POLL_MS * 1000000UL) {
+    g_follow.last_check = now;
+    follow_check();
+  }
+}
+
+void cleanup_follow() {
+  follow_stop();
+}
+
+int follow_cmd(int argc, char *argv[]) {
+  char msg[PATH_MAX + 32];
+
+  if(argc == 2 && strcmp(argv[1], "off") == 0) {
+    follow_stop();
+    set_status_window_text("follow: off");
+    return 0;
+  }
+  if(argc != 1) {
+    set_status_window_text("usage: follow [off]");
+    return -1;
+  }
+  if(!follow_start()) {
+    set_status_window_text("follow: only regular files can be followed");
+    return -1;
+  }
+  if(g_follow.active) {
+    snprintf(msg, sizeof(msg), "following %s", g_follow.filename);
+    set_status_window_text(msg);
+  }
+  return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef __FOLLOW_H__
+#define __FOLLOW_H__
+
+#include <stdbool.h>
+
+// following a growing file
+//
+// ":follow" watches the file with inotify, like tail -f.  bytes appended to
+// it are mapped and split into lines as they arrive, without reading the
+// rest of the file again, and the screen scrolls along if it was showing
+// the end.  a file that shrinks, or a new file under its name after a log
+// rotation, is opened again and shown from the start, or from the end if
+// the end was on the screen.  that would lose unsaved edits, so following
+// stops instead if there are any.
+//
+// the file is also looked at every FOLLOW_POLL_MS in case the events don't
+// come, as on network file systems.
+
+#define FOLLOW_POLL_MS 1000
+
+bool follow_start(); // start following g_curfile, false for pipes and devices
+void follow_stop();
+bool follow_active(); // true while the main loop should call follow_idle()
+void follow_idle(); // bring in whatever happened to the file since the last call
+void cleanup_follow();
+
+int follow_cmd(int argc, char *argv[]); // ":follow [off]"
+
+#endif // __FOLLOW_H__
@@ -2,11 +2,48 @@
 
 #include <string.h>
 
+// the gap never grows by less than this, so a line that is typed into
+// doesn't realloc on every other key
+#define GAP_BUFFER_MIN_GAP 16
+
+// buffers this small are never shrunk
+#define GAP_BUFFER_MIN_SHRINK 64
+
+static void *gap_buffer_default_alloc(size_t len, void *ctx) {
+  (void)ctx;
+  return malloc(len);
+}
+
+static void *gap_buffer_default_realloc(void *p, size_t old_len, size_t new_len, void *ctx) {
+  (void)old_len;
+  (void)ctx;
+  return realloc(p, new_len);
+}
+
+static void gap_buffer_default_free(void *p, size_t len, void *ctx) {
+  (void)len;
+  (void)ctx;
+  free(p);
+}
+
+static const gap_buffer_allocator g_gap_buffer_default_allocator = {
+  gap_buffer_default_alloc,
+  gap_buffer_default_realloc,
+  gap_buffer_default_free,
+  NULL
+};
+
+static const gap_buffer_allocator *g_gap_buffer_allocator = &g_gap_buffer_default_allocator;
+
+void gap_buffer_set_allocator(const gap_buffer_allocator *a) {
+  g_gap_buffer_allocator = a ? a : &g_gap_buffer_default_allocator;
+}
+
 gap_buffer *gap_buffer_new(size_t len) {
   gap_buffer *new_gb = calloc(1, sizeof(gap_buffer));
 
   if(new_gb && len > 0) {
-    new_gb->buf = malloc(len);
+    new_gb->buf = g_gap_buffer_allocator->alloc(len, g_gap_buffer_allocator->ctx);
     if(new_gb->buf) {
       new_gb->maxlen = len;
       new_gb->len = 0;
@@ -22,7 +59,7 @@ gap_buffer *gap_buffer_new(size_t len) {
 void gap_buffer_delete(gap_buffer *gb) {
   if(gb) {
     if(gb->buf) {
-      free(gb->buf);
+      g_gap_buffer_allocator->free(gb->buf, gb->maxlen, g_gap_buffer_allocator->ctx);
     }
     free(gb);
   }
@@ -47,8 +84,8 @@ int _gap_buffer_sync(gap_buffer *gb) {
     memmove(gb->buf + gb->gap_end - count, gb->buf + gb->cursor, count);
     gb->gap_begin -= count;
     gb->gap_end -= count;
-  } else { // cursor is in/past the gap, need to move data to front of buffer
-    int count = gb->cursor - gb->gap_end;
+  } else { // cursor is past the gap, need to move data to front of buffer
+    int count = gb->cursor - gb->gap_begin;
     memmove(gb->buf + gb->gap_begin, gb->buf + gb->gap_end, count);
     gb->gap_begin += count;
     gb->gap_end += count;
@@ -57,56 +94,63 @@ int _gap_buffer_sync(gap_buffer *gb) {
   return gb->cursor;
 }
 
-int _gap_buffer_chkexpand(gap_buffer *gb) {
-  const int multiplier = 2;
-  if(gb->gap_begin == gb->gap_end) {
-    size_t newsize = gb->len ? gb->len * multiplier : 1;
-    if(newsize < gb->len) { // check for overflow
-      return -1;
-    }
+// change the storage to newsize bytes, keeping the text after the gap at the end
+static int gap_buffer_resize(gap_buffer *gb, size_t newsize) {
+  size_t tail = gb->maxlen - gb->gap_end;
+  const gap_buffer_allocator *a = g_gap_buffer_allocator;
 
-    void *newptr = realloc(gb->buf, newsize);
-    if(!newptr) {
-      return -1;
+  if(newsize < gb->maxlen) {
+    memmove(gb->buf + newsize - tail, gb->buf + gb->gap_end, tail);
+  }
+  char *newptr = gb->buf
+    ? a->realloc(gb->buf, gb->maxlen, newsize, a->ctx)
+    : a->alloc(newsize, a->ctx);
+  if(!newptr) {
+    if(newsize < gb->maxlen) { // put the tail back
+      memmove(gb->buf + gb->gap_end, gb->buf + newsize - tail, tail);
     }
-
-    size_t move_ct = gb->len - gb->gap_end;
-    memmove(newptr + newsize - move_ct, newptr + gb->gap_end, move_ct);
-    gb->buf = newptr;
-    gb->gap_end = newsize - move_ct;
-    gb->maxlen = newsize;
+    return -1;
+  }
+  if(newsize > gb->maxlen) {
+    memmove(newptr + newsize - tail, newptr + gb->gap_end, tail);
   }
+  gb->buf = newptr;
+  gb->gap_end = newsize - tail;
+  gb->maxlen = newsize;
   return 0;
 }
 
-// shrink the storage allocated for the gap buffer if it's below a low watermark
-int _gap_buffer_chkshrink(gap_buffer *gb) {
-  const int divisor = 2;
-  size_t low_watermark = gb->maxlen / (2 * divisor);
-  size_t newlen = gb->maxlen / divisor;
-  
-  // avoid shrinking to zero to avoid realloc() acting as a free() call
-  if(newlen && gb->len <= low_watermark) {
-    int old_cursor = gb->cursor;
-
-    // move the buffer gap to the end of the contents
-    if(gap_buffer_setcursor(gb, gb->len) != gb->len) {
-      return -1;
-    }
-    _gap_buffer_sync(gb);
+int gap_buffer_reserve(gap_buffer *gb, size_t n) {
+  if(gb->maxlen - gb->len >= n) {
+    return 0;
+  }
+  // grow by half again of what's needed so a run of reserves stays
+  // amortized linear, without doubling the memory of very long lines
+  size_t need = gb->len + n;
+  size_t extra = need / 2 > GAP_BUFFER_MIN_GAP ? need / 2 : GAP_BUFFER_MIN_GAP;
+  size_t newsize = need + extra;
+  if(need < gb->len || newsize < need) { // check for overflow
+    return -1;
+  }
+  return gap_buffer_resize(gb, newsize);
+}
 
-    char *newptr = realloc(gb->buf, newlen);
-    if(!newptr) {
-      gap_buffer_setcursor(gb, old_cursor);
-      return -1;
-    }
+int _gap_buffer_chkexpand(gap_buffer *gb) {
+  return gap_buffer_reserve(gb, 1);
+}
 
-    gb->buf = newptr;
-    gb->maxlen = newlen;
-    gb->gap_end = newlen;
-    gap_buffer_setcursor(gb, old_cursor);
+// shrink the storage allocated for the gap buffer once it's below a quarter
+// full.  it's cut to twice the text, so the buffer has to lose half of its
+// text again, or double it, before the next realloc
+int _gap_buffer_chkshrink(gap_buffer *gb) {
+  if(gb->maxlen <= GAP_BUFFER_MIN_SHRINK || gb->len >= gb->maxlen / 4) {
+    return 0;
   }
-  return 0;
+  size_t newsize = gb->len * 2;
+  if(newsize < GAP_BUFFER_MIN_SHRINK) {
+    newsize = GAP_BUFFER_MIN_SHRINK;
+  }
+  return gap_buffer_resize(gb, newsize);
 }
 
 int gap_buffer_getcursor(gap_buffer *gb) {
@@ -149,6 +193,19 @@ int gap_buffer_addch(gap_buffer *gb, char c) {
   return 1;
 }
 
+int gap_buffer_addn(gap_buffer *gb, const char *src, size_t n) {
+  _gap_buffer_sync(gb);
+  if(gap_buffer_reserve(gb, n) < 0) {
+    return -1;
+  }
+
+  memcpy(gb->buf + gb->cursor, src, n);
+  gb->cursor += n;
+  gb->gap_begin += n;
+  gb->len += n;
+  return 0;
+}
+
 int gap_buffer_delch(gap_buffer *gb) {
 
   _gap_buffer_sync(gb); // sync gap buffer with cursor
@@ -165,6 +222,45 @@ int gap_buffer_delch(gap_buffer *gb) {
   return 1;
 }
 
+gap_buffer *gap_buffer_split(gap_buffer *gb) {
+  _gap_buffer_sync(gb);
+
+  // the bytes after the cursor are the ones after the gap
+  size_t tail = gb->len - gb->cursor;
+  gap_buffer *new_gb = gap_buffer_new(tail + GAP_BUFFER_MIN_GAP);
+  if(!new_gb) {
+    return NULL;
+  }
+  memcpy(new_gb->buf, gb->buf + gb->gap_end, tail);
+  new_gb->len = tail;
+  new_gb->gap_begin = tail;
+  new_gb->gap_end = new_gb->maxlen;
+  new_gb->cursor = 0;
+
+  gb->len = gb->cursor;
+  gb->gap_end = gb->maxlen;
+  _gap_buffer_chkshrink(gb);
+  return new_gb;
+}
+
+int gap_buffer_append(gap_buffer *gb, gap_buffer *other) {
+  int old_cursor = gb->cursor;
+  size_t n = other->len;
+
+  // gather the gap at the end and make it big enough
+  if(gap_buffer_reserve(gb, n) < 0) {
+    return -1;
+  }
+  gap_buffer_setcursor(gb, gb->len);
+  _gap_buffer_sync(gb);
+
+  gap_buffer_copy(other, gb->buf + gb->gap_begin, n);
+  gb->gap_begin += n;
+  gb->len += n;
+  gap_buffer_setcursor(gb, old_cursor);
+  return 0;
+}
+
 int gap_buffer_copy(gap_buffer *gb, char *dst, size_t len) {
   size_t n_copied = 0;
   size_t n_to_copy = gb->gap_begin;
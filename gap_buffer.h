@@ -36,6 +36,20 @@ struct _gap_buffer {
 
 typedef struct _gap_buffer gap_buffer;
 
+// where gap buffers get their storage.  the old size is passed to realloc
+// and free so an allocator can keep count without asking malloc
+struct _gap_buffer_allocator {
+  void *(*alloc)(size_t len, void *ctx);
+  void *(*realloc)(void *p, size_t old_len, size_t new_len, void *ctx);
+  void (*free)(void *p, size_t len, void *ctx);
+  void *ctx;
+};
+typedef struct _gap_buffer_allocator gap_buffer_allocator;
+
+// use a for the storage of gap buffers created from now on, NULL goes back
+// to malloc.  buffers must be freed by the allocator that created them
+void gap_buffer_set_allocator(const gap_buffer_allocator *a);
+
 gap_buffer *gap_buffer_new(size_t len);
 
 void gap_buffer_delete(gap_buffer *gb);
@@ -47,6 +61,12 @@ size_t gap_buffer_length(gap_buffer *gb);
 // sync up the gap with the cursor
 int _gap_buffer_sync(gap_buffer *gb);
 
+// make room for n more characters without another realloc.  growth is
+// by half again with a minimum gap, shrinking waits until the buffer is a
+// quarter full and leaves it half full, so edits going back and forth
+// around a size don't realloc each time
+int gap_buffer_reserve(gap_buffer *gb, size_t n);
+
 // checks if the buffer should be expanded
 int _gap_buffer_chkexpand(gap_buffer *gb);
 
@@ -65,9 +85,18 @@ int gap_buffer_setcursor(gap_buffer *gb, int pos);
 // return the number of characters added to the buffer
 int gap_buffer_addch(gap_buffer *gb, char c);
 
+// add n characters at the cursor in one go, returns < 0 if memory ran out
+int gap_buffer_addn(gap_buffer *gb, const char *src, size_t n);
 // delete a single character before the cursor position
 int gap_buffer_delch(gap_buffer *gb);
 
+// move the characters from the cursor on into a new gap buffer, returns
+// NULL if memory ran out
+gap_buffer *gap_buffer_split(gap_buffer *gb);
+
+// add the characters of other to the end of gb, the cursor stays put
+int gap_buffer_append(gap_buffer *gb, gap_buffer *other);
+
 int gap_buffer_copy(gap_buffer *gb, char *dst, size_t len);
 
 char gap_buffer_getbyte(gap_buffer *gb, size_t pos);
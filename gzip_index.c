@@ -0,0 +1,595 @@
+#include "gzip_index.h"
+
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#define GZIP_WINDOW 32768               // how far back deflate can refer
+#define GZIP_IN_CHUNK (1U << 30)        // avail_in is an unsigned int
+#define GZIP_INDEX_MAGIC "HXGZI01\n"
+
+// where decompression can start over: a deflate block boundary at out bytes
+// of output.  the block starts bits bits before the byte at in, and window
+// is the deflated output before it
+struct gzip_point {
+  size_t out;
+  size_t in;
+  int bits;
+  size_t window_len;
+  unsigned char *window;
+};
+
+// the decompressed bytes from a checkpoint up to the next one
+struct gzip_span {
+  size_t point;
+  char *data;
+  size_t len;
+  int pins;               // views that have to stay valid, atomic
+  struct gzip_span *prev; // most recently used first
+  struct gzip_span *next;
+};
+
+struct _gzip_file {
+  const unsigned char *in; // the compressed file, mapped
+  size_t in_len;
+  size_t length;
+
+  struct gzip_point *points;
+  size_t n_points;
+  size_t max_points;
+
+  // the cache, spans[i] is the span of points[i] if it's in memory
+  struct gzip_span **spans;
+  struct gzip_span *lru_head;
+  struct gzip_span *lru_tail;
+  size_t cached;
+  pthread_mutex_t lock;
+};
+
+// on disk, followed by the points, each followed by its window
+struct gzip_index_header {
+  char magic[8];
+  uint64_t in_len;  // the compressed file it was made for
+  uint64_t mtime;
+  uint64_t mtime_ns;
+  uint64_t ino;
+  uint64_t length;
+  uint64_t n_points;
+};
+
+struct gzip_index_point {
+  uint64_t out;
+  uint64_t in;
+  uint64_t window_len;
+  uint32_t bits;
+  uint32_t reserved;
+};
+
+// the spans each thread viewed last, pinned in the cache.  a thread takes a
+// row the first time it views anything
+struct gzip_pin {
+  gzip_file *gz;
+  struct gzip_span *span;
+};
+
+static struct gzip_pin g_gzip_pins[GZIP_MAX_THREADS][GZIP_PINNED];
+static int g_gzip_n_threads = 0;
+static __thread int t_gzip_thread = -1;
+static __thread int t_gzip_next_pin = 0;
+
+// functions
+
+bool gzip_detect(int fd) {
+  unsigned char magic[2];
+  return pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+static bool gzip_member_at(const gzip_file *gz, size_t in) {
+  return in + 2 <= gz->in_len && gz->in[in] == 0x1f && gz->in[in + 1] == 0x8b;
+}
+
+// record a checkpoint.  window is the circular output buffer, left the room
+// before it wraps, and have the bytes of output so far
+static int gzip_add_point(gzip_file *gz, size_t in, int bits, size_t out,
+    const unsigned char *window, size_t left, size_t have)
+{
+  unsigned char history[GZIP_WINDOW];
+
+  if(gz->n_points == gz->max_points) {
+    size_t max = gz->max_points ? gz->max_points * 2 : 64;
+    struct gzip_point *points = realloc(gz->points, max * sizeof(struct gzip_point));
+    if(!points) {
+      return -1;
+    }
+    gz->points = points;
+    gz->max_points = max;
+  }
+
+  // the oldest byte is where the next output goes
+  size_t at = GZIP_WINDOW - left;
+  memcpy(history, window + at, left);
+  memcpy(history + left, window, at);
+  size_t n = have < GZIP_WINDOW ? have : GZIP_WINDOW;
+
+  struct gzip_point *p = &gz->points[gz->n_points];
+  p->out = out;
+  p->in = in;
+  p->bits = bits;
+  p->window_len = 0;
+  p->window = NULL;
+  if(n > 0) {
+    uLongf len = compressBound(n);
+    p->window = malloc(len);
+    if(!p->window || compress2(p->window, &len, history + GZIP_WINDOW - n, n, Z_BEST_SPEED) != Z_OK) {
+      free(p->window);
+      return -1;
+    }
+    unsigned char *shrunk = realloc(p->window, len);
+    p->window = shrunk ? shrunk : p->window;
+    p->window_len = len;
+  }
+  ++gz->n_points;
+  return 0;
+}
+
+// inflate the whole file once to find the checkpoints and the length.  a
+// truncated or damaged tail ends the data where the damage starts
+static int gzip_build(gzip_file *gz, gzip_progress_fn progress, void *arg) {
+  unsigned char window[GZIP_WINDOW];
+  size_t in = 0, out = 0, last = 0, shown = 0;
+  z_stream s;
+  int ret = Z_OK;
+
+  memset(&s, 0, sizeof(s));
+  if(inflateInit2(&s, 47) != Z_OK) { // gzip or zlib header
+    return -1;
+  }
+  s.avail_out = 0;
+
+  for(;;) {
+    if(s.avail_in == 0) {
+      if(in >= gz->in_len) {
+        break;
+      }
+      size_t n = gz->in_len - in;
+      s.next_in = (unsigned char *)gz->in + in;
+      s.avail_in = n > GZIP_IN_CHUNK ? GZIP_IN_CHUNK : n;
+    }
+    if(s.avail_out == 0) {
+      s.next_out = window;
+      s.avail_out = GZIP_WINDOW;
+    }
+
+    size_t avail_in = s.avail_in, avail_out = s.avail_out;
+    ret = inflate(&s, Z_BLOCK);
+    in += avail_in - s.avail_in;
+    out += avail_out - s.avail_out;
+
+    if(ret == Z_STREAM_END) {
+      // another member may follow, anything else after the data is ignored
+      if(!gzip_member_at(gz, in)) {
+        break;
+      }
+      inflateReset(&s);
+      continue;
+    }
+    if(ret != Z_OK && !(ret == Z_BUF_ERROR && s.avail_in == 0)) {
+      break;
+    }
+    if((s.data_type & 128) && !(s.data_type & 64) && (gz->n_points == 0 || out - last >= GZIP_SPAN)) {
+      if(gzip_add_point(gz, in, s.data_type & 7, out, window, s.avail_out, out) < 0) {
+        inflateEnd(&s);
+        return -1;
+      }
+      last = out;
+    }
+    if(progress && in - shown >= GZIP_PROGRESS) {
+      progress(in, gz->in_len, arg);
+      shown = in;
+    }
+  }
+  inflateEnd(&s);
+
+  if(gz->n_points == 0) {
+    return -1;
+  }
+  if(ret != Z_STREAM_END) {
+    LOG_MSG("gzip: data ends early or is damaged at %lu, %lu bytes decompressed", in, out);
+  }
+  gz->length = out;
+  return 0;
+}
+
+static int gzip_load_index(gzip_file *gz, const char *path, const struct stat *st) {
+  struct gzip_index_header h;
+  struct gzip_index_point ip;
+
+  FILE *fp = fopen(path, "r");
+  if(!fp) {
+    return -1;
+  }
+  if(fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, GZIP_INDEX_MAGIC, sizeof(h.magic)) != 0
+      || h.in_len != (uint64_t)st->st_size || h.mtime != (uint64_t)st->st_mtim.tv_sec
+      || h.mtime_ns != (uint64_t)st->st_mtim.tv_nsec || h.ino != (uint64_t)st->st_ino || h.n_points == 0)
+  {
+    fclose(fp);
+    return -1;
+  }
+
+  gz->points = calloc(h.n_points, sizeof(struct gzip_point));
+  if(!gz->points) {
+    fclose(fp);
+    return -1;
+  }
+  gz->max_points = h.n_points;
+  for(gz->n_points = 0; gz->n_points < h.n_points; ++gz->n_points) {
+    struct gzip_point *p = &gz->points[gz->n_points];
+    if(fread(&ip, sizeof(ip), 1, fp) != 1 || ip.in > h.in_len || ip.out > h.length || ip.bits > 7
+        || ip.window_len > compressBound(GZIP_WINDOW)
+        || (gz->n_points > 0 && ip.out <= p[-1].out))
+    {
+      break;
+    }
+    p->out = ip.out;
+    p->in = ip.in;
+    p->bits = ip.bits;
+    p->window_len = ip.window_len;
+    p->window = ip.window_len ? malloc(ip.window_len) : NULL;
+    if(ip.window_len && (!p->window || fread(p->window, ip.window_len, 1, fp) != 1)) {
+      free(p->window);
+      break;
+    }
+  }
+  fclose(fp);
+
+  if(gz->n_points != h.n_points || gz->points[0].out != 0) {
+    return -1;
+  }
+  gz->length = h.length;
+  return 0;
+}
+
+// written under another name and renamed, so a reader never sees half of it
+static int gzip_save_index(const gzip_file *gz, const char *path, const struct stat *st) {
+  char tmp[PATH_MAX];
+  struct gzip_index_header h;
+
+  if(snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid()) >= (int)sizeof(tmp)) {
+    return -1;
+  }
+  FILE *fp = fopen(tmp, "w");
+  if(!fp) {
+    return -1;
+  }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, GZIP_INDEX_MAGIC, sizeof(h.magic));
+  h.in_len = st->st_size;
+  h.mtime = st->st_mtim.tv_sec;
+  h.mtime_ns = st->st_mtim.tv_nsec;
+  h.ino = st->st_ino;
+  h.length = gz->length;
+  h.n_points = gz->n_points;
+  bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+
+  for(size_t i = 0; i < gz->n_points && ok; ++i) {
+    const struct gzip_point *p = &gz->points[i];
+    struct gzip_index_point ip = { p->out, p->in, p->window_len, p->bits, 0 };
+    ok = fwrite(&ip, sizeof(ip), 1, fp) == 1 && (!p->window_len || fwrite(p->window, p->window_len, 1, fp) == 1);
+  }
+  ok = fclose(fp) == 0 && ok;
+  if(!ok || rename(tmp, path) < 0) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+gzip_file *gzip_open(int fd, const char *index_path, gzip_progress_fn progress, void *arg) {
+  struct stat st;
+
+  if(fstat(fd, &st) < 0 || st.st_size <= 0) {
+    return NULL;
+  }
+  gzip_file *gz = calloc(1, sizeof(gzip_file));
+  if(!gz) {
+    return NULL;
+  }
+  pthread_mutex_init(&gz->lock, NULL);
+
+  void *in = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(in == MAP_FAILED) {
+    gzip_close(gz);
+    return NULL;
+  }
+  gz->in = in;
+  gz->in_len = st.st_size;
+
+  if(!index_path || gzip_load_index(gz, index_path, &st) < 0) {
+    for(size_t i = 0; i < gz->n_points; ++i) {
+      free(gz->points[i].window);
+    }
+    gz->n_points = 0;
+
+    madvise(in, gz->in_len, MADV_SEQUENTIAL);
+    int r = gzip_build(gz, progress, arg);
+    madvise(in, gz->in_len, MADV_NORMAL);
+    if(r < 0) {
+      gzip_close(gz);
+      return NULL;
+    }
+    LOG_MSG("gzip: indexed %lu bytes into %lu, %lu checkpoints", gz->in_len, gz->length, gz->n_points);
+    if(index_path && gzip_save_index(gz, index_path, &st) < 0) {
+      LOG_MSG("gzip: could not save the index to %s", index_path);
+    }
+  }
+
+  gz->spans = calloc(gz->n_points, sizeof(struct gzip_span *));
+  if(!gz->spans) {
+    gzip_close(gz);
+    return NULL;
+  }
+  return gz;
+}
+
+void gzip_close(gzip_file *gz) {
+  if(!gz) {
+    return;
+  }
+  // nobody is viewing the file any more, but their pins still point at it
+  int n_threads = __atomic_load_n(&g_gzip_n_threads, __ATOMIC_ACQUIRE);
+  for(int t = 0; t < n_threads && t < GZIP_MAX_THREADS; ++t) {
+    for(int i = 0; i < GZIP_PINNED; ++i) {
+      if(g_gzip_pins[t][i].gz == gz) {
+        g_gzip_pins[t][i].gz = NULL;
+        g_gzip_pins[t][i].span = NULL;
+      }
+    }
+  }
+
+  for(struct gzip_span *sp = gz->lru_head; sp; ) {
+    struct gzip_span *next = sp->next;
+    free(sp->data);
+    free(sp);
+    sp = next;
+  }
+  free(gz->spans);
+  for(size_t i = 0; i < gz->n_points; ++i) {
+    free(gz->points[i].window);
+  }
+  free(gz->points);
+  if(gz->in) {
+    munmap((void *)gz->in, gz->in_len);
+  }
+  pthread_mutex_destroy(&gz->lock);
+  free(gz);
+}
+
+size_t gzip_length(const gzip_file *gz) {
+  return gz->length;
+}
+
+size_t gzip_points(const gzip_file *gz) {
+  return gz->n_points;
+}
+
+// index of the last checkpoint at or before offset
+static size_t gzip_find_point(const gzip_file *gz, size_t offset) {
+  size_t lo = 0, hi = gz->n_points;
+  while(hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(gz->points[mid].out <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// decompress the span of checkpoint i, without the lock
+static struct gzip_span *gzip_inflate_span(const gzip_file *gz, size_t i) {
+  const struct gzip_point *p = &gz->points[i];
+  size_t len = (i + 1 < gz->n_points ? gz->points[i + 1].out : gz->length) - p->out;
+  unsigned char history[GZIP_WINDOW];
+  z_stream s;
+  int ret;
+
+  struct gzip_span *sp = calloc(1, sizeof(struct gzip_span));
+  if(!sp || !(sp->data = malloc(len ? len : 1))) {
+    free(sp);
+    return NULL;
+  }
+  sp->point = i;
+  sp->len = len;
+
+  // the checkpoint is inside a deflate stream, past the headers
+  memset(&s, 0, sizeof(s));
+  if(inflateInit2(&s, -15) != Z_OK) {
+    free(sp->data);
+    free(sp);
+    return NULL;
+  }
+  ret = Z_OK;
+  if(p->bits) {
+    ret = inflatePrime(&s, p->bits, gz->in[p->in - 1] >> (8 - p->bits));
+  }
+  if(ret == Z_OK && p->window_len) {
+    uLongf n = sizeof(history);
+    ret = uncompress(history, &n, p->window, p->window_len);
+    if(ret == Z_OK) {
+      ret = inflateSetDictionary(&s, history, n);
+    }
+  }
+
+  size_t in = p->in, done = 0;
+  bool raw = true;
+  while(ret == Z_OK && done < len) {
+    if(s.avail_in == 0) {
+      if(in >= gz->in_len) {
+        break;
+      }
+      size_t n = gz->in_len - in;
+      s.next_in = (unsigned char *)gz->in + in;
+      s.avail_in = n > GZIP_IN_CHUNK ? GZIP_IN_CHUNK : n;
+    }
+    s.next_out = (unsigned char *)sp->data + done;
+    s.avail_out = len - done;
+
+    size_t avail_in = s.avail_in, avail_out = s.avail_out;
+    ret = inflate(&s, Z_NO_FLUSH);
+    in += avail_in - s.avail_in;
+    done += avail_out - s.avail_out;
+
+    if(ret == Z_STREAM_END) {
+      // the member ends inside the span, the next one starts after its
+      // trailer, which only a raw stream leaves unread
+      in += raw ? 8 : 0;
+      if(!gzip_member_at(gz, in)) {
+        break;
+      }
+      inflateReset2(&s, 47);
+      s.avail_in = 0;
+      raw = false;
+      ret = Z_OK;
+    } else if(ret == Z_BUF_ERROR && s.avail_in == 0) {
+      ret = Z_OK;
+    }
+  }
+  inflateEnd(&s);
+
+  if(done != len) {
+    LOG_MSG("gzip: could not decompress the span at %lu", p->out);
+    free(sp->data);
+    free(sp);
+    return NULL;
+  }
+  return sp;
+}
+
+// the caller holds the lock
+static void gzip_unlink_span(gzip_file *gz, struct gzip_span *sp) {
+  if(sp->prev) {
+    sp->prev->next = sp->next;
+  } else {
+    gz->lru_head = sp->next;
+  }
+  if(sp->next) {
+    sp->next->prev = sp->prev;
+  } else {
+    gz->lru_tail = sp->prev;
+  }
+  sp->prev = NULL;
+  sp->next = NULL;
+}
+
+static void gzip_push_span(gzip_file *gz, struct gzip_span *sp) {
+  sp->prev = NULL;
+  sp->next = gz->lru_head;
+  if(gz->lru_head) {
+    gz->lru_head->prev = sp;
+  } else {
+    gz->lru_tail = sp;
+  }
+  gz->lru_head = sp;
+}
+
+// pin a span for this thread, the one pinned GZIP_PINNED views ago is let go
+static void gzip_pin(gzip_file *gz, struct gzip_span *sp) {
+  if(t_gzip_thread < 0) {
+    t_gzip_thread = __atomic_fetch_add(&g_gzip_n_threads, 1, __ATOMIC_ACQ_REL);
+    if(t_gzip_thread >= GZIP_MAX_THREADS) {
+      LOG_MSG("gzip: more than %d threads, views are not pinned", GZIP_MAX_THREADS);
+    }
+  }
+  if(t_gzip_thread >= GZIP_MAX_THREADS) {
+    return;
+  }
+
+  struct gzip_pin *pin = &g_gzip_pins[t_gzip_thread][t_gzip_next_pin];
+  t_gzip_next_pin = (t_gzip_next_pin + 1) % GZIP_PINNED;
+  if(pin->span) {
+    __atomic_sub_fetch(&pin->span->pins, 1, __ATOMIC_RELEASE);
+  }
+  __atomic_add_fetch(&sp->pins, 1, __ATOMIC_RELAXED);
+  pin->gz = gz;
+  pin->span = sp;
+}
+
+// drop the least recently used spans that nobody has pinned
+static void gzip_evict(gzip_file *gz) {
+  struct gzip_span *sp = gz->lru_tail;
+  while(sp && gz->cached > GZIP_CACHE_MAX) {
+    struct gzip_span *prev = sp->prev;
+    if(__atomic_load_n(&sp->pins, __ATOMIC_ACQUIRE) == 0) {
+      gzip_unlink_span(gz, sp);
+      gz->spans[sp->point] = NULL;
+      gz->cached -= sp->len;
+      free(sp->data);
+      free(sp);
+    }
+    sp = prev;
+  }
+}
+
+const char *gzip_view(gzip_file *gz, size_t offset, size_t *len) {
+  if(offset >= gz->length) {
+    *len = 0;
+    return NULL;
+  }
+  size_t i = gzip_find_point(gz, offset);
+
+  pthread_mutex_lock(&gz->lock);
+  struct gzip_span *sp = gz->spans[i];
+  if(!sp) {
+    // other spans can be viewed while this one is decompressed.  if another
+    // thread decompressed it meanwhile, theirs is kept
+    pthread_mutex_unlock(&gz->lock);
+    struct gzip_span *mine = gzip_inflate_span(gz, i);
+    if(!mine) {
+      *len = 0;
+      return NULL;
+    }
+    pthread_mutex_lock(&gz->lock);
+    sp = gz->spans[i];
+    if(sp) {
+      free(mine->data);
+      free(mine);
+    } else {
+      sp = mine;
+      gz->spans[i] = sp;
+      gz->cached += sp->len;
+      gzip_push_span(gz, sp);
+    }
+  }
+  if(sp != gz->lru_head) {
+    gzip_unlink_span(gz, sp);
+    gzip_push_span(gz, sp);
+  }
+  gzip_pin(gz, sp);
+  gzip_evict(gz);
+  pthread_mutex_unlock(&gz->lock);
+
+  size_t skip = offset - gz->points[i].out;
+  if(*len > sp->len - skip) {
+    *len = sp->len - skip;
+  }
+  return sp->data + skip;
+}
+
+size_t gzip_memory(const gzip_file *gz, size_t *cached) {
+  size_t n = gz->max_points * sizeof(struct gzip_point) + gz->n_points * sizeof(struct gzip_span *);
+  for(size_t i = 0; i < gz->n_points; ++i) {
+    n += gz->points[i].window_len;
+  }
+  *cached = gz->cached;
+  return n + gz->cached;
+}
@@ -0,0 +1,49 @@
+#ifndef __GZIP_INDEX_H__
+#define __GZIP_INDEX_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// random access into gzip files
+//
+// the compressed file is mapped and inflated once from start to end to find
+// checkpoints: deflate block boundaries about GZIP_SPAN bytes of output
+// apart, each with the 32K of output before it that later blocks may refer
+// back to (kept deflated).  decompressing from the nearest checkpoint before
+// an offset costs at most one span, wherever it is.  the checkpoints are
+// saved to an index file so the pass is only made once per version of the
+// file.  concatenated gzip members, as written by pigz or appended logs, are
+// followed from one to the next.
+//
+// spans are decompressed whole when they are first viewed and kept, least
+// recently used first out, up to GZIP_CACHE_MAX bytes.  a pointer from
+// gzip_view() stays valid until the same thread has viewed GZIP_PINNED more
+// spans, which covers callers that hold a pointer into each of two files.
+
+#define GZIP_SPAN (4UL << 20)       // bytes of output between checkpoints
+#define GZIP_CACHE_MAX (64UL << 20) // decompressed bytes kept
+#define GZIP_PINNED 4               // spans viewed by a thread that stay in the cache
+#define GZIP_MAX_THREADS 64         // threads that can hold pinned spans
+#define GZIP_PROGRESS (64UL << 20)  // bytes of input between progress calls while indexing
+
+typedef struct _gzip_file gzip_file;
+
+// told how far the indexing pass has come, in bytes of compressed input
+typedef void (*gzip_progress_fn)(size_t done, size_t total, void *arg);
+
+bool gzip_detect(int fd); // the file starts with the gzip magic
+// open the gzip file fd.  the index is read from index_path if it was made
+// for this version of the file, otherwise it is built and written there.
+// index_path can be NULL to build it without saving.  NULL if the file
+// couldn't be mapped or isn't valid gzip data.
+gzip_file *gzip_open(int fd, const char *index_path, gzip_progress_fn progress, void *arg);
+void gzip_close(gzip_file *gz);
+
+size_t gzip_length(const gzip_file *gz); // bytes of decompressed data
+size_t gzip_points(const gzip_file *gz); // number of checkpoints
+// pointer to the decompressed bytes at offset, *len is reduced to what is
+// contiguous.  NULL past the end, or if the span couldn't be decompressed.
+const char *gzip_view(gzip_file *gz, size_t offset, size_t *len);
+size_t gzip_memory(const gzip_file *gz, size_t *cached); // bytes of checkpoints and cache, *cached of the cache
+
+#endif // __GZIP_INDEX_H__
@@ -0,0 +1,188 @@
+#include "hashing.h"
+
+#include "checksum.h"
+#include "document.h"
+#include "editor.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#define HASH_BLOCK (4UL << 20)         // bytes fed to an algorithm per step
+#define HASH_MIN_CHUNK (16UL << 20)    // smallest range worth handing to another thread
+
+static const char *g_hash_names[NUMBER_HASH_ALGOS] = {
+  "crc32",
+  "crc32c",
+  "xxh64",
+  "sha256"
+};
+
+struct hash_job {
+  int algo;
+  size_t offset;
+  size_t len;
+  worker_group *group;
+  size_t *done;      // progress counter shared by all of the jobs
+  uint32_t crc;
+  xxh64_state xxh;
+  sha256_state sha;
+  int failed;        // never queued, or stopped short of the end of its range
+};
+
+const char *hash_algo_name(int algo) {
+  return algo >= 0 && algo < NUMBER_HASH_ALGOS ? g_hash_names[algo] : NULL;
+}
+
+int hash_algo_lookup(const char *name) {
+  for(int i = 0; i < NUMBER_HASH_ALGOS; ++i) {
+    if(strcmp(name, g_hash_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void hash_job_run(void *arg) {
+  struct hash_job *job = arg;
+  size_t offset = job->offset, len = job->len;
+
+  job->crc = CRC32_INIT;
+  xxh64_init(&job->xxh, 0);
+  sha256_init(&job->sha);
+
+  while(len > 0 && !worker_group_cancelled(job->group)) {
+    size_t n = len < HASH_BLOCK ? len : HASH_BLOCK;
+    const char *p = doc_view(offset, &n);
+    if(!p || n == 0) {
+      break;
+    }
+
+    switch(job->algo) {
+      case HASH_CRC32 :
+        job->crc = crc32_update(job->crc, p, n);
+        break;
+      case HASH_CRC32C :
+        job->crc = crc32c_update(job->crc, p, n);
+        break;
+      case HASH_XXH64 :
+        xxh64_update(&job->xxh, p, n);
+        break;
+      case HASH_SHA256 :
+        sha256_update(&job->sha, p, n);
+        break;
+    }
+
+    offset += n;
+    len -= n;
+    __atomic_add_fetch(job->done, n, __ATOMIC_RELAXED);
+  }
+  if(len > 0) {
+    job->failed = 1;
+  }
+}
+
+int hash_range(int algo, size_t offset, size_t len, char *out, size_t out_len) {
+  worker_group group;
+  size_t done = 0;
+  size_t n_jobs = 1;
+
+  if(algo < 0 || algo >= NUMBER_HASH_ALGOS) {
+    return -1;
+  }
+
+  // crcs can be computed piecewise and combined, so split them up
+  if(algo == HASH_CRC32 || algo == HASH_CRC32C) {
+    size_t threads = worker_pool_threads();
+    n_jobs = len / HASH_MIN_CHUNK;
+    n_jobs = n_jobs < threads * 4 ? n_jobs : threads * 4;
+    n_jobs = n_jobs ? n_jobs : 1;
+  }
+
+  struct hash_job *jobs = calloc(n_jobs, sizeof(struct hash_job));
+  if(!jobs) {
+    return -1;
+  }
+
+  worker_group_init(&group);
+  doc_advise(offset, len, MADV_SEQUENTIAL);
+
+  size_t chunk = len / n_jobs;
+  for(size_t i = 0; i < n_jobs; ++i) {
+    jobs[i].algo = algo;
+    jobs[i].offset = offset + i * chunk;
+    jobs[i].len = i + 1 < n_jobs ? chunk : len - i * chunk;
+    jobs[i].group = &group;
+    jobs[i].done = &done;
+    if(worker_pool_submit(&group, hash_job_run, &jobs[i]) < 0) {
+      jobs[i].failed = 1;
+    }
+  }
+
+  int r = editor_wait_progress(&group, hash_algo_name(algo), &done, len);
+  doc_advise(offset, len, MADV_NORMAL);
+  worker_group_destroy(&group);
+
+  // a piece that wasn't hashed would give a digest of other data
+  for(size_t i = 0; i < n_jobs && r == 0; ++i) {
+    if(jobs[i].failed) {
+      r = -1;
+    }
+  }
+  if(r == 0) {
+    uint32_t crc = jobs[0].crc;
+    unsigned char digest[32];
+    switch(algo) {
+      case HASH_CRC32 :
+      case HASH_CRC32C :
+        for(size_t i = 1; i < n_jobs; ++i) {
+          crc = algo == HASH_CRC32
+                  ? crc32_combine(crc, jobs[i].crc, jobs[i].len)
+                  : crc32c_combine(crc, jobs[i].crc, jobs[i].len);
+        }
+        snprintf(out, out_len, "%08x", crc);
+        break;
+      case HASH_XXH64 :
+        snprintf(out, out_len, "%016llx", (unsigned long long)xxh64_final(&jobs[0].xxh));
+        break;
+      case HASH_SHA256 :
+        sha256_final(&jobs[0].sha, digest);
+        for(int i = 0; i < 32 && out_len > (size_t)i * 2 + 2; ++i) {
+          snprintf(out + i * 2, out_len - i * 2, "%02x", digest[i]);
+        }
+        break;
+    }
+  }
+
+  free(jobs);
+  return r;
+}
+
+int hash_cmd(int argc, char *argv[]) {
+  char digest[72], msg[160];
+  int algo = argc > 1 ? hash_algo_lookup(argv[1]) : -1;
+
+  if(algo < 0) {
+    set_status_window_text("usage: hash <crc32|crc32c|xxh64|sha256> [sel]");
+    return -1;
+  }
+
+  size_t offset = 0, len = doc_length();
+  bool sel = argc > 2 && strcmp(argv[2], "sel") == 0;
+  if(sel) {
+    editor_get_selection(&offset, &len);
+  }
+
+  if(hash_range(algo, offset, len, digest, sizeof(digest)) < 0) {
+    set_status_window_text("hash: failed or cancelled");
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "%s %s (%s, %lu bytes)", hash_algo_name(algo), digest,
+      sel ? "selection" : "file", len);
+  set_status_window_text(msg);
+  LOG_MSG("%s", msg);
+  return 0;
+}
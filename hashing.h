@@ -0,0 +1,29 @@
+#ifndef __HASHING_H__
+#define __HASHING_H__
+
+#include <stdlib.h>
+
+// streams document ranges through the checksum algorithms
+//
+// crcs are split across the worker pool and the pieces combined, the other
+// algorithms are inherently sequential and run as one background job.
+// either way the bytes are read in place from the document, never copied.
+
+enum _hash_algo {
+  HASH_CRC32 = 0,
+  HASH_CRC32C,
+  HASH_XXH64,
+  HASH_SHA256,
+  NUMBER_HASH_ALGOS
+};
+
+const char *hash_algo_name(int algo);
+int hash_algo_lookup(const char *name); // -1 if name is not an algorithm
+
+// hash a document range and write the digest in hex to out (at least 65 bytes),
+// returns < 0 if the hash was cancelled or not all of the range could be read
+int hash_range(int algo, size_t offset, size_t len, char *out, size_t out_len);
+
+int hash_cmd(int argc, char *argv[]); // ":hash <algo> [sel]"
+
+#endif // __HASHING_H__
@@ -0,0 +1,81 @@
+#include "histogram.h"
+
+#include <string.h>
+#include <stdbool.h>
+
+static size_t histogram_bucket(uint64_t value) {
+  if(value < (1 << HISTOGRAM_SUB_BITS)) {
+    return value;
+  }
+  int e = 63 - __builtin_clzll(value);
+  if(e >= HISTOGRAM_MAX_BITS) {
+    return HISTOGRAM_BUCKETS - 1;
+  }
+  size_t sub = (value >> (e - HISTOGRAM_SUB_BITS)) & ((1 << HISTOGRAM_SUB_BITS) - 1);
+  return ((size_t)(e - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+// largest value that lands in bucket i
+static uint64_t histogram_bucket_limit(size_t i) {
+  if(i < (1 << HISTOGRAM_SUB_BITS)) {
+    return i;
+  }
+  int e = (i >> HISTOGRAM_SUB_BITS) + HISTOGRAM_SUB_BITS - 1;
+  uint64_t sub = i & ((1 << HISTOGRAM_SUB_BITS) - 1);
+  uint64_t width = 1ULL << (e - HISTOGRAM_SUB_BITS);
+  return (((1ULL << HISTOGRAM_SUB_BITS) + sub) << (e - HISTOGRAM_SUB_BITS)) + width - 1;
+}
+
+void histogram_record(histogram *h, uint64_t value) {
+  __atomic_add_fetch(&h->counts[histogram_bucket(value)], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&h->n, 1, __ATOMIC_RELAXED);
+
+  uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+  while(value > max
+      && !__atomic_compare_exchange_n(&h->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+  {
+  }
+}
+
+void histogram_merge(histogram *into, const histogram *from) {
+  for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+    uint32_t n = __atomic_load_n(&from->counts[i], __ATOMIC_RELAXED);
+    if(n) {
+      __atomic_add_fetch(&into->counts[i], n, __ATOMIC_RELAXED);
+    }
+  }
+  __atomic_add_fetch(&into->n, __atomic_load_n(&from->n, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+  uint64_t value = __atomic_load_n(&from->max, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&into->max, __ATOMIC_RELAXED);
+  while(value > max
+      && !__atomic_compare_exchange_n(&into->max, &max, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+  {
+  }
+}
+
+void histogram_reset(histogram *h) {
+  memset(h, 0, sizeof(histogram));
+}
+
+uint64_t histogram_percentile(const histogram *h, double p) {
+  uint64_t n = __atomic_load_n(&h->n, __ATOMIC_RELAXED);
+  uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+  if(n == 0) {
+    return 0;
+  }
+
+  // rank of the value wanted, counting from 1
+  uint64_t rank = (uint64_t)(p * n + 0.5);
+  rank = rank < 1 ? 1 : rank > n ? n : rank;
+
+  uint64_t seen = 0;
+  for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+    seen += __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+    if(seen >= rank) {
+      uint64_t limit = histogram_bucket_limit(i);
+      return limit < max ? limit : max;
+    }
+  }
+  return max;
+}
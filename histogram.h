@@ -0,0 +1,35 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include <stdlib.h>
+#include <stdint.h>
+
+// log-linear histograms of durations, in the style of hdr histogram
+//
+// values below 16 get a bucket each.  above that every power of two is split
+// into 16 buckets, so a percentile read back is within 1/16 (6.25%) of the
+// value recorded, from nanoseconds up to about 18 minutes.  the counts are
+// updated with relaxed atomics, so recording never takes a lock and a
+// histogram can be read while another thread records into it.
+
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_MAX_BITS 40 // values of 2^40 and up land in the last bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+struct _histogram {
+  uint32_t counts[HISTOGRAM_BUCKETS];
+  uint64_t n;
+  uint64_t max;
+};
+typedef struct _histogram histogram;
+
+void histogram_record(histogram *h, uint64_t value);
+void histogram_merge(histogram *into, const histogram *from); // add the counts of from to into
+void histogram_reset(histogram *h);
+
+// the smallest value at or above the fraction p (0..1) of the recorded
+// values, rounded up to its bucket's limit but never past the max.  0 if
+// nothing was recorded
+uint64_t histogram_percentile(const histogram *h, double p);
+
+#endif // __HISTOGRAM_H__
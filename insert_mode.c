@@ -1,9 +1,11 @@
 #include "insert_mode.h"
 
 #include "editor.h"
+#include "undo.h"
 #include "logger.h"
 
 int insert_mode_enter() {
+  undo_seal();
   editor_set_focus(g_windows.mainwnd);
   return 0;
 }
@@ -26,26 +28,40 @@ int insert_mode_new_char(int c) {
     case 27 : // escape
       editor_switch_mode(MODE_COMMAND);
       break;
-    case KEY_LEFT :
-      {
-        //LOG_MSG("key left");
+    case KEY_MOUSE :
+      editor_mouse_event();
+      break;
+    case '\r' :
+    case '\n' :
+    case KEY_ENTER :
+      if(editor_insert_char_main('\n') < 0) {
+        set_status_window_text("insert: failed");
       }
       break;
-    case KEY_RIGHT :
-      {
-        //LOG_MSG("key right");
+    case KEY_BACKSPACE :
+    case 127 :
+    case 8 :
+      if(editor_backspace_main() < 0) {
+        set_status_window_text("insert: failed");
       }
       break;
+    case KEY_LEFT :
+      editor_char_left_main();
+      break;
+    case KEY_RIGHT :
+      editor_char_right_main();
+      break;
     case KEY_DOWN :
-      {
-        editor_line_down_main();
-        //LOG_MSG("Lines: first: %d, current: %d, last: %d", g_editor.screen.firstline_number, g_editor.screen.curline_number, g_editor.screen.lastline_number);
-      }
+      editor_line_down_main();
       break;
     case KEY_UP :
-      {
-        editor_line_up_main();
-        //LOG_MSG("Lines: first: %d, current: %d, last: %d", g_editor.screen.firstline_number, g_editor.screen.curline_number, g_editor.screen.lastline_number);
+      editor_line_up_main();
+      break;
+    default :
+      if((c >= 0x20 && c < 0x7f) || c == '\t') {
+        if(editor_insert_char_main((char)c) < 0) {
+          set_status_window_text("insert: failed");
+        }
       }
       break;
   }
@@ -53,5 +69,6 @@ int insert_mode_new_char(int c) {
 }
 
 int insert_mode_exit() {
+  undo_seal();
   return 0;
 }
@@ -0,0 +1,146 @@
+#include "latency.h"
+
+#include "histogram.h"
+#include "editor.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+// time from getch() returning to the mode being done with the key, and to
+// the frame being drawn
+static histogram g_latency_handled[NUMBER_MODES][NUMBER_LATENCY_KEY_CLASSES];
+static histogram g_latency_frame[NUMBER_MODES][NUMBER_LATENCY_KEY_CLASSES];
+
+// the last key recorded, for the replay report
+static uint64_t g_latency_last_handled, g_latency_last_frame;
+
+static const char *g_latency_key_class_names[NUMBER_LATENCY_KEY_CLASSES] = {
+  "print",
+  "move",
+  "edit",
+  "control",
+  "other"
+};
+
+uint64_t latency_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int latency_key_class(int c) {
+  switch(c) {
+    case KEY_UP :
+    case KEY_DOWN :
+    case KEY_LEFT :
+    case KEY_RIGHT :
+    case KEY_HOME :
+    case KEY_END :
+    case KEY_PPAGE :
+    case KEY_NPAGE :
+      return LATENCY_KEY_MOVE;
+    case '\r' :
+    case '\n' :
+    case KEY_ENTER :
+    case KEY_BACKSPACE :
+    case KEY_DC :
+    case 127 :
+    case 8 :
+      return LATENCY_KEY_EDIT;
+    case '\t' :
+      return LATENCY_KEY_PRINT;
+  }
+  if(c >= 0 && c < 256) {
+    return isprint(c) ? LATENCY_KEY_PRINT : LATENCY_KEY_CONTROL;
+  }
+  return LATENCY_KEY_OTHER;
+}
+
+void latency_key(int mode, int c, uint64_t t_key, uint64_t t_handled, uint64_t t_drawn) {
+  if(mode < 0 || mode >= NUMBER_MODES) {
+    return;
+  }
+  g_latency_last_handled = t_handled - t_key;
+  g_latency_last_frame = t_drawn - t_key;
+  int k = latency_key_class(c);
+  histogram_record(&g_latency_handled[mode][k], t_handled - t_key);
+  histogram_record(&g_latency_frame[mode][k], t_drawn - t_key);
+}
+
+void latency_last(uint64_t *handled, uint64_t *frame) {
+  *handled = g_latency_last_handled;
+  *frame = g_latency_last_frame;
+}
+
+static const char *latency_format(uint64_t ns, char *buf, size_t len) {
+  if(ns < 1000) {
+    snprintf(buf, len, "%luns", ns);
+  } else if(ns < 1000000) {
+    snprintf(buf, len, "%.1fus", ns / 1e3);
+  } else if(ns < 1000000000) {
+    snprintf(buf, len, "%.1fms", ns / 1e6);
+  } else {
+    snprintf(buf, len, "%.2fs", ns / 1e9);
+  }
+  return buf;
+}
+
+// "p50 85.0us p99 1.2ms max 3.4ms"
+static void latency_summary(const histogram *h, char *buf, size_t len) {
+  char p50[16], p99[16], max[16];
+  snprintf(buf, len, "p50 %s p99 %s max %s",
+      latency_format(histogram_percentile(h, 0.50), p50, sizeof(p50)),
+      latency_format(histogram_percentile(h, 0.99), p99, sizeof(p99)),
+      latency_format(h->max, max, sizeof(max)));
+}
+
+int latency_cmd(int argc, char *argv[]) {
+  static histogram handled, frame;
+  char msg[256], handled_msg[96], frame_msg[96];
+
+  if(argc == 2 && strcmp(argv[1], "reset") == 0) {
+    for(int m = 0; m < NUMBER_MODES; ++m) {
+      for(int k = 0; k < NUMBER_LATENCY_KEY_CLASSES; ++k) {
+        histogram_reset(&g_latency_handled[m][k]);
+        histogram_reset(&g_latency_frame[m][k]);
+      }
+    }
+    set_status_window_text("latency: reset");
+    return 0;
+  }
+  if(argc != 1) {
+    set_status_window_text("usage: latency [reset]");
+    return -1;
+  }
+
+  // the breakdown goes to the log, the totals to the status window
+  histogram_reset(&handled);
+  histogram_reset(&frame);
+  for(int m = 0; m < NUMBER_MODES; ++m) {
+    for(int k = 0; k < NUMBER_LATENCY_KEY_CLASSES; ++k) {
+      if(!g_latency_frame[m][k].n) {
+        continue;
+      }
+      latency_summary(&g_latency_handled[m][k], handled_msg, sizeof(handled_msg));
+      latency_summary(&g_latency_frame[m][k], frame_msg, sizeof(frame_msg));
+      LOG_MSG("latency %s/%s: %lu keys, handled %s, frame %s", g_modes[m].mode_name,
+          g_latency_key_class_names[k], g_latency_frame[m][k].n, handled_msg, frame_msg);
+      histogram_merge(&handled, &g_latency_handled[m][k]);
+      histogram_merge(&frame, &g_latency_frame[m][k]);
+    }
+  }
+  if(!frame.n) {
+    set_status_window_text("latency: no keys recorded");
+    return 0;
+  }
+
+  latency_summary(&handled, handled_msg, sizeof(handled_msg));
+  latency_summary(&frame, frame_msg, sizeof(frame_msg));
+  LOG_MSG("latency all: %lu keys, handled %s, frame %s", frame.n, handled_msg, frame_msg);
+  snprintf(msg, sizeof(msg), "%lu keys, key to frame %s", frame.n, frame_msg);
+  set_status_window_text(msg);
+  return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdint.h>
+
+// keystroke latency tracing
+//
+// the main loop takes a monotonic timestamp when getch() returns, after the
+// mode has handled the key, and after doupdate() has put the frame on the
+// terminal.  the time to handle the key and the time to the frame go into
+// histograms for the mode the key arrived in and the kind of key it was.
+
+// kinds of keys, they tend to cost very different amounts
+enum _latency_key_class {
+  LATENCY_KEY_PRINT = 0, // printable characters and tab
+  LATENCY_KEY_MOVE,      // arrows, home/end and page up/down
+  LATENCY_KEY_EDIT,      // enter, backspace and delete
+  LATENCY_KEY_CONTROL,   // escape and other control characters
+  LATENCY_KEY_OTHER,     // mouse, resize and function keys
+  NUMBER_LATENCY_KEY_CLASSES
+};
+
+uint64_t latency_now(); // monotonic time in nanoseconds
+
+// record a key c that arrived in mode at t_key, was handled by t_handled
+// and drawn by t_drawn
+void latency_key(int mode, int c, uint64_t t_key, uint64_t t_handled, uint64_t t_drawn);
+
+void latency_last(uint64_t *handled, uint64_t *frame); // durations of the last key recorded
+
+int latency_cmd(int argc, char *argv[]); // ":latency [reset]", p50/p99/max to the status window and the log
+
+#endif // __LATENCY_H__
@@ -0,0 +1,77 @@
+#include "line_mode.h"
+
+#include "editor.h"
+#include "commands.h"
+#include "logger.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define LINE_MODE_MAX 256
+
+static char g_line[LINE_MODE_MAX];
+static size_t g_line_len = 0;
+
+int line_mode_enter() {
+  g_line_len = 0;
+  g_line[0] = '\0';
+  editor_set_focus(g_windows.inputwnd);
+  return 0;
+}
+
+// a selection handed over by visual mode lasts for one command
+static void line_mode_leave() {
+  editor_set_selection(0, 0);
+  editor_switch_mode(MODE_COMMAND);
+}
+
+static void line_mode_redraw() {
+  set_input_window_text(":");
+  append_input_window_text(g_line);
+}
+
+int line_mode_new_char(int c) {
+  switch(c) {
+    case 27 : // escape
+      line_mode_leave();
+      break;
+    case '\r' :
+    case '\n' :
+    case KEY_ENTER :
+      {
+        char line[LINE_MODE_MAX];
+        memcpy(line, g_line, g_line_len + 1);
+
+        // switch back first so that the command's output stays in the status window
+        editor_switch_mode(MODE_COMMAND);
+        LOG_MSG("Running command: %s", line);
+        commands_run(line);
+        editor_set_selection(0, 0);
+        editor_update_cursor_main();
+      }
+      break;
+    case KEY_BACKSPACE :
+    case 127 :
+    case 8 :
+      if(g_line_len == 0) {
+        line_mode_leave();
+        break;
+      }
+      g_line[--g_line_len] = '\0';
+      line_mode_redraw();
+      break;
+    default :
+      if(c >= 0 && c < 256 && isprint(c) && g_line_len + 1 < LINE_MODE_MAX) {
+        g_line[g_line_len++] = c;
+        g_line[g_line_len] = '\0';
+        line_mode_redraw();
+      }
+      break;
+  }
+  return 0;
+}
+
+int line_mode_exit() {
+  editor_set_focus(g_windows.mainwnd);
+  return 0;
+}
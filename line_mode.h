@@ -0,0 +1,8 @@
+#ifndef __LINE_MODE_H__
+#define __LINE_MODE_H__
+
+int line_mode_enter();
+int line_mode_new_char(int c);
+int line_mode_exit();
+
+#endif // __LINE_MODE_H__
@@ -1,6 +1,7 @@
 #include "logger.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -8,13 +9,362 @@
 #include <stdarg.h>
 #include <time.h>
 #include <string.h>
+#include <pthread.h>
 
-FILE *g_logger_file = NULL;
+#define LOG_RING_RECORDS 1024 // records per thread, a power of two
+#define LOG_STRINGS 4096      // string addresses remembered as written, a power of two
+#define LOG_DRAIN_MS 100      // the drain thread's longest sleep
+
+// one thread's records.  only the thread itself moves head and only the
+// drain thread moves tail, so neither needs a lock
+struct log_ring {
+  struct log_record records[LOG_RING_RECORDS];
+  uint64_t head;    // next record to write
+  uint64_t tail;    // next record to drain
+  uint64_t dropped; // records lost to a full ring
+  uint16_t thread;
+  struct log_ring *next;
+};
+
+static struct {
+  FILE *fp;
+  int running;          // records are taken while set
+  bool stopping;        // tells the drain thread to finish
+  pthread_t thread;
+  pthread_mutex_t lock; // protects stopping and adding rings
+  pthread_cond_t wake;
+  struct log_ring *rings; // every thread's ring, kept for the life of the process
+  uint16_t n_rings;
+  uint64_t strings[LOG_STRINGS]; // format strings and file names already written
+} g_log = {
+  .fp = NULL,
+  .running = 0,
+  .stopping = false,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+  .rings = NULL,
+  .n_rings = 0
+};
+
+static __thread struct log_ring *t_log_ring;
+
+static struct log_ring *log_ring_new() {
+  struct log_ring *ring = calloc(1, sizeof(struct log_ring));
+  if(!ring) {
+    return NULL;
+  }
+  pthread_mutex_lock(&g_log.lock);
+  ring->thread = g_log.n_rings++;
+  ring->next = g_log.rings;
+  __atomic_store_n(&g_log.rings, ring, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&g_log.lock);
+  t_log_ring = ring;
+  return ring;
+}
+
+// step p past a conversion's flags, width, precision and length modifiers,
+// *longs is set if the argument is a long.  p is left on the conversion
+static const char *log_skip_spec(const char *p, bool *longs) {
+  p += strspn(p, "-+ #0123456789.");
+  *longs = false;
+  for(; *p == 'l' || *p == 'h' || *p == 'z' || *p == 'j' || *p == 't'; ++p) {
+    *longs = *longs || *p != 'h';
+  }
+  return p;
+}
+
+// the conversions log_pack() stores an argument for.  the format strings
+// log_format() reads come from a log file, anything else in them could
+// make snprintf() write through or read past its arguments
+static bool log_conversion_known(char c) {
+  return c && strchr("diuxXocpsfFeEgG", c) != NULL;
+}
+
+// copy the arguments fmt calls for into the record
+static void log_pack(const char *fmt, struct log_record *r, va_list ap) {
+  char *out = r->args, *end = r->args + LOG_RECORD_ARGS;
+
+  for(const char *p = fmt; *p; ++p) {
+    if(*p != '%') {
+      continue;
+    }
+    if(*++p == '%') {
+      continue;
+    }
+    bool longs;
+    p = log_skip_spec(p, &longs);
+
+    int64_t v;
+    double d;
+    switch(*p) {
+      case 'd' :
+      case 'i' :
+      case 'u' :
+      case 'x' :
+      case 'X' :
+      case 'o' :
+      case 'c' :
+        v = longs ? va_arg(ap, long) : va_arg(ap, int);
+        break;
+      case 'p' :
+        v = (int64_t)(intptr_t)va_arg(ap, void *);
+        break;
+      case 'f' :
+      case 'F' :
+      case 'e' :
+      case 'E' :
+      case 'g' :
+      case 'G' :
+        d = va_arg(ap, double);
+        memcpy(&v, &d, sizeof(v));
+        break;
+      case 's' :
+        {
+          const char *s = va_arg(ap, const char *);
+          s = s ? s : "(null)";
+          size_t n = strlen(s);
+          if(end - out < 3) {
+            r->truncated = 1;
+            goto done;
+          }
+          if(n > (size_t)(end - out) - 2) {
+            n = (end - out) - 2;
+            r->truncated = 1;
+          }
+          uint16_t n16 = n;
+          memcpy(out, &n16, 2);
+          memcpy(out + 2, s, n);
+          out += 2 + n;
+          if(r->truncated) {
+            goto done;
+          }
+        }
+        continue;
+      default : // not something that can be read back
+        r->truncated = 1;
+        goto done;
+    }
+    if(end - out < (long)sizeof(v)) {
+      r->truncated = 1;
+      goto done;
+    }
+    memcpy(out, &v, sizeof(v));
+    out += sizeof(v);
+  }
+
+done:
+  r->len = out - r->args;
+}
+
+void log_record_msg(int level, const char *file, int lineno, const char *fmt, ...) {
+  if(!__atomic_load_n(&g_log.running, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  struct log_ring *ring = t_log_ring ? t_log_ring : log_ring_new();
+  if(!ring) {
+    return;
+  }
+
+  uint64_t head = ring->head;
+  uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if(head - tail >= LOG_RING_RECORDS) {
+    __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  struct log_record *r = &ring->records[head & (LOG_RING_RECORDS - 1)];
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  r->time_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  r->fmt = (uintptr_t)fmt;
+  r->file = (uintptr_t)file;
+  r->line = lineno;
+  r->level = level;
+  r->thread = ring->thread;
+  r->truncated = 0;
+
+  va_list ap;
+  va_start(ap, fmt);
+  log_pack(fmt, r, ap);
+  va_end(ap);
+
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+  // the drain thread sleeps, wake it before the ring runs out of room
+  if(head + 1 - tail == LOG_RING_RECORDS / 2) {
+    pthread_cond_signal(&g_log.wake);
+  }
+}
+
+size_t log_format(const char *fmt, const struct log_record *r, char *out, size_t len) {
+  const char *args = r->args, *args_end = r->args + r->len;
+  size_t n = 0;
+
+#define LOG_OUT(...) \
+  do { \
+    int k = snprintf(out + n, n < len ? len - n : 0, __VA_ARGS__); \
+    n += k > 0 ? k : 0; \
+  } while(0)
+
+  for(const char *p = fmt; *p; ++p) {
+    if(*p != '%') {
+      LOG_OUT("%c", *p);
+      continue;
+    }
+    if(p[1] == '%') {
+      LOG_OUT("%%");
+      ++p;
+      continue;
+    }
+
+    bool longs;
+    const char *conv = log_skip_spec(p + 1, &longs);
+    char spec[32];
+    size_t spec_len = conv - p + 1;
+    if(!log_conversion_known(*conv) || spec_len >= sizeof(spec)) {
+      break;
+    }
+    memcpy(spec, p, spec_len);
+    spec[spec_len] = '\0';
+    p = conv;
+
+    if(*conv == 's') {
+      uint16_t k;
+      char s[LOG_RECORD_ARGS];
+      if(args_end - args < 2) {
+        break;
+      }
+      memcpy(&k, args, 2);
+      if(k > args_end - args - 2) {
+        break;
+      }
+      memcpy(s, args + 2, k);
+      s[k] = '\0';
+      args += 2 + k;
+      LOG_OUT(spec, s);
+      continue;
+    }
+
+    int64_t v;
+    if(args_end - args < (long)sizeof(v)) {
+      break;
+    }
+    memcpy(&v, args, sizeof(v));
+    args += sizeof(v);
+
+    switch(*conv) {
+      case 'p' :
+        LOG_OUT(spec, (void *)(intptr_t)v);
+        break;
+      case 'f' :
+      case 'F' :
+      case 'e' :
+      case 'E' :
+      case 'g' :
+      case 'G' :
+        {
+          double d;
+          memcpy(&d, &v, sizeof(d));
+          LOG_OUT(spec, d);
+        }
+        break;
+      default :
+        if(longs) {
+          LOG_OUT(spec, (long)v);
+        } else {
+          LOG_OUT(spec, (int)v);
+        }
+        break;
+    }
+  }
+  if(r->truncated) {
+    LOG_OUT("...");
+  }
+
+#undef LOG_OUT
+  return n;
+}
+
+// write a string the first time its address comes up
+static void log_write_string(uint64_t addr) {
+  if(!addr) {
+    return;
+  }
+  size_t i = (addr * 0x9e3779b97f4a7c15ULL) >> 52 & (LOG_STRINGS - 1);
+  for(int probe = 0; probe < 8; ++probe, i = (i + 1) & (LOG_STRINGS - 1)) {
+    if(g_log.strings[i] == addr) {
+      return;
+    }
+    if(!g_log.strings[i]) {
+      g_log.strings[i] = addr;
+      break;
+    }
+  }
+
+  // a full table just means some strings are written more than once
+  const char *s = (const char *)(uintptr_t)addr;
+  uint32_t tag = LOG_TAG_STRING, len = strlen(s);
+  fwrite(&tag, sizeof(tag), 1, g_log.fp);
+  fwrite(&addr, sizeof(addr), 1, g_log.fp);
+  fwrite(&len, sizeof(len), 1, g_log.fp);
+  fwrite(s, 1, len, g_log.fp);
+}
+
+static void log_drain() {
+  bool wrote = false;
+  for(struct log_ring *ring = __atomic_load_n(&g_log.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    for(uint64_t i = ring->tail; i < head; ++i) {
+      const struct log_record *r = &ring->records[i & (LOG_RING_RECORDS - 1)];
+      uint32_t tag = LOG_TAG_RECORD;
+      log_write_string(r->fmt);
+      log_write_string(r->file);
+      fwrite(&tag, sizeof(tag), 1, g_log.fp);
+      fwrite(r, sizeof(struct log_record), 1, g_log.fp);
+      wrote = true;
+    }
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+    if(dropped) {
+      uint32_t tag = LOG_TAG_DROPPED;
+      fwrite(&tag, sizeof(tag), 1, g_log.fp);
+      fwrite(&dropped, sizeof(dropped), 1, g_log.fp);
+      wrote = true;
+    }
+  }
+  if(wrote) {
+    fflush(g_log.fp);
+  }
+}
+
+static void *log_main(void *arg) {
+  pthread_mutex_lock(&g_log.lock);
+  while(!g_log.stopping) {
+    pthread_mutex_unlock(&g_log.lock);
+    log_drain();
+    pthread_mutex_lock(&g_log.lock);
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += LOG_DRAIN_MS * 1000000L;
+    ts.tv_sec += ts.tv_nsec / 1000000000L;
+    ts.tv_nsec %= 1000000000L;
+    if(!g_log.stopping) {
+      pthread_cond_timedwait(&g_log.wake, &g_log.lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&g_log.lock);
+
+  // what was logged while stopping
+  log_drain();
+  return NULL;
+}
 
 bool setup_logger(const char *filename) {
   int fd = -1;
   struct stat s;
-  if(!filename) {
+  if(!filename || g_log.fp) {
     return false;
   }
 
@@ -36,43 +386,43 @@ bool setup_logger(const char *filename) {
     return false;
   }
 
-  g_logger_file = fdopen(fd, "a");
-  if(!g_logger_file) {
+  g_log.fp = fdopen(fd, "a");
+  if(!g_log.fp) {
     close(fd);
     return false;
   }
 
-  return true;
-}
+  // each session starts with the magic, the addresses of its strings are its own
+  fwrite(LOG_MAGIC, 1, sizeof(LOG_MAGIC), g_log.fp);
+  memset(g_log.strings, 0, sizeof(g_log.strings));
 
-void log_msg_lineinfo(const char *fmt, const char *file, int lineno, ...) {
-  va_list v;
-  time_t t;
-  char buf[32]; // buffer for time string
-
-  if(!g_logger_file) {
-    return;
-  }
-
-  time(&t);
-  if(ctime_r(&t, buf)) {
-    char *newline = strchr(buf, '\n');
-    // get rid of the annoying newline from ctime()
-    if(newline) {
-      *newline = '\0';
-    }
+  // drop anything a ring holds from before
+  for(struct log_ring *ring = g_log.rings; ring; ring = ring->next) {
+    ring->tail = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
   }
 
-  fprintf(g_logger_file, "%s: %s %d: ", buf, file, lineno);
-  va_start(v, lineno);
-  vfprintf(g_logger_file, fmt, v);
-  if(fmt && !strchr(fmt, '\n')) {
-    fputc('\n', g_logger_file);
+  g_log.stopping = false;
+  if(pthread_create(&g_log.thread, NULL, log_main, NULL) != 0) {
+    fclose(g_log.fp);
+    g_log.fp = NULL;
+    return false;
   }
+  __atomic_store_n(&g_log.running, 1, __ATOMIC_RELEASE);
+  return true;
 }
 
 void cleanup_logger() {
-  if(g_logger_file) {
-    fclose(g_logger_file);
+  if(!g_log.fp) {
+    return;
   }
+  __atomic_store_n(&g_log.running, 0, __ATOMIC_RELEASE);
+
+  pthread_mutex_lock(&g_log.lock);
+  g_log.stopping = true;
+  pthread_cond_signal(&g_log.wake);
+  pthread_mutex_unlock(&g_log.lock);
+  pthread_join(g_log.thread, NULL);
+
+  fclose(g_log.fp);
+  g_log.fp = NULL;
 }
@@ -2,15 +2,96 @@
 #define __LOGGER_H__
 
 #include <stdio.h>
+#include <stdint.h>
 #include <stdbool.h>
 
-extern FILE *g_logger_file;
+// logger:
+//
+// LOG_MSG and friends don't format anything.  the caller's thread copies the
+// time, the format string's address and the arguments into a fixed size
+// record in its own ring buffer, and a background thread drains the rings
+// into the log file.  a full ring drops the record (and counts it) rather
+// than wait for the disk.
+//
+// the log file is binary: each format string and file name is written once,
+// the records refer to them by address.  tools/logdecode turns it into text.
+//
+// only %d %i %u %x %X %o %c %p %s %f %e %g are understood, with the usual
+// flags, width, precision and h/l/ll/z length modifiers.  strings are copied
+// into the record and cut short if the record fills up.
+//
+// levels below LOG_MIN_LEVEL are compiled out, arguments and all.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_MIN_LEVEL
+#ifdef DEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define LOG_RECORD_ARGS 216 // bytes of arguments a record holds, records are 256 bytes
+#define LOG_MAGIC "HXLOG1\n"
+
+// a record as it sits in a ring and in the log file
+struct log_record {
+  uint64_t time_ns; // realtime clock
+  uint64_t fmt;     // addresses of the format string and the file name
+  uint64_t file;
+  uint32_t line;
+  uint16_t level;
+  uint16_t thread;  // small number given to each thread that logs
+  uint16_t len;     // bytes of args used
+  uint16_t truncated;
+  uint32_t pad;
+  char args[LOG_RECORD_ARGS];
+};
+
+// what follows a uint32 tag in the log file
+enum _log_tags {
+  LOG_TAG_STRING = 1, // uint64 address, uint32 length, then the bytes
+  LOG_TAG_RECORD,     // a struct log_record
+  LOG_TAG_DROPPED     // uint64 number of records dropped since the last one
+};
 
 bool setup_logger(const char *filename);
 
-void log_msg_lineinfo(const char *fmt, const char *file, int lineno, ...);
-#define LOG_MSG(fmt, ...) log_msg_lineinfo(fmt, __FILE__, __LINE__, ## __VA_ARGS__)
+void log_record_msg(int level, const char *file, int lineno, const char *fmt, ...);
+
+// format a record's message from its format string, returns its length
+size_t log_format(const char *fmt, const struct log_record *r, char *out, size_t len);
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...) log_record_msg(LOG_LEVEL_DEBUG, __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+#else
+#define LOG_DEBUG(fmt, ...) do { } while(0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...) log_record_msg(LOG_LEVEL_INFO, __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+#else
+#define LOG_INFO(fmt, ...) do { } while(0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...) log_record_msg(LOG_LEVEL_WARN, __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+#else
+#define LOG_WARN(fmt, ...) do { } while(0)
+#endif
+
+#if LOG_MIN_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...) log_record_msg(LOG_LEVEL_ERROR, __FILE__, __LINE__, fmt, ## __VA_ARGS__)
+#else
+#define LOG_ERROR(fmt, ...) do { } while(0)
+#endif
+
+#define LOG_MSG LOG_INFO
 
-void cleanup_logger();
+void cleanup_logger(); // drains what's left and closes the file
 
 #endif // __LOGGER_H__
@@ -4,6 +4,8 @@
 #include <ctype.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -13,49 +15,166 @@
 #include "main.h"
 #include "editor.h"
 #include "logger.h"
+#include "worker_pool.h"
+#include "overview.h"
+#include "strings_panel.h"
+#include "undo.h"
+#include "wal.h"
+#include "latency.h"
+#include "memstat.h"
+#include "replay.h"
+#include "batch.h"
+#include "follow.h"
 
 const char *g_progname;
 
 // prototypes
 
 void usage();
+bool ask(const char *question);
+int main_key(int c, uint64_t t_key);
 
 int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    { "replay", required_argument, NULL, 'r' },
+    { "report", required_argument, NULL, 'o' },
+    { "record", required_argument, NULL, 'R' },
+    { "dump", no_argument, NULL, 'd' },
+    { "search", required_argument, NULL, 's' },
+    { "patch", required_argument, NULL, 'p' },
+    { "follow", no_argument, NULL, 'f' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  const char *replay = NULL, *report = NULL, *record = NULL, *batch_arg = NULL;
+  int opt, ret = 0, batch = BATCH_NONE, n_batch = 0;
+  bool follow = false;
+  char error[PATH_MAX + 32] = ""; // printed once the terminal is restored
+
   g_progname = argv[0];
 
-  if(argc < 2) {
+  while((opt = getopt_long(argc, argv, "h", options, NULL)) != -1) {
+    switch(opt) {
+      case 'r' :
+        replay = optarg;
+        break;
+      case 'o' :
+        report = optarg;
+        break;
+      case 'R' :
+        record = optarg;
+        break;
+      case 'd' :
+        batch = BATCH_DUMP;
+        ++n_batch;
+        break;
+      case 's' :
+        batch = BATCH_SEARCH;
+        batch_arg = optarg;
+        ++n_batch;
+        break;
+      case 'p' :
+        batch = BATCH_PATCH;
+        batch_arg = optarg;
+        ++n_batch;
+        break;
+      case 'f' :
+        follow = true;
+        break;
+      default :
+        usage();
+        return -1;
+    }
+  }
+
+  if(optind != argc - 1 || (report && !replay) || (replay && record)
+      || n_batch > 1 || (n_batch && (replay || record)))
+  {
     usage();
     return -1;
   }
+  const char *filename = argv[optind];
 
-  if(!setup_logger("log.txt")) {
+  FILE *report_fp = stdout;
+  if(report && !(report_fp = fopen(report, "w"))) {
+    perror(report);
+    return -1;
+  }
+
+  if(!setup_logger("log.bin")) {
     fprintf(stderr, "Could not set up logging facilities\n");
   }
 
-  if(!setup_curses()) {
+  if(!setup_worker_pool(0)) {
+    fprintf(stderr, "Could not start worker threads, running single threaded\n");
+  }
+
+  // the batch modes use the document, search and save without a screen
+  if(batch != BATCH_NONE) {
+    ret = batch_run(batch, batch_arg, filename);
+    goto cleanup_logger;
+  }
+
+  // before any line is loaded, so that every gap buffer is counted
+  if(!setup_memstat()) {
+    fprintf(stderr, "Could not set up memory accounting\n");
+  }
+
+  // a replay has no terminal, the screen is drawn to /dev/null
+  if(!(replay ? setup_curses_headless() : setup_curses())) {
     fprintf(stderr, "Could not set up terminal\n");
-    return -1;
+    ret = -1;
+    goto cleanup_logger;
   }
 
   if(!setup_windows()) {
-    cleanup_curses();
-    fprintf(stderr, "Could not set up terminal windows\n");
-    return -1;
+    snprintf(error, sizeof(error), "Could not set up terminal windows");
+    ret = -1;
+    goto cleanup_curses;
   }
 
-  if(!open_file(argv[1])) {
-    cleanup_windows();
-    cleanup_curses();
-    fprintf(stderr, "Could not set up terminal windows\n");
-    return -1;
+  if(!open_file(filename)) {
+    snprintf(error, sizeof(error), "Could not open %s", filename);
+    ret = -1;
+    goto cleanup_windows;
   }
   
+  // edits journaled by a session that didn't end cleanly, left alone by a
+  // replay which can't be asked and mustn't touch the journal
+  int n_journaled = replay ? 0 : wal_found();
+  if(n_journaled > 0) {
+    char question[256];
+    snprintf(question, sizeof(question), "%s has %d unsaved changes from a session that crashed, recover them? (y/n)",
+        filename, n_journaled);
+    if(ask(question)) {
+      if(wal_replay() < 0) {
+        LOG_MSG("Could not replay the journal");
+      }
+    } else {
+      wal_discard();
+    }
+  }
+
   if(!setup_editor()) {
-    cleanup_file();
-    cleanup_windows();
-    cleanup_curses();
-    fprintf(stderr, "Could not set up the editor\n");
-    return -1;
+    snprintf(error, sizeof(error), "Could not set up the editor");
+    ret = -1;
+    goto cleanup_file;
+  }
+
+  if(!setup_overview()) {
+    LOG_MSG("Could not set up the overview panel");
+  }
+  if(!setup_strings()) {
+    LOG_MSG("Could not set up the strings panel");
+  }
+  if(!setup_undo()) {
+    LOG_MSG("Could not set up undo");
+  }
+  if(!replay && !setup_wal()) {
+    LOG_MSG("Could not set up the edit journal");
+  }
+  if(record && !replay_record_open(record)) {
+    LOG_MSG("Could not open %s to record keys in", record);
   }
 
   g_editor.mode = MODE_COMMAND - 1;
@@ -78,27 +197,35 @@ int main(int argc, char *argv[]) {
 
   editor_refresh_windows();
 
-  while(1) { // command loop
-    bool exit_loop = false;
-    int c = getch(), r = 0;
-
-    if(c == KEY_RESIZE) { // resize event
-      if(editor_resize_event() < 0) {
-        fprintf(stderr, "Error during window resize\n");
-        break;
-      }
-    }
+  if(follow && !follow_start()) {
+    set_status_window_text("follow: only regular files can be followed");
+  }
 
-    r = g_modes[g_editor.mode].new_char(c);
+  if(replay) {
+    ret = replay_run(replay, report_fp, main_key) < 0 ? -1 : 0;
+    goto cleanup_all;
+  }
 
-    editor_refresh_windows();
+  while(1) { // command loop
+    // poll while background work is running so its results get drawn, and
+    // wake up for the memory log when idle
+    timeout(editor_busy() || wal_pending() || follow_active() ? 50 : memstat_tick_timeout());
+    int c = getch();
+    uint64_t t_key = latency_now();
 
-    if(r < 0) {
+    replay_record_key(c);
+    if(main_key(c, t_key) < 0) {
       break;
     }
   }
 
 cleanup_all:
+  replay_record_close();
+  cleanup_follow();
+  cleanup_wal();
+  cleanup_undo();
+  cleanup_strings();
+  cleanup_overview();
   cleanup_editor();
 cleanup_file:
   cleanup_file();
@@ -106,20 +233,86 @@ cleanup_windows:
   cleanup_windows();
 cleanup_curses:
   cleanup_curses();
+  // once the terminal is back to normal, so that it stays on the screen
+  if(error[0]) {
+    fprintf(stderr, "%s\n", error);
+  }
 cleanup_logger:
+  cleanup_worker_pool();
   cleanup_logger();
-  return 0;
+  if(report_fp != stdout) {
+    fclose(report_fp);
+  }
+  return ret;
+}
+
+// everything the command loop does with a key from getch(), ERR when it
+// timed out.  t_key is when the key arrived.  replays come through here too
+int main_key(int c, uint64_t t_key) {
+  if(c == ERR) {
+    editor_idle();
+    wal_idle();
+    follow_idle();
+    memstat_tick();
+    editor_refresh_windows();
+    return 0;
+  }
+
+  if(c == KEY_RESIZE) { // resize event
+    if(editor_resize_event() < 0) {
+      fprintf(stderr, "Error during window resize\n");
+      return -1;
+    }
+  }
+
+  int mode = g_editor.mode;
+  int r = g_modes[g_editor.mode].new_char(c);
+  uint64_t t_handled = latency_now();
+
+  editor_refresh_windows();
+  latency_key(mode, c, t_key, t_handled, latency_now());
+  memstat_tick();
+
+  return r;
 }
 
 void usage() {
   fprintf(
     stderr, 
-    "Usage: %s <file>\n"
-      "  <file> the file you wish to view/edit\n\n"
+    "Usage: %s [options] <file>\n"
+      "  <file> the file you wish to view/edit, a block device, a gzip file (read only), or - for stdin\n"
+      "  --follow           show what is appended to the file as it grows, like tail -f\n"
+      "  --record <script>  write the keys typed to a script\n"
+      "  --replay <script>  feed the keys of a script to the editor without a terminal,\n"
+      "                     with the time each one took and the final state as JSON lines\n"
+      "  --report <file>    write those to a file instead of stdout\n"
+      "  --dump             print a hex dump in xxd's format and exit\n"
+      "  --search <bytes>   print the offset of each match and exit, with the escapes of :s\n"
+      "  --patch <file>     apply \"<hex offset>: <hex bytes>\" lines (xxd's format), save and exit\n\n"
       "Press 'q' in command mode to quit.\n"
       "Press 'i' in command mode to go to insert mode\n"
+      "Press ':' in command mode to enter a command (e.g. :overview)\n"
       "Press Esc in insert mode to go to command mode\n",
     g_progname
   );
 }
 
+
+// yes/no question in the status window, before the editor is up
+bool ask(const char *question) {
+  set_status_window_text(question);
+  wrefresh(g_windows.statuswnd);
+  for(;;) {
+    switch(wgetch(g_windows.statuswnd)) {
+      case 'y' :
+      case 'Y' :
+        clear_status_window();
+        return true;
+      case 'n' :
+      case 'N' :
+      case 27 :
+        clear_status_window();
+        return false;
+    }
+  }
+}
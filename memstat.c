@@ -0,0 +1,228 @@
+#include "memstat.h"
+
+#include "editor.h"
+#include "document.h"
+#include "undo.h"
+#include "clipboard.h"
+#include "logger.h"
+#include "commands.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include <sys/mman.h>
+
+static struct {
+  size_t buffers;
+  size_t requested;
+  size_t usable;
+  time_t last_log;
+} g_memstat = {
+  .buffers = 0,
+  .requested = 0,
+  .usable = 0,
+  .last_log = 0
+};
+
+static void *memstat_alloc(size_t len, void *ctx) {
+  (void)ctx;
+  void *p = malloc(len);
+  if(p) {
+    __atomic_add_fetch(&g_memstat.buffers, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_memstat.requested, len, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_memstat.usable, malloc_usable_size(p), __ATOMIC_RELAXED);
+  }
+  return p;
+}
+
+static void *memstat_realloc(void *p, size_t old_len, size_t new_len, void *ctx) {
+  (void)ctx;
+  size_t old_usable = malloc_usable_size(p);
+  void *q = realloc(p, new_len);
+  if(q) {
+    __atomic_add_fetch(&g_memstat.requested, new_len - old_len, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&g_memstat.usable, malloc_usable_size(q) - old_usable, __ATOMIC_RELAXED);
+  }
+  return q;
+}
+
+static void memstat_free(void *p, size_t len, void *ctx) {
+  (void)ctx;
+  __atomic_sub_fetch(&g_memstat.buffers, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&g_memstat.requested, len, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&g_memstat.usable, malloc_usable_size(p), __ATOMIC_RELAXED);
+  free(p);
+}
+
+static const gap_buffer_allocator g_memstat_allocator = {
+  memstat_alloc,
+  memstat_realloc,
+  memstat_free,
+  NULL
+};
+
+bool setup_memstat() {
+  gap_buffer_set_allocator(&g_memstat_allocator);
+  g_memstat.last_log = time(NULL);
+  return true;
+}
+
+// bytes of a file's map that are in memory, for gzip data what is decompressed
+static size_t memstat_resident(const file_info *f) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t cached;
+  if(f->gz) {
+    gzip_memory(f->gz, &cached);
+    return cached;
+  }
+  if(!f->mm || f->mm_len <= 0) {
+    return 0;
+  }
+  size_t pages = (f->mm_len + page - 1) / page;
+  unsigned char *vec = malloc(pages);
+  if(!vec) {
+    return 0;
+  }
+  size_t n = 0;
+  if(mincore(f->mm, f->mm_len, vec) == 0) {
+    for(size_t i = 0; i < pages; ++i) {
+      n += vec[i] & 1;
+    }
+  }
+  free(vec);
+  return n * page;
+}
+
+static size_t memstat_rss() {
+  long pages = 0, rss = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if(!f) {
+    return 0;
+  }
+  if(fscanf(f, "%ld %ld", &pages, &rss) != 2) {
+    rss = 0;
+  }
+  fclose(f);
+  return rss * sysconf(_SC_PAGESIZE);
+}
+
+void memstat_collect(memstat *m) {
+  memset(m, 0, sizeof(memstat));
+
+  m->gb_buffers = __atomic_load_n(&g_memstat.buffers, __ATOMIC_RELAXED);
+  m->gb_requested = __atomic_load_n(&g_memstat.requested, __ATOMIC_RELAXED);
+  m->gb_usable = __atomic_load_n(&g_memstat.usable, __ATOMIC_RELAXED);
+
+  for(struct editor_line *el = g_editor.data.lines; el; el = el->next) {
+    ++m->lines;
+    m->line_nodes += malloc_usable_size(el);
+    if(el->gb) {
+      ++m->lines_loaded;
+      m->lines_dirty += (el->flags & EDITOR_LINE_DIRTY) != 0;
+      m->line_text += el->gb->len;
+      m->line_slack += el->gb->maxlen - el->gb->len;
+      m->line_nodes += malloc_usable_size(el->gb);
+    }
+  }
+
+  m->line_cache = editor_line_memory(&m->line_limit);
+
+  m->file_mapped = (g_curfile.mm ? g_curfile.mm_len : 0) + (g_cmpfile.mm ? g_cmpfile.mm_len : 0);
+  size_t cached;
+  m->file_index = (g_curfile.gz ? gzip_memory(g_curfile.gz, &cached) - cached : 0)
+      + (g_cmpfile.gz ? gzip_memory(g_cmpfile.gz, &cached) - cached : 0);
+  m->file_resident = memstat_resident(&g_curfile) + memstat_resident(&g_cmpfile);
+
+  m->doc = doc_memory(&m->doc_add);
+  m->undo = undo_memory(&m->undo_spilled);
+  m->clip = clip_memory();
+
+  struct mallinfo2 mi = mallinfo2();
+  m->heap_used = mi.uordblks + mi.hblkhd;
+  m->heap_free = mi.fordblks;
+  m->rss = memstat_rss();
+}
+
+// "12.3M" and the like
+static const char *memstat_size(size_t n, char *buf, size_t len) {
+  if(n < 1024) {
+    snprintf(buf, len, "%lu", n);
+  } else if(n < (1UL << 20)) {
+    snprintf(buf, len, "%.1fK", n / 1024.0);
+  } else if(n < (1UL << 30)) {
+    snprintf(buf, len, "%.1fM", n / (double)(1UL << 20));
+  } else {
+    snprintf(buf, len, "%.2fG", n / (double)(1UL << 30));
+  }
+  return buf;
+}
+
+static void memstat_log_stats(const memstat *m) {
+  LOG_MSG("mem: %lu gap buffers, %lu bytes asked for, %lu allocated", m->gb_buffers, m->gb_requested, m->gb_usable);
+  LOG_MSG("mem: %lu lines, %lu bytes of text, %lu of slack, %lu in line structs",
+      m->lines, m->line_text, m->line_slack, m->line_nodes);
+  LOG_MSG("mem: %lu lines loaded, %lu of them dirty, %lu bytes of clean lines, limit %lu",
+      m->lines_loaded, m->lines_dirty, m->line_cache, m->line_limit);
+  LOG_MSG("mem: file %lu bytes mapped, %lu resident, %lu in gzip checkpoints", m->file_mapped, m->file_resident, m->file_index);
+  LOG_MSG("mem: document %lu (add buffer %lu used), undo %lu (%lu spilled), clipboard %lu",
+      m->doc, m->doc_add, m->undo, m->undo_spilled, m->clip);
+  LOG_MSG("mem: heap %lu used, %lu free, rss %lu", m->heap_used, m->heap_free, m->rss);
+}
+
+void memstat_log() {
+  memstat m;
+  memstat_collect(&m);
+  memstat_log_stats(&m);
+  g_memstat.last_log = time(NULL);
+}
+
+void memstat_tick() {
+  if(time(NULL) - g_memstat.last_log >= MEMSTAT_INTERVAL) {
+    memstat_log();
+  }
+}
+
+int memstat_tick_timeout() {
+  long left = g_memstat.last_log + MEMSTAT_INTERVAL - time(NULL);
+  return left > 0 ? left * 1000 : 0;
+}
+
+int mem_cmd(int argc, char *argv[]) {
+  char msg[256], a[16], b[16], c[16], d[16], e[16], f[16], g[16], h[16];
+  memstat m;
+  size_t limit;
+
+  if(argc > 1 && strcmp(argv[1], "limit") == 0) {
+    if(argc > 3 || (argc == 3 && !commands_parse_size(argv[2], &limit))) {
+      set_status_window_text("usage: mem limit <bytes>[k|m|g]");
+      return -1;
+    }
+    if(argc == 3) {
+      editor_set_line_memory(limit);
+    }
+    memstat_collect(&m);
+    snprintf(msg, sizeof(msg), "mem: %lu of %lu lines loaded, %lu dirty, clean %s of limit %s",
+        m.lines_loaded, m.lines, m.lines_dirty, memstat_size(m.line_cache, a, sizeof(a)),
+        memstat_size(m.line_limit, b, sizeof(b)));
+    set_status_window_text(msg);
+    return 0;
+  }
+  if(argc != 1) {
+    set_status_window_text("usage: mem [limit <bytes>]");
+    return -1;
+  }
+  memstat_collect(&m);
+  memstat_log_stats(&m);
+  g_memstat.last_log = time(NULL);
+
+  // the line count and exact numbers are in the log
+  snprintf(msg, sizeof(msg), "text %s slack %s lines %s file %s doc %s undo %s heap %s rss %s",
+      memstat_size(m.line_text, a, sizeof(a)), memstat_size(m.line_slack, b, sizeof(b)),
+      memstat_size(m.line_nodes, c, sizeof(c)), memstat_size(m.file_resident, d, sizeof(d)),
+      memstat_size(m.doc + m.clip, e, sizeof(e)), memstat_size(m.undo, f, sizeof(f)),
+      memstat_size(m.heap_used, g, sizeof(g)), memstat_size(m.rss, h, sizeof(h)));
+  set_status_window_text(msg);
+  return 0;
+}
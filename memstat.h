@@ -0,0 +1,61 @@
+#ifndef __MEMSTAT_H__
+#define __MEMSTAT_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// memory accounting
+//
+// the gap buffers get their storage through counting allocator hooks, so
+// what they hold is known at any time.  the rest is collected on demand:
+// the lines are walked for their text and slack, the file maps are checked
+// with mincore(), and the document, undo and clipboard report their own
+// allocations.  sizes are what malloc really set aside (malloc_usable_size)
+// where the pointer is at hand, and the heap totals come from mallinfo2().
+
+#define MEMSTAT_INTERVAL 60 // seconds between dumps to the log
+
+struct _memstat {
+  // gap buffer storage, from the allocator hooks
+  size_t gb_buffers;
+  size_t gb_requested;    // sum of maxlen
+  size_t gb_usable;       // what malloc handed out for it
+
+  // from walking the lines
+  size_t lines;
+  size_t line_text;       // sum of len
+  size_t line_slack;      // sum of maxlen - len
+  size_t line_nodes;      // the editor_line and gap_buffer structs, usable size
+  size_t lines_loaded;    // lines with a gap buffer
+  size_t lines_dirty;     // of those, typed into, the limit doesn't evict them
+  size_t line_cache;      // clean loaded lines, counted against the line memory limit
+  size_t line_limit;
+
+  // the open files
+  size_t file_mapped;
+  size_t file_resident;   // or decompressed, for gzip data
+  size_t file_index;      // gzip checkpoints
+
+  size_t doc;             // pieces, add buffer and patches
+  size_t doc_add;         // bytes of the add buffer in use
+  size_t undo;            // entries and copies
+  size_t undo_spilled;    // in the spill file, not in memory
+  size_t clip;
+
+  // the whole process
+  size_t heap_used;       // malloc'd, including blocks mmapped by malloc
+  size_t heap_free;       // held by malloc but not in use
+  size_t rss;
+};
+typedef struct _memstat memstat;
+
+bool setup_memstat(); // installs the gap buffer hooks, before any line is loaded
+
+void memstat_collect(memstat *m);
+void memstat_log(); // write the numbers to the log
+void memstat_tick(); // called from the main loop, logs every MEMSTAT_INTERVAL seconds
+int memstat_tick_timeout(); // ms until memstat_tick() logs again, for the main loop's getch() timeout
+
+int mem_cmd(int argc, char *argv[]); // ":mem [limit <bytes>]", summary to the status window, details to the log
+
+#endif // __MEMSTAT_H__
@@ -0,0 +1,463 @@
+#include "overview.h"
+
+#include "byte_stats.h"
+#include "document.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define OVERVIEW_WIDTH 20
+#define OVERVIEW_BLOCK_SIZE 4096
+#define OVERVIEW_MAX_BLOCKS (1UL << 22) // block size grows past this many blocks
+#define OVERVIEW_JOB_BLOCKS 256         // blocks handled by one worker job
+#define OVERVIEW_SEL_CHUNK (1UL << 20)  // selection bytes handled by one worker job
+#define OVERVIEW_HIST_X 3               // column the histogram starts at
+
+// each block is packed into one word so a worker can publish its result with
+// a single compare and swap:
+//
+//   bits 0-7:   entropy scaled so that 8 bits/byte == 255
+//   bits 8-15:  byte class
+//   bits 16-31: sequence number, odd when the stats are valid
+//
+// invalidating a block bumps the sequence to the next even number, so a
+// worker that read the old bytes fails its swap and leaves the block stale.
+#define BLOCK_ENTROPY(w) ((w) & 0xff)
+#define BLOCK_CLASS(w) (((w) >> 8) & 0xff)
+#define BLOCK_SEQ(w) ((w) >> 16)
+#define BLOCK_VALID(w) (BLOCK_SEQ(w) & 1)
+
+static const char g_entropy_glyphs[] = " .:-=+*#%@";
+static const char g_class_glyphs[NUMBER_BYTE_CLASSES] = { '0', 'f', 't', 'b', 'r' };
+
+static void overview_redraw(WINDOW *wnd);
+static void overview_click(int y, int x);
+static bool overview_idle();
+static bool overview_busy();
+
+const panel_ops g_overview_panel = {
+  "overview",
+  OVERVIEW_WIDTH,
+  overview_redraw,
+  overview_click,
+  overview_idle,
+  overview_busy
+};
+
+static struct {
+  bool initialized;
+  size_t doc_len;
+  size_t block_size;
+  size_t n_blocks;
+  uint32_t *blocks;
+  worker_group group;      // block statistics jobs
+  worker_group sel_group;  // selection histogram jobs
+  unsigned long completed; // block jobs finished, bumped by the workers
+  unsigned long drawn;     // value of completed at the last redraw
+
+  // histogram of the selection
+  bool sel_valid;
+  size_t sel_offset;
+  size_t sel_len;
+  uint64_t sel_hist[256];
+  double sel_entropy;
+} g_ov = {
+  .initialized = false,
+  .blocks = NULL,
+  .sel_valid = false
+};
+
+struct overview_sel_job {
+  size_t offset;
+  size_t len;
+  uint64_t hist[256];
+};
+
+// histogram of a document range, reading it a contiguous piece at a time
+static void overview_range_histogram(size_t offset, size_t len, uint64_t hist[256]) {
+  while(len > 0) {
+    size_t n = len;
+    const char *p = doc_view(offset, &n);
+    if(!p || n == 0) {
+      break;
+    }
+    byte_stats_histogram((const unsigned char *)p, n, hist);
+    offset += n;
+    len -= n;
+  }
+}
+
+// stats of block b, the last block is as long as what is left of the document
+static uint32_t overview_block_stats(size_t b) {
+  uint64_t hist[256];
+  size_t offset = b * g_ov.block_size, end = doc_length();
+  size_t len = offset < end ? (end - offset < g_ov.block_size ? end - offset : g_ov.block_size) : 0;
+  size_t n = len;
+  const unsigned char *p = (const unsigned char *)doc_view(offset, &n);
+
+  // zero and fill blocks are common in images, skip counting them
+  if(p && n == len && byte_stats_uniform(p, n)) {
+    return (p[0] ? BYTE_CLASS_FILL : BYTE_CLASS_ZERO) << 8;
+  }
+
+  memset(hist, 0, sizeof(hist));
+  overview_range_histogram(offset, len, hist);
+  double e = byte_stats_entropy(hist, len);
+  int klass = byte_stats_class(hist, len, e);
+  int scaled = (int)(e * 255.0 / 8.0 + 0.5);
+  scaled = scaled > 255 ? 255 : scaled;
+  return (klass << 8) | scaled;
+}
+
+static void overview_block_job(void *arg) {
+  size_t first = (size_t)arg * OVERVIEW_JOB_BLOCKS;
+  size_t last = first + OVERVIEW_JOB_BLOCKS;
+  last = last < g_ov.n_blocks ? last : g_ov.n_blocks;
+
+  for(size_t b = first; b < last; ++b) {
+    if(worker_group_cancelled(&g_ov.group)) {
+      break;
+    }
+    uint32_t w = __atomic_load_n(&g_ov.blocks[b], __ATOMIC_ACQUIRE);
+    if(BLOCK_VALID(w)) {
+      continue;
+    }
+    doc_read_lock();
+    uint32_t stats = overview_block_stats(b);
+    doc_read_unlock();
+    uint32_t nw = ((BLOCK_SEQ(w) + 1) << 16) | stats;
+    __atomic_compare_exchange_n(&g_ov.blocks[b], &w, nw, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+  }
+  __atomic_add_fetch(&g_ov.completed, 1, __ATOMIC_RELEASE);
+}
+
+static void overview_sel_job(void *arg) {
+  struct overview_sel_job *job = arg;
+  overview_range_histogram(job->offset, job->len, job->hist);
+}
+
+static void overview_schedule(size_t first_block, size_t last_block) {
+  if(g_editor.panel != &g_overview_panel) {
+    return; // picked up the next time the panel is shown
+  }
+  for(size_t job = first_block / OVERVIEW_JOB_BLOCKS;
+      job * OVERVIEW_JOB_BLOCKS < last_block;
+      ++job)
+  {
+    if(worker_pool_submit(&g_ov.group, overview_block_job, (void *)job) < 0) {
+      LOG_MSG("Could not queue overview job %lu", job);
+      break;
+    }
+  }
+}
+
+// mark blocks [first, last) stale, a worker that read them before fails
+// its swap
+static void overview_stale(size_t first, size_t last) {
+  for(size_t b = first; b < last; ++b) {
+    uint32_t w = __atomic_load_n(&g_ov.blocks[b], __ATOMIC_ACQUIRE);
+    uint32_t nw;
+    do {
+      nw = ((BLOCK_SEQ(w) | 1) + 1) << 16;
+    } while(!__atomic_compare_exchange_n(&g_ov.blocks[b], &w, nw, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  }
+}
+
+// size the block table for the current document after its length changed
+// at offset.  the blocks before offset keep their stats unless the block
+// size changed, the rest are stale.  *first is set to the first block that
+// needs a job, which is before offset if queued jobs had to be dropped
+static int overview_resize(size_t offset, size_t *first) {
+  size_t len = doc_length();
+  *first = g_ov.n_blocks;
+  if(g_ov.blocks && len == g_ov.doc_len) {
+    return 0;
+  }
+
+  size_t block_size = OVERVIEW_BLOCK_SIZE;
+  while(len / block_size > OVERVIEW_MAX_BLOCKS) {
+    block_size *= 2;
+  }
+  size_t n_blocks = (len + block_size - 1) / block_size;
+  size_t keep = g_ov.blocks && block_size == g_ov.block_size ? offset / block_size : 0;
+  keep = keep < g_ov.n_blocks ? keep : g_ov.n_blocks;
+  keep = keep < n_blocks ? keep : n_blocks;
+  *first = keep;
+
+  if(!g_ov.blocks || n_blocks != g_ov.n_blocks) {
+    // the workers index the table, it only moves while none of them run
+    worker_group_cancel(&g_ov.group);
+    uint32_t *blocks = realloc(g_ov.blocks, (n_blocks ? n_blocks : 1) * sizeof(uint32_t));
+    if(!blocks) {
+      return -1;
+    }
+    if(n_blocks > keep) {
+      memset(blocks + keep, 0, (n_blocks - keep) * sizeof(uint32_t));
+    }
+    g_ov.blocks = blocks;
+    g_ov.n_blocks = n_blocks;
+
+    // the dropped jobs may have been on kept blocks still waiting for stats
+    for(size_t b = 0; b < keep; ++b) {
+      if(!BLOCK_VALID(g_ov.blocks[b])) {
+        *first = b;
+        break;
+      }
+    }
+  }
+  overview_stale(keep, n_blocks);
+  g_ov.block_size = block_size;
+  g_ov.doc_len = len;
+  ++g_ov.completed; // force a redraw
+  return 0;
+}
+
+static void overview_doc_changed(size_t offset, size_t old_len, size_t new_len) {
+  overview_invalidate(offset, old_len > new_len ? old_len : new_len);
+}
+
+bool setup_overview() {
+  worker_group_init(&g_ov.group);
+  worker_group_init(&g_ov.sel_group);
+  g_ov.initialized = true;
+  return doc_watch(overview_doc_changed) == 0;
+}
+
+void cleanup_overview() {
+  if(!g_ov.initialized) {
+    return;
+  }
+  worker_group_destroy(&g_ov.group);
+  worker_group_destroy(&g_ov.sel_group);
+  free(g_ov.blocks);
+  g_ov.blocks = NULL;
+  g_ov.n_blocks = 0;
+  g_ov.initialized = false;
+}
+
+void overview_invalidate(size_t offset, size_t len) {
+  if(!g_ov.blocks) {
+    return;
+  }
+
+  if(doc_length() != g_ov.doc_len) {
+    // everything from the change on moved, what comes before it stays
+    size_t first;
+    if(overview_resize(offset, &first) == 0) {
+      overview_schedule(first, g_ov.n_blocks);
+    }
+    if(g_ov.sel_valid && offset < g_ov.sel_offset + g_ov.sel_len) {
+      g_ov.sel_valid = false;
+    }
+    return;
+  }
+
+  if(len == 0 || offset >= g_ov.doc_len) {
+    return;
+  }
+
+  size_t first = offset / g_ov.block_size;
+  size_t last = (offset + len - 1) / g_ov.block_size + 1;
+  last = last < g_ov.n_blocks ? last : g_ov.n_blocks;
+  overview_stale(first, last);
+
+  if(g_ov.sel_valid && offset < g_ov.sel_offset + g_ov.sel_len && offset + len > g_ov.sel_offset) {
+    g_ov.sel_valid = false;
+  }
+
+  overview_schedule(first, last);
+}
+
+// recompute the selection histogram if the selection moved
+static void overview_update_selection() {
+  size_t offset, len;
+  editor_get_selection(&offset, &len);
+  if(g_ov.sel_valid && offset == g_ov.sel_offset && len == g_ov.sel_len) {
+    return;
+  }
+
+  memset(g_ov.sel_hist, 0, sizeof(g_ov.sel_hist));
+  size_t n_jobs = (len + OVERVIEW_SEL_CHUNK - 1) / OVERVIEW_SEL_CHUNK;
+  struct overview_sel_job *jobs = n_jobs > 1 ? calloc(n_jobs, sizeof(struct overview_sel_job)) : NULL;
+
+  if(jobs) {
+    for(size_t i = 0; i < n_jobs; ++i) {
+      jobs[i].offset = offset + i * OVERVIEW_SEL_CHUNK;
+      jobs[i].len = i + 1 < n_jobs ? OVERVIEW_SEL_CHUNK : len - i * OVERVIEW_SEL_CHUNK;
+      worker_pool_submit(&g_ov.sel_group, overview_sel_job, &jobs[i]);
+    }
+    worker_group_wait(&g_ov.sel_group);
+    for(size_t i = 0; i < n_jobs; ++i) {
+      for(int c = 0; c < 256; ++c) {
+        g_ov.sel_hist[c] += jobs[i].hist[c];
+      }
+    }
+    free(jobs);
+  } else {
+    overview_range_histogram(offset, len, g_ov.sel_hist);
+  }
+
+  g_ov.sel_entropy = byte_stats_entropy(g_ov.sel_hist, len);
+  g_ov.sel_offset = offset;
+  g_ov.sel_len = len;
+  g_ov.sel_valid = true;
+}
+
+static size_t overview_blocks_per_row(int h) {
+  if(h <= 0) {
+    return g_ov.n_blocks;
+  }
+  size_t per_row = (g_ov.n_blocks + h - 1) / h;
+  return per_row ? per_row : 1;
+}
+
+static void overview_draw_strip(WINDOW *wnd, int h) {
+  size_t per_row = overview_blocks_per_row(h);
+  size_t view_begin, view_end;
+  editor_screen_range(&view_begin, &view_end);
+
+  for(int y = 0; y < h && y * per_row < g_ov.n_blocks; ++y) {
+    size_t first = y * per_row;
+    size_t last = first + per_row < g_ov.n_blocks ? first + per_row : g_ov.n_blocks;
+    int entropy = 0, klass = BYTE_CLASS_ZERO;
+    bool pending = false;
+
+    for(size_t b = first; b < last; ++b) {
+      uint32_t w = __atomic_load_n(&g_ov.blocks[b], __ATOMIC_ACQUIRE);
+      if(!BLOCK_VALID(w)) {
+        pending = true;
+        continue;
+      }
+      entropy = BLOCK_ENTROPY(w) > entropy ? BLOCK_ENTROPY(w) : entropy;
+      klass = BLOCK_CLASS(w) > klass ? BLOCK_CLASS(w) : klass;
+    }
+
+    size_t row_begin = first * g_ov.block_size;
+    size_t row_end = last * g_ov.block_size;
+    attr_t attr = COLOR_PAIR(PAIR_CLASS_ZERO + klass);
+    if(row_begin < view_end && row_end > view_begin) {
+      attr |= A_REVERSE; // rows currently on screen
+    }
+
+    wattrset(wnd, attr);
+    if(pending) {
+      mvwaddch(wnd, y, 0, '?');
+      mvwaddch(wnd, y, 1, ' ');
+    } else {
+      mvwaddch(wnd, y, 0, g_entropy_glyphs[entropy * 9 / 255]);
+      mvwaddch(wnd, y, 1, g_class_glyphs[klass]);
+    }
+  }
+  wattrset(wnd, A_NORMAL);
+}
+
+static void overview_draw_histogram(WINDOW *wnd, int h, int w) {
+  char buf[32];
+  if(w < OVERVIEW_HIST_X + 16 || h < 17) {
+    return;
+  }
+
+  overview_update_selection();
+
+  snprintf(buf, sizeof(buf), "sel H=%.2f", g_ov.sel_entropy);
+  mvwaddnstr(wnd, 0, OVERVIEW_HIST_X, buf, w - OVERVIEW_HIST_X);
+
+  uint64_t max = 0;
+  for(int c = 0; c < 256; ++c) {
+    max = g_ov.sel_hist[c] > max ? g_ov.sel_hist[c] : max;
+  }
+
+  // row is the high nibble, column the low nibble, glyphs on a log scale
+  for(int c = 0; c < 256; ++c) {
+    int level = 0;
+    if(g_ov.sel_hist[c]) {
+      level = max > 1 ? 1 + (int)(8.0 * log((double)g_ov.sel_hist[c]) / log((double)max)) : 9;
+      level = level > 9 ? 9 : level;
+    }
+    mvwaddch(wnd, 1 + (c >> 4), OVERVIEW_HIST_X + (c & 0xf), g_entropy_glyphs[level]);
+  }
+}
+
+static void overview_redraw(WINDOW *wnd) {
+  int h, w;
+  getmaxyx(wnd, h, w);
+
+  g_ov.drawn = __atomic_load_n(&g_ov.completed, __ATOMIC_ACQUIRE);
+  if(g_ov.blocks) {
+    overview_draw_strip(wnd, h);
+  }
+  overview_draw_histogram(wnd, h, w);
+}
+
+static void overview_click(int y, int x) {
+  if(x > 1 || !g_ov.n_blocks) {
+    return;
+  }
+  size_t offset = y * overview_blocks_per_row(g_windows.panelwnd_geom.h) * g_ov.block_size;
+  if(offset < g_ov.doc_len) {
+    editor_goto_offset_scan(offset);
+  }
+}
+
+static bool overview_idle() {
+  return __atomic_load_n(&g_ov.completed, __ATOMIC_ACQUIRE) != g_ov.drawn;
+}
+
+static bool overview_busy() {
+  return worker_group_busy(&g_ov.group) || overview_idle();
+}
+
+int overview_next_region() {
+  if(!g_ov.blocks || !g_ov.n_blocks) {
+    return -1;
+  }
+
+  set_status_window_text("overview: scanning...");
+  editor_refresh_windows();
+  worker_group_wait(&g_ov.group);
+
+  size_t b = editor_get_cursor_offset() / g_ov.block_size;
+  if(b >= g_ov.n_blocks) {
+    return -1;
+  }
+
+  // blocks that were never scheduled (panel hidden) are computed here
+  for(size_t i = b; i < g_ov.n_blocks; ++i) {
+    uint32_t w = g_ov.blocks[i];
+    if(!BLOCK_VALID(w)) {
+      w = ((BLOCK_SEQ(w) + 1) << 16) | overview_block_stats(i);
+      g_ov.blocks[i] = w;
+    }
+    if(i > b && BLOCK_CLASS(w) != BLOCK_CLASS(g_ov.blocks[b])) {
+      editor_goto_offset_scan(i * g_ov.block_size);
+      set_status_window_text("overview: next region");
+      return 0;
+    }
+  }
+
+  set_status_window_text("overview: no further regions");
+  return -1;
+}
+
+int overview_cmd(int argc, char *argv[]) {
+  size_t first;
+  if(overview_resize(0, &first) < 0) {
+    set_status_window_text("overview: out of memory");
+    return -1;
+  }
+
+  if(argc > 1 && strcmp(argv[1], "next") == 0) {
+    return overview_next_region();
+  }
+
+  if(g_editor.panel == &g_overview_panel) {
+    return editor_show_panel(NULL);
+  }
+
+  int r = editor_show_panel(&g_overview_panel);
+  overview_schedule(0, g_ov.n_blocks);
+  return r;
+}
@@ -0,0 +1,23 @@
+#ifndef __OVERVIEW_H__
+#define __OVERVIEW_H__
+
+#include "editor.h"
+
+// overview panel:
+//
+// a strip down the side of the main window showing the entropy and byte
+// class of every block of the file, next to a byte histogram of the
+// selection.  block statistics are computed on the worker pool, cached, and
+// only recomputed for blocks that change.  clicking the strip jumps there.
+//
+extern const panel_ops g_overview_panel;
+
+bool setup_overview();
+void cleanup_overview();
+
+void overview_invalidate(size_t offset, size_t len); // mark blocks covering a range as stale
+int overview_next_region(); // jump to the next block with a different class than the cursor's
+
+int overview_cmd(int argc, char *argv[]); // ":overview [next]"
+
+#endif // __OVERVIEW_H__
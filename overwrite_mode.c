@@ -0,0 +1,57 @@
+#include "overwrite_mode.h"
+
+#include "editor.h"
+#include "document.h"
+#include "undo.h"
+#include "logger.h"
+
+int overwrite_mode_enter() {
+  undo_seal();
+  editor_set_focus(g_windows.mainwnd);
+  return 0;
+}
+
+static void overwrite_mode_put(char c) {
+  size_t offset = editor_get_cursor_offset();
+  if(doc_overwrite(offset, &c, 1) < 0) {
+    set_status_window_text("overwrite: at the end of the file");
+    return;
+  }
+  editor_char_right_main();
+}
+
+int overwrite_mode_new_char(int c) {
+  switch(c) {
+    case 27 : // escape
+      editor_switch_mode(MODE_COMMAND);
+      break;
+    case KEY_MOUSE :
+      editor_mouse_event();
+      break;
+    case KEY_LEFT :
+    case KEY_BACKSPACE :
+    case 127 :
+      editor_char_left_main();
+      break;
+    case KEY_RIGHT :
+      editor_char_right_main();
+      break;
+    case KEY_DOWN :
+      editor_line_down_main();
+      break;
+    case KEY_UP :
+      editor_line_up_main();
+      break;
+    default :
+      if((c >= 0x20 && c < 0x7f) || c == '\t') {
+        overwrite_mode_put((char)c);
+      }
+      break;
+  }
+  return 0;
+}
+
+int overwrite_mode_exit() {
+  undo_seal();
+  return 0;
+}
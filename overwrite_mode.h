@@ -0,0 +1,12 @@
+#ifndef __OVERWRITE_MODE_H__
+#define __OVERWRITE_MODE_H__
+
+// overwrite mode: typed characters replace the bytes under the cursor, the
+// length of the document never changes.  the edits go to the document's
+// patch map, see document.h
+
+int overwrite_mode_enter();
+int overwrite_mode_new_char(int c);
+int overwrite_mode_exit();
+
+#endif // __OVERWRITE_MODE_H__
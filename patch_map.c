@@ -0,0 +1,181 @@
+#include "patch_map.h"
+
+#include <string.h>
+
+#define PATCH_POOL_MIN 4096
+#define PATCH_COMPACT_MIN (64UL << 10) // garbage worth compacting the pool for
+
+void patch_map_init(patch_map *pm) {
+  memset(pm, 0, sizeof(*pm));
+}
+
+void patch_map_free(patch_map *pm) {
+  free(pm->runs);
+  free(pm->pool);
+  patch_map_init(pm);
+}
+
+void patch_map_clear(patch_map *pm) {
+  pm->n_runs = 0;
+  pm->pool_len = 0;
+  pm->garbage = 0;
+}
+
+size_t patch_map_find(const patch_map *pm, size_t offset) {
+  size_t lo = 0, hi = pm->n_runs;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(pm->runs[mid].offset + pm->runs[mid].len <= offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+const char *patch_map_view(const patch_map *pm, size_t offset, size_t *len) {
+  size_t i = patch_map_find(pm, offset);
+  if(i >= pm->n_runs) {
+    return NULL;
+  }
+  const patch_run *r = &pm->runs[i];
+  if(r->offset > offset) {
+    if(*len > r->offset - offset) {
+      *len = r->offset - offset;
+    }
+    return NULL;
+  }
+  size_t skip = offset - r->offset;
+  if(*len > r->len - skip) {
+    *len = r->len - skip;
+  }
+  return pm->pool + r->data + skip;
+}
+
+size_t patch_map_bytes(const patch_map *pm) {
+  return pm->pool_len - pm->garbage;
+}
+
+size_t patch_map_memory(const patch_map *pm) {
+  return pm->max_runs * sizeof(patch_run) + pm->pool_max;
+}
+
+static int patch_map_reserve(patch_map *pm, size_t n_runs, size_t pool_len) {
+  if(n_runs > pm->max_runs) {
+    size_t max = pm->max_runs ? pm->max_runs * 2 : 16;
+    while(max < n_runs) {
+      max *= 2;
+    }
+    patch_run *runs = realloc(pm->runs, max * sizeof(patch_run));
+    if(!runs) {
+      return -1;
+    }
+    pm->runs = runs;
+    pm->max_runs = max;
+  }
+  if(pool_len > pm->pool_max) {
+    size_t max = pm->pool_max ? pm->pool_max * 2 : PATCH_POOL_MIN;
+    while(max < pool_len) {
+      max *= 2;
+    }
+    char *pool = realloc(pm->pool, max);
+    if(!pool) {
+      return -1;
+    }
+    pm->pool = pool;
+    pm->pool_max = max;
+  }
+  return 0;
+}
+
+// copy the live runs to a fresh pool once most of it is garbage
+static void patch_map_compact(patch_map *pm) {
+  if(pm->garbage < PATCH_COMPACT_MIN || pm->garbage < pm->pool_len / 2) {
+    return;
+  }
+  char *pool = malloc(pm->pool_max);
+  if(!pool) {
+    return; // still correct, just bigger than it needs to be
+  }
+  size_t at = 0;
+  for(size_t i = 0; i < pm->n_runs; ++i) {
+    memcpy(pool + at, pm->pool + pm->runs[i].data, pm->runs[i].len);
+    pm->runs[i].data = at;
+    at += pm->runs[i].len;
+  }
+  free(pm->pool);
+  pm->pool = pool;
+  pm->pool_len = at;
+  pm->garbage = 0;
+}
+
+int patch_map_write(patch_map *pm, size_t offset, const char *src, size_t len) {
+  if(len == 0) {
+    return 0;
+  }
+  size_t end = offset + len;
+
+  // runs [lo, hi) overlap or touch the new bytes
+  size_t lo = patch_map_find(pm, offset);
+  if(lo > 0 && pm->runs[lo - 1].offset + pm->runs[lo - 1].len == offset) {
+    --lo;
+  }
+  size_t hi = lo;
+  while(hi < pm->n_runs && pm->runs[hi].offset <= end) {
+    ++hi;
+  }
+
+  if(hi - lo == 1) {
+    patch_run *r = &pm->runs[lo];
+    if(r->offset <= offset && r->offset + r->len >= end) {
+      // already patched, rewrite in place
+      memcpy(pm->pool + r->data + (offset - r->offset), src, len);
+      return 0;
+    }
+    if(r->offset <= offset && r->data + r->len == pm->pool_len) {
+      // the run ends the pool, grow it there
+      size_t grow = end - (r->offset + r->len);
+      if(patch_map_reserve(pm, pm->n_runs, pm->pool_len + grow) < 0) {
+        return -1;
+      }
+      memcpy(pm->pool + r->data + (offset - r->offset), src, len);
+      r->len += grow;
+      pm->pool_len += grow;
+      return 0;
+    }
+  }
+
+  size_t begin = offset;
+  if(hi > lo) {
+    begin = pm->runs[lo].offset < begin ? pm->runs[lo].offset : begin;
+    size_t last_end = pm->runs[hi - 1].offset + pm->runs[hi - 1].len;
+    end = last_end > end ? last_end : end;
+  }
+  if(patch_map_reserve(pm, pm->n_runs + 1, pm->pool_len + (end - begin)) < 0) {
+    return -1;
+  }
+
+  // the merged run is contiguous since every old run touches the new bytes
+  size_t data = pm->pool_len;
+  for(size_t i = lo; i < hi; ++i) {
+    memcpy(pm->pool + data + (pm->runs[i].offset - begin), pm->pool + pm->runs[i].data, pm->runs[i].len);
+    pm->garbage += pm->runs[i].len;
+  }
+  memcpy(pm->pool + data + (offset - begin), src, len);
+  pm->pool_len += end - begin;
+
+  if(hi == lo) {
+    memmove(&pm->runs[lo + 1], &pm->runs[lo], (pm->n_runs - lo) * sizeof(patch_run));
+    ++pm->n_runs;
+  } else if(hi - lo > 1) {
+    memmove(&pm->runs[lo + 1], &pm->runs[hi], (pm->n_runs - hi) * sizeof(patch_run));
+    pm->n_runs -= hi - lo - 1;
+  }
+  pm->runs[lo].offset = begin;
+  pm->runs[lo].len = end - begin;
+  pm->runs[lo].data = data;
+
+  patch_map_compact(pm);
+  return 0;
+}
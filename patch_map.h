@@ -0,0 +1,55 @@
+#ifndef __PATCH_MAP_H__
+#define __PATCH_MAP_H__
+
+#include <stdlib.h>
+
+// patch map:
+//
+// bytes overwritten in place, keyed by offset, layered over the bytes they
+// replace.  writes that overlap or touch merge into one run, so memory grows
+// with the number of bytes changed rather than the number of keystrokes:
+// overwriting the same byte again rewrites it where it is, and typing along a
+// line keeps extending the same run.
+//
+// runs live in one sorted array and their bytes in one pool, looked up by
+// binary search.  readers don't modify the map, so they can share it while
+// holding whatever lock the owner uses.
+//
+struct _patch_run {
+  size_t offset; // first byte covered
+  size_t len;
+  size_t data;   // where the bytes are in the pool
+};
+typedef struct _patch_run patch_run;
+
+struct _patch_map {
+  patch_run *runs; // sorted by offset, never overlapping or touching
+  size_t n_runs;
+  size_t max_runs;
+
+  char *pool;
+  size_t pool_len;
+  size_t pool_max;
+  size_t garbage; // bytes of the pool no run refers to any more
+};
+typedef struct _patch_map patch_map;
+
+void patch_map_init(patch_map *pm);
+void patch_map_free(patch_map *pm);  // releases the memory, the map is empty afterwards
+void patch_map_clear(patch_map *pm); // forget all runs but keep the memory
+
+// replace len bytes at offset, returns < 0 if memory ran out
+int patch_map_write(patch_map *pm, size_t offset, const char *src, size_t len);
+
+// index of the first run ending after offset, n_runs if there is none
+size_t patch_map_find(const patch_map *pm, size_t offset);
+
+// pointer to the patched bytes at offset with *len reduced to the end of the
+// run, or NULL if offset isn't patched, with *len reduced to where the next
+// run starts
+const char *patch_map_view(const patch_map *pm, size_t offset, size_t *len);
+
+size_t patch_map_bytes(const patch_map *pm); // number of patched bytes
+size_t patch_map_memory(const patch_map *pm); // bytes allocated for the runs and the pool
+
+#endif // __PATCH_MAP_H__
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE // memmem
+#include "replace.h"
+
+#include "document.h"
+#include "editor.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/mman.h>
+
+#define REPLACE_BLOCK (4UL << 20)      // bytes searched per read
+#define REPLACE_MIN_CHUNK (16UL << 20) // smallest range worth handing to another thread
+
+// a growing list of match offsets
+struct replace_matches {
+  size_t *v;
+  size_t n;
+  size_t max;
+};
+
+struct replace_job {
+  size_t offset;     // matches that start in [offset, offset + len)
+  size_t len;
+  const char *find;
+  size_t find_len;
+  struct replace_matches matches;
+  worker_group *group;
+  size_t *done;      // progress counter shared by all of the jobs
+  int failed;
+};
+
+// called for each match found, a non-zero return stops the scan
+typedef int (*replace_match_fn)(size_t offset, void *arg);
+
+static int replace_push(struct replace_matches *m, size_t offset) {
+  if(m->n == m->max) {
+    size_t max = m->max ? m->max * 2 : 1024;
+    size_t *v = realloc(m->v, max * sizeof(size_t));
+    if(!v) {
+      return -1;
+    }
+    m->v = v;
+    m->max = max;
+  }
+  m->v[m->n++] = offset;
+  return 0;
+}
+
+// greedy scan for the matches starting in [from, stop), reading a block at a
+// time with enough of the next one that matches across blocks are seen.
+// returns < 0 on failure, > 0 if fn stopped the scan
+static int replace_scan(const char *find, size_t find_len, size_t from, size_t stop,
+    worker_group *g, size_t *done, replace_match_fn fn, void *arg)
+{
+  size_t doc_len = doc_length();
+  char *buf = malloc(REPLACE_BLOCK + find_len - 1);
+  if(!buf) {
+    return -1;
+  }
+
+  int r = 0;
+  size_t pos = from;
+  while(pos < stop && r == 0) {
+    if(g && worker_group_cancelled(g)) {
+      r = -1;
+      break;
+    }
+    size_t n = stop - pos < REPLACE_BLOCK ? stop - pos : REPLACE_BLOCK;
+    size_t extra = doc_len - pos - n < find_len - 1 ? doc_len - pos - n : find_len - 1;
+    if(doc_read(pos, buf, n + extra) != n + extra) {
+      r = -1;
+      break;
+    }
+
+    // a match ending past the block moves the next block's start with it
+    size_t next = pos + n;
+    const char *p = buf, *end = buf + n + extra;
+    while(r == 0 && (p = memmem(p, end - p, find, find_len)) && p < buf + n) {
+      r = fn(pos + (p - buf), arg);
+      p += find_len;
+      next = pos + (p - buf) > next ? pos + (p - buf) : next;
+    }
+    if(done) {
+      __atomic_add_fetch(done, next - pos, __ATOMIC_RELAXED);
+    }
+    pos = next;
+  }
+
+  free(buf);
+  return r;
+}
+
+static int replace_job_match(size_t offset, void *arg) {
+  return replace_push(arg, offset) < 0 ? -1 : 0;
+}
+
+static void replace_job_run(void *arg) {
+  struct replace_job *job = arg;
+  if(replace_scan(job->find, job->find_len, job->offset, job->offset + job->len,
+      job->group, job->done, replace_job_match, &job->matches) < 0)
+  {
+    job->failed = 1;
+  }
+}
+
+// rescans the start of a job whose first matches overlap the previous job's
+// last one, until a match agrees with what the job found
+struct replace_resync {
+  struct replace_matches *out;
+  const struct replace_job *job;
+  size_t k; // first of the job's matches not yet passed
+};
+
+static int replace_resync_match(size_t offset, void *arg) {
+  struct replace_resync *rs = arg;
+  const struct replace_matches *m = &rs->job->matches;
+  while(rs->k < m->n && m->v[rs->k] < offset) {
+    ++rs->k;
+  }
+  if(rs->k < m->n && m->v[rs->k] == offset) {
+    return 1; // in step with the job again, the rest of its matches hold
+  }
+  return replace_push(rs->out, offset) < 0 ? -1 : 0;
+}
+
+int replace_find_all(const char *find, size_t find_len, size_t **matches, size_t *n_matches) {
+  worker_group group;
+  size_t done = 0;
+  size_t len = doc_length();
+
+  *matches = NULL;
+  *n_matches = 0;
+  if(find_len == 0) {
+    return -1;
+  }
+
+  size_t threads = worker_pool_threads();
+  size_t n_jobs = len / REPLACE_MIN_CHUNK;
+  n_jobs = n_jobs < threads * 4 ? n_jobs : threads * 4;
+  n_jobs = n_jobs ? n_jobs : 1;
+
+  struct replace_job *jobs = calloc(n_jobs, sizeof(struct replace_job));
+  if(!jobs) {
+    return -1;
+  }
+
+  worker_group_init(&group);
+  doc_advise(0, len, MADV_SEQUENTIAL);
+
+  size_t chunk = len / n_jobs;
+  for(size_t i = 0; i < n_jobs; ++i) {
+    jobs[i].offset = i * chunk;
+    jobs[i].len = i + 1 < n_jobs ? chunk : len - i * chunk;
+    jobs[i].find = find;
+    jobs[i].find_len = find_len;
+    jobs[i].group = &group;
+    jobs[i].done = &done;
+    worker_pool_submit(&group, replace_job_run, &jobs[i]);
+  }
+
+  int r = editor_wait_progress(&group, "search", &done, len);
+  doc_advise(0, len, MADV_NORMAL);
+  worker_group_destroy(&group);
+
+  // join the jobs' lists.  a match running over into the next job hides
+  // that job's first matches, which are found again from where it ends
+  struct replace_matches out = { NULL, 0, 0 };
+  for(size_t i = 0; i < n_jobs && r == 0; ++i) {
+    struct replace_job *job = &jobs[i];
+    size_t k = 0;
+    if(job->failed) {
+      r = -1;
+      break;
+    }
+    size_t prev_end = out.n ? out.v[out.n - 1] + find_len : 0;
+    if(job->matches.n && job->matches.v[0] < prev_end) {
+      struct replace_resync rs = { &out, job, 0 };
+      r = replace_scan(find, find_len, prev_end, job->offset + job->len, NULL, NULL, replace_resync_match, &rs);
+      if(r < 0) {
+        break;
+      }
+      k = r > 0 ? rs.k : job->matches.n;
+      r = 0;
+    }
+    for(; k < job->matches.n && r == 0; ++k) {
+      r = replace_push(&out, job->matches.v[k]);
+    }
+  }
+
+  for(size_t i = 0; i < n_jobs; ++i) {
+    free(jobs[i].matches.v);
+  }
+  free(jobs);
+  if(r < 0) {
+    free(out.v);
+    return -1;
+  }
+  *matches = out.v;
+  *n_matches = out.n;
+  return 0;
+}
+
+static int replace_hex_digit(char c) {
+  if(c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = tolower((unsigned char)c);
+  return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+int replace_unescape(const char *s, char delim, char *out, size_t max, const char **end) {
+  size_t n = 0;
+  while(*s && *s != delim) {
+    char c = *s++;
+    if(c == '\\') {
+      switch(*s) {
+        case 'n' :
+          c = '\n';
+          ++s;
+          break;
+        case 't' :
+          c = '\t';
+          ++s;
+          break;
+        case 'x' :
+          {
+            int hi = replace_hex_digit(s[1]), lo = hi < 0 ? -1 : replace_hex_digit(s[2]);
+            if(lo < 0) {
+              return -1;
+            }
+            c = (char)(hi << 4 | lo);
+            s += 3;
+          }
+          break;
+        case '\0' :
+          return -1;
+        default : // the delimiter or a backslash itself
+          c = *s++;
+          break;
+      }
+    }
+    if(n >= max) {
+      return -1;
+    }
+    out[n++] = c;
+  }
+  if(*s != delim) {
+    return -1;
+  }
+  *end = s + 1;
+  return n;
+}
+
+int replace_cmd(int argc, char *argv[]) {
+  char find[REPLACE_MAX], with[REPLACE_MAX];
+  char msg[128];
+  const char *s = argc > 1 ? argv[1] : "";
+  int find_len = -1, with_len = -1;
+
+  if(*s && !isalnum((unsigned char)*s) && !isspace((unsigned char)*s)) {
+    char delim = *s;
+    find_len = replace_unescape(s + 1, delim, find, sizeof(find), &s);
+    if(find_len > 0) {
+      with_len = replace_unescape(s, delim, with, sizeof(with), &s);
+    }
+  }
+  if(find_len <= 0 || with_len < 0 || *s) {
+    set_status_window_text("usage: s/<find>/<replace>/");
+    return -1;
+  }
+
+  size_t *matches, n;
+  if(replace_find_all(find, find_len, &matches, &n) < 0) {
+    set_status_window_text("s: failed or cancelled");
+    return -1;
+  }
+  if(n == 0) {
+    set_status_window_text("s: not found");
+    return 0;
+  }
+
+  int r = doc_replace_all(matches, n, find_len, with, with_len);
+  LOG_MSG("replace: %lu matches of %d bytes with %d bytes", n, find_len, with_len);
+  free(matches);
+  if(r < 0) {
+    set_status_window_text("s: failed");
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "replaced %lu matches", n);
+  set_status_window_text(msg);
+  return 0;
+}
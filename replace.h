@@ -0,0 +1,27 @@
+#ifndef __REPLACE_H__
+#define __REPLACE_H__
+
+#include <stdlib.h>
+
+// replace every occurrence of a byte string in the document
+//
+// the matches are collected first, the document split across the worker
+// pool, and then applied together by doc_replace_all, which rebuilds the
+// piece table in one pass.  nothing is moved per match, so a million
+// replacements cost about as much as reading the file once.
+
+#define REPLACE_MAX 256 // longest search or replacement string
+
+// find the leftmost non-overlapping occurrences of find in the document.
+// *matches is malloced and holds *n_matches sorted offsets, returns < 0 on
+// failure or if cancelled
+int replace_find_all(const char *find, size_t find_len, size_t **matches, size_t *n_matches);
+
+// copy s into out up to an unescaped delim ('\0' for the whole string),
+// handling \xNN, \n, \t and \\.  returns the number of bytes and sets *end
+// past the delimiter, or -1 if it's malformed or longer than max
+int replace_unescape(const char *s, char delim, char *out, size_t max, const char **end);
+
+int replace_cmd(int argc, char *argv[]); // ":s/<find>/<replace>/", \xNN, \n, \t and \\ escapes
+
+#endif // __REPLACE_H__
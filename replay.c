@@ -0,0 +1,288 @@
+#include "replay.h"
+
+#include "editor.h"
+#include "document.h"
+#include "checksum.h"
+#include "histogram.h"
+#include "latency.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+struct replay_key_name {
+  const char *name;
+  int c;
+};
+
+static const struct replay_key_name g_replay_keys[] = {
+  { "esc", 27 },
+  { "enter", '\r' },
+  { "tab", '\t' },
+  { "space", ' ' },
+  { "backspace", KEY_BACKSPACE },
+  { "delete", KEY_DC },
+  { "up", KEY_UP },
+  { "down", KEY_DOWN },
+  { "left", KEY_LEFT },
+  { "right", KEY_RIGHT },
+  { "home", KEY_HOME },
+  { "end", KEY_END },
+  { "pgup", KEY_PPAGE },
+  { "pgdn", KEY_NPAGE },
+  { NULL, 0 }
+};
+
+static struct {
+  FILE *fp;
+  char text[256]; // printable keys not written yet, they go out as one text line
+  size_t text_len;
+  bool idle;      // an idle line was written since the last key
+} g_replay_record = {
+  .fp = NULL,
+  .text_len = 0,
+  .idle = false
+};
+
+// functions
+
+static int replay_parse_key(const char *s) {
+  for(const struct replay_key_name *k = g_replay_keys; k->name; ++k) {
+    if(strcmp(s, k->name) == 0) {
+      return k->c;
+    }
+  }
+  if((s[0] == 'f' || s[0] == 'F') && isdigit((unsigned char)s[1])) {
+    int n = atoi(s + 1);
+    return n >= 1 && n <= 12 ? KEY_F(n) : -1;
+  }
+  if(s[0] == 'C' && s[1] == '-' && s[2] && !s[3]) {
+    return toupper((unsigned char)s[2]) & 0x1f;
+  }
+  if(isdigit((unsigned char)s[0])) {
+    char *end;
+    long n = strtol(s, &end, 0);
+    return *end || n < 0 || n > KEY_MAX ? -1 : (int)n;
+  }
+  return -1;
+}
+
+static void replay_format_key(int c, char *buf, size_t len) {
+  for(const struct replay_key_name *k = g_replay_keys; k->name; ++k) {
+    if(c == k->c) {
+      snprintf(buf, len, "%s", k->name);
+      return;
+    }
+  }
+  if(c >= KEY_F(1) && c <= KEY_F(12)) {
+    snprintf(buf, len, "f%d", c - KEY_F0);
+  } else if(c > 0 && c < 32) {
+    snprintf(buf, len, "C-%c", c + 'a' - 1);
+  } else {
+    snprintf(buf, len, "%d", c);
+  }
+}
+
+// crc32 of the whole document as it stands
+static uint32_t replay_doc_crc(size_t *length) {
+  static char buf[1 << 16];
+  uint32_t crc = CRC32_INIT;
+  size_t len = doc_length(), offset = 0;
+  while(offset < len) {
+    size_t n = doc_read(offset, buf, len - offset < sizeof(buf) ? len - offset : sizeof(buf));
+    if(n == 0) {
+      break;
+    }
+    crc = crc32_update(crc, buf, n);
+    offset += n;
+  }
+  *length = offset;
+  return crc;
+}
+
+// one key through the main loop's handling, its timings go to the report
+static int replay_step(FILE *report, replay_key_fn key, int c, size_t step, int lineno, const char *event,
+    histogram *frames)
+{
+  uint64_t handled, frame;
+  int mode = g_editor.mode;
+  int r = key(c, latency_now());
+  latency_last(&handled, &frame);
+  histogram_record(frames, frame);
+  fprintf(report, "{\"step\":%lu,\"line\":%d,\"event\":\"%s\",\"mode\":\"%s\",\"handled_ns\":%lu,\"frame_ns\":%lu}\n",
+      step, lineno, event, g_modes[mode].mode_name, handled, frame);
+  return r;
+}
+
+static void replay_report_final(FILE *report, size_t steps, uint64_t total, const histogram *frames) {
+  size_t length;
+  uint32_t crc = replay_doc_crc(&length);
+  fprintf(report, "{\"final\":true,\"steps\":%lu,\"total_ns\":%lu,"
+      "\"frame_p50_ns\":%lu,\"frame_p99_ns\":%lu,\"frame_max_ns\":%lu,"
+      "\"mode\":\"%s\",\"offset\":%lu,\"line\":%lu,\"column\":%lu,\"top\":%lu,"
+      "\"length\":%lu,\"modified\":%s,\"crc32\":\"%08x\",\"status\":\"",
+      steps, total,
+      histogram_percentile(frames, 0.5), histogram_percentile(frames, 0.99), histogram_percentile(frames, 1.0),
+      g_modes[g_editor.mode].mode_name, editor_get_cursor_offset(),
+      g_editor.screen.curline_number, (size_t)g_editor.screen.curline_cursor, g_editor.screen.firstline_number,
+      length, doc_modified() ? "true" : "false", crc);
+
+  // the status window says how the last command went
+  char status[256] = "";
+  if(g_windows.statuswnd) {
+    mvwinnstr(g_windows.statuswnd, 0, 0, status, sizeof(status) - 1);
+  }
+  size_t end = strlen(status);
+  while(end > 0 && status[end - 1] == ' ') {
+    --end;
+  }
+  for(size_t i = 0; i < end; ++i) {
+    unsigned char c = status[i];
+    if(c == '"' || c == '\\') {
+      fprintf(report, "\\%c", c);
+    } else if(c < 32 || c > 126) {
+      fprintf(report, "\\u%04x", c);
+    } else {
+      fputc(c, report);
+    }
+  }
+  fprintf(report, "\"}\n");
+}
+
+int replay_run(const char *script, FILE *report, replay_key_fn key) {
+  static histogram frames;
+  char line[4096];
+  int lineno = 0, r = 0;
+  size_t steps = 0;
+
+  FILE *fp = fopen(script, "r");
+  if(!fp) {
+    fprintf(stderr, "%s: %s\n", script, strerror(errno));
+    return -1;
+  }
+  histogram_reset(&frames);
+  uint64_t t_start = latency_now();
+
+  // r < 0 is a key that quit the editor, the replay ends there
+  while(r >= 0 && fgets(line, sizeof(line), fp)) {
+    ++lineno;
+    line[strcspn(line, "\r\n")] = '\0';
+    if(!line[0] || line[0] == '#') {
+      continue;
+    }
+
+    char cmd[16] = "", arg[64] = "";
+    int n = sscanf(line, "%15s %63s", cmd, arg);
+    int cols, lines;
+
+    if(strcmp(cmd, "text") == 0) {
+      // the rest of the line after one space, spaces included
+      for(const char *p = line + 4 + (line[4] == ' '); *p && r >= 0; ++p) {
+        char event[8];
+        snprintf(event, sizeof(event), "%d", (unsigned char)*p);
+        r = replay_step(report, key, (unsigned char)*p, ++steps, lineno, event, &frames);
+      }
+    } else if(strcmp(cmd, "key") == 0 && n == 2) {
+      int c = replay_parse_key(arg);
+      if(c < 0) {
+        fprintf(stderr, "%s:%d: unknown key %s\n", script, lineno, arg);
+        fclose(fp);
+        return -1;
+      }
+      r = replay_step(report, key, c, ++steps, lineno, arg, &frames);
+    } else if(strcmp(cmd, "resize") == 0) {
+      if(sscanf(line, "%*s %d %d", &cols, &lines) != 2 || cols < 1 || lines < 3) {
+        fprintf(stderr, "%s:%d: resize needs columns and lines\n", script, lineno);
+        fclose(fp);
+        return -1;
+      }
+      // what getch() does before it returns KEY_RESIZE
+      resize_term(lines, cols);
+      r = replay_step(report, key, KEY_RESIZE, ++steps, lineno, "resize", &frames);
+    } else if(strcmp(cmd, "idle") == 0) {
+      key(ERR, latency_now());
+    } else {
+      fprintf(stderr, "%s:%d: don't know what to do with \"%s\"\n", script, lineno, line);
+      fclose(fp);
+      return -1;
+    }
+  }
+  fclose(fp);
+
+  replay_report_final(report, steps, latency_now() - t_start, &frames);
+  LOG_MSG("Replayed %lu steps from %s", steps, script);
+  return 0;
+}
+
+bool replay_record_open(const char *script) {
+  g_replay_record.fp = fopen(script, "w");
+  if(!g_replay_record.fp) {
+    return false;
+  }
+  fprintf(g_replay_record.fp, "# keys recorded by hexeditor --record, play back with --replay\n");
+  fprintf(g_replay_record.fp, "resize %d %d\n", COLS, LINES);
+  fflush(g_replay_record.fp);
+  return true;
+}
+
+static void replay_record_flush_text() {
+  if(g_replay_record.text_len) {
+    fprintf(g_replay_record.fp, "text %.*s\n", (int)g_replay_record.text_len, g_replay_record.text);
+    g_replay_record.text_len = 0;
+  }
+}
+
+void replay_record_key(int c) {
+  char name[16];
+
+  if(!g_replay_record.fp) {
+    return;
+  }
+
+  // printable keys pile up into one text line
+  if(c >= 32 && c < 127) {
+    g_replay_record.text[g_replay_record.text_len++] = c;
+    g_replay_record.idle = false;
+    if(g_replay_record.text_len == sizeof(g_replay_record.text)) {
+      replay_record_flush_text();
+      fflush(g_replay_record.fp);
+    }
+    return;
+  }
+  replay_record_flush_text();
+
+  switch(c) {
+    case ERR :
+      // the background work got a turn, once between keys is enough
+      if(!g_replay_record.idle) {
+        fprintf(g_replay_record.fp, "idle\n");
+        g_replay_record.idle = true;
+      }
+      break;
+    case KEY_RESIZE :
+      fprintf(g_replay_record.fp, "resize %d %d\n", COLS, LINES);
+      break;
+    case KEY_MOUSE :
+      // the event itself is gone by the time it could be written
+      fprintf(g_replay_record.fp, "# mouse event not recorded\n");
+      break;
+    default :
+      replay_format_key(c, name, sizeof(name));
+      fprintf(g_replay_record.fp, "key %s\n", name);
+      break;
+  }
+  if(c != ERR) {
+    g_replay_record.idle = false;
+  }
+  fflush(g_replay_record.fp);
+}
+
+void replay_record_close() {
+  if(g_replay_record.fp) {
+    replay_record_flush_text();
+    fclose(g_replay_record.fp);
+    g_replay_record.fp = NULL;
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// keystroke scripts
+//
+// a script is a text file with one event per line, blank lines and lines
+// starting with '#' are skipped:
+//
+//   text <chars>          each byte of the rest of the line is a key
+//   key <key>             a named key (esc, enter, backspace, delete, tab,
+//                         up, down, left, right, home, end, pgup, pgdn,
+//                         f1..f12), C-x for a control key, or a number
+//   resize <cols> <lines> the terminal changes size
+//   idle                  getch() timed out, the background work gets a turn
+//
+// replay_run() feeds the events to the editor through the same function the
+// main loop uses, so each key goes through new_char(), the refresh and the
+// latency histograms exactly as if it was typed.  a JSON line with the time
+// taken is written for each step, and one with the editor's state at the end.
+//
+// replay_record_*() write the keys of an interactive session as a script.
+
+typedef int (*replay_key_fn)(int c, uint64_t t_key); // the main loop's key handling, < 0 to quit
+
+int replay_run(const char *script, FILE *report, replay_key_fn key); // -1 if the script couldn't be read or has errors
+
+bool replay_record_open(const char *script);
+void replay_record_key(int c); // c as returned by getch(), including ERR and KEY_RESIZE
+void replay_record_close();
+
+#endif // __REPLAY_H__
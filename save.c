@@ -0,0 +1,423 @@
+#define _GNU_SOURCE // pwritev, copy_file_range, splice
+
+#include "save.h"
+
+#include "document.h"
+#include "editor.h"
+#include "worker_pool.h"
+#include "undo.h"
+#include "wal.h"
+#include "clipboard.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#define SAVE_MERGE_GAP 4096       // unchanged bytes worth rewriting to save a write call
+#define SAVE_MAX_IOV 64
+#define SAVE_COPY_STEP (64UL << 20) // bytes copied between progress updates
+
+struct save_batch {
+  int fd;
+  struct iovec iov[SAVE_MAX_IOV];
+  int n_iov;
+  size_t offset;  // file offset of the first iovec
+  size_t end;     // file offset after the last iovec
+  size_t written;
+  size_t n_writes;
+};
+
+// pwritev() that retries partial writes
+static int save_pwritev_all(int fd, struct iovec *iov, int n_iov, size_t offset) {
+  while(n_iov > 0) {
+    ssize_t n = pwritev(fd, iov, n_iov, offset);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    offset += n;
+    while(n_iov > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      ++iov;
+      --n_iov;
+    }
+    if(n_iov > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+static int save_flush(struct save_batch *b) {
+  if(b->n_iov == 0) {
+    return 0;
+  }
+  if(save_pwritev_all(b->fd, b->iov, b->n_iov, b->offset) < 0) {
+    LOG_MSG("pwritev at %lu failed: %s", b->offset, strerror(errno));
+    return -1;
+  }
+  b->written += b->end - b->offset;
+  ++b->n_writes;
+  b->n_iov = 0;
+  return 0;
+}
+
+static int save_add_patch(const doc_span *span, void *arg) {
+  struct save_batch *b = arg;
+  if(!span->data) {
+    return 0; // still in the file where it belongs
+  }
+  if(b->n_iov && (span->offset - b->end > SAVE_MERGE_GAP || b->n_iov + 2 > SAVE_MAX_IOV)) {
+    if(save_flush(b) < 0) {
+      return -1;
+    }
+  }
+
+  if(b->n_iov) {
+    // bridge the gap with the bytes the file already holds
+    size_t gap = span->offset - b->end;
+    if(gap) {
+      size_t n = gap;
+      const char *p = file_view(&g_curfile, b->end, &n);
+      if(!p || n < gap) {
+        return -1;
+      }
+      b->iov[b->n_iov].iov_base = (void *)p;
+      b->iov[b->n_iov].iov_len = gap;
+      ++b->n_iov;
+    }
+  } else {
+    b->offset = span->offset;
+  }
+
+  b->iov[b->n_iov].iov_base = (void *)span->data;
+  b->iov[b->n_iov].iov_len = span->len;
+  ++b->n_iov;
+  b->end = span->offset + span->len;
+  return 0;
+}
+
+// undo and the clipboard may still refer to the file bytes a span
+// overwrites.  this stashes bytes in the add buffer, which moves it, so it
+// runs before any pointers into it are gathered
+static int save_detach(const doc_span *span, void *arg) {
+  (void)arg;
+  if(!span->data) {
+    return 0;
+  }
+  return undo_detach_file(span->offset, span->len) < 0 || clip_detach_file(span->offset, span->len) < 0;
+}
+
+// non-zero if a span of the file moved, which rules out saving in place
+static int save_check_in_place(const doc_span *span, void *arg) {
+  (void)arg;
+  return !span->data && span->file_offset != span->offset;
+}
+
+static bool save_writable() {
+  return file_writable(&g_curfile);
+}
+
+int save_in_place() {
+  struct save_batch b = {
+    .fd = g_curfile.fd,
+    .n_iov = 0,
+    .written = 0,
+    .n_writes = 0
+  };
+  char msg[128];
+
+  if(!save_writable()) {
+    set_status_window_text("save: file is not open for writing");
+    return -1;
+  }
+
+  if(doc_for_each_span(save_detach, NULL) != 0
+      || doc_for_each_span(save_add_patch, &b) != 0 || save_flush(&b) < 0)
+  {
+    snprintf(msg, sizeof(msg), "save: write failed: %s", strerror(errno));
+    set_status_window_text(msg);
+    return -1;
+  }
+  if(fdatasync(g_curfile.fd) < 0) {
+    snprintf(msg, sizeof(msg), "save: sync failed: %s", strerror(errno));
+    set_status_window_text(msg);
+    return -1;
+  }
+
+  // the mapping is private but never written, so it reads the new bytes
+  doc_mark_saved();
+  wal_reset();
+
+  snprintf(msg, sizeof(msg), "\"%s\" %lu bytes written in %lu writes",
+      g_curfile.filename, b.written, b.n_writes);
+  set_status_window_text(msg);
+  return 0;
+}
+
+struct save_rewrite_job {
+  int in_fd;
+  int out_fd;
+  doc_span *spans;
+  size_t n_spans;
+  size_t max_spans;
+  size_t done;   // bytes written so far
+  size_t copied; // bytes the kernel copied without them passing through us
+  int error;
+  worker_group *group;
+};
+
+static int save_collect_span(const doc_span *span, void *arg) {
+  struct save_rewrite_job *job = arg;
+  if(job->n_spans == job->max_spans) {
+    size_t max = job->max_spans ? job->max_spans * 2 : 64;
+    doc_span *spans = realloc(job->spans, max * sizeof(doc_span));
+    if(!spans) {
+      return -1;
+    }
+    job->spans = spans;
+    job->max_spans = max;
+  }
+  job->spans[job->n_spans++] = *span;
+  return 0;
+}
+
+// move len bytes through a pipe, for file systems where neither
+// copy_file_range() nor sendfile() work between the two files
+static ssize_t save_splice(int in_fd, loff_t *in_off, int out_fd, loff_t *out_off, size_t len) {
+  int p[2];
+  if(pipe(p) < 0) {
+    return -1;
+  }
+  ssize_t in = splice(in_fd, in_off, p[1], NULL, len, SPLICE_F_MOVE);
+  ssize_t total = in;
+  while(in > 0) {
+    ssize_t out = splice(p[0], NULL, out_fd, out_off, in, SPLICE_F_MOVE);
+    if(out <= 0) {
+      total = -1;
+      break;
+    }
+    in -= out;
+  }
+  close(p[0]);
+  close(p[1]);
+  return total;
+}
+
+// copy part of the file into the new one in the kernel, returns the number of
+// bytes copied or < 0 with errno set.  each call starts over with the fastest
+// method, what one pair of file systems lacks says nothing about the next
+static ssize_t save_copy_file(struct save_rewrite_job *job, loff_t *in_off, loff_t *out_off, size_t len) {
+  int method = 0; // 0: copy_file_range, 1: sendfile, 2: splice
+
+  while(method <= 2) {
+    ssize_t n = -1;
+    switch(method) {
+      case 0 :
+        n = copy_file_range(job->in_fd, in_off, job->out_fd, out_off, len, 0);
+        break;
+      case 1 :
+        // sendfile writes at the file position of out_fd
+        if(lseek(job->out_fd, *out_off, SEEK_SET) >= 0) {
+          off_t off = *in_off;
+          n = sendfile(job->out_fd, job->in_fd, &off, len);
+          if(n > 0) {
+            *in_off += n;
+            *out_off += n;
+          }
+        }
+        break;
+      case 2 :
+        n = save_splice(job->in_fd, in_off, job->out_fd, out_off, len);
+        break;
+    }
+    if(n > 0 || (n < 0 && errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP)) {
+      return n;
+    }
+    if(n == 0) {
+      errno = EIO; // the file got shorter under us
+      return -1;
+    }
+    LOG_MSG("save: copy method %d unsupported (%s), trying the next", method, strerror(errno));
+    ++method;
+  }
+  errno = ENOSYS;
+  return -1;
+}
+
+static int save_write_all(int fd, const char *p, size_t len, size_t offset) {
+  struct iovec iov = { (void *)p, len };
+  return save_pwritev_all(fd, &iov, 1, offset);
+}
+
+static void save_rewrite_job_run(void *arg) {
+  struct save_rewrite_job *job = arg;
+  loff_t out_off = 0;
+
+  for(size_t i = 0; i < job->n_spans && !job->error; ++i) {
+    const doc_span *span = &job->spans[i];
+    loff_t in_off = span->file_offset;
+    size_t left = span->len;
+
+    while(left > 0) {
+      if(worker_group_cancelled(job->group)) {
+        job->error = ECANCELED;
+        return;
+      }
+      size_t step = left < SAVE_COPY_STEP ? left : SAVE_COPY_STEP;
+      ssize_t n;
+      if(span->data) {
+        n = save_write_all(job->out_fd, span->data + (span->len - left), step, out_off) < 0 ? -1 : (ssize_t)step;
+        out_off += n > 0 ? n : 0;
+      } else {
+        n = save_copy_file(job, &in_off, &out_off, step);
+        job->copied += n > 0 ? n : 0;
+      }
+      if(n < 0) {
+        job->error = errno;
+        return;
+      }
+      left -= n;
+      __atomic_add_fetch(&job->done, n, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// the directory has to be synced for the rename to be durable
+static void save_sync_dir(const char *path) {
+  char buf[PATH_MAX];
+  snprintf(buf, sizeof(buf), "%s", path);
+  int fd = open(dirname(buf), O_RDONLY | O_DIRECTORY);
+  if(fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+int save_rewrite() {
+  char path[PATH_MAX], tmp[PATH_MAX], dir[PATH_MAX], base[PATH_MAX], msg[PATH_MAX + 64];
+  struct stat st;
+  worker_group group;
+  struct save_rewrite_job job = {
+    .in_fd = g_curfile.fd,
+    .spans = NULL,
+    .n_spans = 0,
+    .max_spans = 0,
+    .done = 0,
+    .copied = 0,
+    .error = 0,
+    .group = &group
+  };
+
+  if(!g_curfile.filename || fstat(g_curfile.fd, &st) < 0) {
+    set_status_window_text("save: no file");
+    return -1;
+  }
+  // a new file renamed over the name would leave the other names with the old one
+  if(st.st_nlink > 1) {
+    snprintf(msg, sizeof(msg), "save: %s has %lu hard links, only edits that keep every byte in place can be saved",
+        g_curfile.filename, (unsigned long)st.st_nlink);
+    set_status_window_text(msg);
+    return -1;
+  }
+  // replace the file a symlink points to, not the link
+  if(!realpath(g_curfile.filename, path)) {
+    snprintf(msg, sizeof(msg), "save: could not resolve %s: %s", g_curfile.filename, strerror(errno));
+    set_status_window_text(msg);
+    return -1;
+  }
+
+  // the new file goes in the same directory so the rename can't cross file systems
+  snprintf(dir, sizeof(dir), "%s", path);
+  snprintf(base, sizeof(base), "%s", path);
+  if(snprintf(tmp, sizeof(tmp), "%s/.%s.XXXXXX", dirname(dir), basename(base)) >= (int)sizeof(tmp)) {
+    set_status_window_text("save: file name too long");
+    return -1;
+  }
+  job.out_fd = mkstemp(tmp);
+  if(job.out_fd < 0) {
+    snprintf(msg, sizeof(msg), "save: could not create %s: %s", tmp, strerror(errno));
+    set_status_window_text(msg);
+    return -1;
+  }
+  fchmod(job.out_fd, st.st_mode & 07777);
+
+  int r = doc_for_each_span(save_collect_span, &job);
+  if(r == 0) {
+    worker_group_init(&group);
+    worker_pool_submit(&group, save_rewrite_job_run, &job);
+    r = editor_wait_progress(&group, "save", &job.done, doc_length());
+    worker_group_destroy(&group);
+  }
+  free(job.spans);
+
+  if(r == 0 && !job.error && fsync(job.out_fd) < 0) {
+    job.error = errno;
+  }
+  close(job.out_fd);
+
+  if(r < 0 || job.error) {
+    unlink(tmp);
+    snprintf(msg, sizeof(msg), "save: %s", r < 0 || job.error == ECANCELED ? "cancelled" : strerror(job.error));
+    set_status_window_text(msg);
+    return -1;
+  }
+
+  if(rename(tmp, path) < 0) {
+    snprintf(msg, sizeof(msg), "save: could not replace %s: %s", path, strerror(errno));
+    unlink(tmp);
+    set_status_window_text(msg);
+    return -1;
+  }
+  save_sync_dir(path);
+
+  // the document is now the new file, the old one undo referred to is gone
+  undo_clear();
+  clip_clear();
+  if(doc_reopen() < 0) {
+    snprintf(msg, sizeof(msg), "save: written, but could not reopen %s", g_curfile.filename);
+    set_status_window_text(msg);
+    return -1;
+  }
+  wal_reset();
+
+  snprintf(msg, sizeof(msg), "\"%s\" %lu bytes written, %lu copied by the kernel",
+      g_curfile.filename, doc_length(), job.copied);
+  set_status_window_text(msg);
+  return 0;
+}
+
+int save_cmd(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+
+  if(!save_writable()) {
+    set_status_window_text("save: file is not open for writing");
+    return -1;
+  }
+  if(!doc_modified()) {
+    set_status_window_text("save: no changes");
+    return 0;
+  }
+
+  if(doc_length() == (size_t)g_curfile.mm_len && doc_for_each_span(save_check_in_place, NULL) == 0) {
+    return save_in_place();
+  }
+  // there's no writing a new device next to the old one
+  if(g_curfile.kind == FILE_KIND_DEVICE) {
+    set_status_window_text("save: a device can only be saved with its bytes where they were");
+    return -1;
+  }
+  return save_rewrite();
+}
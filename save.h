@@ -0,0 +1,23 @@
+#ifndef __SAVE_H__
+#define __SAVE_H__
+
+// writing the document back to its file
+//
+// when the edits kept every unchanged byte where it was, only the modified
+// ranges are written, in place: ranges close to each other are gathered into
+// one pwritev() along with the unchanged bytes between them, and the whole
+// save costs one fdatasync().  saving a two byte patch to a huge image
+// writes one page.
+//
+// otherwise the file is rewritten into a temporary file next to it that is
+// renamed over it.  unchanged spans are copied by the kernel with
+// copy_file_range() (falling back to sendfile() and splice()), and only the
+// edited spans are written from memory.  a symlink is followed to the file it
+// names, and a file with other hard links is only ever saved in place.
+
+int save_in_place(); // write the edits over the file, returns < 0 on failure
+int save_rewrite(); // write the document to a new file and rename it over the old one
+
+int save_cmd(int argc, char *argv[]); // ":w"
+
+#endif // __SAVE_H__
@@ -0,0 +1,188 @@
+#include "skip.h"
+
+#include "byte_stats.h"
+#include "document.h"
+#include "editor.h"
+#include "worker_pool.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#define SKIP_PIECE (16UL << 20) // bytes scanned between cancel checks
+
+struct skip_job {
+  bool diff;     // skip the run under the cursor instead of the next fill region
+  size_t offset;
+  size_t result; // where to move the cursor, doc_length() if the run reaches the end
+  size_t done;   // bytes passed, including holes
+  worker_group *group;
+};
+
+// first offset at or after offset holding a byte other than c.  zeros run
+// straight through holes, the data between them is compared in place.
+static size_t skip_run_end(struct skip_job *job, size_t offset, unsigned char c) {
+  size_t len = doc_length();
+  size_t p = offset;
+
+  while(p < len && !worker_group_cancelled(job->group)) {
+    size_t end = len;
+    if(c == 0) {
+      size_t data = doc_next_data(p);
+      if(data > p) {
+        p = data;
+        __atomic_store_n(&job->done, p - job->offset, __ATOMIC_RELAXED);
+        continue;
+      }
+      end = doc_next_hole(p);
+    }
+
+    size_t n = end - p < SKIP_PIECE ? end - p : SKIP_PIECE;
+    const unsigned char *v = (const unsigned char *)doc_view(p, &n);
+    if(!v || n == 0) {
+      break;
+    }
+    size_t run = byte_stats_run_length(v, n, c);
+    p += run;
+    __atomic_store_n(&job->done, p - job->offset, __ATOMIC_RELAXED);
+    if(run < n) {
+      break;
+    }
+  }
+  return p < len ? p : len;
+}
+
+// true if a fill region starts at offset
+static bool skip_fill_at(size_t offset) {
+  if(doc_next_hole(offset) == offset && offset < doc_length()) {
+    return true;
+  }
+  size_t n = SKIP_MIN_FILL;
+  const unsigned char *v = (const unsigned char *)doc_view(offset, &n);
+  return v && n == SKIP_MIN_FILL && byte_stats_run_length(v, n, v[0]) == n;
+}
+
+// start of the first fill region at or after offset, doc_length() if there
+// is none.  any run of SKIP_MIN_FILL bytes covers a whole aligned 64 byte
+// block, so only those are tested and a hit is extended backwards.
+static size_t skip_next_fill(struct skip_job *job, size_t offset) {
+  size_t len = doc_length();
+  size_t p = offset;
+
+  while(p < len && !worker_group_cancelled(job->group)) {
+    size_t hole = doc_next_hole(p);
+    if(hole == p) {
+      return p;
+    }
+
+    size_t end = hole - p < SKIP_PIECE ? hole : p + SKIP_PIECE;
+    for(size_t b = (p + 63) & ~63UL; b + 64 <= end; b += 64) {
+      // a cancelled skip_run_end() doesn't get past b, so the step back
+      // below would land on this block again
+      if(worker_group_cancelled(job->group)) {
+        return len;
+      }
+      size_t n = 64;
+      const unsigned char *v = (const unsigned char *)doc_view(b, &n);
+      if(!v || n < 64 || !byte_stats_uniform(v, 64)) {
+        continue;
+      }
+
+      size_t start = b;
+      unsigned char c = v[0];
+      while(start > p) {
+        char prev;
+        if(doc_read(start - 1, &prev, 1) != 1 || (unsigned char)prev != c) {
+          break;
+        }
+        --start;
+      }
+      size_t run_end = skip_run_end(job, b, c);
+      if(run_end - start >= SKIP_MIN_FILL) {
+        return start;
+      }
+      if(run_end >= b + 64) {
+        b = (run_end & ~63UL) - 64; // the loop steps to the block holding run_end
+      }
+    }
+    p = end;
+    __atomic_store_n(&job->done, p - job->offset, __ATOMIC_RELAXED);
+  }
+  return len;
+}
+
+static void skip_job_run(void *arg) {
+  struct skip_job *job = arg;
+  size_t len = doc_length();
+  size_t p = job->offset;
+  char c;
+
+  if(!job->diff) {
+    p = skip_next_fill(job, p);
+  }
+
+  // fill regions of different bytes often follow each other, skip them all
+  while(p < len && doc_read(p, &c, 1) == 1) {
+    p = skip_run_end(job, p, c);
+    if(job->diff || p >= len || !skip_fill_at(p)) {
+      break;
+    }
+  }
+  job->result = p;
+}
+
+static int skip_run(bool diff) {
+  size_t len = doc_length();
+  worker_group group;
+  struct skip_job job = {
+    .diff = diff,
+    .offset = editor_get_cursor_offset(),
+    .result = len,
+    .done = 0,
+    .group = &group
+  };
+
+  if(job.offset >= len) {
+    return -1;
+  }
+
+  worker_group_init(&group);
+  worker_pool_submit(&group, skip_job_run, &job);
+  int r = editor_wait_progress(&group, "skip", &job.done, len - job.offset);
+  worker_group_destroy(&group);
+
+  if(r < 0) {
+    set_status_window_text("skip: cancelled");
+    return -1;
+  }
+  if(job.result >= len) {
+    set_status_window_text(diff ? "skip: no differing byte" : "skip: no further fill regions");
+    return -1;
+  }
+
+  editor_goto_offset_scan(job.result);
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "skip: 0x%lx (+%lu bytes)", job.result, job.result - job.offset);
+  set_status_window_text(msg);
+  return 0;
+}
+
+int skip_fill() {
+  return skip_run(false);
+}
+
+int skip_diff() {
+  return skip_run(true);
+}
+
+int skip_cmd(int argc, char *argv[]) {
+  if(argc > 1 && strcmp(argv[1], "diff") == 0) {
+    return skip_diff();
+  }
+  if(argc > 1) {
+    set_status_window_text("usage: skip [diff]");
+    return -1;
+  }
+  return skip_fill();
+}
@@ -0,0 +1,20 @@
+#ifndef __SKIP_H__
+#define __SKIP_H__
+
+#include <stdlib.h>
+
+// skip navigation
+//
+// moves the cursor past runs of a repeated byte, e.g. the zero and fill
+// padding of disk images and core dumps.  runs are measured 64 bytes at a
+// time with vector compares, and holes in sparse files are stepped over with
+// SEEK_DATA/SEEK_HOLE without reading them.
+
+#define SKIP_MIN_FILL 128 // shortest run of one byte that counts as fill
+
+int skip_fill(); // jump to the first byte after the next fill region
+int skip_diff(); // jump to the first byte that differs from the one under the cursor
+
+int skip_cmd(int argc, char *argv[]); // ":skip [diff]"
+
+#endif // __SKIP_H__
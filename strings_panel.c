@@ -0,0 +1,549 @@
+#include "strings_panel.h"
+
+#include "byte_stats.h"
+#include "document.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#define STRINGS_WIDTH 40
+#define STRINGS_CHUNK (4UL << 20)  // bytes handled by one worker job
+#define STRINGS_WINDOW (64UL << 10) // bytes classified per read
+#define STRINGS_MAX_ROWS 256
+#define STRINGS_TEXT_X 11           // column the text starts at
+
+enum _strings_kind {
+  STRINGS_ASCII = 0,
+  STRINGS_UTF16LE
+};
+
+struct strings_run {
+  size_t offset;
+  size_t len; // in bytes, two per character for utf-16
+  int kind;
+};
+
+// runs starting inside one chunk, sorted by offset.  a run that starts in a
+// chunk belongs to it even if it continues into the next one.
+struct strings_chunk {
+  struct strings_run *runs;
+  size_t n_runs;
+  size_t max_runs;
+  int done; // set by the worker once runs is complete
+};
+
+// follows one kind of run through the masks.  utf-16 characters can start on
+// either parity, so each parity gets its own tracker.
+struct strings_tracker {
+  int kind;
+  size_t unit;    // bytes per character
+  bool in_run;
+  bool foreign;   // the run started in the previous chunk
+  size_t start;
+};
+
+struct strings_scan {
+  size_t chunk_begin;
+  size_t chunk_end;
+  struct strings_chunk *chunk;
+  struct strings_tracker t[3]; // ascii, utf-16 on even and on odd offsets
+  bool failed;
+};
+
+static void strings_redraw(WINDOW *wnd);
+static void strings_click(int y, int x);
+static bool strings_idle();
+static bool strings_busy();
+
+const panel_ops g_strings_panel = {
+  "strings",
+  STRINGS_WIDTH,
+  strings_redraw,
+  strings_click,
+  strings_idle,
+  strings_busy
+};
+
+static struct {
+  bool initialized;
+  size_t min_len;
+  size_t doc_len;
+  size_t n_chunks;
+  struct strings_chunk *chunks;
+  worker_group group;
+  size_t n_done;     // chunks with done set
+  size_t completed;  // chunk jobs finished, bumped by the workers
+  size_t drawn;      // value of completed at the last redraw
+  size_t row_offset[STRINGS_MAX_ROWS]; // offset of the string on each panel row
+  int n_rows;
+} g_str = {
+  .initialized = false,
+  .min_len = STRINGS_MIN_DEFAULT,
+  .chunks = NULL
+};
+
+static void strings_add_run(struct strings_scan *s, size_t offset, size_t len, int kind) {
+  struct strings_chunk *c = s->chunk;
+  if(c->n_runs == c->max_runs) {
+    size_t max = c->max_runs ? c->max_runs * 2 : 64;
+    struct strings_run *runs = realloc(c->runs, max * sizeof(struct strings_run));
+    if(!runs) {
+      s->failed = true;
+      return;
+    }
+    c->runs = runs;
+    c->max_runs = max;
+  }
+  c->runs[c->n_runs].offset = offset;
+  c->runs[c->n_runs].len = len;
+  c->runs[c->n_runs].kind = kind;
+  ++c->n_runs;
+}
+
+static void strings_end_run(struct strings_scan *s, struct strings_tracker *t, size_t end) {
+  if(t->in_run && !t->foreign && (end - t->start) / t->unit >= g_str.min_len) {
+    strings_add_run(s, t->start, end - t->start, t->kind);
+  }
+  t->in_run = false;
+  t->foreign = false;
+}
+
+// feed bits characters of mask, character i being at base + i * unit.
+// whole spans of ones and zeros are skipped with a count of trailing zeros
+// instead of looking at every bit.
+static void strings_feed(struct strings_scan *s, struct strings_tracker *t, uint64_t mask, int bits, size_t base) {
+  int i = 0;
+  while(i < bits) {
+    uint64_t m = mask >> i;
+    if(t->in_run) {
+      int ones = ~m ? __builtin_ctzll(~m) : 64;
+      if(i + ones >= bits) {
+        return;
+      }
+      i += ones;
+      strings_end_run(s, t, base + i * t->unit);
+    } else {
+      if(!m) {
+        return;
+      }
+      i += __builtin_ctzll(m);
+      if(i >= bits || base + i * t->unit >= s->chunk_end) {
+        return; // runs starting past the chunk belong to the next job
+      }
+      t->in_run = true;
+      t->start = base + i * t->unit;
+    }
+  }
+}
+
+// gather the even bits of x into the low 32 bits
+static inline uint64_t strings_even_bits(uint64_t x) {
+  x &= 0x5555555555555555ULL;
+  x = (x | (x >> 1)) & 0x3333333333333333ULL;
+  x = (x | (x >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+  x = (x | (x >> 4)) & 0x00ff00ff00ff00ffULL;
+  x = (x | (x >> 8)) & 0x0000ffff0000ffffULL;
+  x = (x | (x >> 16)) & 0x00000000ffffffffULL;
+  return x;
+}
+
+static inline bool strings_printable(unsigned char c) {
+  return (c >= 0x20 && c < 0x7f) || c == '\t';
+}
+
+// a run that is already going at the start of the chunk was reported by the
+// previous chunk's job, look back to see which trackers start inside one
+static void strings_lookback(struct strings_scan *s) {
+  unsigned char b[3];
+  if(s->chunk_begin < 2) {
+    return;
+  }
+  doc_read_lock();
+  size_t got = doc_read(s->chunk_begin - 2, (char *)b, 3);
+  doc_read_unlock();
+  if(got != 3) {
+    return;
+  }
+  s->t[0].in_run = strings_printable(b[1]);
+  s->t[1].in_run = strings_printable(b[0]) && b[1] == 0;
+  s->t[2].in_run = strings_printable(b[1]) && b[2] == 0;
+  for(int i = 0; i < 3; ++i) {
+    s->t[i].foreign = s->t[i].in_run;
+  }
+}
+
+static int strings_cmp_run(const void *a, const void *b) {
+  const struct strings_run *ra = a, *rb = b;
+  return ra->offset < rb->offset ? -1 : ra->offset > rb->offset;
+}
+
+static void strings_scan_job(void *arg) {
+  size_t index = (size_t)arg;
+  struct strings_scan s = {
+    .chunk_begin = index * STRINGS_CHUNK,
+    .chunk = &g_str.chunks[index],
+    .t = {
+      { STRINGS_ASCII, 1, false, false, 0 },
+      { STRINGS_UTF16LE, 2, false, false, 0 },
+      { STRINGS_UTF16LE, 2, false, false, 0 }
+    },
+    .failed = false
+  };
+  size_t doc_len = g_str.doc_len;
+  s.chunk_end = s.chunk_begin + STRINGS_CHUNK < doc_len ? s.chunk_begin + STRINGS_CHUNK : doc_len;
+
+  // one byte of lookahead for the utf-16 zero byte, padded to whole masks
+  unsigned char *buf = malloc(STRINGS_WINDOW + 128);
+  if(!buf) {
+    __atomic_add_fetch(&g_str.completed, 1, __ATOMIC_RELEASE);
+    return;
+  }
+
+  strings_lookback(&s);
+
+  size_t pos = s.chunk_begin;
+  while(pos < doc_len && !s.failed) {
+    if(pos >= s.chunk_end && !s.t[0].in_run && !s.t[1].in_run && !s.t[2].in_run) {
+      break;
+    }
+    if(worker_group_cancelled(&g_str.group)) {
+      s.failed = true;
+      break;
+    }
+
+    size_t n = doc_len - pos < STRINGS_WINDOW ? doc_len - pos : STRINGS_WINDOW;
+    doc_read_lock();
+    size_t got = doc_read(pos, (char *)buf, n + 1);
+    doc_read_unlock();
+    if(got < n) {
+      s.failed = true;
+      break;
+    }
+    memset(buf + got, 0, STRINGS_WINDOW + 128 - got);
+
+    for(size_t k = 0; k < n; k += 64) {
+      uint64_t printable = byte_stats_printable_mask(buf + k, true);
+      if(k + 64 > n) {
+        printable &= (1ULL << (n - k)) - 1;
+      }
+      strings_feed(&s, &s.t[0], printable, 64, pos + k);
+
+      // a character at i needs a zero at i + 1 that is really in the file
+      uint64_t zero = byte_stats_zero_mask(buf + k + 1);
+      if(k + 65 > got) {
+        zero &= (1ULL << (got - k - 1)) - 1;
+      }
+      uint64_t utf16 = printable & zero;
+      strings_feed(&s, &s.t[1], strings_even_bits(utf16), 32, pos + k);
+      strings_feed(&s, &s.t[2], strings_even_bits(utf16 >> 1), 32, pos + k + 1);
+    }
+    pos += n;
+  }
+  free(buf);
+
+  if(s.failed) {
+    s.chunk->n_runs = 0;
+  } else {
+    // runs still going reach the end of the file
+    strings_end_run(&s, &s.t[0], doc_len);
+    strings_end_run(&s, &s.t[1], doc_len - (doc_len & 1));
+    strings_end_run(&s, &s.t[2], doc_len - ((doc_len - 1) & 1));
+    qsort(s.chunk->runs, s.chunk->n_runs, sizeof(struct strings_run), strings_cmp_run);
+    __atomic_store_n(&s.chunk->done, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&g_str.n_done, 1, __ATOMIC_RELAXED);
+  }
+  __atomic_add_fetch(&g_str.completed, 1, __ATOMIC_RELEASE);
+}
+
+static bool strings_chunk_done(size_t c) {
+  return __atomic_load_n(&g_str.chunks[c].done, __ATOMIC_ACQUIRE);
+}
+
+// queue every chunk that isn't done.  anything already queued is dropped
+// first so no chunk is scanned by two jobs at once.
+static void strings_schedule() {
+  worker_group_cancel(&g_str.group);
+  for(size_t c = 0; c < g_str.n_chunks; ++c) {
+    if(strings_chunk_done(c)) {
+      continue;
+    }
+    g_str.chunks[c].n_runs = 0;
+    if(worker_pool_submit(&g_str.group, strings_scan_job, (void *)c) < 0) {
+      LOG_MSG("Could not queue strings job %lu", c);
+      break;
+    }
+  }
+}
+
+static void strings_reset_chunk(size_t c) {
+  if(g_str.chunks[c].done) {
+    --g_str.n_done;
+  }
+  g_str.chunks[c].done = 0;
+  g_str.chunks[c].n_runs = 0;
+}
+
+// the first chunk a change at offset reaches.  a run reaching into the
+// change from an earlier chunk gets longer or shorter, so that chunk is
+// scanned again too
+static size_t strings_first_changed(size_t offset) {
+  size_t first = offset / STRINGS_CHUNK;
+  first = first < g_str.n_chunks ? first : g_str.n_chunks;
+  while(first > 0 && strings_chunk_done(first - 1) && g_str.chunks[first - 1].n_runs) {
+    struct strings_chunk *prev = &g_str.chunks[first - 1];
+    struct strings_run *r = &prev->runs[prev->n_runs - 1];
+    if(r->offset + r->len < first * STRINGS_CHUNK) {
+      break;
+    }
+    --first;
+  }
+  return first;
+}
+
+// size the chunk table for the current document after its length changed
+// at offset.  the chunks before the change keep their runs, the ones from
+// it on moved and are scanned again
+static int strings_resize(size_t offset) {
+  size_t len = doc_length();
+  if(g_str.chunks && len == g_str.doc_len) {
+    return 0;
+  }
+
+  // the workers index the table
+  worker_group_cancel(&g_str.group);
+
+  size_t n_chunks = (len + STRINGS_CHUNK - 1) / STRINGS_CHUNK;
+  size_t keep = g_str.chunks ? strings_first_changed(offset) : 0;
+  keep = keep < n_chunks ? keep : n_chunks;
+  for(size_t c = keep; c < g_str.n_chunks; ++c) {
+    strings_reset_chunk(c);
+    if(c >= n_chunks) {
+      free(g_str.chunks[c].runs);
+      g_str.chunks[c].runs = NULL;
+      g_str.chunks[c].max_runs = 0;
+    }
+  }
+
+  struct strings_chunk *chunks = realloc(g_str.chunks, (n_chunks ? n_chunks : 1) * sizeof(struct strings_chunk));
+  if(!chunks) {
+    return -1;
+  }
+  if(n_chunks > g_str.n_chunks) {
+    memset(chunks + g_str.n_chunks, 0, (n_chunks - g_str.n_chunks) * sizeof(struct strings_chunk));
+  }
+  g_str.chunks = chunks;
+  g_str.n_chunks = n_chunks;
+  g_str.doc_len = len;
+  ++g_str.completed; // force a redraw
+  return 0;
+}
+
+static void strings_doc_changed(size_t offset, size_t old_len, size_t new_len) {
+  strings_invalidate(offset, old_len > new_len ? old_len : new_len);
+}
+
+bool setup_strings() {
+  worker_group_init(&g_str.group);
+  g_str.initialized = true;
+  return doc_watch(strings_doc_changed) == 0;
+}
+
+void cleanup_strings() {
+  if(!g_str.initialized) {
+    return;
+  }
+  worker_group_destroy(&g_str.group);
+  for(size_t c = 0; c < g_str.n_chunks; ++c) {
+    free(g_str.chunks[c].runs);
+  }
+  free(g_str.chunks);
+  g_str.chunks = NULL;
+  g_str.n_chunks = 0;
+  g_str.initialized = false;
+}
+
+void strings_invalidate(size_t offset, size_t len) {
+  if(!g_str.chunks) {
+    return;
+  }
+
+  if(doc_length() != g_str.doc_len) {
+    // everything from the change on moved, what comes before it stays
+    if(strings_resize(offset) == 0 && g_editor.panel == &g_strings_panel) {
+      strings_schedule();
+    }
+    return;
+  }
+
+  if(offset >= g_str.doc_len) {
+    return;
+  }
+
+  worker_group_cancel(&g_str.group);
+
+  // the next chunk looks back at the last byte of the change
+  size_t first = strings_first_changed(offset);
+  size_t last = (offset + (len ? len : 1) - 1) / STRINGS_CHUNK + 2;
+  last = last < g_str.n_chunks ? last : g_str.n_chunks;
+  for(size_t c = first; c < last; ++c) {
+    strings_reset_chunk(c);
+  }
+  ++g_str.completed; // force a redraw
+
+  if(g_editor.panel == &g_strings_panel) {
+    strings_schedule();
+  }
+}
+
+// first run at or after offset in a finished chunk, NULL if there is none
+static struct strings_run *strings_lower_bound(size_t c, size_t offset) {
+  struct strings_chunk *chunk = &g_str.chunks[c];
+  size_t lo = 0, hi = chunk->n_runs;
+  while(lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if(chunk->runs[mid].offset < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < chunk->n_runs ? &chunk->runs[lo] : NULL;
+}
+
+// the text of a run as ascii, at most n characters
+static int strings_run_text(const struct strings_run *r, char *dst, int n) {
+  char raw[2 * STRINGS_WIDTH];
+  size_t unit = r->kind == STRINGS_UTF16LE ? 2 : 1;
+  size_t want = r->len < n * unit ? r->len : n * unit;
+  want = want < sizeof(raw) ? want : sizeof(raw);
+  size_t got = doc_read(r->offset, raw, want);
+
+  int len = 0;
+  for(size_t i = 0; i < got && len < n; i += unit) {
+    dst[len++] = raw[i];
+  }
+  byte_stats_sanitize(dst, len, ' ');
+  return len;
+}
+
+static void strings_redraw(WINDOW *wnd) {
+  int h, w;
+  getmaxyx(wnd, h, w);
+
+  g_str.drawn = __atomic_load_n(&g_str.completed, __ATOMIC_ACQUIRE);
+  g_str.n_rows = 0;
+  if(!g_str.chunks) {
+    return;
+  }
+
+  size_t n_done = __atomic_load_n(&g_str.n_done, __ATOMIC_RELAXED);
+  char buf[STRINGS_WIDTH + 32];
+  snprintf(buf, sizeof(buf), "strings >= %lu  %3d%%", g_str.min_len,
+      g_str.n_chunks ? (int)(n_done * 100 / g_str.n_chunks) : 100);
+  mvwaddnstr(wnd, 0, 0, buf, w);
+
+  size_t top = g_editor.screen.firstline ? g_editor.screen.firstline->offset : 0;
+  size_t cursor = editor_get_cursor_offset();
+  int y = 1;
+
+  for(size_t c = top / STRINGS_CHUNK; c < g_str.n_chunks && y < h && y < STRINGS_MAX_ROWS; ++c) {
+    if(!strings_chunk_done(c)) {
+      mvwaddnstr(wnd, y, 0, "  scanning...", w);
+      break;
+    }
+    struct strings_run *r = strings_lower_bound(c, top);
+    struct strings_run *end = g_str.chunks[c].runs + g_str.chunks[c].n_runs;
+    for(; r && r < end && y < h && y < STRINGS_MAX_ROWS; ++r, ++y) {
+      bool current = cursor >= r->offset && cursor < r->offset + r->len;
+      wattrset(wnd, current ? A_REVERSE : A_NORMAL);
+      snprintf(buf, sizeof(buf), "%08lx %c ", r->offset, r->kind == STRINGS_ASCII ? 'a' : 'u');
+      mvwaddnstr(wnd, y, 0, buf, w);
+      if(w > STRINGS_TEXT_X) {
+        int n = strings_run_text(r, buf, w - STRINGS_TEXT_X);
+        mvwaddnstr(wnd, y, STRINGS_TEXT_X, buf, n);
+      }
+      g_str.row_offset[y] = r->offset;
+      g_str.n_rows = y + 1;
+    }
+  }
+  wattrset(wnd, A_NORMAL);
+}
+
+static void strings_click(int y, int x) {
+  (void)x;
+  if(y >= 1 && y < g_str.n_rows) {
+    editor_goto_offset_scan(g_str.row_offset[y]);
+  }
+}
+
+static bool strings_idle() {
+  return __atomic_load_n(&g_str.completed, __ATOMIC_ACQUIRE) != g_str.drawn;
+}
+
+static bool strings_busy() {
+  return worker_group_busy(&g_str.group) || strings_idle();
+}
+
+int strings_next() {
+  if(!g_str.chunks || !g_str.n_chunks) {
+    return -1;
+  }
+
+  size_t cursor = editor_get_cursor_offset();
+  for(size_t c = cursor / STRINGS_CHUNK; c < g_str.n_chunks; ++c) {
+    if(!strings_chunk_done(c)) {
+      // scan the rest of the file, the panel may not have been shown yet
+      strings_schedule();
+      int r = editor_wait_progress(&g_str.group, "strings", &g_str.n_done, g_str.n_chunks);
+      if(r < 0 || !strings_chunk_done(c)) {
+        set_status_window_text("strings: cancelled");
+        return -1;
+      }
+    }
+    struct strings_run *r = strings_lower_bound(c, cursor + 1);
+    if(r) {
+      editor_goto_offset_scan(r->offset);
+      set_status_window_text("strings: next string");
+      return 0;
+    }
+  }
+
+  set_status_window_text("strings: no further strings");
+  return -1;
+}
+
+int strings_cmd(int argc, char *argv[]) {
+  if(strings_resize(0) < 0) {
+    set_status_window_text("strings: out of memory");
+    return -1;
+  }
+
+  if(argc > 1 && strcmp(argv[1], "next") == 0) {
+    return strings_next();
+  }
+
+  if(argc > 1) {
+    char *end = NULL;
+    unsigned long n = strtoul(argv[1], &end, 10);
+    if(!end || *end || n == 0) {
+      set_status_window_text("usage: strings [next|<min length>]");
+      return -1;
+    }
+    if(n != g_str.min_len) {
+      worker_group_cancel(&g_str.group);
+      g_str.min_len = n;
+      for(size_t c = 0; c < g_str.n_chunks; ++c) {
+        strings_reset_chunk(c);
+      }
+      ++g_str.completed; // force a redraw
+    }
+  } else if(g_editor.panel == &g_strings_panel) {
+    return editor_show_panel(NULL);
+  }
+
+  int r = editor_show_panel(&g_strings_panel);
+  strings_schedule();
+  return r;
+}
@@ -0,0 +1,26 @@
+#ifndef __STRINGS_PANEL_H__
+#define __STRINGS_PANEL_H__
+
+#include "editor.h"
+
+// strings panel:
+//
+// lists the printable runs of the file, both plain ascii and utf-16le (a
+// printable byte followed by a zero byte), starting at the top of the main
+// window.  the file is scanned in chunks on the worker pool, classifying 64
+// bytes at a time into bitmasks, and the list fills in as chunks complete.
+// clicking a string jumps there.
+//
+#define STRINGS_MIN_DEFAULT 4
+
+extern const panel_ops g_strings_panel;
+
+bool setup_strings();
+void cleanup_strings();
+
+void strings_invalidate(size_t offset, size_t len); // rescan the chunks touching a range
+int strings_next(); // jump to the first string after the cursor
+
+int strings_cmd(int argc, char *argv[]); // ":strings [next|<min length>]"
+
+#endif // __STRINGS_PANEL_H__
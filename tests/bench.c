@@ -0,0 +1,341 @@
+#include "../editor.h"
+#include "../gap_buffer.h"
+#include "../logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+// benchmarks for loading, moving around in and drawing files, and for the gap
+// buffer edits behind typing.
+//
+//   bench [-d dir] [size...]
+//
+// files of each size (1M, 64M, 1G, 10G, ...) are generated into dir in three
+// shapes: short text lines, long lines, and binary with no newlines at all.
+// they are kept between runs.  every file is benchmarked in a child process,
+// so its peak rss is its own and a file too big to load only loses its own
+// results.  curses draws into /dev/null at a fixed window size.
+//
+// results go to stdout one json object per line, so runs can be diffed or
+// collected over time:
+//
+//   {"bench":"load","file":"short-64M","value":812.410,"unit":"ms"}
+
+#define BENCH_SCREEN_LINES "50"
+#define BENCH_SCREEN_COLS "160"
+#define BENCH_GEN_BLOCK (1UL << 20) // bytes generated per write
+#define BENCH_REDRAWS 200           // full redraws timed per file
+#define BENCH_SCROLL_LINES 2000     // lines scrolled down per file
+#define BENCH_GAP_OPS 1000000       // operations per gap buffer benchmark
+
+struct bench_shape {
+  const char *name;
+  size_t min_line; // line lengths are picked from [min_line, max_line]
+  size_t max_line; // 0 means no newlines
+};
+
+static const struct bench_shape g_shapes[] = {
+  { "short", 8, 120 },
+  { "long", 64 << 10, 256 << 10 },
+  { "nonl", 0, 0 },
+};
+
+static uint64_t g_rand = 88172645463325252ULL;
+
+static uint64_t bench_rand() {
+  g_rand ^= g_rand << 13;
+  g_rand ^= g_rand >> 7;
+  g_rand ^= g_rand << 17;
+  return g_rand;
+}
+
+static double bench_now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void bench_result(const char *bench, const char *file, double value, const char *unit) {
+  if(file) {
+    printf("{\"bench\":\"%s\",\"file\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n", bench, file, value, unit);
+  } else {
+    printf("{\"bench\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n", bench, value, unit);
+  }
+  fflush(stdout);
+}
+
+// "64M" and the like, returns 0 if it doesn't parse
+static size_t bench_parse_size(const char *s) {
+  char *end;
+  unsigned long long n = strtoull(s, &end, 10);
+  switch(*end) {
+    case 'k' :
+    case 'K' :
+      n <<= 10;
+      ++end;
+      break;
+    case 'm' :
+    case 'M' :
+      n <<= 20;
+      ++end;
+      break;
+    case 'g' :
+    case 'G' :
+      n <<= 30;
+      ++end;
+      break;
+  }
+  return *end ? 0 : n;
+}
+
+// write len bytes of the shape to path, unless the file is already there
+static int bench_generate(const char *path, const struct bench_shape *shape, size_t len) {
+  struct stat s;
+  if(stat(path, &s) == 0 && (size_t)s.st_size == len) {
+    return 0;
+  }
+
+  char *buf = malloc(BENCH_GEN_BLOCK);
+  if(!buf) {
+    return -1;
+  }
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    free(buf);
+    return -1;
+  }
+
+  g_rand = 88172645463325252ULL;
+  size_t done = 0, line_left = 0;
+  int r = 0;
+  while(done < len && r == 0) {
+    size_t n = len - done < BENCH_GEN_BLOCK ? len - done : BENCH_GEN_BLOCK;
+    for(size_t i = 0; i < n; ++i) {
+      uint64_t x = bench_rand();
+      if(!shape->max_line) {
+        buf[i] = (x & 0xff) == '\n' ? 0 : x & 0xff;
+      } else if(line_left == 0) {
+        buf[i] = '\n';
+        line_left = shape->min_line + x % (shape->max_line - shape->min_line + 1);
+      } else {
+        buf[i] = ' ' + x % 95;
+        --line_left;
+      }
+    }
+    if(write(fd, buf, n) != (ssize_t)n) {
+      r = -1;
+    }
+    done += n;
+  }
+
+  free(buf);
+  if(close(fd) < 0 || r < 0) {
+    unlink(path);
+    return -1;
+  }
+  return 0;
+}
+
+static long bench_rss_kb() {
+  long pages = 0, rss = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if(!f) {
+    return 0;
+  }
+  if(fscanf(f, "%ld %ld", &pages, &rss) != 2) {
+    rss = 0;
+  }
+  fclose(f);
+  return rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// load, navigate and draw one file, run in a child process
+static int bench_file(const char *path, const char *name) {
+  FILE *out = fopen("/dev/null", "w");
+  FILE *in = fopen("/dev/null", "r");
+  setenv("LINES", BENCH_SCREEN_LINES, 1);
+  setenv("COLUMNS", BENCH_SCREEN_COLS, 1);
+  if(!out || !in || !newterm("xterm", out, in) || !setup_windows()) {
+    fprintf(stderr, "%s: could not set up curses\n", name);
+    return -1;
+  }
+
+  long rss_before = bench_rss_kb();
+  double t = bench_now_ms();
+  if(!open_file(path) || !setup_editor()) {
+    fprintf(stderr, "%s: could not load\n", name);
+    return -1;
+  }
+  bench_result("load", name, bench_now_ms() - t, "ms");
+  bench_result("load_rss", name, bench_rss_kb() - rss_before, "KB");
+  bench_result("lines", name, g_editor.data.n_lines, "count");
+
+  long last = g_editor.data.n_lines ? g_editor.data.n_lines - 1 : 0;
+  t = bench_now_ms();
+  editor_goto_line_scan(last / 2);
+  bench_result("goto_middle", name, bench_now_ms() - t, "ms");
+  t = bench_now_ms();
+  editor_goto_line_scan(last);
+  bench_result("goto_last", name, bench_now_ms() - t, "ms");
+  editor_goto_line_scan(0);
+
+  t = bench_now_ms();
+  for(int i = 0; i < BENCH_REDRAWS; ++i) {
+    editor_redraw_main_window_full();
+  }
+  bench_result("redraw", name, (bench_now_ms() - t) * 1e3 / BENCH_REDRAWS, "us/op");
+
+  // down from the top, past the bottom of the screen so that it scrolls
+  int n = 0;
+  t = bench_now_ms();
+  for(; n < BENCH_SCROLL_LINES && n < last; ++n) {
+    editor_line_down_main();
+  }
+  if(n) {
+    bench_result("scroll_down", name, (bench_now_ms() - t) * 1e3 / n, "us/op");
+  }
+
+  cleanup_editor();
+  cleanup_file();
+  cleanup_windows();
+  endwin();
+  return 0;
+}
+
+// fork for a file and report its peak rss, or that it didn't finish
+static void bench_file_child(const char *path, const char *name) {
+  fflush(NULL); // or the child writes out the parent's buffers again
+  pid_t pid = fork();
+  if(pid < 0) {
+    perror("fork");
+    return;
+  }
+  if(pid == 0) {
+    exit(bench_file(path, name) < 0 ? 1 : 0);
+  }
+
+  int status;
+  struct rusage ru;
+  while(wait4(pid, &status, 0, &ru) < 0) {
+    if(errno != EINTR) {
+      perror("wait4");
+      return;
+    }
+  }
+  if(WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+    bench_result("peak_rss", name, ru.ru_maxrss, "KB");
+  } else {
+    bench_result("failed", name, WIFSIGNALED(status) ? WTERMSIG(status) : WEXITSTATUS(status), "status");
+  }
+}
+
+// gap buffer patterns behind typing in a line
+static void bench_gap_buffer() {
+  gap_buffer *gb = gap_buffer_new(16);
+  double t = bench_now_ms();
+  for(int i = 0; i < BENCH_GAP_OPS; ++i) {
+    gap_buffer_addch(gb, 'a');
+  }
+  bench_result("gap_append", NULL, (bench_now_ms() - t) * 1e6 / BENCH_GAP_OPS, "ns/op");
+
+  // a key typed somewhere in a 4 KB line, which moves the gap there
+  gap_buffer *line = gap_buffer_new(4096);
+  for(int i = 0; i < 4096; ++i) {
+    gap_buffer_addch(line, 'b');
+  }
+  t = bench_now_ms();
+  for(int i = 0; i < BENCH_GAP_OPS; ++i) {
+    gap_buffer_setcursor(line, bench_rand() % (gap_buffer_length(line) + 1));
+    gap_buffer_addch(line, 'c');
+    gap_buffer_delch(line);
+  }
+  bench_result("gap_insert_random", NULL, (bench_now_ms() - t) * 1e6 / BENCH_GAP_OPS, "ns/op");
+
+  // cursor moves alone only shift the gap on the next edit
+  t = bench_now_ms();
+  for(int i = 0; i < BENCH_GAP_OPS; ++i) {
+    gap_buffer_movecursor(line, (int)(bench_rand() % 17) - 8);
+  }
+  bench_result("gap_move", NULL, (bench_now_ms() - t) * 1e6 / BENCH_GAP_OPS, "ns/op");
+
+  t = bench_now_ms();
+  gap_buffer_setcursor(gb, gap_buffer_length(gb));
+  for(int i = 0; i < BENCH_GAP_OPS; ++i) {
+    gap_buffer_delch(gb);
+  }
+  bench_result("gap_backspace", NULL, (bench_now_ms() - t) * 1e6 / BENCH_GAP_OPS, "ns/op");
+
+  gap_buffer_delete(line);
+  gap_buffer_delete(gb);
+}
+
+static void usage(const char *progname) {
+  fprintf(stderr, "Usage: %s [-d dir] [size...]\n"
+      "  -d dir  where the generated files are kept (default /tmp/hexeditor-bench)\n"
+      "  size    file sizes to generate and load, like 1M or 10G (default 1M 64M)\n",
+      progname);
+}
+
+int main(int argc, char *argv[]) {
+  const char *dir = "/tmp/hexeditor-bench";
+  const char *default_sizes[] = { "1M", "64M" };
+  const char **sizes = default_sizes;
+  int n_sizes = 2;
+  char path[4096], name[64];
+
+  int opt;
+  while((opt = getopt(argc, argv, "d:h")) != -1) {
+    switch(opt) {
+      case 'd' :
+        dir = optarg;
+        break;
+      default :
+        usage(argv[0]);
+        return -1;
+    }
+  }
+  if(optind < argc) {
+    sizes = (const char **)argv + optind;
+    n_sizes = argc - optind;
+  }
+
+  if(mkdir(dir, 0755) < 0 && errno != EEXIST) {
+    perror(dir);
+    return -1;
+  }
+  snprintf(path, sizeof(path), "%s/bench.log", dir);
+  setup_logger(path);
+
+  bench_gap_buffer();
+
+  for(int i = 0; i < n_sizes; ++i) {
+    size_t len = bench_parse_size(sizes[i]);
+    if(!len) {
+      usage(argv[0]);
+      return -1;
+    }
+    for(size_t k = 0; k < sizeof(g_shapes) / sizeof(g_shapes[0]); ++k) {
+      snprintf(name, sizeof(name), "%s-%s", g_shapes[k].name, sizes[i]);
+      snprintf(path, sizeof(path), "%s/%s", dir, name);
+      double t = bench_now_ms();
+      if(bench_generate(path, &g_shapes[k], len) < 0) {
+        perror(path);
+        return -1;
+      }
+      LOG_MSG("bench: %s ready in %.0f ms", name, bench_now_ms() - t);
+      bench_file_child(path, name);
+    }
+  }
+
+  cleanup_logger();
+  return 0;
+}
@@ -0,0 +1,129 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "../byte_stats.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define BUF_LEN 4096
+
+int g_failures = 0;
+
+static size_t run_length_scalar(const unsigned char *p, size_t n, unsigned char c) {
+  size_t i = 0;
+  while(i < n && p[i] == c) {
+    ++i;
+  }
+  return i;
+}
+
+static bool printable_scalar(unsigned char c, bool tab) {
+  return (c >= 0x20 && c < 0x7f) || (tab && c == '\t');
+}
+
+static bool uniform_scalar(const unsigned char *p, size_t n) {
+  return n > 0 && run_length_scalar(p, n, p[0]) == n;
+}
+
+// a run of one byte broken at a random place, or not at all, at every
+// alignment and length, so the break lands in each 16 byte lane of the
+// 64 byte blocks and in the scalar tail
+void test_runs() {
+  printf("\n\ntest_runs\n");
+  unsigned char buf[BUF_LEN + 64];
+  bool run_ok = true, uniform_ok = true;
+  srand(1);
+
+  for(int i = 0; i < 20000; ++i) {
+    unsigned char c = i % 3 == 0 ? 0 : rand();
+    size_t start = rand() % 64;
+    size_t n = rand() % (i % 2 ? 200 : BUF_LEN);
+    memset(buf, c, sizeof(buf));
+    if(n > 0 && rand() % 4) {
+      buf[start + rand() % n] = c ^ (1 + rand() % 255);
+    }
+    unsigned char look = rand() % 8 ? c : c + 1;
+    if(byte_stats_run_length(buf + start, n, look) != run_length_scalar(buf + start, n, look)) {
+      run_ok = false;
+    }
+    if(byte_stats_uniform(buf + start, n) != uniform_scalar(buf + start, n)) {
+      uniform_ok = false;
+    }
+  }
+  check_assert(run_ok, "vector and scalar run length agree");
+  check_assert(uniform_ok, "vector and scalar uniform test agree");
+
+  memset(buf, 0, sizeof(buf));
+  check_assert(byte_stats_run_length(buf, BUF_LEN, 0) == BUF_LEN, "run to the end");
+  check_assert(byte_stats_run_length(buf, 0, 0) == 0 && !byte_stats_uniform(buf, 0), "empty range");
+  buf[64 + 17] = 1;
+  check_assert(byte_stats_run_length(buf, BUF_LEN, 0) == 64 + 17, "run broken in the second lane of a block");
+  check_assert(!byte_stats_uniform(buf, BUF_LEN) && byte_stats_uniform(buf, 64 + 17), "uniform up to the break");
+}
+
+// the 64 byte classifiers of the strings scan and the sanitizer of the
+// renderer, on random bytes weighted towards the edges of printable ascii
+void test_masks() {
+  printf("\n\ntest_masks\n");
+  static const unsigned char edges[] = { 0x00, 0x09, 0x0a, 0x1f, 0x20, 0x7e, 0x7f, 0x80, 0xa0, 0xff };
+  unsigned char buf[BUF_LEN];
+  char vec[BUF_LEN], ref[BUF_LEN];
+  bool printable_ok = true, zero_ok = true, sanitize_ok = true;
+  srand(2);
+
+  for(size_t i = 0; i < BUF_LEN; ++i) {
+    buf[i] = rand() % 2 ? edges[rand() % sizeof(edges)] : rand();
+  }
+  for(size_t k = 0; k + 64 <= BUF_LEN; ++k) {
+    uint64_t printable = 0, printable_tab = 0, zero = 0;
+    for(int i = 0; i < 64; ++i) {
+      printable |= (uint64_t)printable_scalar(buf[k + i], false) << i;
+      printable_tab |= (uint64_t)printable_scalar(buf[k + i], true) << i;
+      zero |= (uint64_t)(buf[k + i] == 0) << i;
+    }
+    if(byte_stats_printable_mask(buf + k, false) != printable || byte_stats_printable_mask(buf + k, true) != printable_tab) {
+      printable_ok = false;
+    }
+    if(byte_stats_zero_mask(buf + k) != zero) {
+      zero_ok = false;
+    }
+  }
+  check_assert(printable_ok, "vector and scalar printable masks agree");
+  check_assert(zero_ok, "vector and scalar zero masks agree");
+
+  for(int i = 0; i < 2000; ++i) {
+    size_t start = rand() % 32;
+    size_t n = rand() % (BUF_LEN - start);
+    memcpy(vec, buf + start, n);
+    for(size_t j = 0; j < n; ++j) {
+      ref[j] = printable_scalar(buf[start + j], false) ? buf[start + j] : '.';
+    }
+    byte_stats_sanitize(vec, n, '.');
+    if(memcmp(vec, ref, n) != 0) {
+      sanitize_ok = false;
+    }
+  }
+  check_assert(sanitize_ok, "vector and scalar sanitize agree");
+}
+
+int main(int argc, char *argv[]) {
+  test_runs();
+  test_masks();
+
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,122 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "../checksum.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+int g_failures = 0;
+
+const char *g_check = "123456789";
+
+void test_crc() {
+  printf("\n\ntest_crc\n");
+
+  check_assert(crc32_update(CRC32_INIT, g_check, 9) == 0xcbf43926, "crc32 check value");
+  check_assert(crc32c_update(CRC32_INIT, g_check, 9) == 0xe3069283, "crc32c check value");
+  check_assert(crc32_update(CRC32_INIT, "", 0) == 0, "crc32 of nothing");
+
+  uint32_t c = crc32_update(CRC32_INIT, g_check, 4);
+  c = crc32_update(c, g_check + 4, 5);
+  check_assert(c == 0xcbf43926, "crc32 in two pieces");
+
+  printf("crc32c hardware: %s\n", crc32c_hardware() ? "yes" : "no");
+}
+
+void test_crc_combine() {
+  printf("\n\ntest_crc_combine\n");
+
+  // long enough to go through the 8 byte loops, odd split to hit the tails
+  size_t len = 100003, split = 33331;
+  unsigned char *buf = malloc(len);
+  for(size_t i = 0; i < len; ++i) {
+    buf[i] = (i * 2654435761U) >> 13;
+  }
+
+  uint32_t whole = crc32_update(CRC32_INIT, buf, len);
+  uint32_t a = crc32_update(CRC32_INIT, buf, split);
+  uint32_t b = crc32_update(CRC32_INIT, buf + split, len - split);
+  check_assert(crc32_combine(a, b, len - split) == whole, "crc32 combine");
+
+  whole = crc32c_update(CRC32_INIT, buf, len);
+  a = crc32c_update(CRC32_INIT, buf, split);
+  b = crc32c_update(CRC32_INIT, buf + split, len - split);
+  check_assert(crc32c_combine(a, b, len - split) == whole, "crc32c combine");
+
+  free(buf);
+}
+
+void test_xxh64() {
+  printf("\n\ntest_xxh64\n");
+  xxh64_state s;
+
+  xxh64_init(&s, 0);
+  check_assert(xxh64_final(&s) == 0xef46db3751d8e999ULL, "xxh64 of nothing");
+
+  xxh64_init(&s, 0);
+  xxh64_update(&s, "a", 1);
+  check_assert(xxh64_final(&s) == 0xd24ec4f1a98c6e5bULL, "xxh64 of a");
+
+  const char *fox = "The quick brown fox jumps over the lazy dog";
+  xxh64_init(&s, 0);
+  xxh64_update(&s, fox, strlen(fox));
+  uint64_t whole = xxh64_final(&s);
+  check_assert(whole == 0x0b242d361fda71bcULL, "xxh64 of fox");
+
+  xxh64_init(&s, 0);
+  for(const char *p = fox; *p; ++p) {
+    xxh64_update(&s, p, 1);
+  }
+  check_assert(xxh64_final(&s) == whole, "xxh64 a byte at a time");
+}
+
+void test_sha256() {
+  printf("\n\ntest_sha256\n");
+  sha256_state s;
+  unsigned char d[32];
+  char hex[65];
+
+  sha256_init(&s);
+  sha256_update(&s, "abc", 3);
+  sha256_final(&s, d);
+  for(int i = 0; i < 32; ++i) {
+    sprintf(hex + i * 2, "%02x", d[i]);
+  }
+  check_assert(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0, "sha256 of abc");
+
+  // 56 bytes pushes the length into a second padding block
+  const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+  sha256_init(&s);
+  sha256_update(&s, two, 20);
+  sha256_update(&s, two + 20, strlen(two) - 20);
+  sha256_final(&s, d);
+  for(int i = 0; i < 32; ++i) {
+    sprintf(hex + i * 2, "%02x", d[i]);
+  }
+  check_assert(strcmp(hex, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0, "sha256 two blocks");
+}
+
+int main(int argc, char *argv[]) {
+
+  test_crc();
+  test_crc_combine();
+  test_xxh64();
+  test_sha256();
+
+  return g_failures ? -1 : 0;
+}
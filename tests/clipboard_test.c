@@ -0,0 +1,152 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../clipboard.h"
+#include "../save.h"
+#include "../undo.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define BIG_LEN (1UL << 20)
+
+int g_failures = 0;
+
+static char g_path[] = "/tmp/clipboard_test.XXXXXX";
+
+static void write_file(const char *data, size_t len) {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp && fwrite(data, 1, len, fp) == len && fclose(fp) == 0, "file written");
+}
+
+static bool doc_is(const char *data) {
+  char buf[256];
+  size_t n = doc_read(0, buf, sizeof(buf));
+  return n == strlen(data) && doc_length() == n && memcmp(buf, data, n) == 0;
+}
+
+static void open_editor() {
+  fail_assert(open_file(g_path) && setup_editor() && setup_undo(), "file opens");
+}
+
+static void close_editor() {
+  clip_clear();
+  cleanup_undo();
+  cleanup_editor();
+  cleanup_file();
+}
+
+void test_yank_put() {
+  printf("\n\ntest_yank_put\n");
+  write_file("0123456789", 10);
+  open_editor();
+
+  check_assert(clip_put(0) < 0 && doc_is("0123456789"), "nothing to put");
+  check_assert(clip_yank(8, 3) < 0 && clip_length() == 0, "range past the end refused");
+  check_assert(clip_yank(2, 3) == 0 && clip_length() == 3, "range yanked");
+  check_assert(clip_put(10) == 0 && doc_is("0123456789234"), "put at the end");
+  check_assert(clip_put(0) == 0 && doc_is("2340123456789234"), "put again at the start");
+  check_assert(clip_delete(3, 4) == 0 && doc_is("234456789234"), "range cut");
+  check_assert(clip_length() == 4 && clip_put(12) == 0 && doc_is("2344567892340123"), "cut bytes put back");
+  close_editor();
+}
+
+// overwritten bytes are copied when yanked, later overwrites don't reach them
+void test_overwritten() {
+  printf("\n\ntest_overwritten\n");
+  write_file("0123456789", 10);
+  open_editor();
+
+  doc_overwrite(2, "XY", 2);
+  check_assert(clip_yank(0, 5) == 0, "range with overwritten bytes yanked");
+  doc_overwrite(2, "ZZ", 2);
+  check_assert(clip_put(10) == 0 && doc_is("01ZZ45678901XY4"), "yanked bytes as they were");
+  close_editor();
+}
+
+// a megabyte is yanked as a reference and put as one
+void test_big() {
+  printf("\n\ntest_big\n");
+  char *data = malloc(BIG_LEN), *buf = malloc(2 * BIG_LEN);
+  fail_assert(data && buf, "data");
+  for(size_t i = 0; i < BIG_LEN; ++i) {
+    data[i] = i * 13;
+  }
+  write_file(data, BIG_LEN);
+  open_editor();
+
+  check_assert(clip_yank(0, BIG_LEN) == 0 && clip_memory() < 1024, "yank refers to the file");
+  check_assert(clip_put(BIG_LEN / 2) == 0 && doc_length() == 2 * BIG_LEN, "put in the middle");
+  check_assert(doc_read(0, buf, 2 * BIG_LEN) == 2 * BIG_LEN
+      && memcmp(buf, data, BIG_LEN / 2) == 0
+      && memcmp(buf + BIG_LEN / 2, data, BIG_LEN) == 0
+      && memcmp(buf + BIG_LEN + BIG_LEN / 2, data + BIG_LEN / 2, BIG_LEN / 2) == 0, "document holds both copies");
+  close_editor();
+  free(data);
+  free(buf);
+}
+
+// saving in place changes the file bytes the clipboard refers to, they are
+// stashed before they go
+void test_after_save() {
+  printf("\n\ntest_after_save\n");
+  write_file("0123456789", 10);
+  open_editor();
+
+  check_assert(clip_yank(0, 5) == 0, "file bytes yanked");
+  doc_overwrite(1, "AB", 2);
+  check_assert(save_cmd(1, NULL) == 0, "overwrite saved in place");
+  check_assert(clip_put(10) == 0 && doc_is("0AB345678901234"), "yanked bytes survive the save");
+  close_editor();
+}
+
+// the document and its watchers are set up once per process, so every
+// test gets a process of its own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+    test();
+    cleanup_windows();
+    cleanup_curses();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int fd = mkstemp(g_path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+
+  run(test_yank_put);
+  run(test_overwritten);
+  run(test_big);
+  run(test_after_save);
+
+  unlink(g_path);
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../compare.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define FILE_LEN (1UL << 20)
+#define INSERT_AT 200000
+#define INSERT_LEN 100
+#define DELETE_AT 500000
+#define DELETE_LEN 50
+#define CHANGE_AT 800001 // off a block boundary
+#define CHANGE_LEN 10
+
+int g_failures = 0;
+
+static char g_a[] = "/tmp/compare_test_a.XXXXXX";
+static char g_b[] = "/tmp/compare_test_b.XXXXXX";
+static unsigned char g_data[FILE_LEN];
+
+static void write_file(const char *path, const unsigned char *p, size_t n) {
+  FILE *fp = fopen(path, "w");
+  fail_assert(fp && fwrite(p, 1, n, fp) == n && fclose(fp) == 0, "file written");
+}
+
+static bool hunk_is(size_t i, size_t a_off, size_t a_len, size_t b_off, size_t b_len) {
+  const compare_hunk *h = &g_compare.hunks[i];
+  return i < g_compare.n_hunks && h->a_off == a_off && h->a_len == a_len && h->b_off == b_off && h->b_len == b_len;
+}
+
+static int compare_with(const char *path) {
+  if(g_cmpfile.filename) {
+    file_close(&g_cmpfile);
+  }
+  fail_assert(file_open(&g_cmpfile, path, O_RDONLY), "other side opens");
+  return compare_run();
+}
+
+void test_same() {
+  printf("\n\ntest_same\n");
+  write_file(g_b, g_data, FILE_LEN);
+  check_assert(compare_with(g_b) == 0 && g_compare.valid, "compare runs");
+  check_assert(g_compare.n_hunks == 0, "no differences");
+  check_assert(compare_map_offset(12345) == 12345, "offsets map to themselves");
+}
+
+// an insertion, a deletion and a change, each chosen so that no byte next to
+// it could also be part of it.  the data lines up again after each one.
+void test_edits() {
+  printf("\n\ntest_edits\n");
+  static unsigned char b[FILE_LEN + INSERT_LEN];
+  size_t n = 0;
+
+  memcpy(b, g_data, INSERT_AT);
+  n += INSERT_AT;
+  for(size_t i = 0; i < INSERT_LEN; ++i) {
+    b[n + i] = g_data[INSERT_AT + i] ^ 0x5a;
+  }
+  b[n + INSERT_LEN - 1] = g_data[INSERT_AT - 1] ^ 1;
+  n += INSERT_LEN;
+  memcpy(b + n, g_data + INSERT_AT, DELETE_AT - INSERT_AT);
+  n += DELETE_AT - INSERT_AT;
+  memcpy(b + n, g_data + DELETE_AT + DELETE_LEN, FILE_LEN - DELETE_AT - DELETE_LEN);
+  size_t change = n + CHANGE_AT - DELETE_AT - DELETE_LEN;
+  n += FILE_LEN - DELETE_AT - DELETE_LEN;
+  for(size_t i = 0; i < CHANGE_LEN; ++i) {
+    b[change + i] ^= 0xff;
+  }
+  write_file(g_b, b, n);
+
+  check_assert(compare_with(g_b) == 0 && g_compare.valid, "compare runs");
+  check_assert(g_compare.n_hunks == 3, "three differences");
+  check_assert(hunk_is(0, INSERT_AT, 0, INSERT_AT, INSERT_LEN), "insertion");
+  check_assert(hunk_is(1, DELETE_AT, DELETE_LEN, DELETE_AT + INSERT_LEN, 0), "deletion");
+  check_assert(hunk_is(2, CHANGE_AT, CHANGE_LEN, CHANGE_AT + INSERT_LEN - DELETE_LEN, CHANGE_LEN), "change");
+
+  check_assert(compare_map_offset(INSERT_AT - 1) == INSERT_AT - 1, "offset before the insertion");
+  check_assert(compare_map_offset(300000) == 300000 + INSERT_LEN, "offset after the insertion");
+  check_assert(compare_map_offset(600000) == 600000 + INSERT_LEN - DELETE_LEN, "offset after the deletion");
+  check_assert(compare_map_offset(CHANGE_AT + 5) == change + 5, "offset in the change");
+  check_assert(compare_find_hunk(DELETE_AT + 10) == 1 && compare_find_hunk(0) == -1, "hunks found by offset");
+}
+
+// the other side stops short, what's left of the document is one hunk
+void test_truncated() {
+  printf("\n\ntest_truncated\n");
+  write_file(g_b, g_data, FILE_LEN - 1000);
+  check_assert(compare_with(g_b) == 0 && g_compare.n_hunks == 1, "one difference");
+  check_assert(hunk_is(0, FILE_LEN - 1000, 1000, FILE_LEN - 1000, 0), "missing tail");
+}
+
+int main(int argc, char *argv[]) {
+  int fd_a = mkstemp(g_a), fd_b = mkstemp(g_b);
+  fail_assert(fd_a >= 0 && fd_b >= 0, "temporary files");
+  close(fd_a);
+  close(fd_b);
+
+  srand(4);
+  for(size_t i = 0; i < FILE_LEN; ++i) {
+    g_data[i] = rand();
+  }
+  // the deleted bytes differ from the ones that take their place on either side
+  g_data[DELETE_AT] = g_data[DELETE_AT + DELETE_LEN] ^ 1;
+  g_data[DELETE_AT + DELETE_LEN - 1] = g_data[DELETE_AT - 1] ^ 1;
+  write_file(g_a, g_data, FILE_LEN);
+
+  fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+  fail_assert(open_file(g_a) && setup_editor(), "document opens");
+
+  test_same();
+  test_edits();
+  test_truncated();
+
+  compare_free();
+  file_close(&g_cmpfile);
+  cleanup_editor();
+  cleanup_file();
+  cleanup_windows();
+  cleanup_curses();
+  unlink(g_a);
+  unlink(g_b);
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,599 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "../editor.h"
+#include "../document.h"
+#include "../gap_buffer.h"
+#include "../insert_mode.h"
+#include "../memstat.h"
+#include "../overview.h"
+#include "../skip.h"
+#include "../strings_panel.h"
+#include "../worker_pool.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define N_LINES 2000
+#define LONG_LINE (1UL << 20)
+#define HOLE (4UL << 20)
+#define STRINGS_FILE ((9UL << 20) + 12345) // three strings chunks
+#define SHORT_RUNS (128UL << 20)           // long enough for a skip to be cancelled part way
+#define REGION (64UL << 10)                // each region of the overview file
+#define REGION_EDIT 4096                   // bytes inserted and deleted, one overview block
+
+int g_failures = 0;
+
+static char g_path[] = "/tmp/editor_test.XXXXXX";
+
+// what the document should hold after the keys typed so far
+static char g_model[1024];
+static size_t g_model_len;
+
+static void write_lines() {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp, "file opens for writing");
+  for(int i = 0; i < N_LINES; ++i) {
+    fprintf(fp, "line %04d %053d\n", i, i);
+  }
+  fail_assert(fclose(fp) == 0, "lines written");
+}
+
+// one line with no newline, a-z over and over
+static void write_long_line() {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp, "file opens for writing");
+  for(size_t i = 0; i < LONG_LINE; ++i) {
+    fputc('a' + i % 26, fp);
+  }
+  fail_assert(fclose(fp) == 0, "long line written");
+}
+
+// "abc", a hole and "tail", all on one line
+static void write_sparse() {
+  int fd = open(g_path, O_WRONLY | O_TRUNC);
+  fail_assert(fd >= 0 && write(fd, "abc", 3) == 3, "file opens for writing");
+  fail_assert(pwrite(fd, "tail", 4, 3 + HOLE) == 4 && close(fd) == 0, "sparse file written");
+}
+
+// every other 64 byte block is one byte, too short to be fill, between
+// blocks with no two bytes alike
+static void write_short_runs() {
+  static unsigned char block[128];
+  for(int i = 0; i < 64; ++i) {
+    block[i] = i + 1;
+  }
+  memset(block + 64, 'x', 64);
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp, "file opens for writing");
+  for(size_t i = 0; i < SHORT_RUNS; i += sizeof(block)) {
+    fwrite(block, 1, sizeof(block), fp);
+  }
+  fail_assert(fclose(fp) == 0, "short runs written");
+}
+
+static bool is_printable(unsigned char c) {
+  return (c >= 0x20 && c < 0x7f) || c == '\t';
+}
+
+// mark the start of every run of at least STRINGS_MIN_DEFAULT characters,
+// ascii and utf-16le at both parities, a byte at a time
+static void strings_scalar(const unsigned char *p, size_t n, bool *start) {
+  for(size_t i = 0; i < n; ) {
+    size_t b = i;
+    while(i < n && is_printable(p[i])) {
+      ++i;
+    }
+    start[b] |= i - b >= STRINGS_MIN_DEFAULT;
+    i += i == b;
+  }
+  for(size_t parity = 0; parity < 2; ++parity) {
+    for(size_t i = parity; i + 1 < n; ) {
+      size_t b = i;
+      while(i + 1 < n && is_printable(p[i]) && p[i + 1] == 0) {
+        i += 2;
+      }
+      start[b] |= (i - b) / 2 >= STRINGS_MIN_DEFAULT;
+      i += i == b ? 2 : 0;
+    }
+  }
+}
+
+// strings of both kinds and all lengths around the minimum planted in
+// non-printable bytes and newlines, the last two across chunk boundaries
+static unsigned char *make_strings() {
+  unsigned char *p = malloc(STRINGS_FILE);
+  fail_assert(p, "strings buffer");
+  srand(3);
+  for(size_t i = 0; i < STRINGS_FILE; ++i) {
+    p[i] = i % 1000 == 999 ? '\n' : 0x80;
+  }
+  for(int k = 0; k < 302; ++k) {
+    size_t at = k == 300 ? (4UL << 20) - 3 : k == 301 ? (8UL << 20) - 5 : 1 + rand() % (STRINGS_FILE - 64);
+    size_t len = k >= 300 ? 6 : 1 + rand() % 8;
+    bool utf16 = k == 301 || (k < 300 && rand() % 2);
+    for(size_t j = 0; j < len; ++j) {
+      unsigned char c = rand() % 8 ? 'a' + rand() % 26 : '\t';
+      if(utf16) {
+        p[at + 2 * j] = c;
+        p[at + 2 * j + 1] = 0;
+      } else {
+        p[at + j] = c;
+      }
+    }
+  }
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp && fwrite(p, 1, STRINGS_FILE, fp) == STRINGS_FILE && fclose(fp) == 0, "strings file written");
+  return p;
+}
+
+// :strings next from the start of the document stops at each start marked
+// by the scalar scan, and nowhere else
+static bool strings_match(const bool *start, size_t len, size_t *found) {
+  char *next[] = { "strings", "next" };
+  size_t want = 1, n = 0;
+  bool same = true;
+  editor_goto_offset_scan(0);
+  while(strings_cmd(2, next) == 0) {
+    while(want < len && !start[want]) {
+      ++want;
+    }
+    same = same && editor_get_cursor_offset() == want;
+    ++want;
+    ++n;
+  }
+  while(want < len && !start[want]) {
+    ++want;
+  }
+  *found = n;
+  return same && want == len;
+}
+
+// random bytes, zeros and random bytes again, a region of each
+static void write_regions() {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp, "file opens for writing");
+  srand(6);
+  for(size_t i = 0; i < 3 * REGION; ++i) {
+    fputc(i >= REGION && i < 2 * REGION ? 0 : rand(), fp);
+  }
+  fail_assert(fclose(fp) == 0, "regions written");
+}
+
+static void model_insert(size_t at, char c) {
+  memmove(g_model + at + 1, g_model + at, g_model_len - at);
+  g_model[at] = c;
+  ++g_model_len;
+}
+
+static void model_delete(size_t at) {
+  memmove(g_model + at, g_model + at + 1, g_model_len - at - 1);
+  --g_model_len;
+}
+
+static size_t model_line(size_t number) {
+  size_t at = 0;
+  for(; number > 0; --number) {
+    at = (char *)memchr(g_model + at, '\n', g_model_len - at) - g_model + 1;
+  }
+  return at;
+}
+
+static bool doc_is_model() {
+  char buf[sizeof(g_model)];
+  return doc_length() == g_model_len && doc_read(0, buf, g_model_len) == g_model_len
+    && memcmp(buf, g_model, g_model_len) == 0;
+}
+
+// the text drawn on a row of the main window starts with s
+static bool row_is(int row, const char *s) {
+  char buf[64] = "";
+  return mvwinnstr(g_windows.mainwnd, row, 0, buf, strlen(s)) == (int)strlen(s) && strcmp(buf, s) == 0;
+}
+
+static void keys(int c, int n) {
+  while(n-- > 0) {
+    insert_mode_new_char(c);
+  }
+}
+
+// every line of the model starts where the editor has it, and the rows on
+// the screen show them
+static bool lines_are_model() {
+  size_t n = 0;
+  bool ok = true;
+  for(size_t at = 0; at < g_model_len; ++n) {
+    editor_goto_offset_scan(at);
+    ok = ok && editor_get_cursor_offset() == at;
+    const char *nl = memchr(g_model + at, '\n', g_model_len - at);
+    at = nl ? (size_t)(nl - g_model) + 1 : g_model_len;
+  }
+  editor_redraw_main_window_full();
+  for(int row = 0; row < g_windows.mainwnd_geom.h && row + editor_get_top_line() < (long)n; ++row) {
+    char text[16] = "";
+    size_t at = model_line(row + editor_get_top_line());
+    size_t len = strcspn(g_model + at, "\n");
+    memcpy(text, g_model + at, len < 8 ? len : 8);
+    ok = ok && row_is(row, text);
+  }
+  return ok && g_editor.data.n_lines == n;
+}
+
+// gap buffers that can be made to run out of memory
+static bool g_alloc_fails = false;
+
+static void *failing_alloc(size_t len, void *ctx) {
+  (void)ctx;
+  return g_alloc_fails ? NULL : malloc(len);
+}
+
+static void *failing_realloc(void *p, size_t old_len, size_t new_len, void *ctx) {
+  (void)ctx;
+  return g_alloc_fails ? NULL : realloc(p, new_len);
+}
+
+static void failing_free(void *p, size_t len, void *ctx) {
+  (void)ctx;
+  free(p);
+}
+
+static const gap_buffer_allocator g_failing_allocator = {
+  failing_alloc,
+  failing_realloc,
+  failing_free,
+  NULL
+};
+
+static char byte_at(size_t offset) {
+  char c = 0;
+  doc_read(offset, &c, 1);
+  return c;
+}
+
+// scrolling through the file drops the clean lines behind the screen, the
+// line typed into stays
+void test_evict() {
+  printf("\n\ntest_evict\n");
+  char *limit[] = { "mem", "limit", "8k" };
+  memstat m;
+  bool under = true;
+
+  write_lines();
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+  check_assert(editor_insert_char_main('x') == 0, "typed on the first line");
+  check_assert(mem_cmd(3, limit) == 0, "line memory limited");
+
+  for(long line = 0; line < N_LINES; line += 20) {
+    editor_goto_line_scan(line);
+    editor_redraw_main_window_full();
+    memstat_collect(&m);
+    under = under && m.line_cache <= m.line_limit;
+  }
+  check_assert(under, "clean lines stay under the limit while scrolling");
+  check_assert(m.lines_loaded < 100, "lines behind the screen evicted");
+  check_assert(m.lines_dirty == 1, "typed line kept");
+
+  editor_goto_line_scan(0);
+  editor_redraw_main_window_full();
+  check_assert(byte_at(0) == 'x' && byte_at(1) == 'l', "typed line still reads back");
+  cleanup_editor();
+  cleanup_file();
+}
+
+// enter splits the line at the cursor and backspace at the start of a line
+// joins it to the one above, on the screen and in the document, with the
+// lines after an edit moved lazily until the next one
+void test_insert() {
+  printf("\n\ntest_insert\n");
+  FILE *fp = fopen(g_path, "w");
+  g_model_len = 0;
+  for(int i = 0; i < 40; ++i) {
+    g_model_len += sprintf(g_model + g_model_len, "line %02d\n", i);
+  }
+  fail_assert(fp && fwrite(g_model, 1, g_model_len, fp) == g_model_len && fclose(fp) == 0, "lines written");
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+  editor_redraw_main_window_full();
+
+  keys(KEY_RIGHT, 4);
+  keys('\n', 1);
+  model_insert(4, '\n');
+  check_assert(doc_is_model() && g_editor.data.n_lines == 41, "line split");
+  check_assert(editor_get_cursor_offset() == 5 && row_is(0, "line") && row_is(1, " 00") && row_is(2, "line 01"),
+      "cursor and text on the new line");
+  keys('a', 1);
+  keys('b', 1);
+  model_insert(5, 'a');
+  model_insert(6, 'b');
+  check_assert(doc_is_model() && row_is(1, "ab 00"), "typed on the new line");
+
+  keys(KEY_BACKSPACE, 3);
+  model_delete(6);
+  model_delete(5);
+  model_delete(4);
+  check_assert(doc_is_model() && g_editor.data.n_lines == 40, "lines joined");
+  check_assert(editor_get_cursor_offset() == 4 && row_is(0, "line 00") && row_is(1, "line 01"), "cursor where the newline was");
+
+  // a split on the last row scrolls the screen
+  int last = g_windows.mainwnd_geom.h - 1;
+  keys(KEY_DOWN, last);
+  keys('\n', 1);
+  model_insert(model_line(last) + 4, '\n');
+  check_assert(doc_is_model() && editor_get_top_line() == 1, "split on the last row scrolls");
+  check_assert(row_is(last, " 21") && row_is(last - 1, "line"), "split line drawn");
+
+  keys(KEY_UP, 16);
+  keys('Y', 1);
+  model_insert(model_line(last + 1 - 16), 'Y');
+  keys(KEY_DOWN, 20);
+  keys(KEY_RIGHT, 1);
+  keys('Z', 1);
+  model_insert(model_line(last + 1 + 4) + 2, 'Z');
+  keys(KEY_UP, 10);
+  keys(KEY_BACKSPACE, 1);
+  model_delete(model_line(last + 1 - 6) + 2);
+  check_assert(doc_is_model(), "edits on lines above and below each other");
+  check_assert(editor_get_cursor_offset() == model_line(last + 1 - 6) + 2, "cursor after the last edit");
+
+  check_assert(lines_are_model(), "every line starts where the document says");
+
+  editor_goto_offset_scan(0);
+  keys(KEY_BACKSPACE, 1);
+  check_assert(doc_is_model() && editor_get_cursor_offset() == 0, "backspace at the start of the document does nothing");
+  cleanup_editor();
+  cleanup_file();
+}
+
+// keys the document takes but the lines have no memory for are loaded from
+// the document instead, and the lines after them stay where they were
+void test_insert_no_memory() {
+  printf("\n\ntest_insert_no_memory\n");
+  FILE *fp = fopen(g_path, "w");
+  g_model_len = 0;
+  for(int i = 0; i < 40; ++i) {
+    g_model_len += sprintf(g_model + g_model_len, "line %02d\n", i);
+  }
+  fail_assert(fp && fwrite(g_model, 1, g_model_len, fp) == g_model_len && fclose(fp) == 0, "lines written");
+  gap_buffer_set_allocator(&g_failing_allocator);
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+  editor_redraw_main_window_full();
+
+  g_alloc_fails = true;
+  editor_goto_offset_scan(model_line(5) + 4);
+  keys('\n', 1);
+  model_insert(model_line(5) + 4, '\n');
+  check_assert(doc_is_model() && lines_are_model(), "split without memory");
+
+  editor_goto_offset_scan(model_line(10));
+  keys(KEY_BACKSPACE, 1);
+  model_delete(model_line(10) - 1);
+  check_assert(doc_is_model() && lines_are_model(), "join without memory");
+
+  bool typed = true;
+  for(int i = 0; i < 100; ++i) {
+    editor_goto_offset_scan(model_line(15) + 2);
+    keys('Y', 1);
+    model_insert(model_line(15) + 2, 'Y');
+    typed = typed && doc_is_model();
+  }
+  check_assert(typed && lines_are_model(), "typing past the gap without memory");
+  g_alloc_fails = false;
+
+  cleanup_editor();
+  cleanup_file();
+  gap_buffer_set_allocator(NULL);
+}
+
+// a line longer than a window is loaded a window at a time, around where
+// it is drawn and typed into
+void test_long_line() {
+  printf("\n\ntest_long_line\n");
+  size_t offset = 600000;
+  memstat m;
+
+  write_long_line();
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+  editor_redraw_main_window_full();
+  memstat_collect(&m);
+  check_assert(m.lines == 1 && m.lines_loaded == 1 && m.line_text <= EDITOR_LINE_WINDOW, "first window of the line loaded");
+
+  editor_goto_offset_scan(offset);
+  check_assert(editor_get_cursor_offset() == offset, "cursor deep in the line");
+  check_assert(editor_insert_char_main('X') == 0, "typed deep in the line");
+  check_assert(byte_at(offset) == 'X' && byte_at(offset + 1) == 'a' + offset % 26, "character inserted");
+  memstat_collect(&m);
+  check_assert(m.lines_dirty == 1 && m.line_text <= EDITOR_LINE_WINDOW + 1, "only the window typed into loaded");
+
+  check_assert(editor_backspace_main() == 0 && byte_at(offset) == 'a' + offset % 26, "character deleted");
+  check_assert(doc_length() == LONG_LINE, "length back");
+
+  check_assert(editor_insert_char_main('\n') == 0 && byte_at(offset) == '\n', "line split");
+  check_assert(editor_get_cursor_offset() == offset + 1, "cursor at the start of the new line");
+  check_assert(editor_backspace_main() == 0 && doc_length() == LONG_LINE, "lines joined");
+  check_assert(editor_get_cursor_offset() == offset && byte_at(offset) == 'a' + offset % 26, "cursor where the newline was");
+  memstat_collect(&m);
+  check_assert(m.lines == 1 && m.line_text <= 2 * EDITOR_LINE_WINDOW, "joined windows stay bounded");
+  cleanup_editor();
+  cleanup_file();
+}
+
+// a skip over a hole lands deep in a line, the screen shows the width of
+// the line holding the cursor and loads no more than that
+void test_skip() {
+  printf("\n\ntest_skip\n");
+  size_t target = 3 + HOLE;
+  char buf[8] = "";
+  memstat m;
+
+  write_sparse();
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+  editor_redraw_main_window_full();
+  check_assert(skip_diff() == 0 && editor_get_cursor_offset() == 1, "skip past the byte under the cursor");
+  check_assert(skip_fill() == 0 && editor_get_cursor_offset() == target, "skip past the zeros and the hole");
+
+  int x = getcurx(g_windows.mainwnd);
+  check_assert(x == target % g_windows.mainwnd_geom.w, "cursor in the width of the line holding it");
+  check_assert(mvwinnstr(g_windows.mainwnd, 0, x, buf, 4) == 4 && strcmp(buf, "tail") == 0, "landing position drawn");
+  memstat_collect(&m);
+  check_assert(m.line_text <= EDITOR_LINE_WINDOW, "only a window of the line loaded");
+  check_assert(skip_fill() < 0, "no fill after the last one");
+
+  editor_char_left_main();
+  check_assert(editor_get_cursor_offset() == target - 1, "cursor moves back along the line");
+  cleanup_editor();
+  cleanup_file();
+}
+
+// escape is pressed once the skip has waited for keys a while, and then the
+// process is given half a minute to finish before it is killed
+static void press_escape(int sig) {
+  ungetch(27);
+  signal(SIGALRM, SIG_DFL);
+  alarm(30);
+}
+
+// escape while :skip is passing runs too short to be fill stops it, rather
+// than leaving the job on the same block for good
+void test_skip_cancel() {
+  printf("\n\ntest_skip_cancel\n");
+  write_short_runs();
+  fail_assert(setup_worker_pool(1), "worker pool");
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+  struct itimerval later = { .it_value = { .tv_usec = 20000 } };
+  signal(SIGALRM, press_escape);
+  setitimer(ITIMER_REAL, &later, NULL);
+  check_assert(skip_fill() < 0 && editor_get_cursor_offset() == 0, "skip cancelled");
+  alarm(0);
+  cleanup_editor();
+  cleanup_file();
+  cleanup_worker_pool();
+}
+
+// :strings next walks the starts of the runs the mask scan found, which are
+// the ones a byte at a time scan finds
+void test_strings() {
+  printf("\n\ntest_strings\n");
+  unsigned char *p = make_strings();
+  bool *start = calloc(STRINGS_FILE, sizeof(bool));
+  size_t n;
+  fail_assert(start, "reference starts");
+  strings_scalar(p, STRINGS_FILE, start);
+
+  fail_assert(open_file(g_path) && setup_editor() && setup_strings(), "file opens");
+  check_assert(strings_match(start, STRINGS_FILE, &n) && n > 100, "mask scan finds the runs a scalar scan finds");
+  check_assert(start[(4UL << 20) - 3] && start[(8UL << 20) - 5], "runs across the chunk boundary found");
+
+  // a string inserted in the second chunk, then bytes deleted in the first,
+  // moving everything after them
+  size_t len = STRINGS_FILE;
+  p = realloc(p, len + 4);
+  fail_assert(p, "strings buffer grows");
+  memmove(p + (5UL << 20) + 4, p + (5UL << 20), len - (5UL << 20));
+  memcpy(p + (5UL << 20), "word", 4);
+  len += 4;
+  doc_insert(5UL << 20, "word", 4);
+  start = realloc(start, len);
+  fail_assert(start, "reference starts grow");
+  memset(start, 0, len);
+  strings_scalar(p, len, start);
+  check_assert(strings_match(start, len, &n) && start[5UL << 20], "runs after an insert");
+
+  memmove(p + (1UL << 20), p + (1UL << 20) + 3, len - (1UL << 20) - 3);
+  len -= 3;
+  doc_delete(1UL << 20, 3);
+  memset(start, 0, len);
+  strings_scalar(p, len, start);
+  check_assert(strings_match(start, len, &n), "runs after a delete");
+
+  cleanup_strings();
+  cleanup_editor();
+  cleanup_file();
+  free(start);
+  free(p);
+}
+
+// the zero region is found again after an insert and a delete before it move
+// it, and after an insert behind it that leaves it where it was
+void test_overview() {
+  printf("\n\ntest_overview\n");
+  char *overview[] = { "overview" };
+  char edit[REGION_EDIT];
+  for(size_t i = 0; i < sizeof(edit); ++i) {
+    edit[i] = rand();
+  }
+  write_regions();
+  fail_assert(open_file(g_path) && setup_editor() && setup_overview(), "file opens");
+  check_assert(overview_cmd(1, overview) == 0, "panel shown");
+
+  check_assert(overview_next_region() == 0 && editor_get_cursor_offset() == REGION, "zeros found");
+  doc_insert(100, edit, sizeof(edit));
+  editor_goto_offset_scan(0);
+  check_assert(overview_next_region() == 0 && editor_get_cursor_offset() == REGION + REGION_EDIT, "moved by an insert");
+  doc_delete(100, 2 * REGION_EDIT);
+  editor_goto_offset_scan(0);
+  check_assert(overview_next_region() == 0 && editor_get_cursor_offset() == REGION - REGION_EDIT, "moved by a delete");
+  doc_insert(2 * REGION + 100, edit, sizeof(edit));
+  editor_goto_offset_scan(0);
+  check_assert(overview_next_region() == 0 && editor_get_cursor_offset() == REGION - REGION_EDIT, "kept by an insert after it");
+  check_assert(overview_next_region() == 0 && editor_get_cursor_offset() == 2 * REGION - REGION_EDIT, "end of the zeros");
+
+  cleanup_overview();
+  cleanup_editor();
+  cleanup_file();
+}
+
+// the document keeps its state per process, so every test gets one of its own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+    test();
+    cleanup_windows();
+    cleanup_curses();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int fd = mkstemp(g_path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+  setenv("LINES", "24", 1);
+  setenv("COLUMNS", "80", 1);
+
+  run(test_evict);
+  run(test_insert);
+  run(test_insert_no_memory);
+  run(test_long_line);
+  run(test_skip);
+  run(test_skip_cancel);
+  run(test_strings);
+  run(test_overview);
+
+  unlink(g_path);
+  return g_failures ? -1 : 0;
+}
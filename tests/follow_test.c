@@ -0,0 +1,216 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../follow.h"
+#include "../undo.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+int g_failures = 0;
+
+static char g_path[] = "/tmp/follow_test.XXXXXX";
+
+// what the document should hold after the file changed so far
+static char g_model[8192];
+static size_t g_model_len;
+
+static void write_file(const char *mode, const char *data) {
+  FILE *fp = fopen(g_path, mode);
+  fail_assert(fp && fwrite(data, 1, strlen(data), fp) == strlen(data) && fclose(fp) == 0, "file written");
+}
+
+static void append_lines(int from, int to, const char *tail) {
+  char buf[4096];
+  size_t n = 0;
+  for(int i = from; i < to; ++i) {
+    n += sprintf(buf + n, "line %02d\n", i);
+  }
+  n += sprintf(buf + n, "%s", tail);
+  write_file("a", buf);
+  memcpy(g_model + g_model_len, buf, n);
+  g_model_len += n;
+}
+
+static bool doc_is_model() {
+  char buf[sizeof(g_model)];
+  return doc_length() == g_model_len && doc_read(0, buf, g_model_len) == g_model_len
+    && memcmp(buf, g_model, g_model_len) == 0;
+}
+
+// every line of the model is a line of the editor, starting where it should
+static bool lines_are_model() {
+  size_t n = 0;
+  bool ok = true;
+  for(size_t at = 0; at < g_model_len; ++n) {
+    editor_goto_offset_scan(at);
+    ok = ok && editor_get_cursor_offset() == at;
+    const char *nl = memchr(g_model + at, '\n', g_model_len - at);
+    at = nl ? (size_t)(nl - g_model) + 1 : g_model_len;
+  }
+  return ok && g_editor.data.n_lines == n;
+}
+
+// the text drawn on some row of the main window starts with s
+static bool on_screen(const char *s) {
+  for(int row = 0; row < g_windows.mainwnd_geom.h; ++row) {
+    char buf[64] = "";
+    if(mvwinnstr(g_windows.mainwnd, row, 0, buf, strlen(s)) == (int)strlen(s) && strcmp(buf, s) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void open_following() {
+  g_model_len = 0;
+  write_file("w", "");
+  append_lines(0, 40, "");
+  fail_assert(open_file(g_path) && setup_editor() && setup_undo(), "file opens");
+  fail_assert(follow_start() && follow_active(), "following");
+}
+
+static void close_following() {
+  cleanup_follow();
+  cleanup_undo();
+  cleanup_editor();
+  cleanup_file();
+}
+
+// appended bytes become lines at the end, a line without its newline yet is
+// finished by the next append, and the screen stays on the end
+void test_append() {
+  printf("\n\ntest_append\n");
+  open_following();
+  check_assert(editor_at_end() && on_screen("line 39"), "end shown");
+
+  append_lines(40, 45, "tail");
+  follow_idle();
+  check_assert(doc_is_model() && editor_at_end() && on_screen("tail"), "lines appended");
+  append_lines(45, 45, "ed\n");
+  follow_idle();
+  check_assert(doc_is_model() && on_screen("tailed"), "last line finished");
+  append_lines(45, 100, "");
+  follow_idle();
+  check_assert(doc_is_model() && editor_at_end() && on_screen("line 99"), "screen follows the end");
+  check_assert(lines_are_model(), "lines split where the file has newlines");
+  close_following();
+}
+
+// edits stay where they are, the file's new bytes go after them
+void test_append_modified() {
+  printf("\n\ntest_append_modified\n");
+  open_following();
+
+  doc_insert(0, "!!", 2);
+  memmove(g_model + 2, g_model, g_model_len);
+  memcpy(g_model, "!!", 2);
+  g_model_len += 2;
+  append_lines(40, 50, "");
+  follow_idle();
+  check_assert(doc_is_model() && lines_are_model(), "appended after the edit");
+  close_following();
+}
+
+// a truncated file is opened again from its new start
+void test_truncate() {
+  printf("\n\ntest_truncate\n");
+  open_following();
+
+  g_model_len = 0;
+  write_file("w", "");
+  append_lines(0, 3, "");
+  follow_idle();
+  check_assert(follow_active() && doc_is_model() && lines_are_model(), "reopened with what is left");
+  append_lines(3, 5, "");
+  follow_idle();
+  check_assert(doc_is_model() && lines_are_model(), "and followed on");
+  close_following();
+}
+
+// truncating would lose unsaved edits, following stops instead
+void test_truncate_modified() {
+  printf("\n\ntest_truncate_modified\n");
+  open_following();
+
+  doc_overwrite(0, "L", 1);
+  size_t len = doc_length();
+  write_file("w", "short\n");
+  follow_idle();
+  check_assert(!follow_active() && doc_length() == len, "stopped, document kept");
+  close_following();
+}
+
+// a new file under the name after a rotation is opened in place of the old
+void test_rotate() {
+  printf("\n\ntest_rotate\n");
+  char rotated[sizeof(g_path) + 2];
+  snprintf(rotated, sizeof(rotated), "%s.1", g_path);
+  open_following();
+
+  fail_assert(rename(g_path, rotated) == 0, "file rotated");
+  g_model_len = 0;
+  write_file("w", "");
+  append_lines(0, 2, "new");
+  follow_idle();
+  check_assert(follow_active() && doc_is_model() && lines_are_model(), "new file opened");
+  append_lines(2, 4, "");
+  follow_idle();
+  check_assert(doc_is_model() && lines_are_model(), "new file followed");
+  close_following();
+  unlink(rotated);
+}
+
+// the document and its watchers are set up once per process, so every
+// test gets a process of its own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+    test();
+    cleanup_windows();
+    cleanup_curses();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int fd = mkstemp(g_path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+  setenv("LINES", "24", 1);
+  setenv("COLUMNS", "80", 1);
+
+  run(test_append);
+  run(test_append_modified);
+  run(test_truncate);
+  run(test_truncate_modified);
+  run(test_rotate);
+
+  unlink(g_path);
+  return g_failures ? -1 : 0;
+}
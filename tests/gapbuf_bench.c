@@ -0,0 +1,168 @@
+#include "../gap_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// replays edit traces against gap buffers and reports how often the
+// allocator was called and how long each trace took.  the traces follow what
+// insert mode does to an editor_line: typing and backspacing in bursts,
+// moving the cursor around, and splitting and joining lines
+
+#define BENCH_LINES 4096   // lines edited by each trace
+#define BENCH_LINE_LEN 80  // starting length of each line
+
+struct bench_counts {
+  size_t allocs;
+  size_t reallocs;
+  size_t frees;
+  size_t bytes_moved; // bytes a realloc may have had to copy
+  size_t bytes;       // currently allocated
+  size_t peak;
+};
+
+static struct bench_counts g_counts;
+
+static void *bench_alloc(size_t len, void *ctx) {
+  ++g_counts.allocs;
+  g_counts.bytes += len;
+  g_counts.peak = g_counts.bytes > g_counts.peak ? g_counts.bytes : g_counts.peak;
+  return malloc(len);
+}
+
+static void *bench_realloc(void *p, size_t old_len, size_t new_len, void *ctx) {
+  ++g_counts.reallocs;
+  g_counts.bytes_moved += old_len < new_len ? old_len : new_len;
+  g_counts.bytes = g_counts.bytes - old_len + new_len;
+  g_counts.peak = g_counts.bytes > g_counts.peak ? g_counts.bytes : g_counts.peak;
+  return realloc(p, new_len);
+}
+
+static void bench_free(void *p, size_t len, void *ctx) {
+  ++g_counts.frees;
+  g_counts.bytes -= len;
+  free(p);
+}
+
+static unsigned int g_seed = 1;
+
+static int bench_rand(int n) {
+  g_seed = g_seed * 1103515245 + 12345;
+  return (g_seed >> 16) % n;
+}
+
+static gap_buffer *bench_line(size_t len) {
+  gap_buffer *gb = gap_buffer_new(len);
+  for(size_t i = 0; i < len; ++i) {
+    gap_buffer_addch(gb, 'a' + i % 26);
+  }
+  return gb;
+}
+
+// type a word or two, sometimes backspace over it, at random places
+static void trace_typing(gap_buffer **lines) {
+  for(int i = 0; i < BENCH_LINES * 16; ++i) {
+    gap_buffer *gb = lines[bench_rand(BENCH_LINES)];
+    gap_buffer_setcursor(gb, bench_rand(gap_buffer_length(gb) + 1));
+    int n = 1 + bench_rand(12);
+    for(int k = 0; k < n; ++k) {
+      gap_buffer_addch(gb, 'x');
+    }
+    if(bench_rand(3) == 0) {
+      for(int k = 0; k < n; ++k) {
+        gap_buffer_delch(gb);
+      }
+    }
+  }
+}
+
+// backspace most of a line away and type it back in
+static void trace_retype(gap_buffer **lines) {
+  for(int i = 0; i < BENCH_LINES; ++i) {
+    gap_buffer *gb = lines[i];
+    gap_buffer_setcursor(gb, gap_buffer_length(gb));
+    int n = gap_buffer_length(gb) - 4;
+    for(int k = 0; k < n; ++k) {
+      gap_buffer_delch(gb);
+    }
+    for(int k = 0; k < n; ++k) {
+      gap_buffer_addch(gb, 'y');
+    }
+  }
+}
+
+// one character typed and deleted over and over, the worst case for a
+// buffer that shrinks and grows at the same size
+static void trace_flutter(gap_buffer **lines) {
+  for(int i = 0; i < BENCH_LINES; ++i) {
+    gap_buffer *gb = lines[i];
+    for(int k = 0; k < 64; ++k) {
+      gap_buffer_addch(gb, 'z');
+      gap_buffer_delch(gb);
+    }
+  }
+}
+
+// enter in the middle of a line and backspace at the start of the new one
+static void trace_split_join(gap_buffer **lines) {
+  for(int i = 0; i < BENCH_LINES * 4; ++i) {
+    gap_buffer *gb = lines[bench_rand(BENCH_LINES)];
+    gap_buffer_setcursor(gb, bench_rand(gap_buffer_length(gb) + 1));
+    gap_buffer *tail = gap_buffer_split(gb);
+    if(!tail) {
+      continue;
+    }
+    gap_buffer_addch(tail, 'w');
+    gap_buffer_append(gb, tail);
+    gap_buffer_delete(tail);
+  }
+}
+
+struct bench_trace {
+  const char *name;
+  void (*run)(gap_buffer **lines);
+};
+
+static const struct bench_trace g_traces[] = {
+  { "typing", trace_typing },
+  { "retype", trace_retype },
+  { "flutter", trace_flutter },
+  { "split/join", trace_split_join },
+};
+
+int main(int argc, char *argv[]) {
+  gap_buffer_allocator a = { bench_alloc, bench_realloc, bench_free, NULL };
+  gap_buffer_set_allocator(&a);
+
+  printf("%-12s %10s %10s %10s %12s %10s %10s\n",
+      "trace", "allocs", "reallocs", "frees", "moved", "peak", "ms");
+  for(size_t t = 0; t < sizeof(g_traces) / sizeof(g_traces[0]); ++t) {
+    gap_buffer **lines = malloc(BENCH_LINES * sizeof(gap_buffer *));
+    if(!lines) {
+      return -1;
+    }
+    for(int i = 0; i < BENCH_LINES; ++i) {
+      lines[i] = bench_line(BENCH_LINE_LEN);
+    }
+
+    memset(&g_counts, 0, sizeof(g_counts));
+    g_counts.bytes = g_counts.peak = (size_t)BENCH_LINES * BENCH_LINE_LEN;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    g_traces[t].run(lines);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    printf("%-12s %10lu %10lu %10lu %12lu %10lu %10.2f\n", g_traces[t].name,
+        g_counts.allocs, g_counts.reallocs, g_counts.frees, g_counts.bytes_moved, g_counts.peak, ms);
+
+    for(int i = 0; i < BENCH_LINES; ++i) {
+      gap_buffer_delete(lines[i]);
+    }
+    free(lines);
+  }
+
+  gap_buffer_set_allocator(NULL);
+  return 0;
+}
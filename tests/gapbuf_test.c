@@ -11,6 +11,7 @@
  do { \
    if(!(expr)) { \
      fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
      if(fail) { \
        exit(-1); \
      } \
@@ -22,6 +23,37 @@
 #define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
 #define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
 
+int g_failures = 0;
+
+// counts the calls into the allocator hooks
+struct alloc_counts {
+  int allocs;
+  int reallocs;
+  int frees;
+  size_t bytes;
+};
+
+static void *count_alloc(size_t len, void *ctx) {
+  struct alloc_counts *c = ctx;
+  ++c->allocs;
+  c->bytes += len;
+  return malloc(len);
+}
+
+static void *count_realloc(void *p, size_t old_len, size_t new_len, void *ctx) {
+  struct alloc_counts *c = ctx;
+  ++c->reallocs;
+  c->bytes = c->bytes - old_len + new_len;
+  return realloc(p, new_len);
+}
+
+static void count_free(void *p, size_t len, void *ctx) {
+  struct alloc_counts *c = ctx;
+  ++c->frees;
+  c->bytes -= len;
+  free(p);
+}
+
 void print_gap_buf(gap_buffer *p) {
   printf("buf: %p (allocated: %lu), len: %lu, maxlen: %lu, gap_begin: %d, gap_end: %d, cursor: %d\n",
       p->buf, malloc_usable_size(p->buf), p->len, p->maxlen, p->gap_begin, p->gap_end, p->cursor);
@@ -54,7 +86,7 @@ void test_addmove() {
   check_assert(p->cursor == 1, "after addch cursor == 1");
   check_assert(p->gap_begin == 1, "after addch gap_begin == 1");
 
-  gap_buffer_movepos(p, -1);
+  gap_buffer_movecursor(p, -1);
   check_assert(p->cursor == 0, "after move cursor == 0");
   check_assert(p->gap_begin == 1, "after move gap_begin == 1");
 
@@ -76,7 +108,7 @@ void test_delete() {
 
   gap_buffer_addch(p, 'a');
 
-  check_assert(p->maxlen == 1, "after add maxlen == 1");
+  check_assert(p->maxlen == 17, "after add the gap is at least 16");
   check_assert(gap_buffer_length(p) == 1, "after add len == 1");
   check_assert(p->gap_begin == 1, "after add len == 1");
   check_assert(p->cursor == 1, "after add cursor == 1");
@@ -95,7 +127,7 @@ void test_delete() {
   gap_buffer_addch(p, 'c');
   print_gap_buf(p);
 
-  gap_buffer_setpos(p, 1);
+  gap_buffer_setcursor(p, 1);
   _gap_buffer_sync(p);
   gap_buffer_delch(p);
   print_gap_buf(p);
@@ -105,7 +137,7 @@ void test_delete() {
 
 void test_shrink() {
   printf("\n\ntest_shrink\n");
-  gap_buffer *p = gap_buffer_new(8);
+  gap_buffer *p = gap_buffer_new(256);
   //print_gap_buf(p);
 
   for(int i = 0; i < p->maxlen; ++i) {
@@ -113,15 +145,87 @@ void test_shrink() {
   }
   //print_gap_buf(p);
 
-  for(int i = 0; i < 6; ++i) {
+  for(int i = 0; i < 192; ++i) {
     gap_buffer_delch(p);
   }
-  check_assert(p->maxlen == 4, "shrinking works");
+  check_assert(p->maxlen == 256, "no shrinking at a quarter full");
+  gap_buffer_delch(p);
+  check_assert(p->maxlen == 126, "shrinking below a quarter full leaves it half full");
 
-  for(int i = 2; i < 12; ++i) {
+  for(int i = 0; i < 200; ++i) {
+    gap_buffer_addch(p, 'b');
+  }
+  check_assert(p->len == 263, "adding lots of chars after shrinking");
+  check_assert(gap_buffer_getbyte(p, 62) == 'a' && gap_buffer_getbyte(p, 63) == 'b', "text survives the reallocs");
+
+  gap_buffer_delete(p);
+}
+
+// typing and deleting back and forth across a size must not realloc each time
+void test_hysteresis() {
+  printf("\n\ntest_hysteresis\n");
+  struct alloc_counts counts = { 0, 0, 0, 0 };
+  gap_buffer_allocator a = { count_alloc, count_realloc, count_free, &counts };
+  gap_buffer_set_allocator(&a);
+
+  gap_buffer *p = gap_buffer_new(64);
+  for(int i = 0; i < 64; ++i) {
     gap_buffer_addch(p, 'a');
   }
-  check_assert(p->len == 12, "adding lots of chars after shrinking");
+  int reallocs = counts.reallocs;
+  for(int i = 0; i < 1000; ++i) {
+    gap_buffer_addch(p, 'b');
+    gap_buffer_delch(p);
+  }
+  check_assert(counts.reallocs - reallocs <= 1, "alternating add and delete at the threshold");
+
+  check_assert(gap_buffer_reserve(p, 1000) == 0 && p->maxlen - p->len >= 1000, "reserve makes room");
+  reallocs = counts.reallocs;
+  for(int i = 0; i < 1000; ++i) {
+    gap_buffer_addch(p, 'c');
+  }
+  check_assert(counts.reallocs == reallocs, "no reallocs within the reserved room");
+  check_assert(counts.bytes == p->maxlen, "the allocator sees every byte");
+
+  gap_buffer_delete(p);
+  check_assert(counts.bytes == 0 && counts.frees == 1, "and the free");
+  gap_buffer_set_allocator(NULL);
+}
+
+void test_split_append() {
+  printf("\n\ntest_split_append\n");
+  char buf[16] = { 0 };
+  gap_buffer *p = gap_buffer_new(8);
+  for(int i = 'a'; i < 'a' + 8; ++i) {
+    gap_buffer_addch(p, i);
+  }
+
+  gap_buffer_setcursor(p, 3);
+  gap_buffer *q = gap_buffer_split(p);
+  fail_assert(q, "split");
+  gap_buffer_copy(q, buf, sizeof(buf));
+  check_assert(gap_buffer_length(p) == 3 && strcmp(buf, "defgh") == 0, "split moves the tail");
+
+  gap_buffer_setcursor(p, 1);
+  check_assert(gap_buffer_append(p, q) == 0, "append");
+  memset(buf, 0, sizeof(buf));
+  gap_buffer_copy(p, buf, sizeof(buf));
+  check_assert(strcmp(buf, "abcdefgh") == 0 && gap_buffer_getcursor(p) == 1, "append joins them back");
+
+  gap_buffer_delete(q);
+  gap_buffer_delete(p);
+}
+
+void test_addn() {
+  printf("\n\ntest_addn\n");
+  char buf[16] = { 0 };
+  gap_buffer *p = gap_buffer_new(0);
+
+  check_assert(gap_buffer_addn(p, "adef", 4) == 0 && gap_buffer_getcursor(p) == 4, "addn into an empty buffer");
+  gap_buffer_setcursor(p, 1);
+  check_assert(gap_buffer_addn(p, "bc", 2) == 0 && gap_buffer_getcursor(p) == 3, "addn in the middle");
+  gap_buffer_copy(p, buf, sizeof(buf));
+  check_assert(gap_buffer_length(p) == 6 && strcmp(buf, "abcdef") == 0, "addn keeps the text around it");
 
   gap_buffer_delete(p);
 }
@@ -141,7 +245,7 @@ void test_copy() {
 
   check_assert(strcmp(buf, chkbuf) == 0, "copy");
 
-  gap_buffer_setpos(p, 4);
+  gap_buffer_setcursor(p, 4);
   _gap_buffer_sync(p);
   memset(buf, 0, 64);
   gap_buffer_copy(p, buf, 64);
@@ -160,7 +264,10 @@ int main(int argc, char *argv[]) {
   test_addmove();
   test_delete();
   test_shrink();
+  test_hysteresis();
+  test_split_append();
+  test_addn();
   test_copy();
 
-  return 0;
+  return g_failures ? -1 : 0;
 }
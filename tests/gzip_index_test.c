@@ -0,0 +1,146 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "../gzip_index.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define DATA_LEN (5 * GZIP_SPAN + 12345)
+#define MEMBERS 3
+
+int g_failures = 0;
+
+// text that compresses, but not to nothing
+static char *make_data(size_t len) {
+  char *data = malloc(len);
+  unsigned int x = 12345;
+  for(size_t i = 0; i < len; ++i) {
+    x = x * 1103515245 + 12345;
+    data[i] = (x >> 16) % 7 == 0 ? '\n' : 'a' + (x >> 20) % 16;
+  }
+  return data;
+}
+
+// the data as concatenated gzip members, like pigz or appending writes them
+static int write_gzip(const char *path, const char *data, size_t len) {
+  FILE *fp = fopen(path, "w");
+  static unsigned char out[1 << 16];
+  if(!fp) {
+    return -1;
+  }
+  for(int m = 0; m < MEMBERS; ++m) {
+    size_t begin = len / MEMBERS * m, end = m == MEMBERS - 1 ? len : len / MEMBERS * (m + 1);
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    deflateInit2(&s, Z_BEST_SPEED, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
+    s.next_in = (unsigned char *)data + begin;
+    s.avail_in = end - begin;
+    int ret;
+    do {
+      s.next_out = out;
+      s.avail_out = sizeof(out);
+      ret = deflate(&s, Z_FINISH);
+      fwrite(out, 1, sizeof(out) - s.avail_out, fp);
+    } while(ret == Z_OK);
+    deflateEnd(&s);
+  }
+  return fclose(fp);
+}
+
+static bool read_back(gzip_file *gz, const char *data, size_t offset, size_t len) {
+  while(len > 0) {
+    size_t n = len;
+    const char *p = gzip_view(gz, offset, &n);
+    if(!p || n == 0 || memcmp(p, data + offset, n) != 0) {
+      return false;
+    }
+    offset += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void test_random_access(const char *path, const char *index, const char *data) {
+  FILE *fp = fopen(path, "r");
+  fail_assert(fp && gzip_detect(fileno(fp)), "gzip magic is detected");
+
+  gzip_file *gz = gzip_open(fileno(fp), index, NULL, NULL);
+  fail_assert(gz, "gzip file opens");
+  check_assert(gzip_length(gz) == DATA_LEN, "length is the decompressed length");
+  check_assert(gzip_points(gz) >= DATA_LEN / GZIP_SPAN, "a checkpoint every span");
+  check_assert(access(index, F_OK) == 0, "index is saved");
+
+  check_assert(read_back(gz, data, 0, DATA_LEN), "reads back in order across members");
+
+  bool ok = true;
+  unsigned int x = 42;
+  for(int i = 0; i < 200 && ok; ++i) {
+    x = x * 1103515245 + 12345;
+    size_t offset = x % DATA_LEN;
+    size_t len = offset + 70000 < DATA_LEN ? 70000 : DATA_LEN - offset;
+    ok = read_back(gz, data, offset, len);
+  }
+  check_assert(ok, "reads back at random offsets");
+
+  size_t cached;
+  gzip_memory(gz, &cached);
+  check_assert(cached <= GZIP_CACHE_MAX, "cache stays under its limit");
+
+  size_t len = 1;
+  check_assert(!gzip_view(gz, DATA_LEN, &len) && len == 0, "nothing past the end");
+  gzip_close(gz);
+  fclose(fp);
+}
+
+static void test_index_reload(const char *path, const char *index, const char *data) {
+  struct stat before, after;
+  FILE *fp = fopen(path, "r");
+  fail_assert(fp && stat(index, &before) == 0, "gzip file opens again");
+
+  // a rebuilt index would have been renamed over the old one
+  gzip_file *gz = gzip_open(fileno(fp), index, NULL, NULL);
+  fail_assert(gz, "gzip file opens with its index");
+  check_assert(stat(index, &after) == 0 && after.st_ino == before.st_ino, "index is loaded, not built");
+  check_assert(gzip_length(gz) == DATA_LEN, "length comes from the index");
+  check_assert(read_back(gz, data, DATA_LEN - 3 * GZIP_SPAN, 3 * GZIP_SPAN), "reads back through a loaded index");
+  gzip_close(gz);
+  fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+  char path[] = "/tmp/gzip_index_test.XXXXXX";
+  char index[sizeof(path) + 8];
+  int fd = mkstemp(path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+  snprintf(index, sizeof(index), "%s.hxi", path);
+
+  char *data = make_data(DATA_LEN);
+  fail_assert(write_gzip(path, data, DATA_LEN) == 0, "gzip data written");
+
+  test_random_access(path, index, data);
+  test_index_reload(path, index, data);
+
+  unlink(path);
+  unlink(index);
+  free(data);
+  return g_failures ? -1 : 0;
+}
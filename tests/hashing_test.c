@@ -0,0 +1,100 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "../hashing.h"
+#include "../checksum.h"
+#include "../worker_pool.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define N_THREADS 4
+#define BIG_LEN ((64UL << 20) + 123) // crcs split into a job per thread
+
+int g_failures = 0;
+
+static char g_path[] = "/tmp/hashing_test.XXXXXX";
+static unsigned char *g_data;
+
+static bool hash_is(int algo, size_t offset, size_t len, const char *want) {
+  char out[72];
+  return hash_range(algo, offset, len, out, sizeof(out)) == 0 && strcmp(out, want) == 0;
+}
+
+// the check values of the algorithms, the document starts with "123456789"
+void test_check_values() {
+  printf("\n\ntest_check_values\n");
+  check_assert(hash_is(HASH_CRC32, 0, 9, "cbf43926"), "crc32");
+  check_assert(hash_is(HASH_CRC32C, 0, 9, "e3069283"), "crc32c");
+  check_assert(hash_is(HASH_SHA256, 0, 9, "15e2b0d3c33891ebb0f1ef609ec419420c20e320ce94c65fbc8c3312448eb225"), "sha256");
+}
+
+// crcs of pieces hashed by different jobs combine to the crc of the whole
+void test_split() {
+  printf("\n\ntest_split\n");
+  char want[16];
+  snprintf(want, sizeof(want), "%08x", crc32_update(CRC32_INIT, g_data, BIG_LEN));
+  check_assert(hash_is(HASH_CRC32, 0, BIG_LEN, want), "crc32 of the document");
+  snprintf(want, sizeof(want), "%08x", crc32c_update(CRC32_INIT, g_data + 1, BIG_LEN - 1));
+  check_assert(hash_is(HASH_CRC32C, 1, BIG_LEN - 1, want), "crc32c of all but the first byte");
+}
+
+// a range running past the end of the document has bytes that can't be
+// read, it is not a hash of the part that could
+void test_short() {
+  printf("\n\ntest_short\n");
+  char out[72];
+  check_assert(hash_range(HASH_CRC32, 0, BIG_LEN + 1, out, sizeof(out)) < 0, "crc32 past the end");
+  check_assert(hash_range(HASH_XXH64, BIG_LEN - 10, 20, out, sizeof(out)) < 0, "xxh64 past the end");
+  check_assert(hash_range(HASH_SHA256, BIG_LEN - 10, 20, out, sizeof(out)) < 0, "sha256 past the end");
+}
+
+int main(int argc, char *argv[]) {
+  int fd = mkstemp(g_path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+  setenv("LINES", "24", 1);
+  setenv("COLUMNS", "80", 1);
+
+  g_data = malloc(BIG_LEN);
+  fail_assert(g_data, "data");
+  for(size_t i = 0; i < BIG_LEN; ++i) {
+    g_data[i] = i * 29 + (i >> 12);
+  }
+  memcpy(g_data, "123456789", 9);
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp && fwrite(g_data, 1, BIG_LEN, fp) == BIG_LEN && fclose(fp) == 0, "file written");
+
+  fail_assert(setup_curses_headless() && setup_windows() && setup_worker_pool(N_THREADS), "headless screen");
+  fail_assert(open_file(g_path) && setup_editor(), "document opens");
+
+  test_check_values();
+  test_split();
+  test_short();
+
+  cleanup_editor();
+  cleanup_file();
+  cleanup_worker_pool();
+  cleanup_windows();
+  cleanup_curses();
+  unlink(g_path);
+  free(g_data);
+  return g_failures ? -1 : 0;
+}
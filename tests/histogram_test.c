@@ -0,0 +1,92 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "../histogram.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+int g_failures = 0;
+
+// true if got is no further than 1/16 above want
+static bool close_above(uint64_t got, uint64_t want) {
+  return got >= want && got - want <= want / 16;
+}
+
+void test_small() {
+  printf("\n\ntest_small\n");
+  histogram *h = calloc(1, sizeof(histogram));
+
+  check_assert(histogram_percentile(h, 0.5) == 0, "empty histogram");
+  for(uint64_t v = 1; v <= 10; ++v) {
+    histogram_record(h, v);
+  }
+  check_assert(h->n == 10 && h->max == 10, "count and max");
+  check_assert(histogram_percentile(h, 0.5) == 5, "small values are exact");
+  check_assert(histogram_percentile(h, 0.99) == 10, "p99 of ten is the last");
+  check_assert(histogram_percentile(h, 0) == 1, "p0 is the first");
+
+  free(h);
+}
+
+void test_precision() {
+  printf("\n\ntest_precision\n");
+  histogram *h = calloc(1, sizeof(histogram));
+
+  // 1..100000 us in ns
+  for(uint64_t v = 1; v <= 100000; ++v) {
+    histogram_record(h, v * 1000);
+  }
+  check_assert(close_above(histogram_percentile(h, 0.50), 50000 * 1000ULL), "p50 within 1/16");
+  check_assert(close_above(histogram_percentile(h, 0.99), 99000 * 1000ULL), "p99 within 1/16");
+  check_assert(histogram_percentile(h, 1.0) == 100000 * 1000ULL, "p100 is the max");
+
+  // values past the last bucket still count
+  histogram_record(h, 1ULL << 50);
+  check_assert(h->max == 1ULL << 50 && histogram_percentile(h, 1.0) > 100000 * 1000ULL, "huge value");
+
+  free(h);
+}
+
+void test_merge() {
+  printf("\n\ntest_merge\n");
+  histogram *a = calloc(1, sizeof(histogram));
+  histogram *b = calloc(1, sizeof(histogram));
+
+  for(int i = 0; i < 99; ++i) {
+    histogram_record(a, 100);
+  }
+  histogram_record(b, 5000000);
+  histogram_merge(a, b);
+  check_assert(a->n == 100 && a->max == 5000000, "merged count and max");
+  check_assert(close_above(histogram_percentile(a, 0.5), 100), "p50 of the merge");
+  check_assert(histogram_percentile(a, 1.0) == 5000000, "the outlier is kept");
+
+  histogram_reset(a);
+  check_assert(a->n == 0 && histogram_percentile(a, 0.99) == 0, "reset");
+
+  free(a);
+  free(b);
+}
+
+int main(int argc, char *argv[]) {
+  test_small();
+  test_precision();
+  test_merge();
+
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,151 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "../logger.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+int g_failures = 0;
+
+#define TEST_MESSAGES 20000
+
+// what was read back from a log
+struct test_log {
+  char first[256];  // the first two messages
+  char second[256];
+  char last[256];   // and the last one
+  int levels;       // bit per level seen
+  long records;
+  long dropped;
+  int strings;
+};
+
+// read a log back the way tools/logdecode does, the format strings are
+// still in memory so their addresses can be used directly
+static int read_log(const char *path, struct test_log *t) {
+  char magic[sizeof(LOG_MAGIC)];
+  uint32_t tag;
+  FILE *fp = fopen(path, "rb");
+  memset(t, 0, sizeof(*t));
+  if(!fp || fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0) {
+    return -1;
+  }
+  while(fread(&tag, sizeof(tag), 1, fp) == 1) {
+    if(tag == LOG_TAG_STRING) {
+      uint64_t addr;
+      uint32_t len;
+      char s[256];
+      if(fread(&addr, sizeof(addr), 1, fp) != 1 || fread(&len, sizeof(len), 1, fp) != 1
+          || len >= sizeof(s) || fread(s, 1, len, fp) != len)
+      {
+        return -1;
+      }
+      s[len] = '\0';
+      if(strcmp(s, (const char *)(uintptr_t)addr) != 0) {
+        return -1;
+      }
+      ++t->strings;
+    } else if(tag == LOG_TAG_RECORD) {
+      struct log_record r;
+      if(fread(&r, sizeof(r), 1, fp) != 1) {
+        return -1;
+      }
+      char *out = t->records == 0 ? t->first : t->records == 1 ? t->second : t->last;
+      log_format((const char *)(uintptr_t)r.fmt, &r, out, 256);
+      t->levels |= 1 << r.level;
+      ++t->records;
+    } else if(tag == LOG_TAG_DROPPED) {
+      uint64_t n;
+      if(fread(&n, sizeof(n), 1, fp) != 1) {
+        return -1;
+      }
+      t->dropped += n;
+    } else {
+      return -1;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+void test_log() {
+  printf("\n\ntest_log\n");
+  char path[] = "/tmp/logger_test_XXXXXX";
+  struct test_log t;
+  int fd = mkstemp(path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+
+  LOG_MSG("before setup %d", 1);
+  fail_assert(setup_logger(path), "setup");
+
+  const char *name = "name";
+  char long_string[LOG_RECORD_ARGS * 2];
+  memset(long_string, '0', sizeof(long_string) - 1);
+  long_string[sizeof(long_string) - 1] = '\0';
+  LOG_INFO("int %d long %ld unsigned %lu hex %#x str '%-6s' char %c %.2f%%", -5, -6L, 7UL, 255, name, 'z', 2.5);
+  LOG_WARN("null %s and a long string %s", (char *)NULL, long_string);
+  LOG_DEBUG("debug %d", 1);
+  for(int i = 0; i < TEST_MESSAGES; ++i) {
+    LOG_ERROR("message %d", i);
+  }
+  cleanup_logger();
+
+  fail_assert(read_log(path, &t) == 0, "the log reads back");
+  check_assert(strcmp(t.first, "int -5 long -6 unsigned 7 hex 0xff str 'name  ' char z 2.50%") == 0, "formats come back");
+  check_assert(strncmp(t.second, "null (null) and a long string 0000", 34) == 0
+      && strcmp(t.second + strlen(t.second) - 3, "...") == 0, "long strings are cut short");
+  check_assert(t.strings == 4 + (LOG_MIN_LEVEL == LOG_LEVEL_DEBUG), "strings are written once");
+  check_assert(t.records + t.dropped == 2 + TEST_MESSAGES + (LOG_MIN_LEVEL == LOG_LEVEL_DEBUG), "every message is written or counted as dropped");
+  check_assert(t.dropped || strcmp(t.last, "message 19999") == 0, "the last message");
+  check_assert((t.levels & 1 << LOG_LEVEL_DEBUG) == (LOG_MIN_LEVEL == LOG_LEVEL_DEBUG), "debug is compiled out");
+  printf("%ld records, %ld dropped\n", t.records, t.dropped);
+
+  LOG_MSG("after cleanup %d", 1);
+  fail_assert(read_log(path, &t) == 0, "the log reads back again");
+  check_assert(t.records + t.dropped == 2 + TEST_MESSAGES + (LOG_MIN_LEVEL == LOG_LEVEL_DEBUG), "nothing after cleanup");
+
+  unlink(path);
+}
+
+// a format string from a damaged or crafted log stops at conversions that
+// log_pack() never stores an argument for
+void test_format_unknown() {
+  printf("\n\ntest_format_unknown\n");
+  struct log_record r;
+  char out[64];
+  int64_t v = 7;
+  memset(&r, 0, sizeof(r));
+  memcpy(r.args, &v, sizeof(v));
+  r.len = sizeof(v);
+
+  check_assert(log_format("a %d b", &r, out, sizeof(out)) == 5 && strcmp(out, "a 7 b") == 0, "known conversion");
+  check_assert(log_format("a %n b", &r, out, sizeof(out)) == 2 && strcmp(out, "a ") == 0, "%n stops the message");
+  check_assert(log_format("a %hhn b", &r, out, sizeof(out)) == 2 && strcmp(out, "a ") == 0, "%hhn stops the message");
+  check_assert(log_format("a %a b", &r, out, sizeof(out)) == 2 && strcmp(out, "a ") == 0, "%a stops the message");
+  check_assert(log_format("a %*d b", &r, out, sizeof(out)) == 2 && strcmp(out, "a ") == 0, "a width argument stops the message");
+  check_assert(log_format("a %5", &r, out, sizeof(out)) == 2 && strcmp(out, "a ") == 0, "a spec with no conversion stops the message");
+}
+
+int main(int argc, char *argv[]) {
+  test_log();
+  test_format_unknown();
+
+  return g_failures ? -1 : 0;
+}
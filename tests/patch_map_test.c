@@ -0,0 +1,117 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "../patch_map.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define BASE_LEN 4096
+
+int g_failures = 0;
+
+// read the map over base the way the document does
+static void read_through(const patch_map *pm, const char *base, char *dst, size_t n) {
+  size_t offset = 0;
+  while(offset < n) {
+    size_t len = n - offset;
+    const char *p = patch_map_view(pm, offset, &len);
+    memcpy(dst + offset, p ? p : base + offset, len);
+    offset += len;
+  }
+}
+
+static bool runs_sorted(const patch_map *pm) {
+  for(size_t i = 1; i < pm->n_runs; ++i) {
+    if(pm->runs[i - 1].offset + pm->runs[i - 1].len >= pm->runs[i].offset) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void test_merge() {
+  printf("\n\ntest_merge\n");
+  patch_map pm;
+  patch_map_init(&pm);
+
+  patch_map_write(&pm, 10, "ab", 2);
+  patch_map_write(&pm, 20, "cd", 2);
+  check_assert(pm.n_runs == 2, "separate writes make separate runs");
+
+  patch_map_write(&pm, 12, "xxxxxxxx", 8);
+  check_assert(pm.n_runs == 1 && pm.runs[0].offset == 10 && pm.runs[0].len == 12, "bridging write merges runs");
+
+  size_t pool = pm.pool_len;
+  patch_map_write(&pm, 15, "y", 1);
+  check_assert(pm.pool_len == pool, "rewriting a patched byte doesn't grow the pool");
+
+  for(int i = 0; i < 100; ++i) {
+    patch_map_write(&pm, 22 + i, "z", 1);
+  }
+  check_assert(pm.n_runs == 1 && patch_map_bytes(&pm) == 112, "typing extends the run");
+
+  size_t len = 100;
+  check_assert(!patch_map_view(&pm, 0, &len) && len == 10, "view stops at the next run");
+  len = 200;
+  const char *p = patch_map_view(&pm, 15, &len);
+  check_assert(p && *p == 'y' && len == 107, "view returns the run's bytes");
+
+  patch_map_free(&pm);
+}
+
+void test_random() {
+  printf("\n\ntest_random\n");
+  char base[BASE_LEN], expect[BASE_LEN], got[BASE_LEN], src[64];
+  patch_map pm;
+  patch_map_init(&pm);
+  srand(1);
+
+  for(size_t i = 0; i < BASE_LEN; ++i) {
+    base[i] = rand();
+  }
+  memcpy(expect, base, BASE_LEN);
+
+  bool ok = true;
+  for(int i = 0; i < 20000 && ok; ++i) {
+    size_t len = 1 + rand() % sizeof(src);
+    size_t offset = rand() % (BASE_LEN - len);
+    for(size_t j = 0; j < len; ++j) {
+      src[j] = rand();
+    }
+    fail_assert(patch_map_write(&pm, offset, src, len) == 0, "write");
+    memcpy(expect + offset, src, len);
+
+    read_through(&pm, base, got, BASE_LEN);
+    ok = memcmp(got, expect, BASE_LEN) == 0 && runs_sorted(&pm);
+  }
+  check_assert(ok, "random writes read back");
+  check_assert(pm.n_runs == 1 && patch_map_bytes(&pm) <= BASE_LEN, "memory is bounded by the bytes patched");
+
+  patch_map_clear(&pm);
+  read_through(&pm, base, got, BASE_LEN);
+  check_assert(memcmp(got, base, BASE_LEN) == 0, "cleared map reads the base");
+
+  patch_map_free(&pm);
+}
+
+int main(int argc, char *argv[]) {
+  test_merge();
+  test_random();
+
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE // memmem
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../replace.h"
+#include "../worker_pool.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define N_JOBS 4
+#define BIG_LEN ((64UL << 20) + 12345) // N_JOBS search jobs, none on a block boundary
+
+int g_failures = 0;
+
+static char g_path[] = "/tmp/replace_test.XXXXXX";
+static char *g_data;
+
+static void write_file(const char *data, size_t len) {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp && fwrite(data, 1, len, fp) == len && fclose(fp) == 0, "file written");
+}
+
+// leftmost non-overlapping matches a memmem at a time over the whole buffer
+static size_t find_all_scalar(const char *p, size_t n, const char *find, size_t find_len, size_t *out) {
+  size_t k = 0;
+  const char *q = p, *end = p + n;
+  while((q = memmem(q, end - q, find, find_len))) {
+    out[k++] = q - p;
+    q += find_len;
+  }
+  return k;
+}
+
+void test_unescape() {
+  printf("\n\ntest_unescape\n");
+  char out[8];
+  const char *end;
+  check_assert(replace_unescape("a\\x41\\n\\t\\/\\\\/rest", '/', out, sizeof(out), &end) == 6
+      && memcmp(out, "aA\n\t/\\", 6) == 0 && strcmp(end, "rest") == 0, "escapes and delimiter");
+  check_assert(replace_unescape("\\x4", '/', out, sizeof(out), &end) < 0, "short hex escape");
+  check_assert(replace_unescape("abc", '/', out, sizeof(out), &end) < 0, "missing delimiter");
+  check_assert(replace_unescape("123456789/", '/', out, sizeof(out), &end) < 0, "longer than the buffer");
+}
+
+// clusters of a's and b's, mostly a's, with long runs of a's over the edges
+// of the search jobs, so a match running over an edge hides the next job's
+// first ones.  self-overlapping patterns make the jobs' own greedy scans
+// disagree with the one over the whole document
+void test_find_all() {
+  printf("\n\ntest_find_all\n");
+  static const char *finds[] = { "aaa", "abab", "aab", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa" };
+  size_t *want = malloc(BIG_LEN / 3 * sizeof(size_t));
+  fail_assert(want, "reference matches");
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+
+  for(size_t i = 0; i < sizeof(finds) / sizeof(finds[0]); ++i) {
+    size_t *matches, n;
+    size_t n_want = find_all_scalar(g_data, BIG_LEN, finds[i], strlen(finds[i]), want);
+    check_assert(replace_find_all(finds[i], strlen(finds[i]), &matches, &n) == 0
+        && n == n_want && n > 0 && memcmp(matches, want, n * sizeof(size_t)) == 0,
+        "jobs find the matches a scan of the whole document finds");
+    free(matches);
+  }
+  cleanup_editor();
+  cleanup_file();
+  free(want);
+}
+
+// :s puts the replacement at every match, in one rebuild of the document
+void test_replace() {
+  printf("\n\ntest_replace\n");
+  char *s[] = { "s", "/aaa/\\x00X/" };
+  size_t *want = malloc(BIG_LEN / 3 * sizeof(size_t));
+  char *expect = malloc(BIG_LEN), *buf = malloc(BIG_LEN);
+  fail_assert(want && expect && buf, "reference data");
+  fail_assert(open_file(g_path) && setup_editor(), "file opens");
+
+  size_t n_want = find_all_scalar(g_data, BIG_LEN, "aaa", 3, want), len = 0, from = 0;
+  for(size_t i = 0; i < n_want; ++i) {
+    memcpy(expect + len, g_data + from, want[i] - from);
+    len += want[i] - from;
+    memcpy(expect + len, "\0X", 2);
+    len += 2;
+    from = want[i] + 3;
+  }
+  memcpy(expect + len, g_data + from, BIG_LEN - from);
+  len += BIG_LEN - from;
+
+  check_assert(replace_cmd(2, s) == 0, "replaced");
+  check_assert(doc_length() == len && doc_read(0, buf, len) == len && memcmp(buf, expect, len) == 0,
+      "every match replaced");
+  cleanup_editor();
+  cleanup_file();
+  free(want);
+  free(expect);
+  free(buf);
+}
+
+// the document and its watchers are set up once per process, so every
+// test gets a process of its own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fail_assert(setup_curses_headless() && setup_windows() && setup_worker_pool(N_JOBS), "headless screen");
+    test();
+    cleanup_worker_pool();
+    cleanup_windows();
+    cleanup_curses();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int fd = mkstemp(g_path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+
+  g_data = malloc(BIG_LEN);
+  fail_assert(g_data, "data");
+  srand(5);
+  memset(g_data, 'c', BIG_LEN);
+  for(size_t i = rand() % 4096; i + 64 < BIG_LEN; i += 1 + rand() % 8192) {
+    for(size_t j = rand() % 64; j > 0; --j) {
+      g_data[i + j] = rand() % 5 ? 'a' : 'b';
+    }
+  }
+  for(size_t i = 1; i < N_JOBS; ++i) {
+    memset(g_data + i * (BIG_LEN / N_JOBS) - 40 - i, 'a', 100);
+  }
+  write_file(g_data, BIG_LEN);
+
+  test_unescape();
+  run(test_find_all);
+  run(test_replace);
+
+  unlink(g_path);
+  free(g_data);
+  return g_failures ? -1 : 0;
+}
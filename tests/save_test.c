@@ -0,0 +1,193 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../save.h"
+#include "../undo.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+int g_failures = 0;
+
+static char g_dir[] = "/tmp/save_test.XXXXXX";
+static char g_path[64], g_link[64];
+
+static void write_file(const char *path, const char *data) {
+  FILE *fp = fopen(path, "w");
+  fail_assert(fp && fputs(data, fp) >= 0 && fclose(fp) == 0, "file written");
+}
+
+// the file on disk holds exactly data
+static bool file_is(const char *path, const char *data) {
+  char buf[256];
+  FILE *fp = fopen(path, "r");
+  if(!fp) {
+    return false;
+  }
+  size_t n = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  return n == strlen(data) && memcmp(buf, data, n) == 0;
+}
+
+// the same for files too long for file_is
+static bool file_is_long(const char *path, const char *data, size_t len) {
+  char *buf = malloc(len + 1);
+  FILE *fp = fopen(path, "r");
+  size_t n = buf && fp ? fread(buf, 1, len + 1, fp) : 0;
+  bool same = n == len && memcmp(buf, data, n) == 0;
+  if(fp) {
+    fclose(fp);
+  }
+  free(buf);
+  return same;
+}
+
+static bool doc_is(const char *data) {
+  char buf[256];
+  size_t n = doc_read(0, buf, sizeof(buf));
+  return n == strlen(data) && doc_length() == n && memcmp(buf, data, n) == 0;
+}
+
+static void open_editor(const char *path) {
+  fail_assert(open_file(path) && setup_editor() && setup_undo(), "file opens");
+}
+
+static void close_editor() {
+  cleanup_undo();
+  cleanup_editor();
+  cleanup_file();
+}
+
+// an overwrite goes back in place, and undo still knows the bytes it
+// replaced on disk
+void test_in_place() {
+  printf("\n\ntest_in_place\n");
+  write_file(g_path, "0123456789");
+  open_editor(g_path);
+
+  doc_overwrite(2, "ab", 2);
+  check_assert(save_cmd(1, NULL) == 0 && file_is(g_path, "01ab456789"), "overwrite saved in place");
+  check_assert(undo() == 0 && doc_is("0123456789"), "undo after saving in place brings back the old bytes");
+  check_assert(save_cmd(1, NULL) == 0 && file_is(g_path, "0123456789"), "undone bytes saved");
+  check_assert(redo() == 0 && doc_is("01ab456789"), "redo after saving");
+  close_editor();
+}
+
+// overwrites near each other go out in one write with the bytes between
+// them, far apart ones in another, and the file keeps its inode
+void test_coalesced() {
+  printf("\n\ntest_coalesced\n");
+  char data[10001], *want = malloc(sizeof(data));
+  struct stat before, after;
+  fail_assert(want, "expected data");
+  for(size_t i = 0; i < sizeof(data) - 1; ++i) {
+    data[i] = 'a' + i % 26;
+  }
+  data[sizeof(data) - 1] = '\0';
+  write_file(g_path, data);
+  open_editor(g_path);
+  fail_assert(stat(g_path, &before) == 0, "file stat");
+
+  memcpy(want, data, sizeof(data));
+  size_t at[] = { 0, 10, 100, 4000, 9000, 9999 };
+  for(size_t i = 0; i < sizeof(at) / sizeof(at[0]); ++i) {
+    size_t len = at[i] == 100 ? 20 : 1;
+    memset(want + at[i], '0' + i, len);
+    doc_overwrite(at[i], want + at[i], len);
+  }
+  check_assert(save_cmd(1, NULL) == 0 && file_is_long(g_path, want, sizeof(data) - 1), "overwrites saved");
+  check_assert(stat(g_path, &after) == 0 && after.st_ino == before.st_ino, "saved in place");
+  check_assert(undo() == 0 && save_cmd(1, NULL) == 0, "last overwrite undone and saved");
+  want[9999] = data[9999];
+  check_assert(file_is_long(g_path, want, sizeof(data) - 1), "undo after saving in place brings back the byte on disk");
+  close_editor();
+  free(want);
+}
+
+// an insert rewrites the file, through a symlink to the file it points to
+void test_rewrite() {
+  printf("\n\ntest_rewrite\n");
+  struct stat st;
+  write_file(g_path, "0123456789");
+  fail_assert(symlink(g_path, g_link) == 0, "symlink made");
+  open_editor(g_link);
+
+  doc_insert(5, "xyz", 3);
+  undo_seal();
+  doc_delete(0, 1);
+  check_assert(save_cmd(1, NULL) == 0, "insert and delete saved");
+  check_assert(lstat(g_link, &st) == 0 && S_ISLNK(st.st_mode), "symlink is still a symlink");
+  check_assert(file_is(g_path, "1234xyz56789"), "file the link points to rewritten");
+  check_assert(doc_is("1234xyz56789"), "document reads the new file");
+  close_editor();
+  unlink(g_link);
+}
+
+// a rewrite would take the name away from the other links
+void test_hard_link() {
+  printf("\n\ntest_hard_link\n");
+  write_file(g_path, "0123456789");
+  fail_assert(link(g_path, g_link) == 0, "hard link made");
+  open_editor(g_path);
+
+  doc_insert(0, "x", 1);
+  check_assert(save_cmd(1, NULL) < 0 && file_is(g_path, "0123456789"), "rewrite of a hard linked file refused");
+  doc_delete(0, 1);
+  doc_overwrite(9, "X", 1);
+  check_assert(save_cmd(1, NULL) == 0 && file_is(g_link, "012345678X"), "in place save reaches every link");
+  close_editor();
+  unlink(g_link);
+}
+
+// the document and its watchers are set up once per process, so every
+// test gets a process of its own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+    test();
+    cleanup_windows();
+    cleanup_curses();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  fail_assert(mkdtemp(g_dir), "temporary directory");
+  snprintf(g_path, sizeof(g_path), "%s/file", g_dir);
+  snprintf(g_link, sizeof(g_link), "%s/link", g_dir);
+
+  run(test_in_place);
+  run(test_coalesced);
+  run(test_rewrite);
+  run(test_hard_link);
+
+  unlink(g_path);
+  rmdir(g_dir);
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,136 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../editor.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define SMALL_LEN ((3UL << 20) + 7)           // a few chunks, kept in memory
+#define BIG_LEN (FILE_STREAM_MEM + SMALL_LEN) // past the memory limit, spilled
+
+int g_failures = 0;
+
+static char g_dir[] = "/tmp/stream_test.XXXXXX";
+static char g_fifo[sizeof(g_dir) + 5];
+static char *g_data;
+
+// a child writes len bytes to fd, in pieces smaller than a read, and exits
+static pid_t writer(int fd, size_t len) {
+  pid_t pid = fork();
+  if(pid == 0) {
+    for(size_t done = 0; done < len; ) {
+      size_t n = len - done < 100000 ? len - done : 100000;
+      ssize_t w = write(fd, g_data + done, n);
+      if(w <= 0) {
+        _exit(1);
+      }
+      done += w;
+    }
+    _exit(0);
+  }
+  return pid;
+}
+
+static bool writer_done(pid_t pid) {
+  int status;
+  return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// open "-" with the read end of a pipe standing in for stdin
+static bool open_stdin(file_info *f, size_t len, pid_t *pid) {
+  int p[2], saved = dup(STDIN_FILENO);
+  fail_assert(saved >= 0 && pipe(p) == 0, "pipe");
+  *pid = writer(p[1], len);
+  close(p[1]);
+  dup2(p[0], STDIN_FILENO);
+  close(p[0]);
+  bool ok = file_open(f, "-", O_RDWR);
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+  return ok;
+}
+
+// a pipe that fits in memory stays there, the descriptor is still the pipe
+void test_small() {
+  printf("\n\ntest_small\n");
+  file_info f = { .fd = -1 };
+  struct stat s;
+  pid_t pid;
+
+  check_assert(open_stdin(&f, SMALL_LEN, &pid) && writer_done(pid), "stdin read to its end");
+  check_assert(f.kind == FILE_KIND_STREAM && !file_writable(&f), "a stream, never saved");
+  check_assert(f.mm_len == SMALL_LEN && memcmp(f.mm, g_data, SMALL_LEN) == 0, "every byte read");
+  check_assert(fstat(f.fd, &s) == 0 && S_ISFIFO(s.st_mode), "kept in memory");
+  file_close(&f);
+}
+
+// a stream that ends at once has nothing to map
+void test_empty() {
+  printf("\n\ntest_empty\n");
+  file_info f = { .fd = -1 };
+  pid_t pid;
+
+  check_assert(open_stdin(&f, 0, &pid) && writer_done(pid), "empty stdin opens");
+  check_assert(f.kind == FILE_KIND_STREAM && f.mm_len == 0 && f.mm == NULL, "no bytes");
+  file_close(&f);
+}
+
+// a fifo past the memory limit goes to a temporary file with no name, which
+// is mapped in place of the anonymous memory
+void test_spill() {
+  printf("\n\ntest_spill\n");
+  file_info f = { .fd = -1 };
+  struct stat s;
+
+  pid_t pid = fork();
+  if(pid == 0) {
+    int fd = open(g_fifo, O_WRONLY);
+    _exit(fd < 0 || !writer_done(writer(fd, BIG_LEN)));
+  }
+  check_assert(file_open(&f, g_fifo, O_RDWR) && writer_done(pid), "fifo read to its end");
+  check_assert(f.kind == FILE_KIND_STREAM && !file_writable(&f), "a stream, never saved");
+  check_assert(f.mm_len == BIG_LEN && memcmp(f.mm, g_data, BIG_LEN) == 0, "every byte read");
+  check_assert(fstat(f.fd, &s) == 0 && S_ISREG(s.st_mode) && s.st_nlink == 0 && (size_t)s.st_size == BIG_LEN,
+      "spilled to an unlinked temporary file");
+  file_close(&f);
+}
+
+int main(int argc, char *argv[]) {
+  fail_assert(mkdtemp(g_dir) == g_dir, "temporary directory");
+  snprintf(g_fifo, sizeof(g_fifo), "%s/fifo", g_dir);
+  fail_assert(mkfifo(g_fifo, 0600) == 0, "fifo");
+
+  g_data = malloc(BIG_LEN);
+  fail_assert(g_data, "data");
+  for(size_t i = 0; i < BIG_LEN; ++i) {
+    g_data[i] = i * 31 + (i >> 16);
+  }
+
+  test_small();
+  test_empty();
+  test_spill();
+
+  unlink(g_fifo);
+  rmdir(g_dir);
+  free(g_data);
+  return g_failures ? -1 : 0;
+}
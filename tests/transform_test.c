@@ -0,0 +1,201 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../byte_transform.h"
+#include "../transform.h"
+#include "../worker_pool.h"
+#include "../undo.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define BUF_LEN 1000
+#define ROUNDS_LEN ((20UL << 20) + 5) // several windows of two threads
+
+int g_failures = 0;
+
+void test_known() {
+  printf("\n\ntest_known\n");
+  const unsigned char key[] = { 0xff, 0x01 };
+  char buf[16];
+
+  memcpy(buf, "\x00\x01\x02\x03\x04\x05\x06\x07\x08", 9);
+  byte_transform(BYTE_TRANSFORM_SWAP16, buf, buf, 9, NULL, 0, 0);
+  check_assert(memcmp(buf, "\x01\x00\x03\x02\x05\x04\x07\x06\x08", 9) == 0, "swap16 leaves the odd byte");
+
+  memcpy(buf, "\x00\x01\x02\x03\x04\x05\x06\x07", 8);
+  byte_transform(BYTE_TRANSFORM_SWAP32, buf, buf, 8, NULL, 0, 0);
+  check_assert(memcmp(buf, "\x03\x02\x01\x00\x07\x06\x05\x04", 8) == 0, "swap32");
+
+  memcpy(buf, "\x00\x01\x02\x03\x04\x05\x06\x07", 8);
+  byte_transform(BYTE_TRANSFORM_SWAP64, buf, buf, 8, NULL, 0, 0);
+  check_assert(memcmp(buf, "\x07\x06\x05\x04\x03\x02\x01\x00", 8) == 0, "swap64");
+
+  memcpy(buf, "\x10\x10\x10", 3);
+  byte_transform(BYTE_TRANSFORM_ADD, buf, buf, 3, key, 2, 1);
+  check_assert(memcmp(buf, "\x11\x0f\x11", 3) == 0, "add wraps and starts at the phase");
+
+  byte_transform(BYTE_TRANSFORM_XOR, buf, buf, 3, key, 2, 0);
+  check_assert(memcmp(buf, "\xee\x0e\xee", 3) == 0, "xor cycles the key");
+}
+
+// the vector kernels against the scalar ones for every op, a range of key
+// lengths and phases and unaligned starts and lengths
+void test_against_scalar() {
+  printf("\n\ntest_against_scalar\n");
+  char src[BUF_LEN], vec[BUF_LEN], ref[BUF_LEN];
+  unsigned char key[BYTE_TRANSFORM_MAX_KEY];
+  srand(1);
+
+  for(size_t i = 0; i < BUF_LEN; ++i) {
+    src[i] = rand();
+  }
+  for(size_t i = 0; i < sizeof(key); ++i) {
+    key[i] = rand();
+  }
+
+  bool ok = true;
+  for(int op = BYTE_TRANSFORM_XOR; op <= BYTE_TRANSFORM_SWAP64; ++op) {
+    for(int i = 0; i < 2000; ++i) {
+      size_t start = rand() % 32;
+      size_t n = rand() % (BUF_LEN - start);
+      size_t key_len = 1 + rand() % sizeof(key);
+      size_t phase = rand();
+      byte_transform(op, vec, src + start, n, key, key_len, phase);
+      byte_transform_scalar(op, ref, src + start, n, key, key_len, phase);
+      if(memcmp(vec, ref, n) != 0) {
+        ok = false;
+      }
+    }
+  }
+  check_assert(ok, "vector and scalar kernels agree");
+
+  memcpy(vec, src, BUF_LEN);
+  byte_transform(BYTE_TRANSFORM_XOR, vec, vec, BUF_LEN, key, 3, 0);
+  byte_transform(BYTE_TRANSFORM_XOR, vec, vec, 500, key, 3, 0);
+  byte_transform(BYTE_TRANSFORM_XOR, vec + 500, vec + 500, 500, key, 3, 500);
+  check_assert(memcmp(vec, src, BUF_LEN) == 0, "xor in two slices undoes xor in one");
+}
+
+// a file of one line, which is both the first and the last line.  the
+// commands work on the current line without a selection
+void test_one_line() {
+  printf("\n\ntest_one_line\n");
+  char path[] = "/tmp/transform_test.XXXXXX";
+  char buf[8];
+  int fd = mkstemp(path);
+  fail_assert(fd >= 0 && write(fd, "abcdef", 6) == 6, "temporary file");
+  close(fd);
+
+  fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+  fail_assert(open_file(path) && setup_editor(), "one line file opens");
+  check_assert(g_editor.screen.curline == g_editor.data.firstline, "cursor is on the only line");
+
+  editor_char_right_main();
+  check_assert(editor_get_cursor_offset() == 1, "cursor moves along the only line");
+
+  char *xor[] = { "xor", "ff" };
+  editor_set_selection(1, 4);
+  check_assert(xor_cmd(2, xor) == 0, "xor over a selection");
+  check_assert(doc_read(0, buf, 6) == 6 && memcmp(buf, "a\x9d\x9c\x9b\x9a" "f", 6) == 0, "xor changes the selected bytes");
+
+  char *fill[] = { "fill", "00" };
+  editor_set_selection(0, 0);
+  check_assert(fill_cmd(2, fill) == 0, "fill without a selection");
+  check_assert(doc_read(0, buf, 6) == 6 && memcmp(buf, "\0\0\0\0\0\0", 6) == 0, "fill covers the current line");
+
+  cleanup_editor();
+  cleanup_file();
+  cleanup_windows();
+  cleanup_curses();
+  unlink(path);
+}
+
+// a range longer than a window is transformed and written back in rounds,
+// the same as in one go, and undone in one step
+void test_rounds() {
+  printf("\n\ntest_rounds\n");
+  char path[] = "/tmp/transform_test.XXXXXX";
+  const unsigned char key[] = { 0x5a, 0x01, 0xc3 };
+  char *src = malloc(ROUNDS_LEN), *want = malloc(ROUNDS_LEN), *buf = malloc(ROUNDS_LEN);
+  fail_assert(src && want && buf, "buffers");
+  for(size_t i = 0; i < ROUNDS_LEN; ++i) {
+    src[i] = i * 13 + (i >> 10);
+  }
+  int fd = mkstemp(path);
+  fail_assert(fd >= 0 && write(fd, src, ROUNDS_LEN) == (ssize_t)ROUNDS_LEN, "temporary file");
+  close(fd);
+
+  fail_assert(setup_curses_headless() && setup_windows() && setup_worker_pool(2), "headless screen");
+  fail_assert(open_file(path) && setup_editor() && setup_undo(), "file opens");
+
+  byte_transform_scalar(BYTE_TRANSFORM_XOR, want + 3, src + 3, ROUNDS_LEN - 4, key, 3, 0);
+  memcpy(want, src, 3);
+  want[ROUNDS_LEN - 1] = src[ROUNDS_LEN - 1];
+  undo_seal();
+  check_assert(transform_range(BYTE_TRANSFORM_XOR, 3, ROUNDS_LEN - 4, key, 3) == 0, "xor over several windows");
+  check_assert(doc_read(0, buf, ROUNDS_LEN) == ROUNDS_LEN && memcmp(buf, want, ROUNDS_LEN) == 0,
+      "every window transformed with the key in phase");
+
+  byte_transform_scalar(BYTE_TRANSFORM_SWAP64, want + 1, want + 1, ROUNDS_LEN - 5, NULL, 0, 0);
+  undo_seal();
+  check_assert(transform_range(BYTE_TRANSFORM_SWAP64, 1, ROUNDS_LEN - 5, NULL, 0) == 0, "swap over several windows");
+  check_assert(doc_read(0, buf, ROUNDS_LEN) == ROUNDS_LEN && memcmp(buf, want, ROUNDS_LEN) == 0,
+      "no word split between windows");
+  check_assert(undo() == 0 && undo() == 0 && undo() < 0, "one undo entry per transform");
+  check_assert(doc_read(0, buf, ROUNDS_LEN) == ROUNDS_LEN && memcmp(buf, src, ROUNDS_LEN) == 0, "undone");
+
+  cleanup_undo();
+  cleanup_editor();
+  cleanup_file();
+  cleanup_worker_pool();
+  cleanup_windows();
+  cleanup_curses();
+  unlink(path);
+  free(src);
+  free(want);
+  free(buf);
+}
+
+// the document is opened once per process, so tests of a file get a
+// process of their own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    test();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  test_known();
+  test_against_scalar();
+  run(test_one_line);
+  run(test_rounds);
+
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,201 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../undo.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define BIG_LEN (1UL << 20)
+#define SPILL_CHANGES 64
+#define SPILL_LEN 512
+
+int g_failures = 0;
+
+static char g_path[] = "/tmp/undo_test.XXXXXX";
+
+static void write_file(const char *data, size_t len) {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp && fwrite(data, 1, len, fp) == len && fclose(fp) == 0, "file written");
+}
+
+static bool doc_is_n(const char *data, size_t len) {
+  char *buf = malloc(len + 1);
+  size_t n = buf ? doc_read(0, buf, len + 1) : 0;
+  bool same = n == len && doc_length() == len && memcmp(buf, data, len) == 0;
+  free(buf);
+  return same;
+}
+
+static bool doc_is(const char *data) {
+  return doc_is_n(data, strlen(data));
+}
+
+static void open_undo() {
+  fail_assert(open_file(g_path) && setup_undo(), "file opens");
+}
+
+// every kind of change, undone one at a time and redone again
+void test_undo_redo() {
+  printf("\n\ntest_undo_redo\n");
+  write_file("0123456789", 10);
+  open_undo();
+
+  doc_insert(5, "abc", 3);
+  undo_seal();
+  doc_delete(0, 2);
+  undo_seal();
+  doc_overwrite(1, "XY", 2);
+  undo_seal();
+  doc_fill(6, 4, "-", 1);
+  fail_assert(doc_is("2XYabc----9"), "changes made");
+
+  check_assert(undo() == 0 && doc_is("2XYabc56789"), "fill undone");
+  check_assert(undo() == 0 && doc_is("234abc56789"), "overwrite undone");
+  check_assert(undo() == 0 && doc_is("01234abc56789"), "delete undone");
+  check_assert(undo() == 0 && doc_is("0123456789"), "insert undone");
+  check_assert(undo() < 0 && doc_is("0123456789"), "nothing more to undo");
+
+  check_assert(redo() == 0 && redo() == 0 && doc_is("234abc56789"), "insert and delete redone");
+  doc_insert(0, "!", 1);
+  check_assert(redo() < 0 && doc_is("!234abc56789"), "a new change drops what was undone");
+  check_assert(undo() == 0 && undo() == 0 && doc_is("01234abc56789"), "undo goes on past the new change");
+  cleanup_undo();
+  cleanup_file();
+}
+
+// keystrokes one after another are one entry until sealed
+void test_coalesce() {
+  printf("\n\ntest_coalesce\n");
+  write_file("abc", 3);
+  open_undo();
+
+  doc_insert(1, "x", 1);
+  doc_insert(2, "y", 1);
+  doc_insert(3, "z", 1);
+  undo_seal();
+  doc_insert(4, "w", 1);
+  doc_overwrite(0, "A", 1);
+  fail_assert(doc_is("Axyzwbc"), "keys typed");
+
+  check_assert(undo() == 0 && doc_is("axyzwbc"), "overwrite elsewhere is an entry of its own");
+  check_assert(undo() == 0 && doc_is("axyzbc"), "typing after a seal is a new entry");
+  check_assert(undo() == 0 && doc_is("abc"), "keys typed in a row undone together");
+  cleanup_undo();
+  cleanup_file();
+}
+
+// a deleted megabyte is journaled by reference, not copied
+void test_reference() {
+  printf("\n\ntest_reference\n");
+  char *data = malloc(BIG_LEN);
+  size_t spilled;
+  fail_assert(data, "data");
+  for(size_t i = 0; i < BIG_LEN; ++i) {
+    data[i] = i * 7;
+  }
+  write_file(data, BIG_LEN);
+  open_undo();
+
+  size_t before = undo_memory(&spilled);
+  doc_delete(1000, BIG_LEN - 2000);
+  check_assert(undo_memory(&spilled) - before < BIG_LEN / 64, "delete recorded by reference");
+  check_assert(undo() == 0 && doc_is_n(data, BIG_LEN), "deleted bytes put back");
+  check_assert(redo() == 0 && doc_length() == 2000, "delete redone");
+  check_assert(undo() == 0 && doc_is_n(data, BIG_LEN), "and undone again");
+  cleanup_undo();
+  cleanup_file();
+  free(data);
+}
+
+// copies of overwritten bytes beyond the limit go to the spill file and are
+// read back from it when undone
+void test_spill() {
+  printf("\n\ntest_spill\n");
+  char *limit[] = { "undo", "limit", "4k" };
+  char *data = malloc(SPILL_CHANGES * SPILL_LEN), *changed = malloc(SPILL_CHANGES * SPILL_LEN);
+  size_t spilled;
+  fail_assert(data && changed, "data");
+  for(size_t i = 0; i < SPILL_CHANGES * SPILL_LEN; ++i) {
+    data[i] = 'a' + i % 26;
+    changed[i] = 'A' + i % 23;
+  }
+  write_file(data, SPILL_CHANGES * SPILL_LEN);
+  open_undo();
+  check_assert(undo_cmd(3, limit) == 0, "undo memory limited");
+
+  for(size_t i = 0; i < SPILL_CHANGES; ++i) {
+    doc_overwrite(i * SPILL_LEN, changed + i * SPILL_LEN, SPILL_LEN);
+    undo_seal();
+  }
+  fail_assert(doc_is_n(changed, SPILL_CHANGES * SPILL_LEN), "overwrites made");
+  size_t memory = undo_memory(&spilled);
+  check_assert(spilled >= (SPILL_CHANGES - 8) * SPILL_LEN, "oldest copies spilled");
+  check_assert(memory < SPILL_CHANGES * SPILL_LEN, "memory stays under the copies");
+
+  bool undone = true;
+  for(size_t i = 0; i < SPILL_CHANGES; ++i) {
+    undone = undone && undo() == 0;
+  }
+  check_assert(undone && doc_is_n(data, SPILL_CHANGES * SPILL_LEN), "every overwrite undone from memory and spill file");
+  bool redone = true;
+  for(size_t i = 0; i < SPILL_CHANGES; ++i) {
+    redone = redone && redo() == 0;
+  }
+  check_assert(redone && doc_is_n(changed, SPILL_CHANGES * SPILL_LEN), "and redone");
+  cleanup_undo();
+  cleanup_file();
+  free(data);
+  free(changed);
+}
+
+// the document and its watchers are set up once per process, so every
+// test gets a process of its own
+static void run(void (*test)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fail_assert(setup_curses_headless() && setup_windows(), "headless screen");
+    test();
+    cleanup_windows();
+    cleanup_curses();
+    exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "test process");
+  if(!WIFEXITED(status) || WEXITSTATUS(status)) {
+    ++g_failures;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int fd = mkstemp(g_path);
+  fail_assert(fd >= 0, "temporary file");
+  close(fd);
+
+  run(test_undo_redo);
+  run(test_coalesce);
+  run(test_reference);
+  run(test_spill);
+
+  unlink(g_path);
+  return g_failures ? -1 : 0;
+}
@@ -0,0 +1,140 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../wal.h"
+#include "../editor.h"
+#include "../document.h"
+
+#define check_assert_with_fail(expr, msg, fail) \
+ do { \
+   if(!(expr)) { \
+     fprintf(stderr, "FAIL %s line %d: %s\n", __FILE__, __LINE__, msg); \
+     g_failures++; \
+     if(fail) { \
+       exit(-1); \
+     } \
+   } else { \
+     fprintf(stderr, "OK   %s line %d: %s\n", __FILE__, __LINE__, msg); \
+   } \
+ } while(false);
+
+#define check_assert(expr, msg) check_assert_with_fail(expr, msg, false)
+#define fail_assert(expr, msg) check_assert_with_fail(expr, msg, true)
+
+#define ORIGINAL "0123456789abcdef"
+#define EDITED "Head xyxy7ZZ9ZZbcdef"
+#define BEFORE_LAST "head xyxy7ZZ9ZZbcdef" // without the last overwrite
+
+int g_failures = 0;
+
+static char g_dir[] = "/tmp/wal_test.XXXXXX";
+static char g_path[64], g_journal[64];
+
+static bool doc_is(const char *data) {
+  char buf[256];
+  size_t n = doc_read(0, buf, sizeof(buf));
+  return n == strlen(data) && doc_length() == n && memcmp(buf, data, n) == 0;
+}
+
+// the document and its log are set up once per process, and a crash is a
+// process that exits without cleaning up
+static int run(void (*fn)()) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid == 0) {
+    fn();
+    _exit(g_failures);
+  }
+  int status;
+  fail_assert(pid > 0 && waitpid(pid, &status, 0) == pid, "child process");
+  return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+// one change of every kind the journal has a record for, committed and
+// then lost in a crash
+static void edit_and_crash() {
+  size_t offsets[] = { 10, 12 };
+  struct timespec wait = { 0, (WAL_COMMIT_MS + 100) * 1000000L };
+
+  fail_assert(open_file(g_path) && setup_wal(), "file opens with a journal");
+  doc_insert(0, "head ", 5);
+  doc_fill(5, 4, "xy", 2);
+  doc_delete(9, 3);
+  doc_replace_all(offsets, 2, 1, "ZZ", 2);
+  doc_overwrite(0, "H", 1);
+  fail_assert(doc_is(EDITED), "edits made");
+  check_assert(wal_pending(), "records wait for their commit");
+
+  nanosleep(&wait, NULL);
+  wal_idle();
+  check_assert(!wal_pending(), "records committed when idle");
+}
+
+static void recover_all() {
+  fail_assert(open_file(g_path), "file opens again");
+  int n = wal_found();
+  check_assert(n > 0, "journal found");
+  check_assert(wal_replay() == n && doc_is(EDITED), "every change recovered");
+}
+
+static void recover_torn() {
+  fail_assert(open_file(g_path), "file opens again");
+  int n = wal_found();
+  check_assert(wal_replay() == n && doc_is(BEFORE_LAST), "changes before the torn record recovered");
+}
+
+static void recover_other_version() {
+  fail_assert(open_file(g_path), "file opens again");
+  check_assert(wal_found() == 0, "journal of another version of the file ignored");
+}
+
+static void write_original() {
+  FILE *fp = fopen(g_path, "w");
+  fail_assert(fp && fputs(ORIGINAL, fp) >= 0 && fclose(fp) == 0, "file written");
+}
+
+void test_recover() {
+  printf("\n\ntest_recover\n");
+  write_original();
+  g_failures += run(edit_and_crash);
+  g_failures += run(recover_all);
+}
+
+void test_torn() {
+  printf("\n\ntest_torn\n");
+  struct stat st;
+  write_original();
+  g_failures += run(edit_and_crash);
+  fail_assert(stat(g_journal, &st) == 0 && truncate(g_journal, st.st_size - 3) == 0, "last record torn");
+  g_failures += run(recover_torn);
+}
+
+void test_other_version() {
+  printf("\n\ntest_other_version\n");
+  write_original();
+  g_failures += run(edit_and_crash);
+  write_original();
+  FILE *fp = fopen(g_path, "a");
+  fail_assert(fp && fputs("more", fp) >= 0 && fclose(fp) == 0, "file changed after the crash");
+  g_failures += run(recover_other_version);
+}
+
+int main(int argc, char *argv[]) {
+  fail_assert(mkdtemp(g_dir), "temporary directory");
+  snprintf(g_path, sizeof(g_path), "%s/file", g_dir);
+  snprintf(g_journal, sizeof(g_journal), "%s/.file.hxj", g_dir);
+
+  test_recover();
+  test_torn();
+  test_other_version();
+
+  unlink(g_journal);
+  unlink(g_path);
+  rmdir(g_dir);
+  return g_failures ? -1 : 0;
+}
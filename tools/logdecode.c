@@ -0,0 +1,171 @@
+#include "../logger.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// turns the binary log written by logger.c back into text, one line per
+// record:
+//
+//   2026-10-19 17:10:00.123456 I 0 editor.c 545: Could not reload lines at 4096
+//
+// usage: logdecode [log file...], stdin if none are given
+
+struct log_string {
+  uint64_t addr;
+  char *s;
+};
+
+// the strings of the current session
+static struct log_string *g_strings;
+static size_t g_n_strings;
+static size_t g_max_strings;
+
+static void forget_strings() {
+  for(size_t i = 0; i < g_n_strings; ++i) {
+    free(g_strings[i].s);
+  }
+  g_n_strings = 0;
+}
+
+static const char *find_string(uint64_t addr) {
+  for(size_t i = g_n_strings; i > 0; --i) {
+    if(g_strings[i - 1].addr == addr) {
+      return g_strings[i - 1].s;
+    }
+  }
+  return NULL;
+}
+
+static int add_string(uint64_t addr, char *s) {
+  if(g_n_strings == g_max_strings) {
+    size_t max = g_max_strings ? g_max_strings * 2 : 256;
+    struct log_string *v = realloc(g_strings, max * sizeof(struct log_string));
+    if(!v) {
+      return -1;
+    }
+    g_strings = v;
+    g_max_strings = max;
+  }
+  g_strings[g_n_strings].addr = addr;
+  g_strings[g_n_strings].s = s;
+  ++g_n_strings;
+  return 0;
+}
+
+static void print_record(const struct log_record *r) {
+  static const char levels[] = "DIWE";
+  char msg[1024], when[32];
+  const char *fmt = find_string(r->fmt);
+  const char *file = find_string(r->file);
+
+  time_t t = r->time_ns / 1000000000ULL;
+  struct tm tm;
+  localtime_r(&t, &tm);
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+
+  if(fmt) {
+    log_format(fmt, r, msg, sizeof(msg));
+  } else {
+    snprintf(msg, sizeof(msg), "(format string %#lx missing)", r->fmt);
+  }
+  printf("%s.%06lu %c %u %s %u: %s\n", when, (unsigned long)(r->time_ns % 1000000000ULL / 1000),
+      r->level < 4 ? levels[r->level] : '?', r->thread, file ? file : "?", r->line, msg);
+}
+
+static int decode(FILE *fp, const char *name) {
+  char magic[sizeof(LOG_MAGIC)];
+  uint32_t tag;
+
+  if(fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, LOG_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "%s: not a log\n", name);
+    return -1;
+  }
+  forget_strings();
+
+  while(fread(&tag, sizeof(tag), 1, fp) == 1) {
+    if(memcmp(&tag, LOG_MAGIC, sizeof(tag)) == 0) {
+      // the next session appended to the same file
+      if(fread(magic + sizeof(tag), sizeof(magic) - sizeof(tag), 1, fp) != 1) {
+        break;
+      }
+      forget_strings();
+      continue;
+    }
+
+    switch(tag) {
+      case LOG_TAG_STRING :
+        {
+          uint64_t addr;
+          uint32_t len;
+          if(fread(&addr, sizeof(addr), 1, fp) != 1 || fread(&len, sizeof(len), 1, fp) != 1) {
+            goto truncated;
+          }
+          char *s = malloc(len + 1);
+          if(!s || fread(s, 1, len, fp) != len) {
+            free(s);
+            goto truncated;
+          }
+          s[len] = '\0';
+          if(add_string(addr, s) < 0) {
+            free(s);
+            return -1;
+          }
+        }
+        break;
+      case LOG_TAG_RECORD :
+        {
+          struct log_record r;
+          if(fread(&r, sizeof(r), 1, fp) != 1) {
+            goto truncated;
+          }
+          if(r.len > LOG_RECORD_ARGS) {
+            fprintf(stderr, "%s: bad record\n", name);
+            return -1;
+          }
+          print_record(&r);
+        }
+        break;
+      case LOG_TAG_DROPPED :
+        {
+          uint64_t n;
+          if(fread(&n, sizeof(n), 1, fp) != 1) {
+            goto truncated;
+          }
+          printf("(%lu records dropped)\n", (unsigned long)n);
+        }
+        break;
+      default :
+        fprintf(stderr, "%s: unknown tag %u\n", name, tag);
+        return -1;
+    }
+  }
+  return 0;
+
+truncated:
+  // the editor may still be writing it
+  fprintf(stderr, "%s: ends in the middle of an entry\n", name);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int r = 0;
+
+  if(argc < 2) {
+    return decode(stdin, "stdin") < 0 ? 1 : 0;
+  }
+  for(int i = 1; i < argc; ++i) {
+    FILE *fp = fopen(argv[i], "rb");
+    if(!fp) {
+      perror(argv[i]);
+      r = 1;
+      continue;
+    }
+    if(decode(fp, argv[i]) < 0) {
+      r = 1;
+    }
+    fclose(fp);
+  }
+  return r;
+}
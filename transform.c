@@ -0,0 +1,206 @@
+#include "transform.h"
+
+#include "document.h"
+#include "editor.h"
+#include "edit.h"
+#include "worker_pool.h"
+#include "undo.h"
+#include "byte_transform.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define TRANSFORM_BLOCK (4UL << 20)      // bytes read and transformed per step
+#define TRANSFORM_MIN_CHUNK (1UL << 20)  // smallest range worth handing to another thread
+
+struct transform_job {
+  int op;
+  size_t offset;
+  size_t len;
+  char *out;         // where the transformed bytes of the job go
+  const unsigned char *key;
+  size_t key_len;
+  size_t phase;      // key index of the job's first byte
+  worker_group *group;
+  size_t *done;      // progress counter shared by all of the jobs
+  int failed;
+};
+
+static void transform_job_run(void *arg) {
+  struct transform_job *job = arg;
+  size_t done = 0;
+
+  while(done < job->len && !worker_group_cancelled(job->group)) {
+    size_t n = job->len - done < TRANSFORM_BLOCK ? job->len - done : TRANSFORM_BLOCK;
+    char *out = job->out + done;
+    if(doc_read(job->offset + done, out, n) != n) {
+      job->failed = 1;
+      break;
+    }
+    byte_transform(job->op, out, out, n, job->key, job->key_len, job->phase + done);
+    done += n;
+    __atomic_add_fetch(job->done, n, __ATOMIC_RELAXED);
+  }
+}
+
+int transform_range(int op, size_t offset, size_t len, const unsigned char *key, size_t key_len) {
+  worker_group group;
+  size_t done = 0;
+  int r = 0;
+
+  if(len == 0) {
+    return 0;
+  }
+
+  // about a block per thread is transformed and written back per round, so
+  // the copy held at once doesn't grow with the selection
+  size_t threads = worker_pool_threads();
+  size_t window = (threads ? threads : 1) * TRANSFORM_BLOCK;
+  window = window < len ? window : len;
+  size_t max_jobs = window / TRANSFORM_MIN_CHUNK;
+  max_jobs = max_jobs < threads * 4 ? max_jobs : threads * 4;
+  max_jobs = max_jobs ? max_jobs : 1;
+
+  char *out = malloc(window);
+  struct transform_job *jobs = calloc(max_jobs, sizeof(struct transform_job));
+  if(!out || !jobs) {
+    free(out);
+    free(jobs);
+    return -1;
+  }
+
+  worker_group_init(&group);
+  doc_advise(offset, len, MADV_SEQUENTIAL);
+
+  // rounds after the first continue the undo entry of the first
+  for(size_t at = 0; at < len && r == 0; at += window) {
+    size_t n = len - at < window ? len - at : window;
+    size_t n_jobs = n / TRANSFORM_MIN_CHUNK;
+    n_jobs = n_jobs < max_jobs ? n_jobs : max_jobs;
+    n_jobs = n_jobs ? n_jobs : 1;
+
+    // chunks stay a multiple of 64 so that no word of a swap is split
+    size_t chunk = n / n_jobs & ~(size_t)63;
+    for(size_t i = 0; i < n_jobs; ++i) {
+      size_t from = at + i * chunk;
+      jobs[i].op = op;
+      jobs[i].offset = offset + from;
+      jobs[i].len = i + 1 < n_jobs ? chunk : n - i * chunk;
+      jobs[i].out = out + i * chunk;
+      jobs[i].key = key;
+      jobs[i].key_len = key_len;
+      jobs[i].phase = key_len ? from % key_len : 0;
+      jobs[i].group = &group;
+      jobs[i].done = &done;
+      jobs[i].failed = 0;
+      if(worker_pool_submit(&group, transform_job_run, &jobs[i]) < 0) {
+        jobs[i].failed = 1;
+      }
+    }
+
+    r = editor_wait_progress(&group, "transform", &done, len);
+    for(size_t i = 0; i < n_jobs && r == 0; ++i) {
+      if(jobs[i].failed) {
+        r = -1;
+      }
+    }
+    if(r == 0) {
+      if(at > 0) {
+        undo_chain();
+      }
+      r = doc_overwrite(offset + at, out, n);
+    }
+  }
+
+  doc_advise(offset, len, MADV_NORMAL);
+  worker_group_destroy(&group);
+  free(jobs);
+  free(out);
+  return r;
+}
+
+int fill_cmd(int argc, char *argv[]) {
+  char pattern[BYTE_TRANSFORM_MAX_KEY];
+  size_t offset, len;
+  char msg[96];
+
+  int n = edit_parse_hex(argc - 1, argv + 1, pattern, sizeof(pattern));
+  if(n <= 0) {
+    set_status_window_text("usage: fill <hex bytes>");
+    return -1;
+  }
+
+  editor_get_selection(&offset, &len);
+  if(len == 0 || doc_fill(offset, len, pattern, n) < 0) {
+    set_status_window_text("fill: failed");
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "filled %lu bytes at 0x%lx", len, offset);
+  set_status_window_text(msg);
+  return 0;
+}
+
+static int transform_cmd(int op, const char *name, size_t offset, size_t len,
+    const unsigned char *key, size_t key_len)
+{
+  char msg[96];
+
+  if(len == 0 || transform_range(op, offset, len, key, key_len) < 0) {
+    snprintf(msg, sizeof(msg), "%s: failed or cancelled", name);
+    set_status_window_text(msg);
+    return -1;
+  }
+
+  snprintf(msg, sizeof(msg), "%s: changed %lu bytes at 0x%lx", name, len, offset);
+  set_status_window_text(msg);
+  return 0;
+}
+
+static int transform_key_cmd(int op, const char *name, int argc, char *argv[]) {
+  char key[BYTE_TRANSFORM_MAX_KEY];
+  size_t offset, len;
+  char msg[96];
+
+  int n = edit_parse_hex(argc - 1, argv + 1, key, sizeof(key));
+  if(n <= 0) {
+    snprintf(msg, sizeof(msg), "usage: %s <hex bytes>", name);
+    set_status_window_text(msg);
+    return -1;
+  }
+
+  editor_get_selection(&offset, &len);
+  return transform_cmd(op, name, offset, len, (const unsigned char *)key, n);
+}
+
+int xor_cmd(int argc, char *argv[]) {
+  return transform_key_cmd(BYTE_TRANSFORM_XOR, "xor", argc, argv);
+}
+
+int add_cmd(int argc, char *argv[]) {
+  return transform_key_cmd(BYTE_TRANSFORM_ADD, "add", argc, argv);
+}
+
+int swap_cmd(int argc, char *argv[]) {
+  size_t offset, len;
+  int op = -1;
+
+  if(argc == 2) {
+    if(strcmp(argv[1], "16") == 0) {
+      op = BYTE_TRANSFORM_SWAP16;
+    } else if(strcmp(argv[1], "32") == 0) {
+      op = BYTE_TRANSFORM_SWAP32;
+    } else if(strcmp(argv[1], "64") == 0) {
+      op = BYTE_TRANSFORM_SWAP64;
+    }
+  }
+  if(op < 0) {
+    set_status_window_text("usage: swap <16|32|64>");
+    return -1;
+  }
+
+  editor_get_selection(&offset, &len);
+  len -= len % byte_transform_width(op);
+  return transform_cmd(op, "swap", offset, len, NULL, 0);
+}
@@ -0,0 +1,23 @@
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+#include <stdlib.h>
+
+// commands that transform the selection, or the current line without one
+//
+// fills are stored as pattern pieces, so they cost one tile of the pattern
+// however long the range is.  xor, add and byte swaps depend on the bytes
+// they change: the range is read in slices across the worker pool, run
+// through the byte_transform kernels and written back a window of a few
+// blocks at a time.  the windows make up one undo entry.
+
+// apply a byte_transform op to a document range, returns < 0 on failure or
+// if cancelled.  windows written before then stay transformed
+int transform_range(int op, size_t offset, size_t len, const unsigned char *key, size_t key_len);
+
+int fill_cmd(int argc, char *argv[]); // ":fill <hex bytes>" repeats a pattern over the range
+int xor_cmd(int argc, char *argv[]); // ":xor <hex bytes>"
+int add_cmd(int argc, char *argv[]); // ":add <hex bytes>" adds bytewise, wrapping
+int swap_cmd(int argc, char *argv[]); // ":swap <16|32|64>" reverses the bytes of each word
+
+#endif // __TRANSFORM_H__
@@ -0,0 +1,508 @@
+#include "undo.h"
+
+#include "document.h"
+#include "editor.h"
+#include "logger.h"
+#include "commands.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define UNDO_COALESCE_MAX 16 // longest change that still counts as a keystroke
+
+enum _undo_part_kind {
+  UNDO_FILE,   // bytes of the file
+  UNDO_ADD,    // bytes of the add buffer
+  UNDO_COPY,   // copied bytes held in memory
+  UNDO_SPILLED // copied bytes moved to the spill file
+};
+
+struct undo_part {
+  size_t len;
+  int kind;
+  size_t src; // offset in the file, the add buffer or the spill file
+  char *copy; // UNDO_COPY
+};
+
+// the bytes one side of a change consists of, in order
+struct undo_side {
+  struct undo_part *parts;
+  size_t n_parts;
+  size_t max_parts;
+  size_t len;
+};
+
+struct undo_entry {
+  size_t offset;
+  struct undo_side removed;
+  struct undo_side inserted;
+};
+
+static struct {
+  struct undo_entry *entries;
+  size_t n_entries;
+  size_t max_entries;
+  size_t n_applied;         // entries before this can be undone, the rest redone
+  struct undo_side pending; // removed bytes of the change being made
+  bool sealed;
+  bool chained;             // the next change continues the last entry, however long
+  bool replaying;           // undo or redo is changing the document
+  size_t memory;            // bytes of copies held in memory
+  size_t limit;
+  int spill_fd;
+  size_t spill_len;
+} g_undo = {
+  .entries = NULL,
+  .n_entries = 0,
+  .max_entries = 0,
+  .n_applied = 0,
+  .sealed = true,
+  .chained = false,
+  .replaying = false,
+  .memory = 0,
+  .limit = UNDO_MEMORY_LIMIT_DEFAULT,
+  .spill_fd = -1,
+  .spill_len = 0
+};
+
+static void undo_side_free(struct undo_side *side) {
+  for(size_t i = 0; i < side->n_parts; ++i) {
+    if(side->parts[i].kind == UNDO_COPY) {
+      g_undo.memory -= side->parts[i].len;
+      free(side->parts[i].copy);
+    }
+  }
+  free(side->parts);
+  memset(side, 0, sizeof(*side));
+}
+
+static struct undo_part *undo_side_push(struct undo_side *side) {
+  if(side->n_parts == side->max_parts) {
+    size_t max = side->max_parts ? side->max_parts * 2 : 4;
+    struct undo_part *parts = realloc(side->parts, max * sizeof(struct undo_part));
+    if(!parts) {
+      return NULL;
+    }
+    side->parts = parts;
+    side->max_parts = max;
+  }
+  return &side->parts[side->n_parts++];
+}
+
+// append bytes to a side, extending the last part when they follow it
+static int undo_side_add(struct undo_side *side, int kind, size_t src, const char *data, size_t len) {
+  struct undo_part *last = side->n_parts ? &side->parts[side->n_parts - 1] : NULL;
+  if(last && last->kind == kind) {
+    if(kind == UNDO_COPY) {
+      char *copy = realloc(last->copy, last->len + len);
+      if(!copy) {
+        return -1;
+      }
+      memcpy(copy + last->len, data, len);
+      last->copy = copy;
+      last->len += len;
+      side->len += len;
+      g_undo.memory += len;
+      return 0;
+    }
+    if(last->src + last->len == src) {
+      last->len += len;
+      side->len += len;
+      return 0;
+    }
+  }
+
+  struct undo_part *p = undo_side_push(side);
+  if(!p) {
+    return -1;
+  }
+  p->len = len;
+  p->kind = kind;
+  p->src = src;
+  p->copy = NULL;
+  if(kind == UNDO_COPY) {
+    p->copy = malloc(len);
+    if(!p->copy) {
+      --side->n_parts;
+      return -1;
+    }
+    memcpy(p->copy, data, len);
+    g_undo.memory += len;
+  }
+  side->len += len;
+  return 0;
+}
+
+static int undo_collect(const doc_span *span, void *arg) {
+  struct undo_side *side = arg;
+  switch(span->kind) {
+    case DOC_SPAN_FILE :
+      return undo_side_add(side, UNDO_FILE, span->file_offset, NULL, span->len);
+    case DOC_SPAN_ADD :
+      return undo_side_add(side, UNDO_ADD, span->add_offset, NULL, span->len);
+    default :
+      return undo_side_add(side, UNDO_COPY, 0, span->data, span->len);
+  }
+}
+
+// move the parts of from to the end of to
+static int undo_side_append(struct undo_side *to, struct undo_side *from) {
+  for(size_t i = 0; i < from->n_parts; ++i) {
+    struct undo_part *p = &from->parts[i];
+    if(undo_side_add(to, p->kind, p->src, p->copy, p->len) < 0) {
+      return -1;
+    }
+  }
+  undo_side_free(from);
+  return 0;
+}
+
+static int undo_spill_open() {
+  if(g_undo.spill_fd >= 0) {
+    return 0;
+  }
+  const char *dir = getenv("TMPDIR");
+  char path[256];
+  snprintf(path, sizeof(path), "%s/hexeditor-undo-XXXXXX", dir ? dir : "/tmp");
+  g_undo.spill_fd = mkstemp(path);
+  if(g_undo.spill_fd < 0) {
+    LOG_MSG("undo: could not create %s: %s", path, strerror(errno));
+    return -1;
+  }
+  unlink(path);
+  return 0;
+}
+
+static int undo_spill_part(struct undo_part *p) {
+  if(undo_spill_open() < 0) {
+    return -1;
+  }
+  for(size_t done = 0; done < p->len; ) {
+    ssize_t n = pwrite(g_undo.spill_fd, p->copy + done, p->len - done, g_undo.spill_len + done);
+    if(n < 0 && errno != EINTR) {
+      LOG_MSG("undo: spilling failed: %s", strerror(errno));
+      return -1;
+    }
+    done += n > 0 ? n : 0;
+  }
+  free(p->copy);
+  p->copy = NULL;
+  p->kind = UNDO_SPILLED;
+  p->src = g_undo.spill_len;
+  g_undo.spill_len += p->len;
+  g_undo.memory -= p->len;
+  return 0;
+}
+
+// move copies to the spill file, oldest first, until they fit in the limit
+static void undo_enforce_limit() {
+  for(size_t i = 0; i < g_undo.n_entries && g_undo.memory > g_undo.limit; ++i) {
+    struct undo_side *sides[2] = { &g_undo.entries[i].removed, &g_undo.entries[i].inserted };
+    for(int s = 0; s < 2; ++s) {
+      for(size_t j = 0; j < sides[s]->n_parts && g_undo.memory > g_undo.limit; ++j) {
+        if(sides[s]->parts[j].kind == UNDO_COPY && undo_spill_part(&sides[s]->parts[j]) < 0) {
+          return;
+        }
+      }
+    }
+  }
+}
+
+static void undo_drop_redo() {
+  for(size_t i = g_undo.n_applied; i < g_undo.n_entries; ++i) {
+    undo_side_free(&g_undo.entries[i].removed);
+    undo_side_free(&g_undo.entries[i].inserted);
+  }
+  g_undo.n_entries = g_undo.n_applied;
+}
+
+static void undo_before_change(size_t offset, size_t old_len, size_t new_len) {
+  (void)new_len;
+  // bytes a followed file grew by aren't an edit, they can't be undone
+  if(g_undo.replaying || doc_external_change()) {
+    return;
+  }
+  undo_side_free(&g_undo.pending);
+  if(doc_for_each_span_in(offset, old_len, undo_collect, &g_undo.pending) != 0) {
+    LOG_MSG("undo: out of memory recording a change at %lu", offset);
+  }
+}
+
+static void undo_after_change(size_t offset, size_t old_len, size_t new_len) {
+  bool chained = g_undo.chained;
+  g_undo.chained = false;
+  if(g_undo.replaying || doc_external_change()) {
+    return;
+  }
+  undo_drop_redo();
+
+  // a keystroke right after the previous one of the same kind extends its
+  // entry, and so does the next piece of a chained change
+  struct undo_entry *last = g_undo.n_entries ? &g_undo.entries[g_undo.n_entries - 1] : NULL;
+  if(last && !g_undo.sealed
+      && (chained || (old_len <= UNDO_COALESCE_MAX && new_len <= UNDO_COALESCE_MAX))
+      && offset == last->offset + last->inserted.len
+      && ((old_len == 0 && last->removed.len == 0)
+        || (old_len == new_len && last->removed.len == last->inserted.len)))
+  {
+    if(undo_side_append(&last->removed, &g_undo.pending) == 0
+        && doc_for_each_span_in(offset, new_len, undo_collect, &last->inserted) == 0)
+    {
+      undo_enforce_limit();
+      return;
+    }
+    // the entry is incomplete, nothing before it can be undone correctly
+    LOG_MSG("undo: out of memory, history dropped");
+    undo_clear();
+    return;
+  }
+
+  if(g_undo.n_entries == g_undo.max_entries) {
+    size_t max = g_undo.max_entries ? g_undo.max_entries * 2 : 64;
+    struct undo_entry *entries = realloc(g_undo.entries, max * sizeof(struct undo_entry));
+    if(!entries) {
+      LOG_MSG("undo: out of memory, history dropped");
+      undo_clear();
+      return;
+    }
+    g_undo.entries = entries;
+    g_undo.max_entries = max;
+  }
+
+  struct undo_entry *e = &g_undo.entries[g_undo.n_entries];
+  e->offset = offset;
+  e->removed = g_undo.pending;
+  memset(&g_undo.pending, 0, sizeof(g_undo.pending));
+  memset(&e->inserted, 0, sizeof(e->inserted));
+  if(doc_for_each_span_in(offset, new_len, undo_collect, &e->inserted) != 0) {
+    undo_side_free(&e->removed);
+    undo_side_free(&e->inserted);
+    LOG_MSG("undo: out of memory recording a change at %lu", offset);
+    return;
+  }
+  g_undo.n_applied = ++g_undo.n_entries;
+  g_undo.sealed = false;
+  undo_enforce_limit();
+}
+
+// put the bytes of side in place of old_len bytes at offset.  copies are
+// moved into the document's add buffer on the way, after which the side
+// refers to them there
+static int undo_apply(size_t offset, size_t old_len, struct undo_side *side) {
+  doc_ref *refs = malloc((side->n_parts ? side->n_parts : 1) * sizeof(doc_ref));
+  if(!refs) {
+    return -1;
+  }
+
+  int r = 0;
+  for(size_t i = 0; i < side->n_parts && r == 0; ++i) {
+    struct undo_part *p = &side->parts[i];
+    if(p->kind == UNDO_COPY || p->kind == UNDO_SPILLED) {
+      char *buf = p->copy;
+      if(p->kind == UNDO_SPILLED) {
+        buf = malloc(p->len);
+        if(!buf || pread(g_undo.spill_fd, buf, p->len, p->src) != (ssize_t)p->len) {
+          free(buf);
+          r = -1;
+          break;
+        }
+      }
+      r = doc_stash(buf, p->len, &refs[i]);
+      if(r == 0) {
+        if(p->kind == UNDO_COPY) {
+          g_undo.memory -= p->len;
+        }
+        free(buf);
+        p->copy = NULL;
+        p->kind = UNDO_ADD;
+        p->src = refs[i].src;
+      } else if(p->kind == UNDO_SPILLED) {
+        free(buf);
+      }
+      continue;
+    }
+    refs[i].len = p->len;
+    refs[i].in_file = p->kind == UNDO_FILE;
+    refs[i].src = p->src;
+  }
+
+  if(r == 0) {
+    g_undo.replaying = true;
+    r = doc_replace_refs(offset, old_len, refs, side->n_parts);
+    g_undo.replaying = false;
+  }
+  free(refs);
+
+  if(r == 0) {
+    editor_goto_offset_scan(offset);
+  }
+  return r;
+}
+
+int undo() {
+  char msg[96];
+  g_undo.sealed = true;
+  if(g_undo.n_applied == 0) {
+    set_status_window_text("already at the oldest change");
+    return -1;
+  }
+  struct undo_entry *e = &g_undo.entries[g_undo.n_applied - 1];
+  if(undo_apply(e->offset, e->inserted.len, &e->removed) < 0) {
+    set_status_window_text("undo failed");
+    return -1;
+  }
+  --g_undo.n_applied;
+  snprintf(msg, sizeof(msg), "undid change at 0x%lx, %lu more", e->offset, g_undo.n_applied);
+  set_status_window_text(msg);
+  return 0;
+}
+
+int redo() {
+  char msg[96];
+  g_undo.sealed = true;
+  if(g_undo.n_applied == g_undo.n_entries) {
+    set_status_window_text("already at the newest change");
+    return -1;
+  }
+  struct undo_entry *e = &g_undo.entries[g_undo.n_applied];
+  if(undo_apply(e->offset, e->removed.len, &e->inserted) < 0) {
+    set_status_window_text("redo failed");
+    return -1;
+  }
+  ++g_undo.n_applied;
+  snprintf(msg, sizeof(msg), "redid change at 0x%lx, %lu more", e->offset, g_undo.n_entries - g_undo.n_applied);
+  set_status_window_text(msg);
+  return 0;
+}
+
+void undo_seal() {
+  g_undo.sealed = true;
+  g_undo.chained = false;
+}
+
+void undo_chain() {
+  g_undo.chained = true;
+}
+
+void undo_clear() {
+  g_undo.n_applied = 0;
+  undo_drop_redo();
+  undo_side_free(&g_undo.pending);
+  if(g_undo.spill_fd >= 0 && ftruncate(g_undo.spill_fd, 0) == 0) {
+    g_undo.spill_len = 0;
+  }
+  g_undo.sealed = true;
+}
+
+// split the file parts of a side that overlap [offset, end) and copy the
+// overlap out of the file
+static int undo_side_detach(struct undo_side *side, size_t offset, size_t end) {
+  struct undo_side out;
+  memset(&out, 0, sizeof(out));
+
+  bool touched = false;
+  for(size_t i = 0; i < side->n_parts; ++i) {
+    struct undo_part *p = &side->parts[i];
+    if(p->kind == UNDO_FILE && p->src < end && p->src + p->len > offset) {
+      touched = true;
+      break;
+    }
+  }
+  if(!touched) {
+    return 0;
+  }
+
+  for(size_t i = 0; i < side->n_parts; ++i) {
+    struct undo_part *p = &side->parts[i];
+    int r = 0;
+    if(p->kind != UNDO_FILE || p->src >= end || p->src + p->len <= offset) {
+      r = undo_side_add(&out, p->kind, p->src, p->copy, p->len);
+    } else {
+      size_t b = p->src > offset ? p->src : offset;
+      size_t e = p->src + p->len < end ? p->src + p->len : end;
+      size_t n = e - b;
+      const char *data = file_view(&g_curfile, b, &n);
+      if(b > p->src) {
+        r = undo_side_add(&out, UNDO_FILE, p->src, NULL, b - p->src);
+      }
+      if(r == 0) {
+        r = data && n == e - b ? undo_side_add(&out, UNDO_COPY, 0, data, e - b) : -1;
+      }
+      if(r == 0 && e < p->src + p->len) {
+        r = undo_side_add(&out, UNDO_FILE, e, NULL, p->src + p->len - e);
+      }
+    }
+    if(r < 0) {
+      undo_side_free(&out);
+      return -1;
+    }
+  }
+  undo_side_free(side);
+  *side = out;
+  return 0;
+}
+
+int undo_detach_file(size_t offset, size_t len) {
+  for(size_t i = 0; i < g_undo.n_entries; ++i) {
+    if(undo_side_detach(&g_undo.entries[i].removed, offset, offset + len) < 0
+        || undo_side_detach(&g_undo.entries[i].inserted, offset, offset + len) < 0)
+    {
+      return -1;
+    }
+  }
+  undo_enforce_limit();
+  return 0;
+}
+
+bool setup_undo() {
+  return doc_watch_before(undo_before_change) == 0 && doc_watch(undo_after_change) == 0;
+}
+
+void cleanup_undo() {
+  undo_clear();
+  free(g_undo.entries);
+  g_undo.entries = NULL;
+  g_undo.max_entries = 0;
+  if(g_undo.spill_fd >= 0) {
+    close(g_undo.spill_fd);
+    g_undo.spill_fd = -1;
+  }
+}
+
+size_t undo_memory(size_t *spilled) {
+  size_t n = g_undo.max_entries * sizeof(struct undo_entry) + g_undo.memory
+    + g_undo.pending.max_parts * sizeof(struct undo_part);
+  for(size_t i = 0; i < g_undo.n_entries; ++i) {
+    n += (g_undo.entries[i].removed.max_parts + g_undo.entries[i].inserted.max_parts) * sizeof(struct undo_part);
+  }
+  *spilled = g_undo.spill_len;
+  return n;
+}
+
+int undo_cmd(int argc, char *argv[]) {
+  char msg[128];
+  if(argc == 1) {
+    return undo();
+  }
+  if(strcmp(argv[1], "limit") == 0) {
+    if(argc > 2 && !commands_parse_size(argv[2], &g_undo.limit)) {
+      set_status_window_text("usage: undo limit <bytes>[k|m|g]");
+      return -1;
+    }
+    undo_enforce_limit();
+    snprintf(msg, sizeof(msg), "undo: %lu changes, %lu bytes in memory, %lu spilled, limit %lu",
+        g_undo.n_entries, g_undo.memory, g_undo.spill_len, g_undo.limit);
+    set_status_window_text(msg);
+    return 0;
+  }
+  set_status_window_text("usage: undo [limit <bytes>]");
+  return -1;
+}
+
+int redo_cmd(int argc, char *argv[]) {
+  (void)argc;
+  (void)argv;
+  return redo();
+}
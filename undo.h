@@ -0,0 +1,44 @@
+#ifndef __UNDO_H__
+#define __UNDO_H__
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+// undo journal:
+//
+// every change of the document is recorded as the offset plus the bytes it
+// removed and the bytes it put there.  bytes that are still in the file or
+// in the document's add buffer are recorded by reference (see doc_ref), so
+// deleting a gigabyte costs a few words of journal and undoing it puts the
+// same references back.  only overwritten bytes, which the patch map keeps
+// changing, are copied.
+//
+// keystrokes typed one after another at consecutive offsets go into one
+// entry until undo_seal() is called.  copies beyond the memory limit are
+// moved, oldest first, to an unlinked temporary file.
+//
+#define UNDO_MEMORY_LIMIT_DEFAULT (16UL << 20)
+
+bool setup_undo();
+void cleanup_undo();
+
+int undo(); // revert the last change, returns < 0 if there is none
+int redo(); // apply the last undone change again
+void undo_seal(); // the next change starts a new entry
+// the next change goes into the last entry if it carries on where that one
+// ended, so a long change made in pieces is undone in one step
+void undo_chain();
+void undo_clear(); // forget everything, e.g. after the file was replaced
+
+// the file is about to be rewritten at [offset, offset + len), copy the
+// bytes entries still refer to there
+int undo_detach_file(size_t offset, size_t len);
+
+// bytes allocated for the entries and their copies, *spilled is the size of
+// the spill file
+size_t undo_memory(size_t *spilled);
+
+int undo_cmd(int argc, char *argv[]); // ":undo [limit <bytes>]"
+int redo_cmd(int argc, char *argv[]); // ":redo"
+
+#endif // __UNDO_H__
@@ -0,0 +1,98 @@
+#include "visual_mode.h"
+
+#include "editor.h"
+#include "document.h"
+#include "clipboard.h"
+#include "skip.h"
+#include "logger.h"
+
+#include <stdio.h>
+
+static size_t g_visual_anchor = 0; // offset visual mode was entered at
+static bool g_visual_keep = false;  // leave the selection for a command to act on
+
+static void visual_mode_update() {
+  size_t cursor = editor_get_cursor_offset();
+  size_t begin = cursor < g_visual_anchor ? cursor : g_visual_anchor;
+  size_t end = (cursor < g_visual_anchor ? g_visual_anchor : cursor) + 1;
+  if(end > doc_length()) {
+    end = doc_length();
+  }
+  editor_set_selection(begin, end > begin ? end - begin : 0);
+  editor_update_cursor_main();
+}
+
+int visual_mode_enter() {
+  editor_set_focus(g_windows.mainwnd);
+  g_visual_anchor = editor_get_cursor_offset();
+  g_visual_keep = false;
+  visual_mode_update();
+  return 0;
+}
+
+int visual_mode_new_char(int c) {
+  size_t offset, len;
+  char msg[96];
+
+  switch(c) {
+    case 27 : // escape
+      editor_switch_mode(MODE_COMMAND);
+      break;
+    case 'y' :
+    case 'd' :
+    case 'x' :
+      editor_get_selection(&offset, &len);
+      if((c == 'y' ? clip_yank(offset, len) : clip_delete(offset, len)) < 0) {
+        set_status_window_text("visual: failed");
+        break;
+      }
+      editor_switch_mode(MODE_COMMAND);
+      snprintf(msg, sizeof(msg), "%s %lu bytes at 0x%lx", c == 'y' ? "yanked" : "deleted", len, offset);
+      set_status_window_text(msg);
+      break;
+    case ':' :
+      // the command line takes over the selection and clears it when done
+      g_visual_keep = true;
+      editor_switch_mode(MODE_LINE);
+      break;
+    case 'z' :
+      skip_fill();
+      visual_mode_update();
+      break;
+    case 'Z' :
+      skip_diff();
+      visual_mode_update();
+      break;
+    case KEY_LEFT :
+    case 'h' :
+      editor_char_left_main();
+      visual_mode_update();
+      break;
+    case KEY_RIGHT :
+    case 'l' :
+      editor_char_right_main();
+      visual_mode_update();
+      break;
+    case KEY_DOWN :
+    case 'j' :
+      editor_line_down_main();
+      visual_mode_update();
+      break;
+    case KEY_UP :
+    case 'k' :
+      editor_line_up_main();
+      visual_mode_update();
+      break;
+  }
+  return 0;
+}
+
+int visual_mode_exit() {
+  if(g_visual_keep) {
+    g_visual_keep = false;
+    return 0;
+  }
+  editor_set_selection(0, 0);
+  editor_update_cursor_main();
+  return 0;
+}
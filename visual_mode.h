@@ -0,0 +1,11 @@
+#ifndef __VISUAL_MODE_H__
+#define __VISUAL_MODE_H__
+
+// visual mode: selects the bytes between where it was entered and the
+// cursor.  y yanks them, d or x deletes them, see clipboard.h
+
+int visual_mode_enter();
+int visual_mode_new_char(int c);
+int visual_mode_exit();
+
+#endif // __VISUAL_MODE_H__
@@ -0,0 +1,477 @@
+#include "wal.h"
+
+#include "document.h"
+#include "editor.h"
+#include "checksum.h"
+#include "worker_pool.h"
+#include "logger.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <libgen.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define WAL_MAGIC "HXWAL001"
+
+enum _wal_record_type {
+  WAL_REPLACE = 1, // payload: the new bytes
+  WAL_REFS,        // payload: struct wal_ref[]
+  WAL_STASH,       // payload: bytes appended to the add buffer
+  WAL_FILL,        // payload: the pattern, old_len is the length of the fill
+  WAL_REPLACE_ALL  // payload: offset uint64_t match offsets, then the new bytes
+};
+
+// start of the journal, names the version of the file it applies to
+struct wal_header {
+  char magic[8];
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t ino;
+  uint32_t crc; // of the fields before it
+  uint32_t pad;
+};
+
+struct wal_record {
+  uint32_t crc; // of the rest of the record header and the payload
+  uint32_t type;
+  uint64_t offset;
+  uint64_t old_len;
+  uint64_t len; // bytes of payload following the header
+};
+
+struct wal_ref {
+  uint64_t len;
+  uint64_t in_file;
+  uint64_t src;
+};
+
+static struct {
+  char path[PATH_MAX];
+  int fd;               // -1 until the first change
+  bool disabled;        // the journal couldn't be created
+  pthread_mutex_t lock; // protects buf, len and first
+  char *buf;            // records waiting for the writer
+  size_t len;
+  size_t max;
+  char *out;            // the writer's buffer, swapped with buf
+  size_t out_max;
+  struct timespec first; // when the oldest waiting record was added
+  worker_group group;
+} g_wal = {
+  .fd = -1,
+  .disabled = false,
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .buf = NULL,
+  .len = 0,
+  .max = 0,
+  .out = NULL,
+  .out_max = 0
+};
+
+static void wal_init_path() {
+  char dir[PATH_MAX], base[PATH_MAX];
+  snprintf(dir, sizeof(dir), "%s", g_curfile.filename);
+  snprintf(base, sizeof(base), "%s", g_curfile.filename);
+  snprintf(g_wal.path, sizeof(g_wal.path), "%s/.%s.hxj", dirname(dir), basename(base));
+}
+
+static uint32_t wal_header_crc(const struct wal_header *h) {
+  return crc32c_update(CRC32_INIT, h, offsetof(struct wal_header, crc));
+}
+
+// the header a journal of the file as it is on disk now has
+static int wal_make_header(struct wal_header *h) {
+  struct stat st;
+  if(fstat(g_curfile.fd, &st) < 0) {
+    return -1;
+  }
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, WAL_MAGIC, sizeof(h->magic));
+  h->size = st.st_size;
+  h->mtime_sec = st.st_mtim.tv_sec;
+  h->mtime_nsec = st.st_mtim.tv_nsec;
+  h->ino = st.st_ino;
+  h->crc = wal_header_crc(h);
+  return 0;
+}
+
+static uint32_t wal_record_crc(const struct wal_record *r, const void *payload) {
+  uint32_t crc = crc32c_update(CRC32_INIT, &r->type, sizeof(*r) - offsetof(struct wal_record, type));
+  return crc32c_update(crc, payload, r->len);
+}
+
+static long wal_ms_since(const struct timespec *t) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - t->tv_sec) * 1000 + (now.tv_nsec - t->tv_nsec) / 1000000;
+}
+
+static int wal_write_all(int fd, const char *p, size_t len) {
+  while(len > 0) {
+    ssize_t n = write(fd, p, len);
+    if(n < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// writes and syncs everything that is waiting, as many rounds as it takes
+static void wal_write_job(void *arg) {
+  (void)arg;
+  for(;;) {
+    pthread_mutex_lock(&g_wal.lock);
+    size_t n = g_wal.len;
+    if(n == 0) {
+      pthread_mutex_unlock(&g_wal.lock);
+      return;
+    }
+    char *out = g_wal.out;
+    size_t out_max = g_wal.out_max;
+    g_wal.out = g_wal.buf;
+    g_wal.out_max = g_wal.max;
+    g_wal.buf = out;
+    g_wal.max = out_max;
+    g_wal.len = 0;
+    pthread_mutex_unlock(&g_wal.lock);
+
+    if(wal_write_all(g_wal.fd, g_wal.out, n) < 0 || fdatasync(g_wal.fd) < 0) {
+      LOG_MSG("wal: writing %s failed: %s", g_wal.path, strerror(errno));
+    }
+  }
+}
+
+static void wal_commit() {
+  if(!worker_group_busy(&g_wal.group)) {
+    worker_pool_submit(&g_wal.group, wal_write_job, NULL);
+  }
+}
+
+// queue a record, the payload comes in up to two parts
+static void wal_append(uint32_t type, size_t offset, size_t old_len,
+    const void *p1, size_t n1, const void *p2, size_t n2)
+{
+  struct wal_record r = { 0, type, offset, old_len, n1 + n2 };
+  uint32_t crc = crc32c_update(CRC32_INIT, &r.type, sizeof(r) - offsetof(struct wal_record, type));
+  crc = crc32c_update(crc, p1, n1);
+  r.crc = crc32c_update(crc, p2, n2);
+
+  pthread_mutex_lock(&g_wal.lock);
+  size_t need = g_wal.len + sizeof(r) + n1 + n2;
+  if(need > g_wal.max) {
+    size_t max = g_wal.max ? g_wal.max : WAL_COMMIT_BYTES * 2;
+    while(max < need) {
+      max *= 2;
+    }
+    char *buf = realloc(g_wal.buf, max);
+    if(!buf) {
+      pthread_mutex_unlock(&g_wal.lock);
+      LOG_MSG("wal: out of memory, a change at %lu is not journaled", offset);
+      return;
+    }
+    g_wal.buf = buf;
+    g_wal.max = max;
+  }
+  if(g_wal.len == 0) {
+    clock_gettime(CLOCK_MONOTONIC, &g_wal.first);
+  }
+  memcpy(g_wal.buf + g_wal.len, &r, sizeof(r));
+  memcpy(g_wal.buf + g_wal.len + sizeof(r), p1, n1);
+  memcpy(g_wal.buf + g_wal.len + sizeof(r) + n1, p2, n2);
+  g_wal.len = need;
+  bool due = g_wal.len >= WAL_COMMIT_BYTES || wal_ms_since(&g_wal.first) >= WAL_COMMIT_MS;
+  pthread_mutex_unlock(&g_wal.lock);
+
+  if(due) {
+    wal_commit();
+  }
+}
+
+// create the journal on the first change after opening or saving.  the add
+// buffer outlives saves, so a new journal starts with a copy of it
+static bool wal_open() {
+  if(g_wal.fd >= 0 || g_wal.disabled) {
+    return g_wal.fd >= 0;
+  }
+
+  struct wal_header h;
+  if(wal_make_header(&h) < 0) {
+    g_wal.disabled = true;
+    return false;
+  }
+  g_wal.fd = open(g_wal.path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+  if(g_wal.fd < 0 || wal_write_all(g_wal.fd, (const char *)&h, sizeof(h)) < 0) {
+    LOG_MSG("wal: could not create %s: %s", g_wal.path, strerror(errno));
+    if(g_wal.fd >= 0) {
+      close(g_wal.fd);
+      unlink(g_wal.path);
+      g_wal.fd = -1;
+    }
+    g_wal.disabled = true;
+    return false;
+  }
+
+  size_t add_len;
+  const char *add = doc_add_buffer(&add_len);
+  if(add_len > 0) {
+    wal_append(WAL_STASH, 0, 0, add, add_len, NULL, 0);
+  }
+  return true;
+}
+
+static void wal_log_replace(size_t offset, size_t old_len, const char *src, size_t new_len) {
+  if(wal_open()) {
+    wal_append(WAL_REPLACE, offset, old_len, src, new_len, NULL, 0);
+  }
+}
+
+static void wal_log_replace_refs(size_t offset, size_t old_len, const doc_ref *refs, size_t n) {
+  struct wal_ref buf[64];
+  if(!wal_open()) {
+    return;
+  }
+  struct wal_ref *out = n <= 64 ? buf : malloc(n * sizeof(struct wal_ref));
+  if(!out) {
+    LOG_MSG("wal: out of memory, a change at %lu is not journaled", offset);
+    return;
+  }
+  for(size_t i = 0; i < n; ++i) {
+    out[i].len = refs[i].len;
+    out[i].in_file = refs[i].in_file;
+    out[i].src = refs[i].src;
+  }
+  wal_append(WAL_REFS, offset, old_len, out, n * sizeof(struct wal_ref), NULL, 0);
+  if(out != buf) {
+    free(out);
+  }
+}
+
+static void wal_log_stash(const char *src, size_t len) {
+  if(wal_open()) {
+    wal_append(WAL_STASH, 0, 0, src, len, NULL, 0);
+  }
+}
+
+static void wal_log_fill(size_t offset, size_t len, const char *pattern, size_t pattern_len) {
+  if(wal_open()) {
+    wal_append(WAL_FILL, offset, len, pattern, pattern_len, NULL, 0);
+  }
+}
+
+static void wal_log_replace_all(const size_t *offsets, size_t n, size_t old_len, const char *with, size_t new_len) {
+  if(wal_open()) {
+    wal_append(WAL_REPLACE_ALL, n, old_len, offsets, n * sizeof(uint64_t), with, new_len);
+  }
+}
+
+static const doc_log_ops g_wal_ops = {
+  wal_log_replace,
+  wal_log_replace_refs,
+  wal_log_stash,
+  wal_log_fill,
+  wal_log_replace_all
+};
+
+// calls fn for every intact record of the journal at fd, returns the
+// offset after the last one or -1 if the journal is not for this file
+typedef int (*wal_record_fn)(const struct wal_record *r, const char *payload);
+
+static off_t wal_scan(int fd, wal_record_fn fn, int *n_records) {
+  struct wal_header h, expect;
+  if(pread(fd, &h, sizeof(h), 0) != sizeof(h) || wal_make_header(&expect) < 0
+      || memcmp(h.magic, WAL_MAGIC, sizeof(h.magic)) != 0 || h.crc != wal_header_crc(&h))
+  {
+    return -1;
+  }
+  if(h.size != expect.size || h.mtime_sec != expect.mtime_sec
+      || h.mtime_nsec != expect.mtime_nsec || h.ino != expect.ino)
+  {
+    LOG_MSG("wal: %s is for another version of the file, ignored", g_wal.path);
+    return -1;
+  }
+
+  struct stat st;
+  if(fstat(fd, &st) < 0) {
+    return -1;
+  }
+
+  off_t at = sizeof(h);
+  char *payload = NULL;
+  size_t payload_max = 0;
+  *n_records = 0;
+  for(;;) {
+    struct wal_record r;
+    if(pread(fd, &r, sizeof(r), at) != sizeof(r) || r.len > (size_t)(st.st_size - at - sizeof(r))) {
+      break;
+    }
+    if(r.len > payload_max) {
+      char *p = realloc(payload, r.len);
+      if(!p) {
+        break;
+      }
+      payload = p;
+      payload_max = r.len;
+    }
+    if(pread(fd, payload, r.len, at + sizeof(r)) != (ssize_t)r.len || r.crc != wal_record_crc(&r, payload)) {
+      break; // torn by the crash
+    }
+    if(fn && fn(&r, payload) < 0) {
+      LOG_MSG("wal: record at %ld does not apply", (long)at);
+      break;
+    }
+    at += sizeof(r) + r.len;
+    ++*n_records;
+  }
+  free(payload);
+  return at;
+}
+
+static int wal_apply(const struct wal_record *r, const char *payload) {
+  switch(r->type) {
+    case WAL_REPLACE :
+      return doc_replace(r->offset, r->old_len, payload, r->len);
+    case WAL_REFS :
+      {
+        size_t n = r->len / sizeof(struct wal_ref);
+        const struct wal_ref *in = (const struct wal_ref *)payload;
+        doc_ref *refs = malloc((n ? n : 1) * sizeof(doc_ref));
+        if(!refs) {
+          return -1;
+        }
+        for(size_t i = 0; i < n; ++i) {
+          refs[i].len = in[i].len;
+          refs[i].in_file = in[i].in_file;
+          refs[i].src = in[i].src;
+        }
+        int ret = doc_replace_refs(r->offset, r->old_len, refs, n);
+        free(refs);
+        return ret;
+      }
+    case WAL_STASH :
+      {
+        doc_ref ref;
+        return doc_stash(payload, r->len, &ref);
+      }
+    case WAL_FILL :
+      return doc_fill(r->offset, r->old_len, payload, r->len);
+    case WAL_REPLACE_ALL :
+      {
+        size_t n = r->offset;
+        if(n > r->len / sizeof(uint64_t)) {
+          return -1;
+        }
+        const char *with = payload + n * sizeof(uint64_t);
+        return doc_replace_all((const size_t *)payload, n, r->old_len, with, r->len - n * sizeof(uint64_t));
+      }
+  }
+  return -1;
+}
+
+int wal_found() {
+  wal_init_path();
+  int fd = open(g_wal.path, O_RDONLY);
+  if(fd < 0) {
+    return 0;
+  }
+  int n = 0;
+  off_t end = wal_scan(fd, NULL, &n);
+  close(fd);
+  return end < 0 ? 0 : n;
+}
+
+int wal_replay() {
+  int fd = open(g_wal.path, O_RDWR);
+  if(fd < 0) {
+    return -1;
+  }
+  int n = 0;
+  off_t end = wal_scan(fd, wal_apply, &n);
+  if(end < 0) {
+    close(fd);
+    return -1;
+  }
+
+  // keep journaling onto the end of it, past a torn record if there is one
+  if(ftruncate(fd, end) < 0 || fcntl(fd, F_SETFL, O_APPEND) < 0) {
+    close(fd);
+    return -1;
+  }
+  g_wal.fd = fd;
+  return n;
+}
+
+void wal_discard() {
+  unlink(g_wal.path);
+}
+
+bool setup_wal() {
+  wal_init_path();
+  worker_group_init(&g_wal.group);
+  if(!file_writable(&g_curfile)) {
+    return false; // the edits couldn't be saved anyway
+  }
+  if(g_curfile.kind == FILE_KIND_DEVICE) {
+    return false; // the journal would have to go in /dev
+  }
+  doc_set_log(&g_wal_ops);
+  return true;
+}
+
+static void wal_close() {
+  worker_group_wait(&g_wal.group);
+  pthread_mutex_lock(&g_wal.lock);
+  g_wal.len = 0;
+  pthread_mutex_unlock(&g_wal.lock);
+  if(g_wal.fd >= 0) {
+    close(g_wal.fd);
+    unlink(g_wal.path);
+    g_wal.fd = -1;
+  }
+}
+
+void cleanup_wal() {
+  doc_set_log(NULL);
+  wal_close();
+  worker_group_destroy(&g_wal.group);
+  free(g_wal.buf);
+  free(g_wal.out);
+  g_wal.buf = NULL;
+  g_wal.out = NULL;
+  g_wal.max = 0;
+  g_wal.out_max = 0;
+}
+
+void wal_reset() {
+  wal_close();
+  g_wal.disabled = false;
+}
+
+bool wal_pending() {
+  pthread_mutex_lock(&g_wal.lock);
+  bool pending = g_wal.len > 0;
+  pthread_mutex_unlock(&g_wal.lock);
+  return pending;
+}
+
+void wal_idle() {
+  pthread_mutex_lock(&g_wal.lock);
+  bool due = g_wal.len > 0 && wal_ms_since(&g_wal.first) >= WAL_COMMIT_MS;
+  pthread_mutex_unlock(&g_wal.lock);
+  if(due) {
+    wal_commit();
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef __WAL_H__
+#define __WAL_H__
+
+#include <stdbool.h>
+
+// write-ahead journal:
+//
+// every change of the document is appended to a journal next to the file
+// (".<name>.hxj") so that edits survive the editor or the machine going
+// down.  records are gathered in memory and written and synced by a worker
+// in one go once WAL_COMMIT_BYTES have piled up or the oldest of them is
+// WAL_COMMIT_MS old, so typing never waits for the disk.  at most the last
+// WAL_COMMIT_MS of typing is lost.
+//
+// the journal starts with the identity of the file it applies to (size,
+// mtime, inode) and is removed when the document is saved or the editor
+// quits.  each record carries a crc32c, replay stops at the first torn one.
+//
+#define WAL_COMMIT_BYTES (64UL << 10)
+#define WAL_COMMIT_MS 500
+
+bool setup_wal(); // start journaling changes of g_curfile
+void cleanup_wal(); // sync and remove the journal
+
+// a journal for the current version of g_curfile was left behind, returns
+// the number of changes in it
+int wal_found();
+int wal_replay(); // apply the changes of a journal found by wal_found()
+void wal_discard(); // remove a journal found by wal_found()
+
+void wal_reset(); // the document was saved, start over with the next change
+bool wal_pending(); // true while records are waiting for their commit
+void wal_idle(); // commit records that have waited long enough
+
+#endif // __WAL_H__
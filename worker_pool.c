@@ -0,0 +1,196 @@
+#include "worker_pool.h"
+
+#include "logger.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+struct worker_job {
+  worker_group *group;
+  worker_fn fn;
+  void *arg;
+  struct worker_job *next;
+};
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  struct worker_job *head;
+  struct worker_job *tail;
+  pthread_t *threads;
+  int n_threads;
+  bool stopping;
+} g_pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .wake = PTHREAD_COND_INITIALIZER,
+  .head = NULL,
+  .tail = NULL,
+  .threads = NULL,
+  .n_threads = 0,
+  .stopping = false
+};
+
+static void worker_group_finish(worker_group *g) {
+  pthread_mutex_lock(&g->lock);
+  if(--g->pending == 0) {
+    pthread_cond_broadcast(&g->done);
+  }
+  pthread_mutex_unlock(&g->lock);
+}
+
+static void *worker_main(void *unused) {
+  (void)unused;
+  while(1) {
+    pthread_mutex_lock(&g_pool.lock);
+    while(!g_pool.head && !g_pool.stopping) {
+      pthread_cond_wait(&g_pool.wake, &g_pool.lock);
+    }
+    if(!g_pool.head) { // stopping and nothing left to do
+      pthread_mutex_unlock(&g_pool.lock);
+      break;
+    }
+    struct worker_job *job = g_pool.head;
+    g_pool.head = job->next;
+    if(!g_pool.head) {
+      g_pool.tail = NULL;
+    }
+    pthread_mutex_unlock(&g_pool.lock);
+
+    if(!job->group->cancel) {
+      job->fn(job->arg);
+    }
+    worker_group_finish(job->group);
+    free(job);
+  }
+  return NULL;
+}
+
+bool setup_worker_pool(int n_threads) {
+  if(n_threads <= 0) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = n > 0 ? n : 1;
+  }
+
+  g_pool.threads = calloc(n_threads, sizeof(pthread_t));
+  if(!g_pool.threads) {
+    return false;
+  }
+
+  g_pool.stopping = false;
+  for(int i = 0; i < n_threads; ++i) {
+    if(pthread_create(&g_pool.threads[i], NULL, worker_main, NULL) != 0) {
+      LOG_MSG("Could only start %d of %d worker threads", i, n_threads);
+      break;
+    }
+    ++g_pool.n_threads;
+  }
+
+  return g_pool.n_threads > 0;
+}
+
+void cleanup_worker_pool() {
+  pthread_mutex_lock(&g_pool.lock);
+  g_pool.stopping = true;
+  pthread_cond_broadcast(&g_pool.wake);
+  pthread_mutex_unlock(&g_pool.lock);
+
+  for(int i = 0; i < g_pool.n_threads; ++i) {
+    pthread_join(g_pool.threads[i], NULL);
+  }
+
+  free(g_pool.threads);
+  g_pool.threads = NULL;
+  g_pool.n_threads = 0;
+}
+
+int worker_pool_threads() {
+  return g_pool.n_threads;
+}
+
+void worker_group_init(worker_group *g) {
+  pthread_mutex_init(&g->lock, NULL);
+  pthread_cond_init(&g->done, NULL);
+  g->pending = 0;
+  g->cancel = 0;
+}
+
+void worker_group_destroy(worker_group *g) {
+  worker_group_cancel(g);
+  pthread_cond_destroy(&g->done);
+  pthread_mutex_destroy(&g->lock);
+}
+
+int worker_pool_submit(worker_group *g, worker_fn fn, void *arg) {
+  if(g_pool.n_threads == 0) { // no workers, run the job on the caller
+    fn(arg);
+    return 0;
+  }
+
+  struct worker_job *job = malloc(sizeof(struct worker_job));
+  if(!job) {
+    return -1;
+  }
+  job->group = g;
+  job->fn = fn;
+  job->arg = arg;
+  job->next = NULL;
+
+  pthread_mutex_lock(&g->lock);
+  ++g->pending;
+  pthread_mutex_unlock(&g->lock);
+
+  pthread_mutex_lock(&g_pool.lock);
+  if(g_pool.tail) {
+    g_pool.tail->next = job;
+  } else {
+    g_pool.head = job;
+  }
+  g_pool.tail = job;
+  pthread_cond_signal(&g_pool.wake);
+  pthread_mutex_unlock(&g_pool.lock);
+
+  return 0;
+}
+
+bool worker_group_busy(worker_group *g) {
+  pthread_mutex_lock(&g->lock);
+  bool busy = g->pending > 0;
+  pthread_mutex_unlock(&g->lock);
+  return busy;
+}
+
+void worker_group_wait(worker_group *g) {
+  pthread_mutex_lock(&g->lock);
+  while(g->pending > 0) {
+    pthread_cond_wait(&g->done, &g->lock);
+  }
+  pthread_mutex_unlock(&g->lock);
+}
+
+void worker_group_cancel(worker_group *g) {
+  g->cancel = 1;
+
+  // pull any of the group's jobs that haven't started out of the queue
+  pthread_mutex_lock(&g_pool.lock);
+  struct worker_job **pp = &g_pool.head;
+  g_pool.tail = NULL;
+  while(*pp) {
+    struct worker_job *job = *pp;
+    if(job->group == g) {
+      *pp = job->next;
+      free(job);
+      worker_group_finish(g);
+    } else {
+      g_pool.tail = job;
+      pp = &job->next;
+    }
+  }
+  pthread_mutex_unlock(&g_pool.lock);
+
+  worker_group_wait(g);
+  g->cancel = 0;
+}
+
+bool worker_group_cancelled(worker_group *g) {
+  return g->cancel != 0;
+}
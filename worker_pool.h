@@ -0,0 +1,42 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// worker pool:
+//
+// a fixed set of threads that run jobs off of a shared queue.  jobs are
+// submitted as part of a group so that a subsystem can wait for (or cancel)
+// only the work it queued.  long running jobs should poll
+// worker_group_cancelled() and return early when it is set.
+//
+// if no worker threads could be started, jobs run inline on submit.
+//
+struct _worker_group {
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+  int pending;          // jobs queued or running for this group
+  volatile int cancel;  // set while the group is being cancelled
+};
+typedef struct _worker_group worker_group;
+
+typedef void (*worker_fn)(void *arg);
+
+bool setup_worker_pool(int n_threads); // start n_threads workers, 0 uses the number of cpus
+void cleanup_worker_pool();
+
+int worker_pool_threads(); // number of running worker threads
+
+void worker_group_init(worker_group *g);
+void worker_group_destroy(worker_group *g);
+
+// queue fn(arg) to run on a worker, returns 0 on success
+int worker_pool_submit(worker_group *g, worker_fn fn, void *arg);
+
+bool worker_group_busy(worker_group *g); // true if the group has outstanding jobs
+void worker_group_wait(worker_group *g); // block until the group has no outstanding jobs
+void worker_group_cancel(worker_group *g); // drop queued jobs, wait for running ones
+bool worker_group_cancelled(worker_group *g);
+
+#endif // __WORKER_POOL_H__